@@ -0,0 +1,300 @@
+#if defined(__linux__)
+#define _GNU_SOURCE
+#endif
+#include "capture.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__APPLE__)
+#include <OpenGL/gl3.h>
+#else
+#define GL_GLEXT_PROTOTYPES
+#include <GL/gl.h>
+#include <GL/glext.h>
+#endif
+
+typedef struct {
+    FILE *file;
+    char path[256];
+    bool y4m;
+    int width;
+    int height;
+    size_t frame_bytes;         // RGBA で1フレーム分
+
+    // 読み戻し（描画スレッドだけが触る）
+    GLuint pbo[2];
+    int pbo_frame;              // 次に読み出しを発行する PBO の通し番号
+    bool pbo_pending[2];
+
+    // キュー（mutex で守る）
+    uint8_t *slots[CAPTURE_QUEUE_FRAMES];
+    int head;
+    int count;
+    bool stop;
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    pthread_cond_t space;
+    pthread_t thread;
+
+    uint8_t *out;               // エンコーダースレッドの変換先
+    CaptureStats stats;
+} Capture;
+
+static Capture capture;
+static bool capture_active = false;
+static bool capture_blocking = false;   // 一杯なら捨てずに空くまで待つ（オフスクリーン用）
+
+static double CaptureNow(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// GL の読み出しは左下原点なので、行を逆順にたどる
+static size_t EncodeRgb24(const uint8_t *rgba, uint8_t *out, int w, int h) {
+    for (int y=0; y<h; y++) {
+        const uint8_t *src = rgba + (size_t)(h - 1 - y) * w * 4;
+        uint8_t *dst = out + (size_t)y * w * 3;
+        for (int x=0; x<w; x++) {
+            dst[x*3] = src[x*4]; dst[x*3 + 1] = src[x*4 + 1]; dst[x*3 + 2] = src[x*4 + 2];
+        }
+    }
+    return (size_t)w * h * 3;
+}
+
+// BT.601（フルレンジ、C420jpeg）。色差は 2x2 の平均
+static size_t EncodeYuv420(const uint8_t *rgba, uint8_t *out, int w, int h) {
+    int cw = (w + 1) / 2, ch = (h + 1) / 2;
+    uint8_t *py = out, *pu = out + (size_t)w * h, *pv = pu + (size_t)cw * ch;
+    for (int y=0; y<h; y++) {
+        const uint8_t *src = rgba + (size_t)(h - 1 - y) * w * 4;
+        for (int x=0; x<w; x++) {
+            int r = src[x*4], g = src[x*4 + 1], b = src[x*4 + 2];
+            py[(size_t)y * w + x] = (uint8_t)((77 * r + 150 * g + 29 * b + 128) >> 8);
+        }
+    }
+    for (int cy=0; cy<ch; cy++) {
+        for (int cx=0; cx<cw; cx++) {
+            int r = 0, g = 0, b = 0, n = 0;
+            for (int dy=0; dy<2; dy++) {
+                int y = cy * 2 + dy;
+                if (y >= h) break;
+                const uint8_t *src = rgba + (size_t)(h - 1 - y) * w * 4;
+                for (int dx=0; dx<2; dx++) {
+                    int x = cx * 2 + dx;
+                    if (x >= w) break;
+                    r += src[x*4]; g += src[x*4 + 1]; b += src[x*4 + 2]; n++;
+                }
+            }
+            r /= n; g /= n; b /= n;
+            int u = ((-43 * r - 85 * g + 128 * b + 128) >> 8) + 128;
+            int v = ((128 * r - 107 * g - 21 * b + 128) >> 8) + 128;
+            pu[(size_t)cy * cw + cx] = (uint8_t)(u < 0 ? 0 : (u > 255 ? 255 : u));
+            pv[(size_t)cy * cw + cx] = (uint8_t)(v < 0 ? 0 : (v > 255 ? 255 : v));
+        }
+    }
+    return (size_t)w * h + (size_t)cw * ch * 2;
+}
+
+static void *CaptureEncoderMain(void *arg) {
+    (void)arg;
+    Capture *c = &capture;
+    for (;;) {
+        pthread_mutex_lock(&c->lock);
+        while (c->count == 0 && !c->stop) pthread_cond_wait(&c->ready, &c->lock);
+        if (c->count == 0 && c->stop) {
+            pthread_mutex_unlock(&c->lock);
+            break;
+        }
+        uint8_t *frame = c->slots[c->head];
+        pthread_mutex_unlock(&c->lock);
+
+        // 変換と書き込みはロックの外で（描画スレッドはその間も次の枠に入れられる）
+        double t0 = CaptureNow();
+        size_t bytes;
+        if (c->y4m) {
+            fputs("FRAME\n", c->file);
+            bytes = EncodeYuv420(frame, c->out, c->width, c->height);
+        } else {
+            bytes = EncodeRgb24(frame, c->out, c->width, c->height);
+        }
+        fwrite(c->out, 1, bytes, c->file);
+        double t1 = CaptureNow();
+
+        pthread_mutex_lock(&c->lock);
+        c->head = (c->head + 1) % CAPTURE_QUEUE_FRAMES;
+        c->count--;
+        c->stats.frames_written++;
+        c->stats.bytes_written += bytes;
+        c->stats.encode_seconds += t1 - t0;
+        pthread_cond_signal(&c->space);
+        pthread_mutex_unlock(&c->lock);
+    }
+    return NULL;
+}
+
+bool CaptureStart(const char *path, int width, int height, int fps) {
+    if (capture_active || width <= 0 || height <= 0) return false;
+    Capture *c = &capture;
+    memset(c, 0, sizeof(*c));
+    c->file = fopen(path, "wb");
+    if (!c->file) return false;
+    snprintf(c->path, sizeof(c->path), "%s", path);
+    size_t len = strlen(path);
+    c->y4m = len >= 4 && strcmp(path + len - 4, ".y4m") == 0;
+    c->width = width;
+    c->height = height;
+    c->frame_bytes = (size_t)width * height * 4;
+    if (c->y4m) fprintf(c->file, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", width, height, fps > 0 ? fps : 60);
+
+    for (int i=0; i<CAPTURE_QUEUE_FRAMES; i++) c->slots[i] = malloc(c->frame_bytes);
+    c->out = malloc((size_t)width * height * 3);
+    pthread_mutex_init(&c->lock, NULL);
+    pthread_cond_init(&c->ready, NULL);
+    pthread_cond_init(&c->space, NULL);
+    if (pthread_create(&c->thread, NULL, CaptureEncoderMain, NULL) != 0) {
+        for (int i=0; i<CAPTURE_QUEUE_FRAMES; i++) free(c->slots[i]);
+        free(c->out);
+        fclose(c->file);
+        return false;
+    }
+
+    // GL 側の準備はテスト用に CaptureSubmit だけを使う場合もあるので、最初の CaptureFrame で行う
+    capture_active = true;
+    return true;
+}
+
+// 空いている枠に1フレームを入れる。一杯なら捨てる
+void CaptureSubmit(const uint8_t *rgba) {
+    Capture *c = &capture;
+    if (!capture_active) return;
+    pthread_mutex_lock(&c->lock);
+    while (capture_blocking && c->count >= CAPTURE_QUEUE_FRAMES) pthread_cond_wait(&c->space, &c->lock);
+    if (c->count >= CAPTURE_QUEUE_FRAMES) {
+        c->stats.frames_dropped++;
+        pthread_mutex_unlock(&c->lock);
+        return;
+    }
+    int tail = (c->head + c->count) % CAPTURE_QUEUE_FRAMES;
+    uint8_t *slot = c->slots[tail];
+    pthread_mutex_unlock(&c->lock);
+
+    // 枠 tail はまだキューに入っていないので、エンコーダーは触らない
+    memcpy(slot, rgba, c->frame_bytes);
+
+    pthread_mutex_lock(&c->lock);
+    c->count++;
+    c->stats.frames_read++;
+    if (c->count > c->stats.queue_peak) c->stats.queue_peak = c->count;
+    pthread_cond_signal(&c->ready);
+    pthread_mutex_unlock(&c->lock);
+}
+
+// 描画が終わってバッファを入れ替える前に呼ぶ（fbWidth/fbHeight は今の画面の画素数）。
+// 今のフレームの読み出しを発行し、1つ前のフレームの PBO を取り出してキューに入れる
+void CaptureFrame(int fbWidth, int fbHeight) {
+    Capture *c = &capture;
+    if (!capture_active) return;
+    double t0 = CaptureNow();
+
+    if (c->pbo[0] == 0) {
+        glGenBuffers(2, c->pbo);
+        for (int i=0; i<2; i++) {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, c->pbo[i]);
+            glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr)c->frame_bytes, NULL, GL_STREAM_READ);
+        }
+    }
+
+    int cur = c->pbo_frame & 1, prev = cur ^ 1;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, c->pbo[cur]);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    // 画面の大きさが開始時と違うフレームは書けない（出力は大きさ固定）
+    if (fbWidth == c->width && fbHeight == c->height) {
+        glReadBuffer(GL_BACK);
+        glReadPixels(0, 0, c->width, c->height, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        c->pbo_pending[cur] = true;
+    } else {
+        pthread_mutex_lock(&c->lock);
+        c->stats.frames_dropped++;
+        pthread_mutex_unlock(&c->lock);
+    }
+
+    if (c->pbo_pending[prev]) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, c->pbo[prev]);
+        const uint8_t *pixels = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, (GLsizeiptr)c->frame_bytes, GL_MAP_READ_BIT);
+        if (pixels) {
+            CaptureSubmit(pixels);
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        }
+        c->pbo_pending[prev] = false;
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    c->pbo_frame++;
+
+    pthread_mutex_lock(&c->lock);
+    c->stats.readback_seconds += CaptureNow() - t0;
+    pthread_mutex_unlock(&c->lock);
+}
+
+// 残っている PBO とキューを書き出してから閉じる
+void CaptureStop(void) {
+    Capture *c = &capture;
+    if (!capture_active) return;
+    if (c->pbo[0] != 0) {
+        for (int k=0; k<2; k++) {
+            int i = (c->pbo_frame + k) & 1;     // 古い方から
+            if (!c->pbo_pending[i]) continue;
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, c->pbo[i]);
+            const uint8_t *pixels = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, (GLsizeiptr)c->frame_bytes, GL_MAP_READ_BIT);
+            if (pixels) {
+                CaptureSubmit(pixels);
+                glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+            }
+            c->pbo_pending[i] = false;
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        glDeleteBuffers(2, c->pbo);
+    }
+
+    pthread_mutex_lock(&c->lock);
+    c->stop = true;
+    pthread_cond_signal(&c->ready);
+    pthread_mutex_unlock(&c->lock);
+    pthread_join(c->thread, NULL);
+
+    fclose(c->file);
+    for (int i=0; i<CAPTURE_QUEUE_FRAMES; i++) free(c->slots[i]);
+    free(c->out);
+    pthread_mutex_destroy(&c->lock);
+    pthread_cond_destroy(&c->ready);
+    pthread_cond_destroy(&c->space);
+    capture_active = false;
+}
+
+void CaptureSetBlocking(bool block) {
+    capture_blocking = block;
+}
+
+bool CaptureActive(void) {
+    return capture_active;
+}
+
+void CaptureGetStats(CaptureStats *out) {
+    Capture *c = &capture;
+    if (!capture_active) {
+        *out = c->stats;
+        return;
+    }
+    pthread_mutex_lock(&c->lock);
+    *out = c->stats;
+    out->queue_depth = c->count;
+    pthread_mutex_unlock(&c->lock);
+}
+
+const char *CapturePath(void) {
+    return capture.path;
+}
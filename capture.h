@@ -0,0 +1,35 @@
+// 動画キャプチャ
+// 表示するフレームをピクセルバッファオブジェクト (PBO) 2枚で交互に読み戻し、
+// 1フレーム遅れで取り出してエンコーダースレッドに渡す。描画側は glReadPixels の完了を待たない。
+// 出力は拡張子が .y4m なら YUV4MPEG2 (4:2:0)、それ以外は上下を直した RGB24 の生データ。
+// キューが一杯のときはそのフレームを捨てて数える（CaptureSetBlocking で待つようにもできる）。
+// GL のヘッダーは raylib と一緒に読めないので、このファイルは raylib を含めない。
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define CAPTURE_QUEUE_FRAMES 8
+
+typedef struct {
+    uint64_t frames_read;       // 読み戻してキューに入れたフレーム
+    uint64_t frames_written;
+    uint64_t frames_dropped;    // キューが一杯・画面の大きさが変わったなどで捨てたフレーム
+    uint64_t bytes_written;
+    int queue_depth;
+    int queue_peak;
+    double readback_seconds;    // 描画スレッドで使った時間（読み出しの発行と取り出し）
+    double encode_seconds;      // エンコーダースレッドで使った時間（変換と書き込み）
+} CaptureStats;
+
+bool CaptureStart(const char *path, int width, int height, int fps);
+void CaptureFrame(int fbWidth, int fbHeight);
+void CaptureSubmit(const uint8_t *rgba);
+void CaptureStop(void);
+void CaptureSetBlocking(bool block);
+bool CaptureActive(void);
+void CaptureGetStats(CaptureStats *out);
+const char *CapturePath(void);
+
+#endif
@@ -0,0 +1,122 @@
+#if defined(__linux__)
+#define _GNU_SOURCE
+#endif
+#include "input_sampler.h"
+
+#include <string.h>
+#include <time.h>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <X11/Xlib.h>
+
+// 最新の1件だけをシーケンスロックで渡す（書き込み中は seq が奇数）
+static InputSample sampler_latest;
+static uint32_t sampler_seq = 0;
+static pthread_t sampler_thread;
+static bool sampler_running = false;
+static int sampler_stop = 0;
+static int sampler_hz = 1000;
+static Display *sampler_display = NULL;
+
+static double SamplerNow(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void SamplerPublish(const InputSample *s) {
+    uint32_t seq = __atomic_load_n(&sampler_seq, __ATOMIC_RELAXED);
+    __atomic_store_n(&sampler_seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    sampler_latest = *s;
+    __atomic_store_n(&sampler_seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+static void *SamplerMain(void *arg) {
+    (void)arg;
+    Window root = DefaultRootWindow(sampler_display);
+    long periodNs = 1000000000L / sampler_hz;
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+
+    InputSample s;
+    memset(&s, 0, sizeof(s));
+    while (!__atomic_load_n(&sampler_stop, __ATOMIC_ACQUIRE)) {
+        Window rootRet, childRet;
+        int rx, ry, wx, wy;
+        unsigned int mask;
+        if (XQueryPointer(sampler_display, root, &rootRet, &childRet, &rx, &ry, &wx, &wy, &mask)) {
+            uint32_t buttons = 0;
+            if (mask & Button1Mask) buttons |= INPUT_SAMPLER_LEFT;
+            if (mask & Button3Mask) buttons |= INPUT_SAMPLER_RIGHT;
+            s.time = SamplerNow();
+            if ((buttons & INPUT_SAMPLER_LEFT) && !(s.buttons & INPUT_SAMPLER_LEFT)) {
+                s.press_count++;
+                s.press_time = s.time;
+            }
+            s.root_x = rx;
+            s.root_y = ry;
+            s.buttons = buttons;
+            SamplerPublish(&s);
+        }
+
+        // 締め切りを積み上げて周期を保つ（処理時間でずれない）
+        next.tv_nsec += periodNs;
+        while (next.tv_nsec >= 1000000000L) { next.tv_nsec -= 1000000000L; next.tv_sec++; }
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+    }
+    return NULL;
+}
+
+bool InputSamplerStart(int hz) {
+    if (sampler_running) return true;
+    // ゲーム側の接続とは別に開く（スレッドをまたいで Display を共有しない）
+    sampler_display = XOpenDisplay(NULL);
+    if (!sampler_display) return false;
+    sampler_hz = (hz > 0) ? hz : 1000;
+    sampler_stop = 0;
+    sampler_seq = 0;
+    if (pthread_create(&sampler_thread, NULL, SamplerMain, NULL) != 0) {
+        XCloseDisplay(sampler_display);
+        sampler_display = NULL;
+        return false;
+    }
+    sampler_running = true;
+    return true;
+}
+
+void InputSamplerStop(void) {
+    if (!sampler_running) return;
+    __atomic_store_n(&sampler_stop, 1, __ATOMIC_RELEASE);
+    pthread_join(sampler_thread, NULL);
+    XCloseDisplay(sampler_display);
+    sampler_display = NULL;
+    sampler_running = false;
+}
+
+bool InputSamplerRunning(void) {
+    return sampler_running;
+}
+
+bool InputSamplerLatest(InputSample *out) {
+    if (!sampler_running) return false;
+    for (;;) {
+        uint32_t before = __atomic_load_n(&sampler_seq, __ATOMIC_ACQUIRE);
+        if (before == 0) return false;      // まだ1件も読めていない
+        if (before & 1) continue;
+        *out = sampler_latest;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&sampler_seq, __ATOMIC_RELAXED) == before) return true;
+    }
+}
+
+#else
+
+// X11 以外では使わない（呼び出し側は raylib の入力だけで動く）
+bool InputSamplerStart(int hz) { (void)hz; return false; }
+void InputSamplerStop(void) {}
+bool InputSamplerRunning(void) { return false; }
+bool InputSamplerLatest(InputSample *out) { memset(out, 0, sizeof(*out)); return false; }
+
+#endif
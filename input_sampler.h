@@ -0,0 +1,29 @@
+// 入力サンプラー
+// 別スレッドで一定周期（既定 1000Hz）にマウスの位置とボタンを読み、最新の値を公開する。
+// raylib の入力はフレームの最後（EndDrawing）でしか更新されないので、描画直前に
+// より新しいカーソル位置を使うためのもの。X11 専用（他の環境では起動に失敗するだけ）。
+// X11 のヘッダーは raylib と型名がぶつかるので、このファイルは raylib を含めない。
+#ifndef INPUT_SAMPLER_H
+#define INPUT_SAMPLER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define INPUT_SAMPLER_LEFT  0x1
+#define INPUT_SAMPLER_RIGHT 0x2
+
+typedef struct {
+    double time;            // 読んだ時刻（CLOCK_MONOTONIC の秒）
+    int root_x;             // 画面全体でのカーソル位置（画素）
+    int root_y;
+    uint32_t buttons;       // INPUT_SAMPLER_LEFT / RIGHT
+    uint32_t press_count;   // 左ボタンが押された回数
+    double press_time;      // 最後に左ボタンが押された時刻
+} InputSample;
+
+bool InputSamplerStart(int hz);
+void InputSamplerStop(void);
+bool InputSamplerRunning(void);
+bool InputSamplerLatest(InputSample *out);
+
+#endif
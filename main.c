@@ -1,9 +1,28 @@
+#if defined(__linux__)
+#define _GNU_SOURCE
+#endif
 #include "raylib.h"
 #include "rlgl.h"
 #include "raymath.h"
+#include "input_sampler.h"
+#include "capture.h"
+#include "telemetry.h"
+#include "render_stats.h"
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <signal.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
 
 
 
@@ -12,13 +31,172 @@
 #define INITIAL_SCREEN_HEIGHT 450
 #define MAX_BULLETS 300
 #define MAX_ENEMIES 100
+#define ENEMY_BOSS_SLOTS 1                      // ボス専用の枠（通常の敵の容量の外）
+#define MAX_ENEMY_SLOTS (MAX_ENEMIES + ENEMY_BOSS_SLOTS)
 #define MAX_PARTICLES 600
 #define MAX_ITEMS 100
+#define MAX_ENEMY_BULLETS 16384
+
+// ワールドのメモリ
+// プールの容量は起動時に --budget で変えられる（MAX_* は上限。ネットの ID とリプレイの形式が使う）
+#define WORLD_ALIGN 64                          // 各プールの先頭をキャッシュラインに揃える
+#define WORLD_HUGE_PAGE (2 * 1024 * 1024)
+#define FRAME_SCRATCH_DEFAULT (256 * 1024)      // フレームごとの一時領域
 
 // バランス調整
 #define KILLS_TO_BOSS_BASE 10
 #define TRAIL_LENGTH 10
 #define FIELD_LIMIT 45.0f
+#define PLAYER_RADIUS 0.8f
+
+// ボクセルアリーナ
+#define VOXEL_SIZE 2.0f
+#define ARENA_CELLS 48
+#define ARENA_HEIGHT 4
+#define ARENA_HALF (ARENA_CELLS * VOXEL_SIZE * 0.5f)
+#define ARENA_VOXELS (ARENA_CELLS * ARENA_CELLS * ARENA_HEIGHT)
+#define ARENA_CHUNK_SIZE 16
+#define ARENA_CHUNKS (ARENA_CELLS / ARENA_CHUNK_SIZE)
+#define ARENA_MAX_CHUNK_QUADS (ARENA_CHUNK_SIZE * ARENA_CHUNK_SIZE * ARENA_HEIGHT * 6)
+#define ARENA_COVER_PIECES 18
+#define ARENA_REMESH_PER_FRAME 2
+
+// 敵弾（弾幕）
+#define ENEMY_BULLET_Y 1.5f
+#define ENEMY_BULLET_PATTERN_LIFE 5.0f
+#define ENEMY_BULLET_MAX_VOLLEYS 8
+#define BOSS_PATTERN_STEPS 4
+#define BOSS_PATTERN_PAUSE 0.6f
+
+// 武器（レール・レーザーの当たり判定）
+#define HIT_GRID_CELL (VOXEL_SIZE * 2)
+#define HIT_GRID_DIM (ARENA_CELLS / 2)
+#define HIT_GRID_MAX_REFS (MAX_ENEMY_SLOTS * 9)
+#define HIT_GRID_OUTSIDE (HIT_GRID_DIM * HIT_GRID_DIM)  // グリッドからはみ出した敵を入れる最後のセル
+#define MAX_RAY_HITS 32
+#define RAIL_RANGE 60.0f
+#define LASER_RANGE 30.0f
+
+// 省電力（静止画面・タイトルのフレームレート）
+#define FROZEN_FPS 30
+#define TITLE_FPS 30
+#define KIOSK_FPS 10
+#define KIOSK_IDLE_SECONDS 60.0f
+
+// 画質の自動調整（負荷は目標フレーム時間に対する割合）
+#define QUALITY_LEVELS 4
+#define QUALITY_DOWN_LOAD 0.85f
+#define QUALITY_UP_LOAD 0.55f
+#define QUALITY_MISS_RATIO 1.15f
+#define QUALITY_DOWN_SECONDS 0.5f
+#define QUALITY_UP_SECONDS 3.0f
+#define QUALITY_UP_MAX_SECONDS 30.0f
+#define QUALITY_RETRY_WINDOW 5.0f
+#define QUALITY_SETTLE_SECONDS 30.0f
+#define QUALITY_COOLDOWN 1.0f
+
+// ブルーム（明るさのしきい値は 0〜1 の最大チャンネル）
+#define BLOOM_LEVELS 2
+#define BLOOM_THRESHOLD 0.6f
+#define BLOOM_INTENSITY 0.8f
+#define SCENE_MAX_VIEWS 2
+
+// 描画キュー（並べ替えのキーは下位 24 ビットがコマンドの番号、その上の 24 ビットに
+// パス 2・材質 4・深度 18 ビット。並べ替えるのは上の 3 バイトだけ）
+#define RENDER_QUEUE_FAR 256.0f         // 深度を量子化する範囲（カメラの前方向の距離）
+#define RENDER_INDEX_BITS 24            // 1回のキューに入るコマンドの上限は 2^24
+#define RENDER_DEPTH_BITS 18
+#define RENDER_MATERIAL_BITS 4
+#define RENDER_PASS_SHIFT (RENDER_INDEX_BITS + RENDER_MATERIAL_BITS + RENDER_DEPTH_BITS)
+#define RENDER_KEY_BYTES ((RENDER_PASS_SHIFT + 2 + 7) / 8)
+
+// 入力遅延（サンプラー周期・遅延の分布・フレームリミッター）
+#define INPUT_SAMPLER_HZ 1000
+#define LATENCY_BUCKET_MS 0.25f
+#define LATENCY_BUCKETS 400
+#define LIMITER_SPIN_SECONDS 0.00025   // 締め切りの直前だけ回して待つ（nanosleep の遅れの分）
+#define LIMITER_SLEEP_SECONDS 0.001    // それまでは短く区切って眠る（1回で長く眠るより起きる時刻がずれない）
+#define SAMPLER_MISMATCH_FRAMES 30
+
+// HUD（ウィジェットは値が変わったときだけアトラスに描き直す）
+#define HUD_ATLAS_WIDTH 1024
+#define HUD_ATLAS_HEIGHT 512
+#define HUD_FEED_ENTRIES 4
+#define HUD_FEED_SECONDS 3.0f
+#define HUD_FEED_Y 160                  // キルフィードの1行目（右上）
+#define HUD_FEED_ROW 24
+#define HUD_DIGIT_SIZE 20
+#define HUD_DIGIT_CELL 24
+#define MAX_DAMAGE_NUMBERS 64
+#define DAMAGE_NUMBER_SECONDS 0.8f
+#define DAMAGE_NUMBER_MERGE 0.15f     // 同じ敵への連続ヒットをまとめる間隔
+
+// レーダー（周りの敵・敵弾・アイテムを粗い格子に数え、1枚のテクスチャにして貼る）
+#define RADAR_GRID 32
+#define RADAR_RANGE 48.0f             // 中心から端までの距離（出現の輪より外まで映す）
+#define RADAR_SPAWN_RING 35.0f        // SpawnEnemy が地上に出す距離（目安の輪として描く）
+#define RADAR_SIZE 160
+#define RADAR_VIEWS 2                 // 対戦の画面分割では1人に1枚
+
+// リプレイ（入力の記録と一定間隔のキーフレーム）
+#define REPLAY_MAGIC 0x50525356u        // "VSRP"
+#define REPLAY_SEGMENT_MAGIC 0x4D474553u    // "SEGM"
+#define REPLAY_VERSION 4
+#define REPLAY_KEYFRAME_TICKS 300       // 60fps で約5秒ごと
+#define REPLAY_MAX_STEPS_PER_FRAME 240  // 早送りで1フレームに進める上限
+#define REPLAY_BULLET_BYTES (5 * sizeof(float) + sizeof(uint16_t) + sizeof(uint8_t))  // 敵弾1発分（SoA の各列）
+
+// 状態のハッシュ（毎ティック。--hash-trace で項目ごとに書き出し、--hash-compare で比べる）
+#define HASH_MULTIPLIER 0x9E3779B97F4A7C15ull
+#define HASH_TRACE_MAGIC 0x54485356u    // "VSHT"
+#define HASH_TRACE_VERSION 1
+#define HASH_TRACE_MINUTES 10           // リプレイを渡さないときの自動操縦の長さ
+#define HASH_PLAYER_FIELDS 4            // プレイヤー1人分の項目数
+
+// 探索モード（外周のない平地。浮動原点で座標を小さく保ち、周りのセクターの中身を読み込む）
+#define ROAM_SECTOR_SIZE 64.0f          // 原点を動かす単位（2 の累乗なので引き算に誤差が出ない。床の格子の間隔の倍数）
+#define ROAM_REBASE_DISTANCE 40.0f      // 原点からこれより離れたら、原点を今いるセクターへ移す
+#define ROAM_STREAM_RADIUS 2            // 周りのこの距離（セクター数）までは先に作っておく
+#define ROAM_ACTIVE_RADIUS 1            // この距離までのセクターの中身を出す
+#define ROAM_SECTOR_SLOTS 49            // (2 * (ROAM_STREAM_RADIUS + 1) + 1)^2。捨てるのは1つ外側からなので足りなくならない
+#define ROAM_GENERATE_PER_TICK 1        // 1ティックに作るセクターの上限
+#define ROAM_SETS 3                     // 1セクターの出現群の上限
+#define ROAM_SET_ENEMIES 8              // 1つの出現群の敵の上限
+#define ROAM_PICKUPS 4
+#define ROAM_TRIGGER_RADIUS 28.0f       // 出現群にこれだけ近づいたら敵を出す
+#define ROAM_SPAWNS_PER_TICK 8          // 1ティックに出す敵の上限（残りは次のティックへ）
+#define ROAM_PENDING 32                 // 出し終えていない出現群の待ち行列（出す範囲の 9 セクター x ROAM_SETS より多い）
+#define ROAM_DROP_DISTANCE 96.0f        // 原点を移すとき、これより遠くに置き去りの敵と落ちたアイテムは消す
+#define ROAM_PICKUP_LIFE 1.0e6f         // セクターのアイテムは時間では消えない（セクターと一緒に消える）
+#define ROAM_MEMORY 512                 // 手を付けたセクターを覚えておく数（古いものから忘れる）
+
+// 動画キャプチャとオフスクリーン実行
+#define CAPTURE_FPS 60
+#define OFFSCREEN_WIDTH 1280
+#define OFFSCREEN_HEIGHT 720
+#define OFFSCREEN_GAMEOVER_SECONDS 2.0f
+
+// 描画ベンチマーク（--render-bench）
+#define RENDER_BENCH_WARMUP 30
+#define RENDER_BENCH_FRAMES 300
+#define RENDER_BENCH_ANIM_TIME 1.25     // アニメーションを止める時刻（秒）
+#define RENDER_BENCH_ENEMIES 100
+
+// メカ描画（焼き込みメッシュ）
+#define MECHA_TYPES 3
+#define MECHA_MAX_VERTICES 1024
+
+// ネットワーク（協力プレイ）
+#define MAX_NET_PLAYERS 8
+#define NET_DEFAULT_PORT 27960
+#define NET_TICK_RATE 30
+#define NET_HISTORY 32
+#define NET_INTEREST_RADIUS 45.0f
+#define NET_MAX_SNAPSHOT_ENTITIES 1024
+#define NET_MAX_PACKET 60000
+#define NET_MAX_ARENA_CELLS 256
+#define NET_MAX_SNAPSHOT_ENEMY_BULLETS 384
+#define NET_ENEMY_BULLET_IDS 16384
 
 // カラー設定
 #define COL_NEON_CYAN   (Color){ 0, 255, 255, 255 }
@@ -59,7 +237,7 @@ typedef struct {
     int exp;
     int next_level_exp;
     int damage;
-    int weapon_type; 
+    int weapon_type;    // WeaponType
     float shoot_cooldown;
     float dash_cooldown;
     float dash_duration;
@@ -69,8 +247,20 @@ typedef struct {
     float invincible_timer;
     Vector3 trail_pos[TRAIL_LENGTH];
     int trail_idx;
+    float beam_timer;   // レール・レーザーの表示時間
+    float beam_length;
 } Player;
 
+// 1ティック分の入力（ローカル・ネットワーク共通）
+typedef struct {
+    float move_x;       // ワールド座標系の移動方向
+    float move_z;
+    Vector3 aim_point;  // 地面上の照準位置
+    bool fire;
+    bool dash;          // 押した瞬間のみ true
+    int weapon_select;  // 武器の切り替え（0: なし、1〜: weapon_type + 1）
+} PlayerInput;
+
 typedef enum { ENEMY_DRONE, ENEMY_TANK, ENEMY_BOSS } EnemyType;
 
 // 敵情報
@@ -88,16 +278,28 @@ typedef struct {
     bool is_grounded;     
     float shoot_cooldown;
     float attack_range;
+    int pattern_step;       // ボスの弾幕パターンの進行
+    float pattern_time;
+    float pattern_timer;
+    float pattern_angle;
 } Enemy;
 
+// 敵の種類ごとの置き場所（プールの中の連続した範囲 [start, end)）。
+// ドローンは先頭から、タンクは末尾から詰め、ボスは通常の容量の後ろの専用枠に置く。
+// 範囲の中には倒した敵の空きが残る（範囲は広めでもよく、狭くてはいけない）
+typedef struct {
+    int start;
+    int end;
+} EnemyBucket;
+
 // 弾設定
 typedef struct {
     Vector3 position;
     Vector3 velocity;
     bool active;
     float life_time;
-    bool is_enemy_bullet;
     bool is_p2_bullet;
+    int owner;          // 撃ったプレイヤー（sim_players の添字）
 } Bullet;
 
 // エフェクト
@@ -113,15 +315,554 @@ typedef struct {
 
 typedef enum { ITEM_HEAL, ITEM_EXP } ItemType;
 
+typedef enum { WEAPON_BLASTER, WEAPON_SPREAD, WEAPON_RAIL, WEAPON_LASER, WEAPON_COUNT } WeaponType;
+
+// HUD のウィジェット（アトラス上の場所は InitHud で決める）
+typedef enum {
+    HUD_STAGE, HUD_HP, HUD_LEVEL, HUD_WEAPON, HUD_EXP, HUD_BOSS_BAR, HUD_BOSS_WARNING,
+    HUD_BANNER_WARNING, HUD_BANNER_CLEAR, HUD_BANNER_GAMEOVER, HUD_RETURN_PROMPT,
+    HUD_PVP_P1, HUD_PVP_P2, HUD_PVP_RESULT, HUD_ROAM,
+    HUD_FEED,                                   // キルフィード（HUD_FEED_ENTRIES 個）
+    HUD_DIGITS = HUD_FEED + HUD_FEED_ENTRIES,   // ダメージ数字用の 0〜9
+    HUD_WIDGET_COUNT
+} HudWidgetId;
+
+typedef struct {
+    Rectangle slot;     // アトラス上の場所
+    int value[3];       // 描いたときの値（変わったら描き直す）
+    bool valid;
+    bool dirty;
+} HudWidget;
+
+typedef struct {
+    char text[32];
+    Color color;
+    float age;
+    int serial;
+    bool active;
+} KillFeedEntry;
+
+typedef struct {
+    Vector3 position;
+    int value;
+    int enemy;
+    float age;
+    bool active;
+} DamageNumber;
+
+// レーダー
+typedef enum { RADAR_ENEMY, RADAR_SKYFALL, RADAR_ENEMY_BULLET, RADAR_ITEM, RADAR_OTHER, RADAR_CHANNELS } RadarChannel;
+typedef struct {
+    float cx, cz;       // 中心（ワールド）
+    float ux, uz;       // ワールドの1単位でセルの横方向に進む量
+    float vx, vz;       // 縦方向（上が視線の向き）
+} RadarBasis;
+typedef struct {
+    Texture2D texture;
+    uint16_t counts[RADAR_CHANNELS][RADAR_GRID * RADAR_GRID];
+    Color pixels[RADAR_GRID * RADAR_GRID];
+} Radar;
+
+// レイが当たった敵
+typedef struct {
+    int enemy;
+    float t;
+} RayHit;
+
+// 敵の当たり箱の一様グリッド（CSR 形式。ティックごとに作り直す）
+typedef struct {
+    int cell_start[HIT_GRID_OUTSIDE + 2];
+    uint16_t refs[HIT_GRID_MAX_REFS];
+    BoundingBox boxes[MAX_ENEMY_SLOTS];
+    uint32_t stamp[MAX_ENEMY_SLOTS];    // 同じクエリで2回調べないための印
+    uint32_t query;
+    int ref_count;
+} EnemyHitGrid;
+
+// グリッド上の DDA
+typedef struct {
+    int cx, cz;
+    int stepX, stepZ;
+    int dim;
+    float tMaxX, tMaxZ;
+    float tDeltaX, tDeltaZ;
+    float t;            // 今いるセルに入った距離
+} GridWalk;
+
+// 敵弾プール（SoA。生きている弾は先頭 count 個に詰めて持つ。各列はワールドの領域に置く）
+typedef enum { ENEMY_BULLET_SHOT, ENEMY_BULLET_PATTERN } EnemyBulletStyle;
+typedef struct {
+    float *x;
+    float *z;
+    float *vx;
+    float *vz;
+    float *life;
+    uint8_t *style;
+    uint16_t *serial;   // ネット同期用の通し番号
+    int capacity;
+    int count;
+    int peak;
+    int dropped;
+    uint16_t next_serial;
+} EnemyBulletPool;
+
+// 弾幕パターン（データで定義する）
+typedef enum { PATTERN_RADIAL, PATTERN_SPIRAL, PATTERN_AIMED_BURST } BulletPatternKind;
+typedef struct {
+    BulletPatternKind kind;
+    float duration;     // このパターンを続ける秒数
+    float interval;     // 発射間隔（秒）
+    int ways;           // 1回の発射数
+    float speed;
+    float spread;       // AIMED_BURST の扇の開き（ラジアン）
+    float spin;         // 1回ごとの回転量（ラジアン）
+} BulletPattern;
+
+typedef struct {
+    int count;
+    BulletPattern steps[BOSS_PATTERN_STEPS];
+} BossPatternSet;
+
+typedef enum { BLOCK_EMPTY, BLOCK_WALL, BLOCK_PILLAR, BLOCK_COVER } BlockType;
+
+// 画質の段階（0 が最も軽い）
+typedef struct {
+    float render_scale;     // 3D シーンの内部解像度
+    int particle_cap;       // 同時に出せるパーティクル数
+    float particle_ratio;   // SpawnExplosion の個数に掛ける
+    int grid_slices;        // DrawCyberGrid の半径（本数）
+    bool mecha_detail;      // メカの縁取りまで描くか
+    int bloom_mip;          // ブルームの開始解像度（0: なし 1: 1/2 2: 1/4）
+} QualityPreset;
+
+// 画質の自動調整の状態（時間はすべて秒）
+typedef struct {
+    int level;
+    float sim_avg;
+    float draw_avg;
+    float frame_avg;
+    float headroom;         // 1 - 負荷
+    float over_time;        // 負荷が高い状態の継続時間
+    float under_time;       // 余裕がある状態の継続時間
+    float up_delay;         // 上げるまでに必要な余裕の継続時間
+    float since_up;
+    float since_change;
+    float cooldown;
+    bool show;
+} QualityGovernor;
+
+// 遅延の分布（LATENCY_BUCKET_MS 刻み。最後のビンはそれ以上すべて）
+typedef struct {
+    int bins[LATENCY_BUCKETS];
+    int count;
+    double sum;
+    double max;
+} LatencyHistogram;
+
+// 描画直前に取り直した照準（描画専用）
+typedef struct {
+    bool valid;
+    Vector3 aim;
+    float facing;
+} LateLatch;
+
+// メカメッシュの焼き込み用バッファ
+typedef struct {
+    float pos[MECHA_MAX_VERTICES * 3];
+    float uv[MECHA_MAX_VERTICES * 2];
+    float uv2[MECHA_MAX_VERTICES * 2];
+    unsigned char col[MECHA_MAX_VERTICES * 4];
+    unsigned short idx[MECHA_MAX_VERTICES * 3 / 2];
+    int vertexCount;
+    int indexCount;
+} MechaBuilder;
+
 // アイテム
 typedef struct {
     Vector3 position;
     bool active;
+    uint8_t sector;     // 探索モードで置いたセクターの枠 + 1（0: 敵が落としたもの）
+    uint8_t pickup;     // セクターの中の番号
     ItemType type;
     float life_time;
     float angle;
 } Item;
 
+// 描画キュー
+// 床より上の 3D はいったんキューに積み、キーで並べ替えてから描く。
+// 不透明は手前から奥へ（深度を書く）、半透明は奥から手前へ（深度は書かない）、
+// 加算合成は順番で結果が変わらないので材質でまとめる（深度は書かない）
+typedef enum { RENDER_PASS_OPAQUE, RENDER_PASS_ALPHA, RENDER_PASS_ADDITIVE, RENDER_PASS_COUNT } RenderPass;
+
+// 材質はメカの種類（メッシュとシェーダー）、rlgl の即時描画（1つのバッチにまとまる）、敵弾のプール
+typedef enum { RENDER_MAT_MECHA = 0, RENDER_MAT_SHAPES = MECHA_TYPES, RENDER_MAT_ENEMY_BULLETS } RenderMaterial;
+
+typedef enum {
+    RENDER_CMD_MECHA,           // a: 位置、angle: 向き、param: アニメ時刻、sub: 種類
+    RENDER_CMD_MECHA_INSTANCED, // sub: 種類（行列は RenderQueue 側に持つ）
+    RENDER_CMD_SHADOW,          // a: 位置、sub: 種類
+    RENDER_CMD_CUBE,            // a: 中心、b: 大きさ
+    RENDER_CMD_HP_BAR,          // a: 中心、b.x: 幅、param: 残りの割合
+    RENDER_CMD_DROP_MARKER,     // a: 落下中の敵
+    RENDER_CMD_BULLET,          // a: 位置、param: 半径
+    RENDER_CMD_ENEMY_BULLETS,   // 敵弾のプール全部
+    RENDER_CMD_BEAM,            // a: 始点、b: 終点、param: 太さ
+    RENDER_CMD_ITEM,            // a: 位置、angle: 向き（度）
+    RENDER_CMD_CURSOR,          // a: 照準、b: 撃つプレイヤー、angle: 向き（度）
+} RenderCommandType;
+
+typedef struct {
+    Vector3 a;
+    Vector3 b;
+    Color color;
+    float angle;
+    float param;
+    uint8_t type;           // RenderCommandType
+    uint8_t sub;
+} RenderCommand;
+
+typedef struct {
+    RenderCommand *cmds;
+    uint64_t *keys;
+    uint64_t *scratch;      // 基数ソートの受け皿
+    int count;
+    int capacity;
+    Vector3 eye;
+    Vector3 forward;
+    const Matrix *instance_transforms[MECHA_TYPES];
+    int instance_counts[MECHA_TYPES];
+    // 計測
+    int last_count;
+    int last_sort_passes;   // 基数ソートで実際に回した桁の数
+    uint64_t overflows;     // 一時領域が足りずにその場で描いたコマンド
+} RenderQueue;
+
+// 描画ベンチマークの場面
+typedef enum {
+    RENDER_SCENE_TITLE,
+    RENDER_SCENE_WAVE_3D,   // 敵100体のウェーブを DrawScene だけで（縮小描画・グロー・HUD なし）
+    RENDER_SCENE_WAVE,      // 同じ場面を DrawGame で
+    RENDER_SCENE_BOSS,      // ボス戦（パーティクル全部・弾幕・ダメージ表示）
+    RENDER_SCENE_PVP,
+    RENDER_SCENE_COUNT
+} RenderBenchScene;
+
+// ネットワーク
+enum { NET_MSG_HELLO = 1, NET_MSG_WELCOME, NET_MSG_INPUT, NET_MSG_SNAPSHOT, NET_MSG_BYE };
+enum { NET_KIND_PLAYER, NET_KIND_ENEMY, NET_KIND_BULLET, NET_KIND_ITEM, NET_KIND_ENEMY_BULLET };
+enum { NET_MODE_OFFLINE, NET_MODE_SERVER, NET_MODE_CLIENT };
+#define NET_MAGIC 0x31565356u
+
+// 差分で送るフィールド
+#define NET_F_POS   0x01
+#define NET_F_ANGLE 0x02
+#define NET_F_FLAGS 0x04
+#define NET_F_HP    0x08
+#define NET_F_KIND  0x10
+#define NET_F_STATS 0x20
+#define NET_F_WEAPON 0x40
+#define NET_F_ALL   0x7F
+
+// エンティティフラグ
+#define NET_EF_DASH         0x01
+#define NET_EF_INVINCIBLE   0x02
+#define NET_EF_FLASH        0x04
+#define NET_EF_AIRBORNE     0x08
+
+// エンティティID（種類ごとにプール添字をずらして割り当てる）
+#define NET_ID_PLAYER 0
+#define NET_ID_ENEMY  (NET_ID_PLAYER + MAX_NET_PLAYERS)
+#define NET_ID_BULLET (NET_ID_ENEMY + MAX_ENEMY_SLOTS)
+#define NET_ID_ITEM   (NET_ID_BULLET + MAX_BULLETS)
+#define NET_ID_ENEMY_BULLET (NET_ID_ITEM + MAX_ITEMS)   // 敵弾は通し番号で NET_ENEMY_BULLET_IDS 個
+
+// 量子化済みのエンティティ状態（位置は 1/16 単位）
+typedef struct {
+    uint16_t id;
+    uint8_t kind;
+    uint8_t sub;
+    int16_t x, y, z;
+    uint8_t angle;
+    uint8_t flags;
+    uint16_t hp, max_hp;
+    uint8_t level;
+    uint16_t exp, next_exp;
+    uint8_t weapon;
+    uint8_t beam;       // ビームの長さ（1/4 単位、0 で非表示）
+} NetEntity;
+
+// ID 昇順に並んだ1ティック分の状態
+typedef struct {
+    uint32_t tick;
+    int arena_epoch;    // アリーナを生成し直した回数
+    int arena_log;      // 送信済みの破壊ブロック数（サーバー側）
+    int count;
+    NetEntity ents[NET_MAX_SNAPSHOT_ENTITIES];
+} NetSnapshot;
+
+typedef struct {
+    uint8_t *data;
+    int len;
+    int cap;
+    int pos;
+    bool overflow;
+} NetBuf;
+
+// サーバー側のクライアント枠
+typedef struct {
+    bool connected;
+    struct sockaddr_in addr;
+    PlayerInput input;
+    bool pending_dash;
+    int pending_weapon;
+    uint32_t ack_tick;
+    double last_heard;
+    NetSnapshot history[NET_HISTORY];
+    uint64_t bytes_out, bytes_in;
+    uint64_t total_out, total_in;
+    int entity_count;
+} NetClientSlot;
+
+// クライアント（ウィンドウ版・ベンチ用ボット共通）
+typedef struct {
+    int sock;
+    struct sockaddr_in server;
+    int slot;
+    uint32_t latest_tick;
+    NetSnapshot *history;
+    uint64_t bytes_in, bytes_out;
+    uint8_t state, stage, boss;
+    uint16_t kills, kills_required;
+    int arena_epoch;
+} NetClient;
+
+// ワールドのメモリ
+// プールごとの容量・使用数・確保できなかった回数
+typedef enum { POOL_ENEMIES, POOL_BULLETS, POOL_ENEMY_BULLETS, POOL_PARTICLES, POOL_ITEMS, POOL_COUNT } PoolId;
+
+typedef struct {
+    const char *name;       // --budget での名前
+    int *capacity;
+    int limit;              // 上限（MAX_*）
+    size_t item_size;
+    int in_use;             // 直近のフレームの区切りで使っていた数
+    int peak;
+    uint64_t failures;      // 一杯で出せなかった数
+} PoolStats;
+
+typedef struct {
+    uint8_t *base;          // 1つの領域（mmap）
+    size_t size;
+    size_t used;            // プールに使った分（起動時に確定）
+    const char *page_mode;  // "4k" / "madvise" / "hugetlb"
+    // フレーム用の一時領域（フレームの先頭で空にする）
+    uint8_t *frame_base;
+    size_t frame_size;
+    size_t frame_used;
+    size_t frame_peak;
+    uint64_t frame_failures;
+    uint64_t frames;
+} WorldArena;
+
+// リプレイ
+// ファイルは ReplayHeader、セグメントの並び、最後に索引（ReplayIndexEntry の配列）。
+// セグメントはキーフレーム（その時点の状態）と、そこから続くティックの入力。
+// 構造体をそのまま書くので、同じビルドで読むことを前提にする（大きさで確かめる）。
+// 区切りはすべて8バイト境界に揃え、mmap したまま構造体として読めるようにする
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t state_size;        // sizeof(ReplayState)
+    uint32_t tick_size;         // sizeof(ReplayTick)
+    uint32_t player_size;
+    uint32_t enemy_size;
+    uint16_t pool_capacity[4];  // 敵・弾・アイテム・敵弾（--budget が違うと再生できない）
+    int32_t mode;               // 0: 1人用、1: 対戦
+    int32_t difficulty;
+    uint32_t keyframe_ticks;
+    uint32_t segment_count;
+    uint64_t tick_count;
+    double duration;            // ゲーム内の秒数
+    uint64_t index_offset;      // 0 なら途中で終わったファイル（先頭から辿って索引を作る）
+} ReplayHeader;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t state_bytes;       // 可変長部分を含むキーフレームの大きさ
+    uint64_t first_tick;
+    double start_time;
+} ReplaySegmentHeader;
+
+typedef struct {
+    uint64_t first_tick;
+    double start_time;
+    uint64_t offset;            // ReplaySegmentHeader の位置
+    uint32_t tick_count;
+    uint32_t state_bytes;
+} ReplayIndexEntry;
+
+typedef struct {
+    float dt;
+    uint32_t hash;              // このティックを始める前の状態のハッシュ（下位32ビット）
+    PlayerInput input[2];       // 1人用は input[0] だけ使う
+} ReplayTick;
+
+// キーフレームの固定長部分。後ろに敵弾（生きている分）と壊れたブロックの一覧が続く。
+// カメラ・画面の揺れ・パーティクルは見た目だけなので持たない。
+// アリーナはシードと壊れたブロックの一覧から作り直せるので、耐久値だけ持つ
+typedef struct {
+    GameState state;
+    DifficultyMode difficulty;
+    int winner_id;
+    int current_stage;
+    int stage_kills;
+    int kills_required_for_boss;
+    bool boss_spawned;
+    float state_timer;
+    float enemy_spawn_timer;
+    float game_time;
+    uint32_t sim_rng;
+    Player player;
+    Player player2;
+    Enemy enemies[MAX_ENEMY_SLOTS];
+    Bullet bullets[MAX_BULLETS];
+    Item items[MAX_ITEMS];
+    uint8_t arena_block_hp[ARENA_VOXELS];
+    int arena_seed;
+    int arena_destroyed_count;
+    int enemy_bullet_count;
+    uint16_t enemy_bullet_next_serial;
+} ReplayState;
+
+typedef struct {
+    FILE *file;
+    char path[256];
+    ReplayHeader header;
+    ReplayIndexEntry *index;
+    int index_cap;
+    uint64_t tick;
+    double time;
+    uint32_t segment_ticks;     // 今のセグメントに書いた入力の数
+    bool active;
+} ReplayRecorder;
+
+typedef struct {
+    const uint8_t *data;        // ファイル全体を mmap したもの
+    size_t size;
+    const ReplayHeader *header;
+    const ReplayIndexEntry *index;  // ファイル末尾の索引（mmap 上をそのまま引く）
+    ReplayIndexEntry *scanned;      // 索引のないファイルはセグメントを辿って作る
+    int segment_count;
+    uint64_t tick_count;
+    double duration;
+    int segment;                // 今いるセグメント
+    uint64_t tick;              // 次に進めるティック
+    double time;
+    int desyncs;                // キーフレームと食い違った回数（再生で次のキーフレームに着いたときに確かめる）
+    int tick_desyncs;           // 記録したハッシュと食い違ったティックの数（毎ティック確かめる）
+    uint64_t first_desync_tick;
+} ReplayPlayer;
+
+// 状態のハッシュ。どこで食い違ったか分かるよう、項目ごとに別々に足してから全体をまとめる。
+// キーフレームに入る状態だけを対象にする（再生でキーフレームを戻した直後も同じ値になる）
+typedef enum {
+    HASH_PROGRESS, HASH_TIMERS, HASH_RNG, HASH_ARENA,
+    HASH_P1_POSITION, HASH_P1_STATS, HASH_P1_TIMERS, HASH_P1_MOTION,
+    HASH_P2_POSITION, HASH_P2_STATS, HASH_P2_TIMERS, HASH_P2_MOTION,
+    HASH_ENEMY_ACTIVE, HASH_ENEMY_POSITION, HASH_ENEMY_HP, HASH_ENEMY_MOTION, HASH_ENEMY_ATTACK,
+    HASH_BULLET_ACTIVE, HASH_BULLET_POSITION, HASH_BULLET_VELOCITY, HASH_BULLET_LIFE,
+    HASH_ENEMY_BULLET_COUNT, HASH_ENEMY_BULLET_POSITION, HASH_ENEMY_BULLET_VELOCITY, HASH_ENEMY_BULLET_LIFE,
+    HASH_ITEM_ACTIVE, HASH_ITEM_POSITION, HASH_ITEM_LIFE,
+    HASH_FIELD_COUNT
+} HashField;
+
+typedef struct {
+    uint64_t sum;
+    uint64_t weighted;          // sum の途中の値の和（並びの違いが分かる）
+} HashSum;
+
+typedef struct {
+    uint64_t field[HASH_FIELD_COUNT];
+    uint64_t total;
+} WorldHash;
+
+// --hash-trace のファイルは HashTraceHeader のあとに HashTraceRecord がティックの数だけ続く
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t field_count;
+    uint32_t record_size;
+    char build[96];             // コンパイラと最適化の有無
+    char source[96];            // リプレイのファイル名（自動操縦なら "autopilot"）
+} HashTraceHeader;
+
+typedef struct {
+    uint32_t tick;
+    float game_time;
+    uint64_t total;
+    uint64_t field[HASH_FIELD_COUNT];
+} HashTraceRecord;
+
+// 探索モードのセクター。中身はシードとセクター座標から決まる（捨てて作り直しても同じ）
+typedef struct {
+    float x, z;                 // セクターの中心からの位置
+    uint8_t drones;
+    uint8_t tanks;
+} RoamSpawnSet;
+
+typedef struct {
+    float x, z;
+    ItemType type;
+} RoamPickup;
+
+typedef struct {
+    int32_t x, z;               // ワールドでのセクター座標
+    bool used;
+    uint8_t set_count;
+    uint8_t pickup_count;
+    uint8_t sets_done;          // 出し終えた出現群のビット
+    uint8_t pickups_taken;      // 取られたアイテムのビット
+    uint8_t pickups_placed;     // items に置いているアイテムのビット
+    RoamSpawnSet sets[ROAM_SETS];
+    RoamPickup pickups[ROAM_PICKUPS];
+} RoamSector;
+
+// 近づいたが、まだ敵を出し切っていない出現群
+typedef struct {
+    RoamSpawnSet set;
+    Vector3 center;
+    uint8_t next;               // 次に出す敵
+} RoamPendingSpawn;
+
+// 手を付けたセクターの記録（作り直したときに、倒した出現群や取ったアイテムを戻さない）
+typedef struct {
+    int32_t x, z;
+    uint8_t sets_done;
+    uint8_t pickups_taken;
+} RoamMemory;
+
+typedef struct {
+    uint32_t seed;
+    int32_t origin_x, origin_z;     // ローカル座標の原点があるセクター
+    int32_t center_x, center_z;     // 読み込みの中心（プレイヤーのいるセクター）
+    bool streamed;                  // 中心の周りがそろっている
+    RoamSector sectors[ROAM_SECTOR_SLOTS];
+    RoamMemory memory[ROAM_MEMORY];
+    int memory_count;
+    int memory_next;
+    RoamPendingSpawn pending[ROAM_PENDING];
+    int pending_count;
+    // 計測（--bench roam）
+    int rebases;
+    int generated;
+    int evicted;
+    int sets_triggered;
+    int pickups_taken;
+    double rebase_sec_max;
+    double stream_sec_max;
+    double stream_sec;              // 直前のティックの読み込みと中身を出す時間
+    double sec;                     // RoamUpdate の時間の累計
+} RoamWorld;
 
 
 // グローバル変数
@@ -129,13 +870,33 @@ GameState current_state = STATE_TITLE;
 GameState previous_state = STATE_TITLE;
 DifficultyMode difficulty = MODE_NORMAL;
 
-// エンティティ
+// エンティティ（プールは InitWorldArena でワールドの領域から取る）
 Player player = { 0 };
 Player player2 = { 0 };
-Enemy enemies[MAX_ENEMIES] = { 0 };
-Bullet bullets[MAX_BULLETS] = { 0 };
-Particle particles[MAX_PARTICLES] = { 0 };
-Item items[MAX_ITEMS] = { 0 };
+Enemy *enemies = NULL;
+Bullet *bullets = NULL;
+EnemyBulletPool enemy_bullets = { 0 };
+EnemyHitGrid enemy_hit_grid = { 0 };
+Particle *particles = NULL;
+Item *items = NULL;
+int enemy_capacity = MAX_ENEMIES;       // 通常の敵（ドローンとタンク）の数の上限
+int enemy_slots = MAX_ENEMY_SLOTS;      // ボスの枠を足した配列の大きさ
+EnemyBucket enemy_buckets[MECHA_TYPES];
+int bullet_capacity = MAX_BULLETS;
+int particle_capacity = MAX_PARTICLES;
+int item_capacity = MAX_ITEMS;
+int enemy_bullet_capacity = MAX_ENEMY_BULLETS;
+
+// ワールドのメモリ
+WorldArena world_arena = { .frame_size = FRAME_SCRATCH_DEFAULT, .page_mode = "-" };
+PoolStats pool_stats[POOL_COUNT] = {
+    [POOL_ENEMIES]       = { "enemies",       &enemy_capacity,        MAX_ENEMIES,       sizeof(Enemy) },
+    [POOL_BULLETS]       = { "bullets",       &bullet_capacity,       MAX_BULLETS,       sizeof(Bullet) },
+    [POOL_ENEMY_BULLETS] = { "enemy-bullets", &enemy_bullet_capacity, MAX_ENEMY_BULLETS, 5 * sizeof(float) + sizeof(uint8_t) + sizeof(uint16_t) },
+    [POOL_PARTICLES]     = { "particles",     &particle_capacity,     MAX_PARTICLES,     sizeof(Particle) },
+    [POOL_ITEMS]         = { "items",         &item_capacity,         MAX_ITEMS,         sizeof(Item) },
+};
+bool world_huge_pages = false;          // --hugepages
 
 // カメラ
 Camera3D camera = { 0 };
@@ -152,7 +913,210 @@ float state_timer = 0.0f;
 float enemy_spawn_timer = 0.0f;
 float screen_shake = 0.0f;
 float camera_angle_rad = 0.0f;
+uint32_t sim_rng = 0x9E3779B9u;    // ゲーム進行用の乱数（SimRandom）
+
+// アリーナ
+uint8_t arena_blocks[ARENA_VOXELS] = { 0 };
+uint8_t arena_block_hp[ARENA_VOXELS] = { 0 };
+uint64_t arena_occupancy[(ARENA_VOXELS + 63) / 64] = { 0 };
+uint16_t arena_destroyed[ARENA_VOXELS];
+int arena_destroyed_count = 0;
+int arena_seed = -1;
+int arena_epoch = 0;
+Mesh arena_chunk_meshes[ARENA_CHUNKS * ARENA_CHUNKS] = { 0 };
+bool arena_chunk_dirty[ARENA_CHUNKS * ARENA_CHUNKS] = { 0 };
+bool arena_full_rebuild = false;
+Material arena_material;
+bool arena_material_ready = false;
+
+// 静止画面のキャッシュと省電力の状態
+RenderTexture2D frozen_frame = { 0 };
+bool frozen_frame_valid = false;
+bool frozen_frame_capturing = false;
+bool event_waiting = false;
+bool power_resumed = false;     // 待機明けのフレーム
+int target_fps = 60;
+float idle_timer = 0.0f;
+
+// 画質
+const QualityPreset quality_presets[QUALITY_LEVELS] = {
+    { 0.50f, 150, 0.35f,  8, false, 0 },
+    { 0.70f, 300, 0.60f, 12, false, 2 },
+    { 0.85f, 450, 0.80f, 16, true,  1 },
+    { 1.00f, MAX_PARTICLES, 1.00f, 20, true, 1 },
+};
+QualityGovernor quality = { .level = QUALITY_LEVELS - 1, .up_delay = QUALITY_UP_SECONDS, .since_up = QUALITY_RETRY_WINDOW };
+RenderTexture2D scene_target = { 0 };
+bool scene_offscreen = false;           // 3D シーンを scene_target に描いている
+bool scene_bloom = false;
+int scene_fb_width = INITIAL_SCREEN_WIDTH;
+int scene_fb_height = INITIAL_SCREEN_HEIGHT;
+int scene_view_count = 0;               // BeginSceneView で区切った区画（0 なら画面全体）
+int scene_view_x[SCENE_MAX_VIEWS];
+int scene_view_w[SCENE_MAX_VIEWS];
+RenderQueue render_queue = { 0 };
+
+// ブルーム
+bool bloom_enabled = true;              // F4 / --no-bloom
+bool bloom_ready = false;
+int bloom_mip_override = -1;            // ベンチマーク用（-1 なら画質の段階に従う）
+Shader bloom_downsample_shader;
+Shader bloom_blur_shader;
+Shader bloom_composite_shader;
+int bloom_loc_down_clamp = -1;
+int bloom_loc_down_texel = -1;
+int bloom_loc_threshold = -1;
+int bloom_loc_blur_clamp = -1;
+int bloom_loc_blur_texel = -1;
+int bloom_loc_bloom0 = -1;
+int bloom_loc_bloom1 = -1;
+int bloom_loc_intensity = -1;
+RenderTexture2D bloom_targets[BLOOM_LEVELS][2] = { 0 };    // 段ごとに結果と作業用
+float bloom_cpu_avg = 0;
+
+// 入力遅延の対策と計測（時刻は NetNow の秒）
+bool late_latch_enabled = true;         // --no-late-latch で無効
+bool input_thread_enabled = true;       // --no-input-thread で無効
+bool frame_limiter_enabled = false;     // --vsync-off で有効
+double limiter_deadline = 0;
+double limiter_late_max = 0;
+LateLatch late_latch = { 0 };
+LatencyHistogram latency_click = { 0 };     // 左クリック → EndDrawing
+LatencyHistogram latency_aim = { 0 };       // 表示した照準のカーソル位置 → EndDrawing
+double latency_pending_click = 0;
+double latency_aim_sample = 0;
+double last_poll_time = 0;              // 直前の EndDrawing（raylib が入力を更新した）時刻
+uint32_t sampler_press_seen = 0;
+int sampler_mismatch = 0;
+
+// HUD
+RenderTexture2D hud_atlas = { 0 };
+HudWidget hud_widgets[HUD_WIDGET_COUNT];
+const int hud_widget_size[HUD_WIDGET_COUNT][2] = {
+    [HUD_STAGE] = { 200, 32 }, [HUD_HP] = { 340, 42 }, [HUD_LEVEL] = { 200, 42 }, [HUD_WEAPON] = { 300, 47 },
+    [HUD_EXP] = { 200, 20 }, [HUD_BOSS_BAR] = { 300, 20 }, [HUD_BOSS_WARNING] = { 480, 32 },
+    [HUD_BANNER_WARNING] = { 300, 52 }, [HUD_BANNER_CLEAR] = { 420, 52 }, [HUD_BANNER_GAMEOVER] = { 520, 82 },
+    [HUD_RETURN_PROMPT] = { 360, 22 }, [HUD_PVP_P1] = { 220, 72 }, [HUD_PVP_P2] = { 220, 72 }, [HUD_PVP_RESULT] = { 420, 42 },
+    [HUD_ROAM] = { 300, 22 },
+    [HUD_FEED] = { 260, 22 }, [HUD_FEED + 1] = { 260, 22 }, [HUD_FEED + 2] = { 260, 22 }, [HUD_FEED + 3] = { 260, 22 },
+    [HUD_DIGITS] = { HUD_DIGIT_CELL * 10, HUD_DIGIT_CELL },
+};
+int hud_digit_width[10];
+int hud_redraws = 0;                    // 描き直したウィジェットの累計
+KillFeedEntry kill_feed[HUD_FEED_ENTRIES];
+int kill_feed_next = 0;
+int kill_feed_serial = 0;
+DamageNumber damage_numbers[MAX_DAMAGE_NUMBERS];
+const char *enemy_names[3] = { "DRONE", "TANK", "BOSS" };
+
+// レーダー
+Radar radars[RADAR_VIEWS];
+bool radar_enabled = true;              // F5
+
+// 状態のハッシュ
+const char *hash_field_names[HASH_FIELD_COUNT] = {
+    [HASH_PROGRESS] = "progress", [HASH_TIMERS] = "timers", [HASH_RNG] = "sim_rng", [HASH_ARENA] = "arena",
+    [HASH_P1_POSITION] = "player.position", [HASH_P1_STATS] = "player.stats",
+    [HASH_P1_TIMERS] = "player.timers", [HASH_P1_MOTION] = "player.motion",
+    [HASH_P2_POSITION] = "player2.position", [HASH_P2_STATS] = "player2.stats",
+    [HASH_P2_TIMERS] = "player2.timers", [HASH_P2_MOTION] = "player2.motion",
+    [HASH_ENEMY_ACTIVE] = "enemies.active", [HASH_ENEMY_POSITION] = "enemies.position", [HASH_ENEMY_HP] = "enemies.hp",
+    [HASH_ENEMY_MOTION] = "enemies.motion", [HASH_ENEMY_ATTACK] = "enemies.attack",
+    [HASH_BULLET_ACTIVE] = "bullets.active", [HASH_BULLET_POSITION] = "bullets.position",
+    [HASH_BULLET_VELOCITY] = "bullets.velocity", [HASH_BULLET_LIFE] = "bullets.life",
+    [HASH_ENEMY_BULLET_COUNT] = "enemy_bullets.count", [HASH_ENEMY_BULLET_POSITION] = "enemy_bullets.position",
+    [HASH_ENEMY_BULLET_VELOCITY] = "enemy_bullets.velocity", [HASH_ENEMY_BULLET_LIFE] = "enemy_bullets.life",
+    [HASH_ITEM_ACTIVE] = "items.active", [HASH_ITEM_POSITION] = "items.position", [HASH_ITEM_LIFE] = "items.life",
+};
+WorldHash world_hash;                   // 直近のティックを始める前の状態
+uint32_t world_hash_ticks = 0;
+double world_hash_sec = 0;              // ハッシュにかかった時間の累計
+FILE *hash_trace_file = NULL;           // --hash-trace の書き出し先
+
+// 探索モード
+bool roam_mode = false;                 // タイトルの [O]
+RoamWorld roam;
+
+// リプレイ
+bool replay_record_enabled = false;     // --record
+int replay_match_count = 0;
+ReplayRecorder replay_recorder = { 0 };
+ReplayState replay_scratch;             // キーフレームの書き出し・突き合わせ用（大きいので静的に持つ）
+
+// 動画キャプチャとオフスクリーン実行
+bool offscreen_mode = false;            // --offscreen
+int offscreen_frames = 0;               // --frames（0 なら止めない）
+const char *capture_path_arg = NULL;    // --capture
+float offscreen_gameover_timer = 0;
+
+// テレメトリ
+const char *telemetry_path_arg = NULL;  // --telemetry（"" なら日時から名前を付ける）
+bool telemetry_enabled = false;
+float match_start_time = 0;             // 試合・ステージ・ボスの所要時間を測る起点（game_time）
+float stage_start_time = 0;
+float boss_spawn_time = 0;
 
+// 描画ベンチマーク
+double anim_time_fixed = -1.0;          // 0 以上なら描画のアニメーションをこの時刻で止める
+
+// メカの焼き込みメッシュとシェーダー（縁取りなしの軽量版も持つ）
+Mesh mecha_meshes[MECHA_TYPES] = { 0 };
+Mesh mecha_meshes_lod[MECHA_TYPES] = { 0 };
+Vector2 mecha_anim_params[MECHA_TYPES] = { 0 };
+Shader mecha_shader;
+Shader mecha_shader_instanced;
+Material mecha_material;
+Material mecha_material_instanced;
+int mecha_loc_time = -1;
+int mecha_loc_anim = -1;
+int mecha_loc_anim_instanced = -1;
+bool mecha_ready = false;
+
+// 武器の解放レベルと表示名
+const int weapon_unlock_level[WEAPON_COUNT] = { 1, 3, 6, 9 };
+const char *weapon_names[WEAPON_COUNT] = { "BLASTER", "SPREAD", "RAIL", "LASER" };
+
+// 敵弾の当たり判定（プレイヤー中心との水平距離の2乗）と見た目の大きさ
+const float enemy_bullet_hit_r2[2] = { 3.75f, 1.3f * 1.3f };
+const float enemy_bullet_size[2] = { 0.6f, 0.5f };
+
+// ステージごとのボスの弾幕（最後のセットは以降のステージでも使う）
+const BossPatternSet boss_pattern_sets[] = {
+    { 2, {
+        { PATTERN_RADIAL,      3.0f, 0.40f, 16, 10.0f, 0.0f,  0.10f },
+        { PATTERN_AIMED_BURST, 2.0f, 0.25f,  5, 14.0f, 0.6f,  0.0f  },
+    } },
+    { 3, {
+        { PATTERN_SPIRAL,      4.0f, 0.05f,  3, 11.0f, 0.0f,  0.22f },
+        { PATTERN_RADIAL,      2.0f, 0.30f, 24,  9.0f, 0.0f,  0.13f },
+        { PATTERN_AIMED_BURST, 2.0f, 0.15f,  7, 16.0f, 0.9f,  0.0f  },
+    } },
+    { 4, {
+        { PATTERN_SPIRAL,      4.0f, 0.03f,  5, 12.0f, 0.0f,  0.17f },
+        { PATTERN_RADIAL,      3.0f, 0.20f, 36, 10.0f, 0.0f,  0.09f },
+        { PATTERN_AIMED_BURST, 2.0f, 0.10f,  9, 18.0f, 1.0f,  0.0f  },
+        { PATTERN_SPIRAL,      3.0f, 0.02f,  8,  9.0f, 0.0f, -0.11f },
+    } },
+};
+#define BOSS_PATTERN_SETS ((int)(sizeof(boss_pattern_sets) / sizeof(boss_pattern_sets[0])))
+
+// シミュレーション対象のプレイヤー（通常は player のみ、サーバーでは接続中の全員）
+Player *sim_players[MAX_NET_PLAYERS] = { &player };
+int sim_player_count = 1;
+
+// ネットワーク
+int net_mode = NET_MODE_OFFLINE;
+int net_socket = -1;
+uint32_t net_tick = 0;
+Player net_players[MAX_NET_PLAYERS] = { 0 };
+bool net_player_present[MAX_NET_PLAYERS] = { 0 };
+NetClientSlot net_slots[MAX_NET_PLAYERS];
+NetClient net_client = { .sock = -1, .slot = -1 };
+volatile sig_atomic_t net_quit = 0;
+static const NetSnapshot net_empty_snapshot = { 0 };
+
+void InitGameWindow();
+void CloseGameWindow();
 void InitGame(bool reset_player);
 void UpdateGame();
 void UpdateGamePvP();
@@ -160,40 +1124,301 @@ void UpdatePaused();
 void DrawGame();
 void DrawGamePvP();
 void DrawPaused();
+bool IsFrozenState(GameState state);
+void UpdatePowerMode();
+float FrameDelta();
+void DrawFrozenFrame(void (*drawScene)(void));
+void DrawPausedScene();
+const QualityPreset *CurrentQuality();
+void InitQuality();
+void SetQualityLevel(int level);
+void UpdateQuality(float simSec, float drawSec);
+void BeginSceneTarget();
+void EndSceneTarget();
+void BeginSceneView(int x, int w);
+void EndSceneView();
+void DrawQualityOverlay();
+void InitBloom();
+RenderTexture2D LoadHdrRenderTexture(int w, int h);
+void BloomResize(int w, int h, int mip);
+void BloomPass(Shader shader, int clampLoc, RenderTexture2D src, RenderTexture2D dst, float u0, float u1);
+void ApplyBloom();
+int CurrentBloomMip();
+void SetFrameRate(int fps);
+void FrameLimiterWait();
+Vector2 SampledMousePosition(double *sampleTime);
+bool SampledFireDown();
+void CheckInputSampler();
+void LatencyProbeInput();
+void LatencyAdd(LatencyHistogram *h, double sec);
+float LatencyPercentile(const LatencyHistogram *h, float p);
+void LatencyProbePresent();
+const char *LatencySummary(const char *name, const LatencyHistogram *h);
+void PrintLatencyReport();
+void LateLatchView();
+void InitHud();
+void HudSet(HudWidgetId id, int a, int b, int c);
+void HudRedraw(HudWidgetId id, int x, int y, int w);
+void HudFlush();
+void HudBegin();
+void HudEnd();
+void HudDraw(HudWidgetId id, float x, float y, Color tint);
+void HudDrawCentered(HudWidgetId id, float cx, float y, Color tint);
+Color HudTint(Color c, float alpha);
+void HudDrawNumber(int value, float cx, float cy, float scale, Color tint);
+void ClearHudEvents();
+void UpdateHudEvents(float dt);
+void AddKillFeed(EnemyType type);
+void SpawnDamageNumber(int enemy, int damage, Vector3 pos);
+void DrawDamageNumbers(Camera3D cam);
+void DrawKillFeed(int screenW);
+void InitRadar();
+RadarBasis RadarMakeBasis(Vector3 center, Camera3D cam);
+void RadarBin(uint16_t *counts, const float *x, const float *z, int n, const RadarBasis *b);
+void RadarAdd(uint16_t *counts, float x, float z, const RadarBasis *b);
+void UpdateRadar(Radar *r, const Player *self, Camera3D cam);
+void RadarPixels(Radar *r, float blink);
+void DrawRadar(int view, const Player *self, Camera3D cam, int x, int y);
+int SimRandom(int min, int max);
+int XorshiftRandom(uint32_t *state, int min, int max);
+bool ParseBudget(const char *spec);
+size_t WorldAlign(size_t n);
+bool InitWorldArena();
+void *WorldArenaPush(size_t bytes);
+void *FrameAlloc(size_t bytes);
+void WorldFrameReset();
+void PoolSpawnFailed(PoolId pool, int count);
+void PrintMemoryReport();
+void StepGame(float dt, const PlayerInput *input);
+void StepPvP(float dt, const PlayerInput input[2]);
+PlayerInput ReadPvPInput(int idx);
+void ApplyPvPInput(Player *p, const PlayerInput *in, Vector3 aim, Vector3 defaultDash, bool isP2, float dt);
+void UpdatePvPCameras();
+uint32_t ReplayCaptureState(ReplayState *st);
+void ReplayWriteState(FILE *f, const ReplayState *st);
+void ReplayRestoreState(const uint8_t *p);
+bool ReplayStateMatches(const ReplayState *a, const ReplayState *b);
+bool ReplayStartRecording(const char *path, int mode);
+void ReplayWriteKeyframe(ReplayRecorder *r);
+void ReplayRecordTick(float dt, const PlayerInput *p1, const PlayerInput *p2);
+void ReplayStopRecording();
+void ReplayAutoStart();
+bool ReplayOpen(ReplayPlayer *rp, const char *path);
+void ReplayClose(ReplayPlayer *rp);
+int ReplayFindSegment(const ReplayPlayer *rp, double t);
+const ReplayTick *ReplayNextTick(const ReplayPlayer *rp);
+void ReplayRestoreSegment(ReplayPlayer *rp, int seg);
+bool ReplayStep(ReplayPlayer *rp);
+int ReplaySeek(ReplayPlayer *rp, double t);
+void HashWord(HashSum *h, uint32_t w);
+void HashFloat(HashSum *h, float f);
+void HashVector3(HashSum *h, Vector3 v);
+void HashColumn(HashSum *h, const void *data, size_t bytes);
+uint64_t HashFinish(const HashSum *h);
+void WorldHashCompute(WorldHash *wh);
+void WorldHashTick();
+const char *HashTraceBuild();
+int RunHashTrace(const char *outPath, const char *replayPath);
+int RunHashCompare(const char *pathA, const char *pathB);
+int RunReplay(const char *path);
+Rectangle ReplayTimelineRect();
+void DrawReplayControls(const ReplayPlayer *rp, double speed, bool paused, double seekMs, int seekTicks);
+const char *FormatReplayTime(double t);
+void ToggleCapture(const char *path);
+void CapturePresentedFrame();
+void PrintCaptureReport();
+void StartOffscreenRun();
+void UpdateOffscreenRun();
+PlayerInput AutopilotInput();
+double NetNow();
+void NetSleepUntil(double t);
 void DrawScene(Camera3D cam, bool draw_cursor);
 void UpdateTitle();
 void DrawTitle();
 void DrawMecha(Vector3 pos, float angle, Color color, float anim_time, EnemyType type);
+void DrawMechaImmediate(Vector3 pos, float angle, Color color, float anim_time, EnemyType type);
+void DrawMechaInstanced(EnemyType type, const Matrix *transforms, int count);
+Matrix MechaTransform(Vector3 pos, float angle);
+Matrix MechaInstanceTransform(Vector3 pos, float angle, Color color, float anim_time);
+void MechaAddQuad(MechaBuilder *mb, const Vector3 v[4], Color color, int part, float pivotY, float tint);
+void MechaAddBox(MechaBuilder *mb, Vector3 center, Vector3 size, Color color, int part, float pivotY, float tint);
+void MechaAddBoxEdges(MechaBuilder *mb, Vector3 center, Vector3 size, Color color, float thickness);
+Mesh BakeMechaMesh(EnemyType type, bool detail);
+Shader LoadMechaShader(bool instanced);
+void InitMechaMeshes();
 void SpawnEnemy(bool force_boss);
-void SpawnBullet(Vector3 pos, Vector3 direction, bool is_enemy, bool is_p2);
+Enemy NewEnemy(EnemyType type);
+bool AddEnemy(const Enemy *e);
+int AddEnemies(const Enemy *list, int n);
+void EnemyBucketsRebuild();
+int AllocEnemySlot(EnemyType type);
+int TakeEnemySlot(EnemyType type);
+void UpdateEnemies(float dt);
+void UpdateDrones(int start, int end, float dt);
+void UpdateTanks(int start, int end, float dt);
+void UpdateBosses(int start, int end, float dt);
+int DrawDrones(int start, int end, Matrix *transforms);
+int DrawTanks(int start, int end, Matrix *transforms);
+int DrawBosses(int start, int end, Matrix *transforms);
+void PushEnemyMarkers(const Enemy *e, float barWidth, float barHeight);
+int SpawnBullet(Vector3 pos, Vector3 direction, bool is_p2);
+bool SpawnEnemyBullet(float x, float z, float vx, float vz, float life, EnemyBulletStyle style);
+void FireBulletPattern(const BulletPattern *pat, Vector3 origin, Vector3 target, float baseAngle, float late);
+void UpdateBossPattern(Enemy *e, Vector3 target, float dt);
+void UpdateEnemyBullets(float dt);
+void DrawEnemyBullets();
+void DrawMechaShadow(Vector3 pos, EnemyType type);
+int RenderQueueCapacity();
+void RenderQueueBegin(Camera3D cam, int capacity);
+void RenderPush(RenderPass pass, RenderMaterial material, const RenderCommand *cmd);
+void RenderPushMecha(Vector3 pos, float angle, Color color, float anim_time, EnemyType type);
+void RenderQueueSort(uint64_t *keys, uint64_t *scratch, int n);
+void RenderSetPass(RenderPass pass);
+void RenderExecute(const RenderCommand *cmd);
+void RenderQueueFlush();
+size_t FrameMark();
+void FrameRewind(size_t mark);
+int RunRenderQueueBench();
+int RunRadarBench();
+int RunHashBench();
+int RunRoamBench();
+void RoamReset();
+int32_t RoamSectorOf(float v, int32_t origin);
+uint32_t RoamSectorSeed(int32_t x, int32_t z);
+void RoamShiftWorld(float dx, float dz);
+bool RoamRebase();
+int RoamFindSector(int32_t x, int32_t z);
+RoamMemory *RoamRecall(int32_t x, int32_t z);
+void RoamGenerate(RoamSector *s, int32_t x, int32_t z);
+void RoamRemovePickups(int slot);
+void RoamEvict(int slot);
+void RoamStream(int budget);
+void RoamActivate();
+bool RoamSpawnPending();
+bool RoamPlacePickup(int slot, int k, Vector3 pos);
+void RoamPickupTaken(const Item *it);
+void RoamUpdate();
+int CompareRenderKey(const void *a, const void *b);
+bool WeaponUnlocked(const Player *p, int weapon);
+BoundingBox EnemyHitbox(const Enemy *e);
+BoundingBox EnemyBox(Vector3 pos, float hitSize);
+int HitGridCoord(float v);
+void EnemyHitGridBuild();
+bool RayHitsBox2D(Vector3 origin, float invX, float invZ, BoundingBox box, float maxT, float *tHit);
+void GridWalkBegin(GridWalk *w, Vector3 origin, Vector3 dir, float cellSize, int dim);
+bool GridWalkInside(const GridWalk *w);
+void GridWalkStep(GridWalk *w);
+float ArenaRayDistance(Vector3 origin, Vector3 dir, float maxDist, int *cell);
+int EnemyRayQuery(Vector3 origin, Vector3 dir, float maxDist, bool firstOnly, RayHit *hits, int maxHits);
+bool DamageEnemy(int i, int damage, Vector3 push, Vector3 hitPos);
+float FireRay(Vector3 origin, Vector3 dir, float range, bool pierce, int damage, float push);
+void FireWeapon(int idx, Vector3 aim_dir);
+void PushPlayerBeam(const Player *p, Color color);
 void SpawnExplosion(Vector3 pos, Color color, int count);
 void SpawnItem(Vector3 pos);
 void ResetStage();
 void AddScreenShake(float amount);
 void UpdateTrail(Player *p);
 void DrawCyberGrid(Vector3 centerPos);
+void InitPlayer(Player *p, Vector3 pos);
+void ArenaGenerate(int seed);
+void ArenaPlaceBlocks(int seed);
+bool ArenaSolidCell(int cx, int cy, int cz);
+Vector3 ArenaMove(Vector3 pos, Vector3 delta, float radius);
+Vector3 ArenaFindFree(Vector3 pos, float radius);
+bool ArenaHitBlock(Vector3 p);
+void ArenaDestroyCell(int idx);
+void ArenaDraw();
+Vector3 GetGroundAimPoint(Vector2 screenPos, Camera3D cam);
+void UpdateFollowCamera(Vector3 focus, float dt);
+PlayerInput ReadLocalInput();
+void ApplyPlayerInput(int idx, const PlayerInput *in, float dt);
+bool UpdateStageFlow(float dt);
+void UpdateWorld(float dt);
+Player *NearestAlivePlayer(Vector3 pos);
+bool AllPlayersDown();
+int RunServer(int port);
+int RunServerBench();
+int RunBench(const char *name, const char *arg);
+int NetCollectEnemyBullets(NetEntity *out, int max, Vector3 center);
+int NetCompareEntityId(const void *a, const void *b);
+int RunBulletBench();
+int RunWeaponBench();
+int RunBloomBench();
+int RunSeekBench(const char *arg);
+int RunEnemyBench();
+int RunTelemetryBench();
+int RunRenderBench(const char *hashPath);
+void RenderBenchSetup(int scene);
+void RenderBenchDraw(int scene);
+uint64_t HashScreen();
+double AnimTime();
+void StartTelemetry();
+void StopTelemetry();
+void TelemetryEmit(TelemetryEventType type, const Player *p, int sub, Vector3 pos, int value, int value2);
+void TelemetryMatchStart();
+void UpdateEnemiesMixed(int count, float dt);
+int RunNetClient(const char *host, int port);
 
 
 
 // メイン
-int main(void) {
-    SetConfigFlags(FLAG_WINDOW_RESIZABLE | FLAG_MSAA_4X_HINT);
-    InitWindow(INITIAL_SCREEN_WIDTH, INITIAL_SCREEN_HEIGHT, "Voxel Survivor 6.1 - Bug Fixes");
-    HideCursor();
-    SetTargetFPS(60); 
-    
-    int monitor = GetCurrentMonitor();
-    int x = (GetMonitorWidth(monitor) - INITIAL_SCREEN_WIDTH) / 2;
-    int y = (GetMonitorHeight(monitor) - INITIAL_SCREEN_HEIGHT) / 2;
-    SetWindowPosition(x, y);
+int main(int argc, char **argv) {
+    // 入力遅延まわりの設定（他の起動オプションと組み合わせられる）
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--vsync-off") == 0) frame_limiter_enabled = true;
+        if (strcmp(argv[i], "--no-late-latch") == 0) late_latch_enabled = false;
+        if (strcmp(argv[i], "--no-input-thread") == 0) input_thread_enabled = false;
+        if (strcmp(argv[i], "--no-bloom") == 0) bloom_enabled = false;
+        if (strcmp(argv[i], "--offscreen") == 0) offscreen_mode = true;
+        if (strcmp(argv[i], "--record") == 0) replay_record_enabled = true;
+        if (strcmp(argv[i], "--capture") == 0 && i + 1 < argc) capture_path_arg = argv[++i];
+        if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) offscreen_frames = atoi(argv[++i]);
+        if (strcmp(argv[i], "--hugepages") == 0) world_huge_pages = true;
+        if (strcmp(argv[i], "--budget") == 0 && i + 1 < argc && !ParseBudget(argv[++i])) return 1;
+        if (strcmp(argv[i], "--telemetry") == 0) telemetry_path_arg = (i + 1 < argc && argv[i + 1][0] != '-') ? argv[++i] : "";
+    }
+    if (!InitWorldArena()) return 1;
+    if (offscreen_mode) {
+        // 自動操縦はマウスを使わない
+        late_latch_enabled = false;
+        input_thread_enabled = false;
+    }
+
+    // ヘッドレス・ネットワーク系の起動オプション
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--server") == 0) {
+            return RunServer((i + 1 < argc) ? atoi(argv[i + 1]) : NET_DEFAULT_PORT);
+        }
+        if (strcmp(argv[i], "--server-bench") == 0) return RunServerBench();
+        if (strcmp(argv[i], "--render-bench") == 0) return RunRenderBench((i + 1 < argc && argv[i + 1][0] != '-') ? argv[i + 1] : NULL);
+        if (strcmp(argv[i], "--bench") == 0) return RunBench((i + 1 < argc) ? argv[i + 1] : "", (i + 2 < argc) ? argv[i + 2] : NULL);
+        if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) return RunReplay(argv[i + 1]);
+        if (strcmp(argv[i], "--hash-trace") == 0 && i + 1 < argc) {
+            return RunHashTrace(argv[i + 1], (i + 2 < argc && argv[i + 2][0] != '-') ? argv[i + 2] : NULL);
+        }
+        if (strcmp(argv[i], "--hash-compare") == 0 && i + 2 < argc) return RunHashCompare(argv[i + 1], argv[i + 2]);
+        if (strcmp(argv[i], "--connect") == 0) {
+            const char *host = (i + 1 < argc) ? argv[i + 1] : "127.0.0.1";
+            return RunNetClient(host, (i + 2 < argc) ? atoi(argv[i + 2]) : NET_DEFAULT_PORT);
+        }
+    }
+
+    StartTelemetry();
+    InitGameWindow();
 
     camera.position = (Vector3){ 0.0f, 20.0f, 20.0f };
     camera.target = (Vector3){ 0.0f, 0.0f, 0.0f };
     camera.up = (Vector3){ 0.0f, 1.0f, 0.0f };
     camera.fovy = 45.0f;
     camera.projection = CAMERA_PERSPECTIVE;
+    if (offscreen_mode) StartOffscreenRun();
+    if (capture_path_arg) ToggleCapture(capture_path_arg);
 
+    int framesDone = 0;
     while (!WindowShouldClose()) {
+        FrameLimiterWait();
+        WorldFrameReset();
         if (screen_shake > 0) screen_shake -= GetFrameTime() * 30.0f;
         if (screen_shake < 0) screen_shake = 0;
 
@@ -207,19 +1432,96 @@ int main(void) {
                 current_state = STATE_PAUSED;
             }
         }
+        if (IsKeyPressed(KEY_F3)) quality.show = !quality.show;
+        if (IsKeyPressed(KEY_F4)) bloom_enabled = !bloom_enabled;
+        if (IsKeyPressed(KEY_F5)) radar_enabled = !radar_enabled;
+        if (IsKeyPressed(KEY_F9)) ToggleCapture(NULL);
+        if (offscreen_mode) UpdateOffscreenRun();
+        UpdatePowerMode();
+        CheckInputSampler();
+
+        // 更新と描画を分けて計測する（描画は更新前の状態で行う）
+        GameState drawState = current_state;
+        double frameStart = GetTime();
+        switch (drawState) {
+            case STATE_TITLE: UpdateTitle(); break;
+            case STATE_PVP: case STATE_PVP_RESULT: UpdateGamePvP(); break;
+            case STATE_PAUSED: UpdatePaused(); break;
+            default: UpdateGame(); break;
+        }
+        double simEnd = GetTime();
 
-        switch (current_state) {
-            case STATE_TITLE: UpdateTitle(); BeginDrawing(); DrawTitle(); EndDrawing(); break;
-            case STATE_PVP: UpdateGamePvP(); BeginDrawing(); DrawGamePvP(); EndDrawing(); break;
-            case STATE_PAUSED: UpdatePaused(); BeginDrawing(); if (previous_state == STATE_PVP) DrawGamePvP(); else DrawGame(); DrawPaused(); EndDrawing(); break;
-            case STATE_PVP_RESULT: UpdateGamePvP(); BeginDrawing(); DrawGamePvP(); EndDrawing(); break;
-            default: UpdateGame(); BeginDrawing(); DrawGame(); EndDrawing(); break;
+        // ポーズ・ゲームオーバー・対戦結果はキャッシュした画面を貼るだけ
+        BeginDrawing();
+        switch (drawState) {
+            case STATE_TITLE: DrawTitle(); break;
+            case STATE_PVP: DrawGamePvP(); break;
+            case STATE_PAUSED: DrawFrozenFrame(DrawPausedScene); DrawPaused(); break;
+            case STATE_PVP_RESULT: DrawFrozenFrame(DrawGamePvP); break;
+            case STATE_GAMEOVER: DrawFrozenFrame(DrawGame); break;
+            default: DrawGame(); break;
         }
+        CapturePresentedFrame();
+        DrawQualityOverlay();
+        double drawEnd = GetTime();
+        EndDrawing();
+        LatencyProbePresent();
+        UpdateQuality((float)(simEnd - frameStart), (float)(drawEnd - simEnd));
+        if (replay_recorder.active && current_state == STATE_TITLE) ReplayStopRecording();
+        if (offscreen_frames > 0 && ++framesDone >= offscreen_frames) break;
     }
-    CloseWindow();
+    CloseGameWindow();
     return 0;
 }
 
+void InitGameWindow() {
+    // オフスクリーンは隠したウィンドウに一定の大きさで描く（録画の大きさをそろえる）
+    if (offscreen_mode) SetConfigFlags(FLAG_WINDOW_HIDDEN);
+    SetConfigFlags(FLAG_WINDOW_RESIZABLE | FLAG_MSAA_4X_HINT);
+    InitWindow(offscreen_mode ? OFFSCREEN_WIDTH : INITIAL_SCREEN_WIDTH, offscreen_mode ? OFFSCREEN_HEIGHT : INITIAL_SCREEN_HEIGHT,
+               "Voxel Survivor 6.1 - Bug Fixes");
+    HideCursor();
+    if (frame_limiter_enabled || offscreen_mode) {
+        // raylib は付いているときしか垂直同期を切らないので、一度付けてから外す
+        SetWindowState(FLAG_VSYNC_HINT);
+        ClearWindowState(FLAG_VSYNC_HINT);
+    }
+    SetFrameRate(60);
+    
+    int monitor = GetCurrentMonitor();
+    int x = (GetMonitorWidth(monitor) - INITIAL_SCREEN_WIDTH) / 2;
+    int y = (GetMonitorHeight(monitor) - INITIAL_SCREEN_HEIGHT) / 2;
+    SetWindowPosition(x, y);
+
+    InitMechaMeshes();
+    InitBloom();
+    InitHud();
+    InitRadar();
+    InitQuality();
+    if (input_thread_enabled && !InputSamplerStart(INPUT_SAMPLER_HZ)) {
+        TraceLog(LOG_INFO, "INPUT: sampler thread unavailable, using raylib input only");
+        input_thread_enabled = false;
+    }
+    last_poll_time = NetNow();
+}
+
+void CloseGameWindow() {
+    if (CaptureActive()) ToggleCapture(NULL);
+    ReplayStopRecording();
+    StopTelemetry();
+    InputSamplerStop();
+    PrintLatencyReport();
+    PrintMemoryReport();
+    if (frozen_frame.id > 0) UnloadRenderTexture(frozen_frame);
+    if (scene_target.id > 0) UnloadRenderTexture(scene_target);
+    if (hud_atlas.id > 0) UnloadRenderTexture(hud_atlas);
+    for (int v=0; v<RADAR_VIEWS; v++) if (radars[v].texture.id > 0) UnloadTexture(radars[v].texture);
+    for (int l=0; l<BLOOM_LEVELS; l++) {
+        for (int k=0; k<2; k++) if (bloom_targets[l][k].id > 0) UnloadRenderTexture(bloom_targets[l][k]);
+    }
+    CloseWindow();
+}
+
 void UpdatePaused() { 
     if (IsKeyPressed(KEY_R)) {
         current_state = STATE_TITLE;
@@ -237,92 +1539,1013 @@ void DrawPaused() {
     DrawText("R: TITLE", w/2 - MeasureText("R: TITLE", 20)/2, h/2 + 40, 20, WHITE);
 }
 
-void UpdateTitle() {
-    float time = GetTime();
-    camera.position.x = sinf(time * 0.3f) * 35.0f;
-    camera.position.z = cosf(time * 0.3f) * 35.0f;
-    camera.target = (Vector3){ 0, 0, 0 };
+// 省電力
+// 止まっている画面は入った直後に一度だけ RenderTexture に描き、以降はそれを貼って
+// オーバーレイを重ねるだけにする。さらにイベント待ちにして、入力がなければ
+// フレームを回さない（長時間ポーズしたままでも CPU をほぼ使わない）。
+// タイトルは 30 FPS、無操作が続くかウィンドウが非アクティブなら 10 FPS に落とす。
 
-    if (IsKeyDown(KEY_N)) { difficulty = MODE_NORMAL; InitGame(true); current_state = STATE_PLAYING; }
-    if (IsKeyDown(KEY_H)) { difficulty = MODE_HARD; InitGame(true); current_state = STATE_PLAYING; }
-    if (IsKeyDown(KEY_P)) {
-        InitGame(true);
-        player.position = (Vector3){ -10, 0, 0 };
-        player2.position = (Vector3){ 10, 0, 0 };
-        player2.hp = 100; player2.max_hp = 100; player2.speed = 10.0f;
-        camera2 = camera;
-        current_state = STATE_PVP;
+bool IsFrozenState(GameState state) {
+    return state == STATE_PAUSED || state == STATE_GAMEOVER || state == STATE_PVP_RESULT;
+}
+
+void UpdatePowerMode() {
+    bool input = GetKeyPressed() != 0 || GetMouseWheelMove() != 0 ||
+                 Vector2LengthSqr(GetMouseDelta()) > 0 ||
+                 IsMouseButtonPressed(MOUSE_LEFT_BUTTON) || IsMouseButtonPressed(MOUSE_RIGHT_BUTTON);
+    if (input) idle_timer = 0.0f;
+    else idle_timer += GetFrameTime();
+
+    bool frozen = IsFrozenState(current_state);
+    if (!frozen) frozen_frame_valid = false;
+
+    // 録画中とオフスクリーンではフレームを間引かない（動画の時間がずれる）
+    bool realtime = CaptureActive() || offscreen_mode;
+    bool wait = frozen && !realtime;
+    power_resumed = false;
+    if (wait != event_waiting) {
+        if (wait) EnableEventWaiting();
+        else { DisableEventWaiting(); power_resumed = true; }
+        event_waiting = wait;
+    }
+
+    int fps = 60;
+    if (wait) fps = FROZEN_FPS;
+    else if (current_state == STATE_TITLE && !realtime) {
+        fps = (idle_timer > KIOSK_IDLE_SECONDS || !IsWindowFocused()) ? KIOSK_FPS : TITLE_FPS;
     }
+    if (fps != target_fps) SetFrameRate(fps);
 }
 
-void DrawTitle() {
+// 待機明けのフレームは経過時間が長すぎるので 1/60 秒として扱う。
+// オフスクリーンでは描画の速さに関係なく毎フレーム 1/CAPTURE_FPS 秒進める
+float FrameDelta() {
+    if (offscreen_mode) return 1.0f / CAPTURE_FPS;
+    return power_resumed ? 1.0f / 60.0f : GetFrameTime();
+}
+
+// 描画のアニメーションの時刻（描画ベンチマークでは止めて、毎フレーム同じ絵にする）
+double AnimTime() {
+    return (anim_time_fixed >= 0) ? anim_time_fixed : GetTime();
+}
+
+void DrawPausedScene() {
+    if (previous_state == STATE_PVP) DrawGamePvP();
+    else DrawGame();
+}
+
+void DrawFrozenFrame(void (*drawScene)(void)) {
     int w = GetScreenWidth();
+    int h = GetScreenHeight();
+    if (!frozen_frame_valid || frozen_frame.texture.width != w || frozen_frame.texture.height != h) {
+        if (frozen_frame.texture.width != w || frozen_frame.texture.height != h) {
+            if (frozen_frame.id > 0) UnloadRenderTexture(frozen_frame);
+            frozen_frame = LoadRenderTexture(w, h);
+        }
+        BeginTextureMode(frozen_frame);
+        frozen_frame_capturing = true;
+        drawScene();
+        frozen_frame_capturing = false;
+        EndTextureMode();
+        frozen_frame_valid = true;
+    }
     ClearBackground(COL_DARK_BG);
-    
-    BeginMode3D(camera);
-        DrawCyberGrid((Vector3){0,0,GetTime()*5.0f}); 
-        DrawMecha((Vector3){5,0,0}, 0, COL_NEON_PINK, GetTime(), ENEMY_DRONE);
-        DrawMecha((Vector3){-5,0,0}, 3.14, COL_NEON_PURPLE, GetTime(), ENEMY_TANK);
-        DrawMecha((Vector3){0,5,-10}, 0, COL_NEON_ORANGE, GetTime(), ENEMY_BOSS);
-    EndMode3D();
+    DrawTextureRec(frozen_frame.texture, (Rectangle){ 0, 0, (float)w, (float)-h }, (Vector2){ 0, 0 }, WHITE);
+}
 
-    DrawText("VOXEL SURVIVOR", w/2 - MeasureText("VOXEL SURVIVOR", 60)/2, 100, 60, COL_NEON_CYAN);
-    DrawText("NEON EDITION", w/2 - MeasureText("NEON EDITION", 40)/2, 170, 40, COL_NEON_PINK);
-    DrawText("[N] NORMAL", w/2 - 150, 300, 30, WHITE);
-    DrawText("[H] HARD", w/2 - 150, 350, 30, COL_NEON_ORANGE);
-    DrawText("[P] VS 2P", w/2 - 150, 400, 30, COL_NEON_GREEN);
+// 画質の自動調整
+// 直近のシミュレーション・描画時間（CPU）とフレーム時間を平均し、目標フレーム時間に対する
+// 負荷で画質を1段ずつ上げ下げする。下げるのは速く、上げるのは余裕が続いたときだけにして、
+// 上げた直後にまた下げた場合は次に上げるまでの待ち時間を倍にする（行ったり来たりしない）。
+// MSAA はウィンドウ作成時にしか変えられないので、縮小描画中の RenderTexture で代わりに軽くなる。
+
+const QualityPreset *CurrentQuality() {
+    return &quality_presets[quality.level];
 }
 
-void InitGame(bool reset_player) {
-    if (reset_player) {
-        player.position = (Vector3){ 0, 0, 0 };
-        player.speed = 12.0f;
-        player.hp = 100; player.max_hp = 100;
-        player.level = 1; player.exp = 0; 
-        player.next_level_exp = 5;
-        player.damage = 20;
-        player.weapon_type = 0;
-        player.shoot_cooldown = 0.0f;
-        player.dash_cooldown = 0; player.dash_duration = 0;
-        player.invincible_timer = 0;
-        for(int i=0; i<TRAIL_LENGTH; i++) player.trail_pos[i] = player.position;
-        current_stage = 1;
-        player2 = player; 
-    }
-    ResetStage();
-    camera.position = (Vector3){ 0.0f, 25.0f, 18.0f }; 
-    camera.up = (Vector3){ 0.0f, 1.0f, 0.0f };
-    camera.fovy = 50.0f;
-    game_time = 0.0f;
-    screen_shake = 0.0f;
+void InitQuality() {
+    quality = (QualityGovernor){ 0 };
+    quality.level = QUALITY_LEVELS - 1;
+    quality.up_delay = QUALITY_UP_SECONDS;
+    quality.since_up = QUALITY_RETRY_WINDOW;
 }
 
-void ResetStage() {
-    stage_kills = 0;
-    boss_spawned = false;
-    kills_required_for_boss = KILLS_TO_BOSS_BASE + (current_stage - 1) * 5; 
-    enemy_spawn_timer = 0.0f;
-    for(int i=0; i<MAX_ENEMIES; i++) enemies[i].active = false;
-    for(int i=0; i<MAX_BULLETS; i++) bullets[i].active = false;
-    for(int i=0; i<MAX_PARTICLES; i++) particles[i].active = false;
-    for(int i=0; i<MAX_ITEMS; i++) items[i].active = false;
+void SetQualityLevel(int level) {
+    QualityGovernor *q = &quality;
+    if (level < 0) level = 0;
+    if (level >= QUALITY_LEVELS) level = QUALITY_LEVELS - 1;
+    if (level == q->level) return;
+    if (level < q->level) {
+        // 上げてすぐ下げた：次に上げるまでの待ちを延ばす
+        if (q->since_up < QUALITY_RETRY_WINDOW) q->up_delay = fminf(q->up_delay * 2.0f, QUALITY_UP_MAX_SECONDS);
+        q->since_up = QUALITY_RETRY_WINDOW;
+    } else q->since_up = 0;
+    q->level = level;
+    q->since_change = 0;
+    q->over_time = q->under_time = 0;
+    q->cooldown = QUALITY_COOLDOWN;
 }
 
-void AddScreenShake(float amount) {
-    screen_shake = amount;
-    if(screen_shake > 2.0f) screen_shake = 2.0f;
+// 1フレームの計測結果を入れる。sim・draw は CPU 時間（秒）
+void UpdateQuality(float simSec, float drawSec) {
+    QualityGovernor *q = &quality;
+    // 静止画面や待機明けのフレームは負荷ではないので数えない。オフスクリーンは画質を固定する
+    if (IsFrozenState(current_state) || power_resumed || offscreen_mode) return;
+
+    float frame = GetFrameTime();
+    float budget = 1.0f / target_fps;
+    const float k = 0.1f;
+    q->sim_avg += (simSec - q->sim_avg) * k;
+    q->draw_avg += (drawSec - q->draw_avg) * k;
+    q->frame_avg += (frame - q->frame_avg) * k;
+
+    // CPU に余裕があっても目標に届いていなければ GPU 側の待ちとみなす
+    float load = (q->sim_avg + q->draw_avg) / budget;
+    if (q->frame_avg > budget * QUALITY_MISS_RATIO) load = fmaxf(load, q->frame_avg / budget);
+    q->headroom = 1.0f - load;
+
+    q->since_up += frame;
+    q->since_change += frame;
+    if (q->since_change > QUALITY_SETTLE_SECONDS) q->up_delay = QUALITY_UP_SECONDS;
+    if (q->cooldown > 0) {
+        q->cooldown -= frame;
+        return;
+    }
+    q->over_time = (load > QUALITY_DOWN_LOAD) ? q->over_time + frame : 0;
+    q->under_time = (load < QUALITY_UP_LOAD) ? q->under_time + frame : 0;
+    if (q->over_time > QUALITY_DOWN_SECONDS && q->level > 0) SetQualityLevel(q->level - 1);
+    else if (q->under_time > q->up_delay && q->level < QUALITY_LEVELS - 1) SetQualityLevel(q->level + 1);
 }
 
-void UpdateTrail(Player *p) {
-    if (p->dash_duration > 0 || (int)(game_time * 10) % 2 == 0) { 
-        p->trail_idx = (p->trail_idx + 1) % TRAIL_LENGTH;
-        p->trail_pos[p->trail_idx] = p->position;
+// 3D シーンの描画先。縮小描画中かブルームを掛けるときは RenderTexture に描き、
+// EndSceneTarget で（ブルームを足して）画面に引き伸ばす
+void BeginSceneTarget() {
+    float scale = CurrentQuality()->render_scale;
+    int mip = CurrentBloomMip();
+    scene_bloom = mip > 0;
+    scene_offscreen = scale < 1.0f || scene_bloom;
+    scene_view_count = 0;
+    if (!scene_offscreen) {
+        scene_fb_width = frozen_frame_capturing ? frozen_frame.texture.width : GetRenderWidth();
+        scene_fb_height = frozen_frame_capturing ? frozen_frame.texture.height : GetRenderHeight();
+        return;
     }
+    int w = (int)(GetScreenWidth() * scale), h = (int)(GetScreenHeight() * scale);
+    if (w < 1) w = 1;
+    if (h < 1) h = 1;
+    if (scene_target.texture.width != w || scene_target.texture.height != h) {
+        if (scene_target.id > 0) UnloadRenderTexture(scene_target);
+        scene_target = LoadHdrRenderTexture(w, h);
+    }
+    if (scene_bloom) BloomResize(w, h, mip);
+    scene_fb_width = w;
+    scene_fb_height = h;
+    // 静止画面のキャッシュ中は RenderTexture を入れ子にできないので、いったん抜けて EndSceneTarget で戻る
+    if (frozen_frame_capturing) EndTextureMode();
+    BeginTextureMode(scene_target);
+    ClearBackground(COL_DARK_BG);
 }
 
-void DrawCyberGrid(Vector3 centerPos) {
-    int slices = 20;
-    float spacing = 4.0f;
+void EndSceneTarget() {
+    if (!scene_offscreen) return;
+    EndTextureMode();
+    if (scene_bloom) ApplyBloom();
+    if (frozen_frame_capturing) BeginTextureMode(frozen_frame);
+
+    Rectangle src = { 0, 0, (float)scene_target.texture.width, (float)-scene_target.texture.height };
+    Rectangle dst = { 0, 0, (float)GetScreenWidth(), (float)GetScreenHeight() };
+    if (scene_bloom) {
+        BeginShaderMode(bloom_composite_shader);
+        SetShaderValueTexture(bloom_composite_shader, bloom_loc_bloom0, bloom_targets[0][0].texture);
+        SetShaderValueTexture(bloom_composite_shader, bloom_loc_bloom1, bloom_targets[1][0].texture);
+    }
+    DrawTexturePro(scene_target.texture, src, dst, (Vector2){ 0, 0 }, 0, WHITE);
+    if (scene_bloom) EndShaderMode();
+    scene_offscreen = false;
+    scene_bloom = false;
+}
+
+// 分割画面の1区画（画面座標の横範囲）に描画を絞る。BeginSceneTarget の中で使う
+void BeginSceneView(int x, int w) {
+    if (scene_view_count < SCENE_MAX_VIEWS) {
+        scene_view_x[scene_view_count] = x;
+        scene_view_w[scene_view_count] = w;
+        scene_view_count++;
+    }
+    float sx = (float)scene_fb_width / GetScreenWidth();
+    int fx = (int)(x * sx), fw = (int)(w * sx);
+    rlDrawRenderBatchActive();
+    rlViewport(fx, 0, fw, scene_fb_height);
+    rlEnableScissorTest();
+    rlScissor(fx, 0, fw, scene_fb_height);
+}
+
+void EndSceneView() {
+    rlDrawRenderBatchActive();
+    rlDisableScissorTest();
+    rlViewport(0, 0, scene_fb_width, scene_fb_height);
+}
+
+// F3 で表示する
+void DrawQualityOverlay() {
+    if (CaptureActive()) {
+        // 読み戻しの後に描くので動画には入らない
+        CaptureStats cs;
+        CaptureGetStats(&cs);
+        int rx = GetScreenWidth() - 190, ry = GetScreenHeight() - 24;
+        DrawCircle(rx, ry + 5, 5, RED);
+        DrawText(TextFormat("REC %llu  drop %llu  queue %d/%d", (unsigned long long)cs.frames_written, (unsigned long long)cs.frames_dropped,
+                            cs.queue_depth, CAPTURE_QUEUE_FRAMES), rx + 10, ry, 10, RED);
+    }
+    if (!quality.show) return;
+    const QualityPreset *p = CurrentQuality();
+    float budgetMs = 1000.0f / target_fps;
+    // 右上のキルフィードの下に、1行ずつ y を進めて並べる
+    const int rows = 10, rowH = 15;
+    int x = GetScreenWidth() - 270, y = HUD_FEED_Y + HUD_FEED_ENTRIES * HUD_FEED_ROW + 10;
+    DrawRectangle(x - 10, y - 5, 270, rows * rowH + 5, (Color){ 0, 0, 0, 170 });
+    DrawText(TextFormat("QUALITY %d/%d  scale %d%%", quality.level, QUALITY_LEVELS - 1, (int)(p->render_scale * 100)), x, y, 10, COL_NEON_CYAN);
+    y += rowH;
+    DrawText(TextFormat("particles %d  grid %d  mecha %s", p->particle_cap, p->grid_slices, p->mecha_detail ? "full" : "lod"), x, y, 10, WHITE);
+    y += rowH;
+    DrawText(TextFormat("frame %.2f ms / %.2f ms (%d fps)", quality.frame_avg * 1000.0f, budgetMs, GetFPS()), x, y, 10, WHITE);
+    y += rowH;
+    DrawText(TextFormat("sim %.2f ms  draw %.2f ms", quality.sim_avg * 1000.0f, quality.draw_avg * 1000.0f), x, y, 10, WHITE);
+    y += rowH;
+    Color hc = quality.headroom < 1.0f - QUALITY_DOWN_LOAD ? COL_NEON_PINK : (quality.headroom > 1.0f - QUALITY_UP_LOAD ? COL_NEON_GREEN : GOLD);
+    DrawText(TextFormat("headroom %d%%  next up %.1fs", (int)(quality.headroom * 100), quality.up_delay), x, y, 10, hc);
+    y += rowH;
+    DrawText(TextFormat("click p50 %.1f p99 %.1f ms (n=%d)", LatencyPercentile(&latency_click, 0.5f), LatencyPercentile(&latency_click, 0.99f), latency_click.count), x, y, 10, WHITE);
+    y += rowH;
+    DrawText(TextFormat("aim   p50 %.1f p99 %.1f ms  %s%s", LatencyPercentile(&latency_aim, 0.5f), LatencyPercentile(&latency_aim, 0.99f),
+                        late_latch_enabled ? "latch " : "", input_thread_enabled ? "thread" : ""), x, y, 10, WHITE);
+    y += rowH;
+    int mip = CurrentBloomMip();
+    DrawText(TextFormat("bloom %s  cpu %.2f ms", mip == 0 ? "off" : (mip == 1 ? "1/2" : "1/4"), bloom_cpu_avg * 1000.0f), x, y, 10, WHITE);
+    y += rowH;
+    DrawText(TextFormat("hud %d widgets  %d redraws", HUD_WIDGET_COUNT, hud_redraws), x, y, 10, WHITE);
+    y += rowH;
+    uint64_t fails = world_arena.frame_failures;
+    for (int k=0; k<POOL_COUNT; k++) fails += pool_stats[k].failures;
+    DrawText(TextFormat("pools e %d/%d b %d/%d p %d/%d  scratch %dK  fail %llu", pool_stats[POOL_ENEMIES].peak, enemy_capacity,
+                        pool_stats[POOL_BULLETS].peak, bullet_capacity, pool_stats[POOL_PARTICLES].peak, particle_capacity,
+                        (int)(world_arena.frame_peak / 1024), (unsigned long long)fails), x, y, 10, fails > 0 ? GOLD : WHITE);
+}
+
+// ネオンのグロー（ブルーム）
+// 3D シーンを HDR の RenderTexture に描き、明るい部分だけを 1/2（重いときは 1/4）の解像度へ
+// 抜き出して、さらに半分の解像度とあわせて2段のぼかしを縦横分離で掛け、最後に足し合わせる。
+// 画面全体の処理だけなので、敵や弾の数に関係なく毎フレームほぼ一定のコストで済む。
+// 分割画面では区画ごとに処理し、ぼかしが隣の区画の画面を拾わないよう UV を区画内に留める。
+
+static const char *BLOOM_DOWNSAMPLE_FS =
+    "#version 330\n"
+    "in vec2 fragTexCoord;\n"
+    "uniform sampler2D texture0;\n"
+    "uniform vec4 uvClamp;\n"
+    "uniform vec2 texel;\n"
+    "uniform float threshold;\n"
+    "out vec4 finalColor;\n"
+    "vec3 tap(vec2 o) { return texture(texture0, clamp(fragTexCoord + o * texel, uvClamp.xy, uvClamp.zw)).rgb; }\n"
+    "void main() {\n"
+    "    vec3 c = (tap(vec2(-1.0, -1.0)) + tap(vec2(1.0, -1.0)) + tap(vec2(-1.0, 1.0)) + tap(vec2(1.0, 1.0))) * 0.25;\n"
+    "    float br = max(c.r, max(c.g, c.b));\n"
+    "    float knee = threshold * 0.5 + 1e-4;\n"
+    "    float soft = clamp(br - threshold + knee, 0.0, 2.0 * knee);\n"
+    "    soft = soft * soft / (4.0 * knee);\n"
+    "    finalColor = vec4(c * (max(soft, br - threshold) / max(br, 1e-4)), 1.0);\n"
+    "}\n";
+
+// 9タップのガウスをバイリニアで5回の読み出しに畳んだもの
+static const char *BLOOM_BLUR_FS =
+    "#version 330\n"
+    "in vec2 fragTexCoord;\n"
+    "uniform sampler2D texture0;\n"
+    "uniform vec4 uvClamp;\n"
+    "uniform vec2 texel;\n"
+    "out vec4 finalColor;\n"
+    "vec3 tap(vec2 o) { return texture(texture0, clamp(fragTexCoord + o * texel, uvClamp.xy, uvClamp.zw)).rgb; }\n"
+    "void main() {\n"
+    "    vec3 c = tap(vec2(0.0)) * 0.2270270270;\n"
+    "    c += (tap(vec2(1.3846153846)) + tap(vec2(-1.3846153846))) * 0.3162162162;\n"
+    "    c += (tap(vec2(3.2307692308)) + tap(vec2(-3.2307692308))) * 0.0702702703;\n"
+    "    finalColor = vec4(c, 1.0);\n"
+    "}\n";
+
+static const char *BLOOM_COMPOSITE_FS =
+    "#version 330\n"
+    "in vec2 fragTexCoord;\n"
+    "uniform sampler2D texture0;\n"
+    "uniform sampler2D bloom0;\n"
+    "uniform sampler2D bloom1;\n"
+    "uniform float intensity;\n"
+    "out vec4 finalColor;\n"
+    "void main() {\n"
+    "    vec3 c = texture(texture0, fragTexCoord).rgb;\n"
+    "    c += (texture(bloom0, fragTexCoord).rgb + texture(bloom1, fragTexCoord).rgb) * intensity;\n"
+    "    finalColor = vec4(c, 1.0);\n"
+    "}\n";
+
+// 起動時に一度だけ（ウィンドウ作成後）
+void InitBloom() {
+    bloom_downsample_shader = LoadShaderFromMemory(NULL, BLOOM_DOWNSAMPLE_FS);
+    bloom_blur_shader = LoadShaderFromMemory(NULL, BLOOM_BLUR_FS);
+    bloom_composite_shader = LoadShaderFromMemory(NULL, BLOOM_COMPOSITE_FS);
+    unsigned int def = rlGetShaderIdDefault();
+    if (bloom_downsample_shader.id == def || bloom_blur_shader.id == def || bloom_composite_shader.id == def) {
+        TraceLog(LOG_WARNING, "BLOOM: shader unavailable, glow disabled");
+        return;
+    }
+    bloom_loc_down_clamp = GetShaderLocation(bloom_downsample_shader, "uvClamp");
+    bloom_loc_down_texel = GetShaderLocation(bloom_downsample_shader, "texel");
+    bloom_loc_threshold = GetShaderLocation(bloom_downsample_shader, "threshold");
+    bloom_loc_blur_clamp = GetShaderLocation(bloom_blur_shader, "uvClamp");
+    bloom_loc_blur_texel = GetShaderLocation(bloom_blur_shader, "texel");
+    bloom_loc_bloom0 = GetShaderLocation(bloom_composite_shader, "bloom0");
+    bloom_loc_bloom1 = GetShaderLocation(bloom_composite_shader, "bloom1");
+    bloom_loc_intensity = GetShaderLocation(bloom_composite_shader, "intensity");
+    float intensity = BLOOM_INTENSITY;
+    SetShaderValue(bloom_composite_shader, bloom_loc_intensity, &intensity, SHADER_UNIFORM_FLOAT);
+    bloom_ready = true;
+}
+
+// 色を半精度浮動小数点にした RenderTexture（作れなければ通常の 8bit のまま）
+RenderTexture2D LoadHdrRenderTexture(int w, int h) {
+    RenderTexture2D target = LoadRenderTexture(w, h);
+    unsigned int tex = rlLoadTexture(NULL, w, h, PIXELFORMAT_UNCOMPRESSED_R16G16B16A16, 1);
+    if (tex > 0) {
+        rlFramebufferAttach(target.id, tex, RL_ATTACHMENT_COLOR_CHANNEL0, RL_ATTACHMENT_TEXTURE2D, 0);
+        if (rlFramebufferComplete(target.id)) {
+            rlUnloadTexture(target.texture.id);
+            target.texture.id = tex;
+            target.texture.format = PIXELFORMAT_UNCOMPRESSED_R16G16B16A16;
+        } else {
+            rlFramebufferAttach(target.id, target.texture.id, RL_ATTACHMENT_COLOR_CHANNEL0, RL_ATTACHMENT_TEXTURE2D, 0);
+            rlUnloadTexture(tex);
+        }
+    }
+    SetTextureFilter(target.texture, TEXTURE_FILTER_BILINEAR);
+    SetTextureWrap(target.texture, TEXTURE_WRAP_CLAMP);
+    return target;
+}
+
+// シーンの大きさ w x h に合わせてぼかし用のターゲットを用意する（mip: 1 で 1/2 から、2 で 1/4 から）
+void BloomResize(int w, int h, int mip) {
+    for (int l=0; l<BLOOM_LEVELS; l++) {
+        int lw = w >> (mip + l), lh = h >> (mip + l);
+        if (lw < 1) lw = 1;
+        if (lh < 1) lh = 1;
+        for (int k=0; k<2; k++) {
+            RenderTexture2D *t = &bloom_targets[l][k];
+            if (t->texture.width == lw && t->texture.height == lh) continue;
+            if (t->id > 0) UnloadRenderTexture(*t);
+            *t = LoadHdrRenderTexture(lw, lh);
+        }
+    }
+}
+
+// src の横範囲 [u0, u1]（UV）を dst の同じ範囲へシェーダーを通して描く。uniform は先に設定しておく
+void BloomPass(Shader shader, int clampLoc, RenderTexture2D src, RenderTexture2D dst, float u0, float u1) {
+    float sw = (float)src.texture.width, sh = (float)src.texture.height;
+    float dw = (float)dst.texture.width, dh = (float)dst.texture.height;
+    float uv[4] = { u0 + 0.5f / sw, 0.5f / sh, u1 - 0.5f / sw, 1.0f - 0.5f / sh };
+    SetShaderValue(shader, clampLoc, uv, SHADER_UNIFORM_VEC4);
+    BeginTextureMode(dst);
+    BeginShaderMode(shader);
+    DrawTexturePro(src.texture, (Rectangle){ u0 * sw, 0, (u1 - u0) * sw, -sh }, (Rectangle){ u0 * dw, 0, (u1 - u0) * dw, dh }, (Vector2){ 0, 0 }, 0, WHITE);
+    EndShaderMode();
+    EndTextureMode();
+}
+
+// scene_target から bloom_targets[l][0] を作る（区画ごと）
+void ApplyBloom() {
+    double t0 = NetNow();
+    int views = (scene_view_count > 0) ? scene_view_count : 1;
+    for (int v=0; v<views; v++) {
+        float u0 = 0, u1 = 1;
+        if (scene_view_count > 0) {
+            u0 = (float)scene_view_x[v] / GetScreenWidth();
+            u1 = (float)(scene_view_x[v] + scene_view_w[v]) / GetScreenWidth();
+        }
+        RenderTexture2D src = scene_target;
+        for (int l=0; l<BLOOM_LEVELS; l++) {
+            RenderTexture2D *t = bloom_targets[l];
+            // 1段目は明るい部分の抜き出し、2段目は前の段の結果をそのまま縮小
+            float threshold = (l == 0) ? BLOOM_THRESHOLD : 0.0f;
+            Vector2 texel = { 1.0f / src.texture.width, 1.0f / src.texture.height };
+            SetShaderValue(bloom_downsample_shader, bloom_loc_threshold, &threshold, SHADER_UNIFORM_FLOAT);
+            SetShaderValue(bloom_downsample_shader, bloom_loc_down_texel, &texel, SHADER_UNIFORM_VEC2);
+            BloomPass(bloom_downsample_shader, bloom_loc_down_clamp, src, t[0], u0, u1);
+
+            Vector2 h = { 1.0f / t[0].texture.width, 0 }, vdir = { 0, 1.0f / t[0].texture.height };
+            SetShaderValue(bloom_blur_shader, bloom_loc_blur_texel, &h, SHADER_UNIFORM_VEC2);
+            BloomPass(bloom_blur_shader, bloom_loc_blur_clamp, t[0], t[1], u0, u1);
+            SetShaderValue(bloom_blur_shader, bloom_loc_blur_texel, &vdir, SHADER_UNIFORM_VEC2);
+            BloomPass(bloom_blur_shader, bloom_loc_blur_clamp, t[1], t[0], u0, u1);
+            src = t[0];
+        }
+    }
+    bloom_cpu_avg += ((float)(NetNow() - t0) - bloom_cpu_avg) * 0.1f;
+}
+
+int CurrentBloomMip() {
+    if (!bloom_enabled || !bloom_ready) return 0;
+    return (bloom_mip_override >= 0) ? bloom_mip_override : CurrentQuality()->bloom_mip;
+}
+
+// 入力遅延
+// 照準のカーソルは入力サンプラー（別スレッド・1000Hz）の最新値を使い、カメラの追従と
+// 照準の表示は DrawScene の直前に取り直す（レイトラッチ）。--vsync-off では垂直同期を切り、
+// 締め切りまで短く区切って眠り、最後だけ回して待つリミッターでフレームを刻む（省電力中は回さない）。
+// 左クリックとカーソル位置がそれぞれ EndDrawing から戻るまでの時間を分布で記録し、F3 と終了時に出す。
+
+void SetFrameRate(int fps) {
+    target_fps = fps;
+    SetTargetFPS((frame_limiter_enabled || offscreen_mode) ? 0 : fps);
+}
+
+// 締め切りを積み上げて周期を保つ。大きく遅れたら今から数え直す。
+// 省電力でフレームを落としているときは少しの遅れは構わないので、回さずに締め切りまで眠る
+void FrameLimiterWait() {
+    if (!frame_limiter_enabled) return;
+    double period = 1.0 / target_fps;
+    double now = NetNow();
+    limiter_deadline += period;
+    if (limiter_deadline < now - period) limiter_deadline = now;
+    double spin = (event_waiting || target_fps < 60) ? 0.0 : LIMITER_SPIN_SECONDS;
+    while (limiter_deadline - now > spin) {
+        double wake = now + LIMITER_SLEEP_SECONDS;
+        NetSleepUntil(wake < limiter_deadline - spin ? wake : limiter_deadline - spin);
+        now = NetNow();
+    }
+    while ((now = NetNow()) < limiter_deadline) { }
+    double late = now - limiter_deadline;
+    if (late > limiter_late_max) limiter_late_max = late;
+}
+
+// 最新のカーソル位置（ウィンドウ座標）。sampleTime にはその位置を読んだ時刻を返す
+Vector2 SampledMousePosition(double *sampleTime) {
+    InputSample s;
+    if (input_thread_enabled && InputSamplerLatest(&s)) {
+        Vector2 win = GetWindowPosition();
+        if (sampleTime) *sampleTime = s.time;
+        return (Vector2){ s.root_x - win.x, s.root_y - win.y };
+    }
+    if (sampleTime) *sampleTime = last_poll_time;
+    return GetMousePosition();
+}
+
+bool SampledFireDown() {
+    if (IsMouseButtonDown(MOUSE_LEFT_BUTTON)) return true;
+    InputSample s;
+    return input_thread_enabled && IsWindowFocused() && InputSamplerLatest(&s) && (s.buttons & INPUT_SAMPLER_LEFT);
+}
+
+// カーソルが止まっているのにサンプラーと raylib の位置が合わないなら（Wayland など）使うのをやめる
+void CheckInputSampler() {
+    if (!input_thread_enabled) return;
+    if (!IsWindowFocused() || Vector2LengthSqr(GetMouseDelta()) > 0) return;
+    Vector2 sampled = SampledMousePosition(NULL);
+    if (Vector2DistanceSqr(sampled, GetMousePosition()) <= 4.0f) {
+        sampler_mismatch = 0;
+        return;
+    }
+    if (++sampler_mismatch < SAMPLER_MISMATCH_FRAMES) return;
+    TraceLog(LOG_WARNING, "INPUT: sampler position does not match the window, using raylib input only");
+    InputSamplerStop();
+    input_thread_enabled = false;
+}
+
+// ReadLocalInput から呼ぶ。まだ画面に出ていない左クリックの時刻を覚えておく
+void LatencyProbeInput() {
+    InputSample s;
+    if (input_thread_enabled && InputSamplerLatest(&s)) {
+        if (s.press_count != sampler_press_seen) {
+            sampler_press_seen = s.press_count;
+            if (latency_pending_click == 0) latency_pending_click = s.press_time;
+        }
+    } else if (IsMouseButtonPressed(MOUSE_LEFT_BUTTON) && latency_pending_click == 0) {
+        latency_pending_click = last_poll_time;
+    }
+}
+
+void LatencyAdd(LatencyHistogram *h, double sec) {
+    int bin = (int)(sec * 1000.0 / LATENCY_BUCKET_MS);
+    if (bin < 0) bin = 0;
+    if (bin >= LATENCY_BUCKETS) bin = LATENCY_BUCKETS - 1;
+    h->bins[bin]++;
+    h->count++;
+    h->sum += sec;
+    if (sec > h->max) h->max = sec;
+}
+
+// 分布の p 分位（ミリ秒。ビンの上端を返す）
+float LatencyPercentile(const LatencyHistogram *h, float p) {
+    if (h->count == 0) return 0;
+    int want = (int)ceilf(h->count * p), seen = 0;
+    for (int b=0; b<LATENCY_BUCKETS; b++) {
+        seen += h->bins[b];
+        if (seen >= want) return (b + 1) * LATENCY_BUCKET_MS;
+    }
+    return LATENCY_BUCKETS * LATENCY_BUCKET_MS;
+}
+
+// EndDrawing の直後に呼ぶ
+void LatencyProbePresent() {
+    double now = NetNow();
+    if (latency_pending_click > 0) LatencyAdd(&latency_click, now - latency_pending_click);
+    if (latency_aim_sample > 0) LatencyAdd(&latency_aim, now - latency_aim_sample);
+    latency_pending_click = 0;
+    latency_aim_sample = 0;
+    last_poll_time = now;
+}
+
+const char *LatencySummary(const char *name, const LatencyHistogram *h) {
+    if (h->count == 0) return TextFormat("%-5s  no samples", name);
+    return TextFormat("%-5s  n=%d  avg %.2f  p50 %.2f  p90 %.2f  p99 %.2f  max %.2f ms", name, h->count,
+                      h->sum * 1000.0 / h->count, LatencyPercentile(h, 0.5f), LatencyPercentile(h, 0.9f),
+                      LatencyPercentile(h, 0.99f), h->max * 1000.0);
+}
+
+void PrintLatencyReport() {
+    if (latency_click.count == 0 && latency_aim.count == 0) return;
+    printf("latency to EndDrawing (late latch %s, input thread %s, %s)\n",
+           late_latch_enabled ? "on" : "off", input_thread_enabled ? "on" : "off",
+           frame_limiter_enabled ? TextFormat("vsync off, limiter late max %.3f ms", limiter_late_max * 1000.0) : "raylib pacing");
+    printf("%s\n", LatencySummary("click", &latency_click));
+    printf("%s\n", LatencySummary("aim", &latency_aim));
+}
+
+// DrawScene の直前に呼ぶ。カメラを今の位置で追従させ、カーソルから照準を取り直す
+// （照準と向きは描画だけに使い、シミュレーションの状態は変えない）
+void LateLatchView() {
+    late_latch.valid = false;
+    if (!late_latch_enabled || frozen_frame_capturing || current_state != STATE_PLAYING) return;
+    UpdateFollowCamera(player.position, FrameDelta());
+    Vector2 mouse = SampledMousePosition(&latency_aim_sample);
+    late_latch.aim = GetGroundAimPoint(mouse, camera);
+    Vector3 diff = Vector3Subtract(late_latch.aim, player.position);
+    late_latch.facing = -atan2f(diff.z, diff.x) + PI/2;
+    late_latch.valid = true;
+}
+
+// ワールドのメモリ
+// エンティティのプールとフレームごとの一時領域を、起動時に1つの領域（mmap）からまとめて取る。
+// 各プールの先頭は WORLD_ALIGN に揃え、--hugepages なら 2MB のページを使う
+// （hugetlbfs が使えなければ透過的ヒュージページを頼む）。容量は --budget で決め、
+// フレームの区切りで使用数を数えて最大値を、Spawn* で一杯だった回数を記録する。
+// 終了時（サーバーは停止時）に一覧を出すので、環境ごとの容量決めに使う。
+
+// 例: --budget enemies=200,bullets=600,enemy-bullets=4096,particles=300,items=50,scratch-kb=512
+bool ParseBudget(const char *spec) {
+    char buf[256];
+    snprintf(buf, sizeof(buf), "%s", spec);
+    for (char *tok = strtok(buf, ","); tok; tok = strtok(NULL, ",")) {
+        char *eq = strchr(tok, '=');
+        if (!eq) {
+            fprintf(stderr, "budget: expected name=value, got '%s'\n", tok);
+            return false;
+        }
+        *eq = '\0';
+        int value = atoi(eq + 1);
+        if (strcmp(tok, "scratch-kb") == 0 && value > 0) {
+            world_arena.frame_size = (size_t)value * 1024;
+            continue;
+        }
+        bool found = false;
+        for (int k=0; k<POOL_COUNT; k++) {
+            PoolStats *ps = &pool_stats[k];
+            if (strcmp(tok, ps->name) != 0) continue;
+            if (value < 1 || value > ps->limit) {
+                fprintf(stderr, "budget: %s must be 1..%d\n", ps->name, ps->limit);
+                return false;
+            }
+            *ps->capacity = value;
+            found = true;
+        }
+        if (!found) {
+            fprintf(stderr, "budget: unknown pool '%s' (enemies, bullets, enemy-bullets, particles, items, scratch-kb)\n", tok);
+            return false;
+        }
+    }
+    return true;
+}
+
+size_t WorldAlign(size_t n) {
+    return (n + WORLD_ALIGN - 1) & ~(size_t)(WORLD_ALIGN - 1);
+}
+
+bool InitWorldArena() {
+    WorldArena *w = &world_arena;
+    enemy_slots = enemy_capacity + ENEMY_BOSS_SLOTS;
+    size_t total = WorldAlign(w->frame_size);
+    for (int k=0; k<POOL_COUNT; k++) {
+        if (k == POOL_ENEMY_BULLETS) {
+            // SoA の列ごとに揃える
+            int n = enemy_bullet_capacity;
+            total += 5 * WorldAlign(n * sizeof(float)) + WorldAlign(n * sizeof(uint8_t)) + WorldAlign(n * sizeof(uint16_t));
+        } else if (k == POOL_ENEMIES) {
+            total += WorldAlign(enemy_slots * sizeof(Enemy));
+        } else {
+            total += WorldAlign(*pool_stats[k].capacity * pool_stats[k].item_size);
+        }
+    }
+
+    size_t page = world_huge_pages ? WORLD_HUGE_PAGE : 4096;
+    w->size = (total + page - 1) / page * page;
+    w->base = MAP_FAILED;
+    w->page_mode = "4k";
+#if defined(MAP_HUGETLB)
+    if (world_huge_pages) {
+        w->base = mmap(NULL, w->size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (w->base != MAP_FAILED) w->page_mode = "hugetlb";
+    }
+#endif
+    if (w->base == MAP_FAILED) {
+        w->base = mmap(NULL, w->size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (w->base == MAP_FAILED) {
+            fprintf(stderr, "memory: cannot map %zu bytes: %s\n", w->size, strerror(errno));
+            return false;
+        }
+#if defined(MADV_HUGEPAGE)
+        if (world_huge_pages && madvise(w->base, w->size, MADV_HUGEPAGE) == 0) w->page_mode = "madvise";
+#endif
+    }
+
+    // mmap の領域は 0 で埋まっている（プールは全部 active = false から始まる）
+    enemies = WorldArenaPush(enemy_slots * sizeof(Enemy));
+    bullets = WorldArenaPush(bullet_capacity * sizeof(Bullet));
+    particles = WorldArenaPush(particle_capacity * sizeof(Particle));
+    items = WorldArenaPush(item_capacity * sizeof(Item));
+    EnemyBulletPool *pool = &enemy_bullets;
+    int n = enemy_bullet_capacity;
+    pool->x = WorldArenaPush(n * sizeof(float));
+    pool->z = WorldArenaPush(n * sizeof(float));
+    pool->vx = WorldArenaPush(n * sizeof(float));
+    pool->vz = WorldArenaPush(n * sizeof(float));
+    pool->life = WorldArenaPush(n * sizeof(float));
+    pool->style = WorldArenaPush(n * sizeof(uint8_t));
+    pool->serial = WorldArenaPush(n * sizeof(uint16_t));
+    pool->capacity = n;
+    w->frame_base = WorldArenaPush(w->frame_size);
+    EnemyBucketsRebuild();
+    return true;
+}
+
+// 起動時の確保（足りなくなることはない。InitWorldArena で大きさを数えてある）
+void *WorldArenaPush(size_t bytes) {
+    WorldArena *w = &world_arena;
+    void *p = w->base + w->used;
+    w->used += WorldAlign(bytes);
+    return p;
+}
+
+// フレームの一時領域から取る。一杯なら NULL（呼び出し側は一時領域を使わないやり方に切り替える）
+void *FrameAlloc(size_t bytes) {
+    WorldArena *w = &world_arena;
+    size_t size = WorldAlign(bytes);
+    if (w->frame_used + size > w->frame_size) {
+        w->frame_failures++;
+        return NULL;
+    }
+    void *p = w->frame_base + w->frame_used;
+    w->frame_used += size;
+    if (w->frame_used > w->frame_peak) w->frame_peak = w->frame_used;
+    return p;
+}
+
+// その時点までの一時領域の使用量。FrameRewind で戻すと、間で取ったものはまとめて返る
+size_t FrameMark() {
+    return world_arena.frame_used;
+}
+
+void FrameRewind(size_t mark) {
+    if (mark <= world_arena.frame_used) world_arena.frame_used = mark;
+}
+
+// フレーム（サーバーはティック）の先頭で呼ぶ。一時領域を空にし、プールの使用数を数える
+void WorldFrameReset() {
+    WorldArena *w = &world_arena;
+    w->frame_used = 0;
+    w->frames++;
+
+    int used[POOL_COUNT] = { 0 };
+    for (int i=0; i<enemy_slots; i++) used[POOL_ENEMIES] += enemies[i].active;
+    for (int i=0; i<bullet_capacity; i++) used[POOL_BULLETS] += bullets[i].active;
+    for (int i=0; i<particle_capacity; i++) used[POOL_PARTICLES] += particles[i].active;
+    for (int i=0; i<item_capacity; i++) used[POOL_ITEMS] += items[i].active;
+    used[POOL_ENEMY_BULLETS] = enemy_bullets.count;
+    for (int k=0; k<POOL_COUNT; k++) {
+        pool_stats[k].in_use = used[k];
+        if (used[k] > pool_stats[k].peak) pool_stats[k].peak = used[k];
+    }
+    // 敵弾はプール自身が Spawn のたびに最大値と溢れた数を数えている（ティックの途中の山も拾える）
+    if (enemy_bullets.peak > pool_stats[POOL_ENEMY_BULLETS].peak) pool_stats[POOL_ENEMY_BULLETS].peak = enemy_bullets.peak;
+    pool_stats[POOL_ENEMY_BULLETS].failures = (uint64_t)enemy_bullets.dropped;
+}
+
+void PoolSpawnFailed(PoolId pool, int count) {
+    pool_stats[pool].failures += (uint64_t)count;
+}
+
+void PrintMemoryReport() {
+    WorldArena *w = &world_arena;
+    if (!w->base) return;
+    printf("memory: world arena %.1f KB (pools %.1f KB, frame scratch %.1f KB), pages %s\n", w->size / 1024.0,
+           (w->used - WorldAlign(w->frame_size)) / 1024.0, w->frame_size / 1024.0, w->page_mode);
+    printf("pool            capacity     peak   peak%%   in use   spawn failures        KB\n");
+    for (int k=0; k<POOL_COUNT; k++) {
+        const PoolStats *ps = &pool_stats[k];
+        int cap = *ps->capacity;
+        printf("%-14s %9d %8d %6.1f%% %8d %16llu %9.1f\n", ps->name, cap, ps->peak, 100.0 * ps->peak / cap, ps->in_use,
+               (unsigned long long)ps->failures, cap * ps->item_size / 1024.0);
+    }
+    printf("frame scratch: peak %.1f / %.1f KB over %llu frames, %llu failed allocations\n", w->frame_peak / 1024.0,
+           w->frame_size / 1024.0, (unsigned long long)w->frames, (unsigned long long)w->frame_failures);
+}
+
+// テレメトリ
+// --telemetry を付けると、撃破位置・被ダメージ・アイテム取得・レベルアップ・ステージとボスの所要時間を
+// telemetry.c のリングに入れ、書き出しスレッドがバイナリのログにまとめて書く（ゲームのスレッドは
+// 固定長の記録を1件コピーするだけで、ファイルには触らない）。集計は telemetry_tool で行う。
+// リプレイの再生・ベンチマークでは記録しない（同じ試合を二重に数えないため）。
+
+void StartTelemetry() {
+    if (!telemetry_path_arg) return;
+    char name[64];
+    const char *path = telemetry_path_arg;
+    if (path[0] == '\0') {
+        time_t now = time(NULL);
+        strftime(name, sizeof(name), "telemetry_%Y%m%d_%H%M%S.vtl", localtime(&now));
+        path = name;
+    }
+    telemetry_enabled = TelemetryStart(path, ARENA_HALF);
+    if (telemetry_enabled) printf("telemetry: writing %s\n", path);
+    else fprintf(stderr, "telemetry: cannot write %s\n", path);
+}
+
+void StopTelemetry() {
+    if (!telemetry_enabled) return;
+    telemetry_enabled = false;
+    TelemetryStop();
+    TelemetryStats st;
+    TelemetryGetStats(&st);
+    printf("telemetry: %llu events (%llu dropped), %.1f KB, %llu flushes, ring peak %u/%d -> %s\n",
+           (unsigned long long)st.written, (unsigned long long)st.dropped, st.bytes_written / 1024.0,
+           (unsigned long long)st.flushes, st.ring_peak, TELEMETRY_RING_EVENTS, TelemetryPath());
+}
+
+// p は sim_players（対戦は player / player2）の中から番号を引く
+void TelemetryEmit(TelemetryEventType type, const Player *p, int sub, Vector3 pos, int value, int value2) {
+    if (!telemetry_enabled) return;
+    int idx = TELEMETRY_NO_PLAYER;
+    if (p == &player) idx = 0;
+    else if (p == &player2) idx = 1;
+    else for (int k=0; k<sim_player_count; k++) if (sim_players[k] == p) idx = k;
+    TelemetryEvent e = {
+        .time = game_time, .type = (uint8_t)type, .player = (uint8_t)idx, .stage = (uint8_t)current_stage,
+        .sub = (uint8_t)sub, .x = pos.x, .z = pos.z, .value = value, .value2 = value2
+    };
+    TelemetryPush(&e);
+}
+
+void TelemetryMatchStart() {
+    match_start_time = game_time;
+    stage_start_time = game_time;
+    int mode = (net_mode == NET_MODE_SERVER) ? 2 : (current_state == STATE_PVP ? 1 : 0);
+    TelemetryEmit(TELEMETRY_MATCH_START, NULL, mode, (Vector3){ 0 }, difficulty, 0);
+}
+
+// 動画キャプチャ
+// F9 か --capture で、表示するフレームを capture.c の PBO 読み戻しとエンコーダースレッドで
+// ファイルに書く（描画スレッドは読み出しの発行と1フレーム前の取り出しだけ）。
+// --offscreen はウィンドウを隠して一定の大きさ・一定の時間刻みで自動操縦のゲームを回す。
+// このときキューが一杯なら捨てずに待つので、遅いマシンでも全フレームが残る。
+
+// path が NULL なら日時から名前を付ける（Y4M）
+void ToggleCapture(const char *path) {
+    if (CaptureActive()) {
+        CaptureStop();
+        PrintCaptureReport();
+        return;
+    }
+    char name[64];
+    if (!path) {
+        time_t now = time(NULL);
+        strftime(name, sizeof(name), "capture_%Y%m%d_%H%M%S.y4m", localtime(&now));
+        path = name;
+    }
+    CaptureSetBlocking(offscreen_mode);
+    if (!CaptureStart(path, GetRenderWidth(), GetRenderHeight(), CAPTURE_FPS)) {
+        TraceLog(LOG_WARNING, "CAPTURE: cannot record to %s", path);
+        return;
+    }
+    TraceLog(LOG_INFO, "CAPTURE: recording %s (%dx%d)", path, GetRenderWidth(), GetRenderHeight());
+}
+
+// 画面への描画が終わったところで呼ぶ（デバッグ表示は重ねる前）
+void CapturePresentedFrame() {
+    if (!CaptureActive()) return;
+    rlDrawRenderBatchActive();
+    CaptureFrame(GetRenderWidth(), GetRenderHeight());
+}
+
+void PrintCaptureReport() {
+    CaptureStats s;
+    CaptureGetStats(&s);
+    double n = s.frames_read > 0 ? (double)s.frames_read : 1.0;
+    printf("capture %s: %llu frames written, %llu dropped, queue peak %d/%d, %.1f MB\n", CapturePath(),
+           (unsigned long long)s.frames_written, (unsigned long long)s.frames_dropped, s.queue_peak, CAPTURE_QUEUE_FRAMES,
+           s.bytes_written / (1024.0 * 1024.0));
+    printf("capture: readback %.3f ms/frame (render thread), encode %.2f ms/frame (encoder thread)\n",
+           s.readback_seconds * 1000.0 / n, s.encode_seconds * 1000.0 / n);
+}
+
+// タイトルを飛ばして通常モードで始める（乱数を固定して毎回同じ展開にする）
+void StartOffscreenRun() {
+    SetRandomSeed(1);
+    difficulty = MODE_NORMAL;
+    InitGame(true);
+    current_state = STATE_PLAYING;
+    offscreen_gameover_timer = 0;
+    ReplayAutoStart();
+    TelemetryMatchStart();
+}
+
+// ゲームオーバーは少し見せてから始め直す
+void UpdateOffscreenRun() {
+    if (current_state == STATE_TITLE) StartOffscreenRun();
+    if (current_state != STATE_GAMEOVER) return;
+    offscreen_gameover_timer += FrameDelta();
+    if (offscreen_gameover_timer > OFFSCREEN_GAMEOVER_SECONDS) StartOffscreenRun();
+}
+
+// 一番近い敵を狙って撃ち続け、その周りを回りながら中央へ寄る。近づかれたらダッシュで離れる
+PlayerInput AutopilotInput() {
+    PlayerInput in = { 0 };
+    int nearest = -1;
+    float best = 0;
+    for (int i=0; i<enemy_slots; i++) {
+        if (!enemies[i].active) continue;
+        float d = Vector3DistanceSqr(enemies[i].position, player.position);
+        if (nearest < 0 || d < best) { nearest = i; best = d; }
+    }
+
+    Vector3 move = Vector3Scale((Vector3){ player.position.x, 0, player.position.z }, -0.03f);
+    if (nearest >= 0) {
+        Vector3 to = Vector3Subtract(enemies[nearest].position, player.position);
+        to.y = 0;
+        Vector3 dir = Vector3Length(to) > 0.01f ? Vector3Normalize(to) : (Vector3){ 0, 0, 1 };
+        move = Vector3Add(move, (Vector3){ -dir.z, 0, dir.x });
+        if (best < 36.0f) {
+            move = Vector3Subtract(move, dir);
+            in.dash = true;
+        }
+        in.aim_point = (Vector3){ enemies[nearest].position.x, 0, enemies[nearest].position.z };
+        in.fire = true;
+    } else {
+        in.aim_point = Vector3Add(player.position, (Vector3){ sinf(game_time), 0, cosf(game_time) });
+    }
+    in.move_x = move.x;
+    in.move_z = move.z;
+
+    // 解放済みの武器を順に使う
+    in.weapon_select = ((int)(game_time / 8.0f) % WEAPON_COUNT) + 1;
+    return in;
+}
+
+void UpdateTitle() {
+    float time = GetTime();
+    camera.position.x = sinf(time * 0.3f) * 35.0f;
+    camera.position.z = cosf(time * 0.3f) * 35.0f;
+    camera.target = (Vector3){ 0, 0, 0 };
+
+    if (IsKeyDown(KEY_N)) { difficulty = MODE_NORMAL; roam_mode = false; InitGame(true); current_state = STATE_PLAYING; }
+    if (IsKeyDown(KEY_H)) { difficulty = MODE_HARD; roam_mode = false; InitGame(true); current_state = STATE_PLAYING; }
+    if (IsKeyDown(KEY_O)) { difficulty = MODE_NORMAL; roam_mode = true; InitGame(true); current_state = STATE_PLAYING; }
+    if (IsKeyDown(KEY_P)) {
+        roam_mode = false;
+        InitGame(true);
+        player.position = (Vector3){ -10, 0, 0 };
+        player2.position = (Vector3){ 10, 0, 0 };
+        player2.hp = 100; player2.max_hp = 100; player2.speed = 10.0f;
+        camera2 = camera;
+        current_state = STATE_PVP;
+    }
+    if (current_state != STATE_TITLE) {
+        ReplayAutoStart();
+        TelemetryMatchStart();
+    }
+}
+
+void DrawTitle() {
+    int w = GetScreenWidth();
+    ClearBackground(COL_DARK_BG);
+    
+    BeginSceneTarget();
+    BeginMode3D(camera);
+        DrawCyberGrid((Vector3){0,0,AnimTime()*5.0f}); 
+        DrawMecha((Vector3){5,0,0}, 0, COL_NEON_PINK, AnimTime(), ENEMY_DRONE);
+        DrawMecha((Vector3){-5,0,0}, 3.14, COL_NEON_PURPLE, AnimTime(), ENEMY_TANK);
+        DrawMecha((Vector3){0,5,-10}, 0, COL_NEON_ORANGE, AnimTime(), ENEMY_BOSS);
+        DrawMechaShadow((Vector3){5,0,0}, ENEMY_DRONE);
+        DrawMechaShadow((Vector3){-5,0,0}, ENEMY_TANK);
+        DrawMechaShadow((Vector3){0,5,-10}, ENEMY_BOSS);
+    EndMode3D();
+    EndSceneTarget();
+
+    DrawText("VOXEL SURVIVOR", w/2 - MeasureText("VOXEL SURVIVOR", 60)/2, 100, 60, COL_NEON_CYAN);
+    DrawText("NEON EDITION", w/2 - MeasureText("NEON EDITION", 40)/2, 170, 40, COL_NEON_PINK);
+    DrawText("[N] NORMAL", w/2 - 150, 300, 30, WHITE);
+    DrawText("[H] HARD", w/2 - 150, 350, 30, COL_NEON_ORANGE);
+    DrawText("[P] VS 2P", w/2 - 150, 400, 30, COL_NEON_GREEN);
+    DrawText("[O] ROAM", w/2 - 150, 450, 30, COL_NEON_CYAN);
+}
+
+void InitPlayer(Player *p, Vector3 pos) {
+    p->position = pos;
+    p->speed = 12.0f;
+    p->hp = 100; p->max_hp = 100;
+    p->level = 1; p->exp = 0; 
+    p->next_level_exp = 5;
+    p->damage = 20;
+    p->weapon_type = 0;
+    p->shoot_cooldown = 0.0f;
+    p->dash_cooldown = 0; p->dash_duration = 0;
+    p->invincible_timer = 0;
+    p->beam_timer = 0; p->beam_length = 0;
+    for(int i=0; i<TRAIL_LENGTH; i++) p->trail_pos[i] = p->position;
+}
+
+void InitGame(bool reset_player) {
+    if (reset_player) {
+        InitPlayer(&player, (Vector3){ 0, 0, 0 });
+        current_stage = 1;
+        player2 = player; 
+    }
+    ResetStage();
+    camera.position = (Vector3){ 0.0f, 25.0f, 18.0f }; 
+    camera.up = (Vector3){ 0.0f, 1.0f, 0.0f };
+    camera.fovy = 50.0f;
+    game_time = 0.0f;
+    stage_start_time = 0.0f;
+    screen_shake = 0.0f;
+    // 進行用の乱数は raylib の乱数から種をもらう（リプレイはキーフレームに状態を持つ）
+    sim_rng = ((uint32_t)GetRandomValue(0, 0xFFFF) << 16) | (uint32_t)GetRandomValue(0, 0xFFFF);
+    if (sim_rng == 0) sim_rng = 0x9E3779B9u;
+    ClearHudEvents();
+    RoamReset();
+}
+
+void ResetStage() {
+    stage_kills = 0;
+    stage_start_time = game_time;
+    boss_spawned = false;
+    kills_required_for_boss = KILLS_TO_BOSS_BASE + (current_stage - 1) * 5; 
+    enemy_spawn_timer = 0.0f;
+    for(int i=0; i<enemy_slots; i++) enemies[i].active = false;
+    for(int i=0; i<bullet_capacity; i++) bullets[i].active = false;
+    enemy_bullets.count = 0;
+    EnemyBucketsRebuild();
+    EnemyHitGridBuild();
+    for(int i=0; i<particle_capacity; i++) particles[i].active = false;
+    for(int i=0; i<item_capacity; i++) items[i].active = false;
+    // 探索モードのアイテムは次のティックで置き直す
+    for (int i=0; i<ROAM_SECTOR_SLOTS; i++) roam.sectors[i].pickups_placed = 0;
+    ArenaGenerate(current_stage);
+}
+
+void AddScreenShake(float amount) {
+    screen_shake = amount;
+    if(screen_shake > 2.0f) screen_shake = 2.0f;
+}
+
+// ゲーム進行用の乱数（xorshift32）。リプレイで同じ展開になるよう、状態はキーフレームに入れる。
+// 画面の揺れやパーティクルなど見た目だけのものは GetRandomValue のまま
+int SimRandom(int min, int max) {
+    return XorshiftRandom(&sim_rng, min, max);
+}
+
+int XorshiftRandom(uint32_t *state, int min, int max) {
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    if (max <= min) return min;
+    return min + (int)(x % (uint32_t)(max - min + 1));
+}
+
+void UpdateTrail(Player *p) {
+    if (p->dash_duration > 0 || (int)(game_time * 10) % 2 == 0) { 
+        p->trail_idx = (p->trail_idx + 1) % TRAIL_LENGTH;
+        p->trail_pos[p->trail_idx] = p->position;
+    }
+}
+
+void DrawCyberGrid(Vector3 centerPos) {
+    int slices = CurrentQuality()->grid_slices;
+    float spacing = 4.0f;
     float offsetX = centerPos.x - fmodf(centerPos.x, spacing);
     float offsetZ = centerPos.z - fmodf(centerPos.z, spacing);
 
@@ -340,271 +2563,5017 @@ void DrawCyberGrid(Vector3 centerPos) {
         rlVertex3f(xPos, 0, centerPos.z + slices * spacing);
     }
 
-    for (int i = -slices; i <= slices; i++) {
-        float zPos = offsetZ + i * spacing;
-        
-        float dist = fabsf(zPos - centerPos.z);
-        float alpha = 1.0f - (dist / (slices * spacing)); 
-        if(alpha < 0) alpha = 0;
-        
-        Color c = ColorAlpha(COL_NEON_PURPLE, alpha * 0.5f);
-        rlColor4ub(c.r, c.g, c.b, c.a);
-        rlVertex3f(centerPos.x - slices * spacing, 0, zPos);
-        rlVertex3f(centerPos.x + slices * spacing, 0, zPos);
+    for (int i = -slices; i <= slices; i++) {
+        float zPos = offsetZ + i * spacing;
+        
+        float dist = fabsf(zPos - centerPos.z);
+        float alpha = 1.0f - (dist / (slices * spacing)); 
+        if(alpha < 0) alpha = 0;
+        
+        Color c = ColorAlpha(COL_NEON_PURPLE, alpha * 0.5f);
+        rlColor4ub(c.r, c.g, c.b, c.a);
+        rlVertex3f(centerPos.x - slices * spacing, 0, zPos);
+        rlVertex3f(centerPos.x + slices * spacing, 0, zPos);
+    }
+    rlEnd();
+}
+
+// ボクセルアリーナ
+// ブロックは VOXEL_SIZE 角。当たり判定は占有ビットセットだけを見るので、
+// 地形があってもエンティティあたりのコストは数回のビット参照で済む。
+// 見た目はチャンクごとにグリーディメッシュ化した静的メッシュで描き、
+// ブロックが壊れたチャンクだけを数フレームに分けて作り直す。
+
+int ArenaIndex(int cx, int cy, int cz) {
+    return (cy * ARENA_CELLS + cz) * ARENA_CELLS + cx;
+}
+
+bool ArenaSolidCell(int cx, int cy, int cz) {
+    if (cx < 0 || cz < 0 || cy < 0 || cx >= ARENA_CELLS || cz >= ARENA_CELLS || cy >= ARENA_HEIGHT) return false;
+    int idx = ArenaIndex(cx, cy, cz);
+    return (arena_occupancy[idx >> 6] >> (idx & 63)) & 1;
+}
+
+int ArenaCellCoord(float v) {
+    return (int)floorf((v + ARENA_HALF) / VOXEL_SIZE);
+}
+
+void ArenaSetBlock(int cx, int cy, int cz, uint8_t type) {
+    int idx = ArenaIndex(cx, cy, cz);
+    arena_blocks[idx] = type;
+    arena_block_hp[idx] = (type == BLOCK_COVER) ? 3 : 0;
+    if (type != BLOCK_EMPTY) arena_occupancy[idx >> 6] |= (uint64_t)1 << (idx & 63);
+    else arena_occupancy[idx >> 6] &= ~((uint64_t)1 << (idx & 63));
+}
+
+void ArenaMarkDirty(int cx, int cz) {
+    if (cx < 0 || cz < 0 || cx >= ARENA_CELLS || cz >= ARENA_CELLS) return;
+    arena_chunk_dirty[(cz / ARENA_CHUNK_SIZE) * ARENA_CHUNKS + cx / ARENA_CHUNK_SIZE] = true;
+}
+
+// ステージごとに同じ配置になるよう、シードから決定的に生成する
+void ArenaGenerate(int seed) {
+    memset(arena_blocks, 0, sizeof(arena_blocks));
+    memset(arena_block_hp, 0, sizeof(arena_block_hp));
+    memset(arena_occupancy, 0, sizeof(arena_occupancy));
+    // 探索モードは何も置かない（原点が動くので、原点に固定したボクセルは使えない）
+    if (!roam_mode) ArenaPlaceBlocks(seed);
+
+    arena_seed = seed;
+    arena_epoch++;
+    arena_destroyed_count = 0;
+    for (int i=0; i<ARENA_CHUNKS * ARENA_CHUNKS; i++) arena_chunk_dirty[i] = true;
+    arena_full_rebuild = true;
+}
+
+void ArenaPlaceBlocks(int seed) {
+    unsigned int rng = 2166136261u ^ (unsigned int)seed * 16777619u;
+    #define ARENA_RAND(n) ((int)((rng = rng * 1103515245u + 12345u) >> 16) % (n))
+
+    // 外周の壁（FIELD_LIMIT の外側1マス）
+    for (int cz=0; cz<ARENA_CELLS; cz++) {
+        for (int cx=0; cx<ARENA_CELLS; cx++) {
+            float wx = (cx + 0.5f) * VOXEL_SIZE - ARENA_HALF;
+            float wz = (cz + 0.5f) * VOXEL_SIZE - ARENA_HALF;
+            if (fabsf(wx) > FIELD_LIMIT || fabsf(wz) > FIELD_LIMIT) {
+                for (int cy=0; cy<ARENA_HEIGHT; cy++) ArenaSetBlock(cx, cy, cz, BLOCK_WALL);
+            }
+        }
+    }
+
+    // 柱（2x2、対称配置）
+    int c = ARENA_CELLS / 2;
+    const int pillarOffsets[4][2] = { { -8, -8 }, { 6, -8 }, { -8, 6 }, { 6, 6 } };
+    for (int p=0; p<4; p++) {
+        for (int dz=0; dz<2; dz++) for (int dx=0; dx<2; dx++) {
+            for (int cy=0; cy<ARENA_HEIGHT; cy++) ArenaSetBlock(c + pillarOffsets[p][0] + dx, cy, c + pillarOffsets[p][1] + dz, BLOCK_PILLAR);
+        }
+    }
+
+    // 壊せる遮蔽物（中央の開始地点は空ける）
+    for (int k=0; k<ARENA_COVER_PIECES; k++) {
+        int cx = 2 + ARENA_RAND(ARENA_CELLS - 4);
+        int cz = 2 + ARENA_RAND(ARENA_CELLS - 4);
+        bool alongX = ARENA_RAND(2) == 0;
+        int len = 3 + ARENA_RAND(3);
+        int height = 1 + ARENA_RAND(2);
+        for (int l=0; l<len; l++) {
+            int x = alongX ? cx + l : cx;
+            int z = alongX ? cz : cz + l;
+            if (x >= ARENA_CELLS - 1 || z >= ARENA_CELLS - 1) break;
+            if (abs(x - c) < 6 && abs(z - c) < 6) continue;
+            if (ArenaSolidCell(x, 0, z)) continue;
+            for (int cy=0; cy<height; cy++) ArenaSetBlock(x, cy, z, BLOCK_COVER);
+        }
+    }
+    #undef ARENA_RAND
+}
+
+// 円（XZ 平面上の正方形で近似）が地面付近のブロックと重なるか
+bool ArenaOverlaps(float x, float z, float r) {
+    int x0 = ArenaCellCoord(x - r), x1 = ArenaCellCoord(x + r);
+    int z0 = ArenaCellCoord(z - r), z1 = ArenaCellCoord(z + r);
+    for (int cz=z0; cz<=z1; cz++) {
+        for (int cx=x0; cx<=x1; cx++) {
+            if (ArenaSolidCell(cx, 0, cz)) return true;
+        }
+    }
+    return false;
+}
+
+// 軸ごとに移動して、ぶつかった軸だけ止める（壁沿いに滑る）
+Vector3 ArenaMove(Vector3 pos, Vector3 delta, float radius) {
+    Vector3 next = pos;
+    next.x += delta.x;
+    if (ArenaOverlaps(next.x, next.z, radius)) next.x = pos.x;
+    next.z += delta.z;
+    if (ArenaOverlaps(next.x, next.z, radius)) next.z = pos.z;
+    next.y += delta.y;
+    if (roam_mode) return next;     // 探索モードには外周がない
+    if (next.x > FIELD_LIMIT) next.x = FIELD_LIMIT;
+    if (next.x < -FIELD_LIMIT) next.x = -FIELD_LIMIT;
+    if (next.z > FIELD_LIMIT) next.z = FIELD_LIMIT;
+    if (next.z < -FIELD_LIMIT) next.z = -FIELD_LIMIT;
+    return next;
+}
+
+// 近くの空いている地点を探す（出現位置用）
+Vector3 ArenaFindFree(Vector3 pos, float radius) {
+    if (!roam_mode) {
+        pos.x = Clamp(pos.x, -FIELD_LIMIT + radius, FIELD_LIMIT - radius);
+        pos.z = Clamp(pos.z, -FIELD_LIMIT + radius, FIELD_LIMIT - radius);
+    }
+    if (!ArenaOverlaps(pos.x, pos.z, radius)) return pos;
+    for (int ring=1; ring<ARENA_CELLS; ring++) {
+        for (int k=0; k<8 * ring; k++) {
+            float a = k * (2.0f * PI) / (8 * ring);
+            float x = pos.x + cosf(a) * ring * VOXEL_SIZE;
+            float z = pos.z + sinf(a) * ring * VOXEL_SIZE;
+            if (!roam_mode && (fabsf(x) > FIELD_LIMIT - radius || fabsf(z) > FIELD_LIMIT - radius)) continue;
+            if (!ArenaOverlaps(x, z, radius)) return (Vector3){ x, pos.y, z };
+        }
+    }
+    return pos;
+}
+
+void ArenaDestroyCell(int idx) {
+    int cx = idx % ARENA_CELLS;
+    int cz = (idx / ARENA_CELLS) % ARENA_CELLS;
+    int cy = idx / (ARENA_CELLS * ARENA_CELLS);
+    if (arena_blocks[idx] == BLOCK_EMPTY) return;
+    ArenaSetBlock(cx, cy, cz, BLOCK_EMPTY);
+    if (arena_destroyed_count < ARENA_VOXELS) arena_destroyed[arena_destroyed_count++] = (uint16_t)idx;
+    ArenaMarkDirty(cx, cz);
+    ArenaMarkDirty(cx - 1, cz); ArenaMarkDirty(cx + 1, cz);
+    ArenaMarkDirty(cx, cz - 1); ArenaMarkDirty(cx, cz + 1);
+}
+
+// 弾とブロックの判定。当たれば true（遮蔽物は削れる）
+bool ArenaHitBlock(Vector3 p) {
+    int cx = ArenaCellCoord(p.x), cz = ArenaCellCoord(p.z);
+    int cy = (int)floorf(p.y / VOXEL_SIZE);
+    if (!ArenaSolidCell(cx, cy, cz)) return false;
+    int idx = ArenaIndex(cx, cy, cz);
+    if (arena_blocks[idx] == BLOCK_COVER) {
+        if (--arena_block_hp[idx] == 0) {
+            Vector3 center = { (cx + 0.5f) * VOXEL_SIZE - ARENA_HALF, (cy + 0.5f) * VOXEL_SIZE, (cz + 0.5f) * VOXEL_SIZE - ARENA_HALF };
+            ArenaDestroyCell(idx);
+            SpawnExplosion(center, COL_NEON_PINK, 8);
+        }
+    }
+    return true;
+}
+
+Color ArenaBlockColor(uint8_t type) {
+    switch (type) {
+        case BLOCK_WALL:   return (Color){ 40, 20, 80, 255 };
+        case BLOCK_PILLAR: return (Color){ 20, 90, 110, 255 };
+        case BLOCK_COVER:  return (Color){ 150, 40, 130, 255 };
+        default:           return BLANK;
+    }
+}
+
+// 1チャンク分をグリーディメッシュ化する
+void ArenaBuildChunkMesh(int chunk) {
+    static float verts[ARENA_MAX_CHUNK_QUADS * 4 * 3];
+    static unsigned char cols[ARENA_MAX_CHUNK_QUADS * 4 * 4];
+    static uint8_t mask[ARENA_CHUNK_SIZE * ARENA_CHUNK_SIZE];
+    const float shade[3][2] = { { 0.70f, 0.80f }, { 0.45f, 1.00f }, { 0.60f, 0.90f } };  // [軸][負/正]
+
+    int origin[3] = { (chunk % ARENA_CHUNKS) * ARENA_CHUNK_SIZE, 0, (chunk / ARENA_CHUNKS) * ARENA_CHUNK_SIZE };
+    int dims[3] = { ARENA_CHUNK_SIZE, ARENA_HEIGHT, ARENA_CHUNK_SIZE };
+    int quads = 0;
+
+    for (int d=0; d<3; d++) {
+        int u = (d + 1) % 3, v = (d + 2) % 3;
+        for (int side=0; side<2; side++) {
+            int x[3] = { 0, 0, 0 };
+            for (x[d]=0; x[d]<dims[d]; x[d]++) {
+                // 面が見えるセルのマスク（値はブロック種類）
+                int n = 0;
+                for (x[v]=0; x[v]<dims[v]; x[v]++) {
+                    for (x[u]=0; x[u]<dims[u]; x[u]++) {
+                        int g[3] = { origin[0] + x[0], origin[1] + x[1], origin[2] + x[2] };
+                        uint8_t a = arena_blocks[ArenaIndex(g[0], g[1], g[2])];
+                        g[d] += side ? 1 : -1;
+                        mask[n++] = (a != BLOCK_EMPTY && !ArenaSolidCell(g[0], g[1], g[2])) ? a : BLOCK_EMPTY;
+                    }
+                }
+                // 同じ種類の面を長方形にまとめる
+                n = 0;
+                for (int j=0; j<dims[v]; j++) {
+                    for (int i=0; i<dims[u]; ) {
+                        uint8_t m = mask[n];
+                        if (m == BLOCK_EMPTY) { i++; n++; continue; }
+                        int w = 1;
+                        while (i + w < dims[u] && mask[n + w] == m) w++;
+                        int h = 1;
+                        for (; j + h < dims[v]; h++) {
+                            bool ok = true;
+                            for (int k=0; k<w; k++) if (mask[n + k + h * dims[u]] != m) { ok = false; break; }
+                            if (!ok) break;
+                        }
+                        for (int l=0; l<h; l++) for (int k=0; k<w; k++) mask[n + k + l * dims[u]] = BLOCK_EMPTY;
+
+                        float p[3] = { (float)origin[0], (float)origin[1], (float)origin[2] };
+                        p[d] += x[d] + (side ? 1 : 0);
+                        p[u] += i;
+                        p[v] += j;
+                        float du[3] = { 0, 0, 0 }, dv[3] = { 0, 0, 0 };
+                        du[u] = (float)w; dv[v] = (float)h;
+                        float corners[4][3];
+                        for (int a=0; a<3; a++) {
+                            corners[0][a] = p[a];
+                            corners[1][a] = p[a] + (side ? du[a] : dv[a]);
+                            corners[2][a] = p[a] + du[a] + dv[a];
+                            corners[3][a] = p[a] + (side ? dv[a] : du[a]);
+                        }
+                        Color base = ArenaBlockColor(m);
+                        float s = shade[d][side];
+                        for (int q=0; q<4; q++) {
+                            float *vp = &verts[(quads * 4 + q) * 3];
+                            vp[0] = corners[q][0] * VOXEL_SIZE - ARENA_HALF;
+                            vp[1] = corners[q][1] * VOXEL_SIZE;
+                            vp[2] = corners[q][2] * VOXEL_SIZE - ARENA_HALF;
+                            unsigned char *cp = &cols[(quads * 4 + q) * 4];
+                            cp[0] = (unsigned char)(base.r * s); cp[1] = (unsigned char)(base.g * s);
+                            cp[2] = (unsigned char)(base.b * s); cp[3] = 255;
+                        }
+                        quads++;
+                        i += w; n += w;
+                    }
+                }
+            }
+        }
+    }
+
+    if (arena_chunk_meshes[chunk].vertexCount > 0) UnloadMesh(arena_chunk_meshes[chunk]);
+    Mesh mesh = { 0 };
+    if (quads > 0) {
+        mesh.vertexCount = quads * 4;
+        mesh.triangleCount = quads * 2;
+        mesh.vertices = MemAlloc(mesh.vertexCount * 3 * sizeof(float));
+        mesh.texcoords = MemAlloc(mesh.vertexCount * 2 * sizeof(float));
+        mesh.colors = MemAlloc(mesh.vertexCount * 4);
+        mesh.indices = MemAlloc(mesh.triangleCount * 3 * sizeof(unsigned short));
+        memcpy(mesh.vertices, verts, mesh.vertexCount * 3 * sizeof(float));
+        memcpy(mesh.colors, cols, mesh.vertexCount * 4);
+        for (int q=0; q<quads; q++) {
+            unsigned short b = (unsigned short)(q * 4);
+            unsigned short *ip = &mesh.indices[q * 6];
+            ip[0] = b; ip[1] = b + 1; ip[2] = b + 2;
+            ip[3] = b; ip[4] = b + 2; ip[5] = b + 3;
+        }
+        UploadMesh(&mesh, false);
+    }
+    arena_chunk_meshes[chunk] = mesh;
+    arena_chunk_dirty[chunk] = false;
+}
+
+// 変更のあったチャンクだけ作り直す（破壊時は1フレームあたり budget 個まで）
+void ArenaUpdateMeshes(int budget) {
+    if (!arena_material_ready) {
+        arena_material = LoadMaterialDefault();
+        arena_material_ready = true;
+    }
+    for (int i=0; i<ARENA_CHUNKS * ARENA_CHUNKS; i++) {
+        if (!arena_chunk_dirty[i]) continue;
+        if (!arena_full_rebuild && budget-- <= 0) break;
+        ArenaBuildChunkMesh(i);
+    }
+    arena_full_rebuild = false;
+}
+
+void ArenaDraw() {
+    ArenaUpdateMeshes(ARENA_REMESH_PER_FRAME);
+    for (int i=0; i<ARENA_CHUNKS * ARENA_CHUNKS; i++) {
+        if (arena_chunk_meshes[i].vertexCount > 0) DrawMesh(arena_chunk_meshes[i], arena_material, MatrixIdentity());
+    }
+}
+
+// メカのメッシュ
+// 敵タイプごとに全パーツを1つのメッシュに焼き込み、上下動と脚の振りは頂点シェーダーで行う。
+// 頂点属性: texcoord.x = パーツID（0:胴体側 1:左脚 2:右脚 3:影。影は回転させず地面に置く）、texcoord.y = 脚の回転中心の高さ、
+//           texcoord2.x = 色を tint に置き換える割合（胴体だけ 1）
+// インスタンス描画では変換行列の最下行に anim_time と tint（RGB を 24bit 整数で）を詰めて渡す。
+static const char *MECHA_VS =
+    "in vec3 vertexPosition;\n"
+    "in vec2 vertexTexCoord;\n"
+    "in vec2 vertexTexCoord2;\n"
+    "in vec4 vertexColor;\n"
+    "#ifdef INSTANCED\n"
+    "in mat4 instanceTransform;\n"
+    "#endif\n"
+    "uniform mat4 mvp;\n"
+    "uniform mat4 matModel;\n"
+    "uniform vec4 colDiffuse;\n"
+    "uniform float animTime;\n"
+    "uniform vec2 mechaAnim;\n"
+    "out vec4 fragColor;\n"
+    "void main() {\n"
+    "#ifdef INSTANCED\n"
+    "    mat4 model = instanceTransform;\n"
+    "    float t = model[0][3];\n"
+    "    float rgb = model[1][3];\n"
+    "    model[0][3] = 0.0; model[1][3] = 0.0; model[2][3] = 0.0; model[3][3] = 1.0;\n"
+    "    vec4 tint = vec4(mod(floor(rgb / 65536.0), 256.0), mod(floor(rgb / 256.0), 256.0), mod(rgb, 256.0), 255.0) / 255.0;\n"
+    "#else\n"
+    "    mat4 model = matModel;\n"
+    "    float t = animTime;\n"
+    "    vec4 tint = colDiffuse;\n"
+    "#endif\n"
+    "    vec3 p = vertexPosition;\n"
+    "    float part = vertexTexCoord.x;\n"
+    "    float s = sin(t * 15.0);\n"
+    "    if (part > 0.5 && part < 2.5) {\n"
+    "        float a = s * mechaAnim.y * (part < 1.5 ? 1.0 : -1.0);\n"
+    "        float y = p.y - vertexTexCoord.y;\n"
+    "        p.yz = vec2(y * cos(a) - p.z * sin(a), y * sin(a) + p.z * cos(a));\n"
+    "        p.y += vertexTexCoord.y;\n"
+    "    }\n"
+    "    p.y += s * mechaAnim.x;\n"
+    "    fragColor = mix(vertexColor, tint, vertexTexCoord2.x);\n"
+    "#ifdef INSTANCED\n"
+    "    gl_Position = mvp * model * vec4(p, 1.0);\n"
+    "#else\n"
+    "    gl_Position = mvp * vec4(p, 1.0);\n"
+    "#endif\n"
+    "}\n";
+
+static const char *MECHA_FS =
+    "#version 330\n"
+    "in vec4 fragColor;\n"
+    "out vec4 finalColor;\n"
+    "void main() { finalColor = fragColor; }\n";
+
+void MechaAddQuad(MechaBuilder *mb, const Vector3 v[4], Color color, int part, float pivotY, float tint) {
+    if (mb->vertexCount + 4 > MECHA_MAX_VERTICES) return;
+    int base = mb->vertexCount;
+    for (int i=0; i<4; i++) {
+        int k = mb->vertexCount++;
+        mb->pos[k*3] = v[i].x; mb->pos[k*3 + 1] = v[i].y; mb->pos[k*3 + 2] = v[i].z;
+        mb->uv[k*2] = (float)part; mb->uv[k*2 + 1] = pivotY;
+        mb->uv2[k*2] = tint; mb->uv2[k*2 + 1] = 0.0f;
+        mb->col[k*4] = color.r; mb->col[k*4 + 1] = color.g; mb->col[k*4 + 2] = color.b; mb->col[k*4 + 3] = color.a;
+    }
+    const int order[6] = { 0, 1, 2, 0, 2, 3 };
+    for (int i=0; i<6; i++) mb->idx[mb->indexCount++] = (unsigned short)(base + order[i]);
+}
+
+void MechaAddBox(MechaBuilder *mb, Vector3 center, Vector3 size, Color color, int part, float pivotY, float tint) {
+    // 角の番号は x=1, y=2, z=4 のビット。各面は外から見て反時計回り
+    const int faces[6][4] = { { 1, 3, 7, 5 }, { 0, 4, 6, 2 }, { 2, 6, 7, 3 }, { 0, 1, 5, 4 }, { 4, 5, 7, 6 }, { 0, 2, 3, 1 } };
+    Vector3 corner[8];
+    for (int i=0; i<8; i++) {
+        corner[i].x = center.x + ((i & 1) ? 0.5f : -0.5f) * size.x;
+        corner[i].y = center.y + ((i & 2) ? 0.5f : -0.5f) * size.y;
+        corner[i].z = center.z + ((i & 4) ? 0.5f : -0.5f) * size.z;
+    }
+    for (int f=0; f<6; f++) {
+        Vector3 q[4] = { corner[faces[f][0]], corner[faces[f][1]], corner[faces[f][2]], corner[faces[f][3]] };
+        MechaAddQuad(mb, q, color, part, pivotY, tint);
+    }
+}
+
+// DrawCubeWires の代わりに辺を細い箱で焼き込む
+void MechaAddBoxEdges(MechaBuilder *mb, Vector3 center, Vector3 size, Color color, float thickness) {
+    for (int axis=0; axis<3; axis++) {
+        for (int k=0; k<4; k++) {
+            float a = (k & 1) ? 0.5f : -0.5f, b = (k & 2) ? 0.5f : -0.5f;
+            Vector3 c = center, s = { thickness, thickness, thickness };
+            if (axis == 0) { c.y += a * size.y; c.z += b * size.z; s.x = size.x + thickness; }
+            if (axis == 1) { c.x += a * size.x; c.z += b * size.z; s.y = size.y + thickness; }
+            if (axis == 2) { c.x += a * size.x; c.y += b * size.y; s.z = size.z + thickness; }
+            MechaAddBox(mb, c, s, color, 0, 0.0f, 0.0f);
+        }
+    }
+}
+
+// DrawMechaImmediate と同じ形を、拡大率込みで1メッシュにする。detail が false なら縁取りを省く
+Mesh BakeMechaMesh(EnemyType type, bool detail) {
+    static MechaBuilder mb;
+    mb.vertexCount = 0;
+    mb.indexCount = 0;
+
+    float scale = (type == ENEMY_BOSS) ? 2.5f : 1.0f;
+    float bodySize = (type == ENEMY_TANK || type == ENEMY_BOSS) ? 1.5f : 0.8f;
+    float headSize = bodySize * 0.6f;
+    Vector3 headPos = { 0, bodySize * 1.8f, 0 };
+    float legOffset = bodySize * 0.4f;
+    float legLength = (type == ENEMY_TANK) ? 0.8f : 1.0f;
+    #define S(x, y, z) (Vector3){ (x) * scale, (y) * scale, (z) * scale }
+
+    MechaAddBox(&mb, S(0, bodySize, 0), S(bodySize, bodySize, bodySize), WHITE, 0, 0.0f, 1.0f);
+    if (detail) MechaAddBoxEdges(&mb, S(0, bodySize, 0), S(bodySize, bodySize, bodySize), WHITE, 0.04f * scale);
+    MechaAddBox(&mb, S(headPos.x, headPos.y, headPos.z), S(headSize, headSize, headSize), GRAY, 0, 0.0f, 0.0f);
+    MechaAddBox(&mb, S(0, headPos.y, headSize/2 + 0.05f), S(headSize*0.8f, headSize*0.3f, 0.1f), COL_NEON_CYAN, 0, 0.0f, 0.0f);
+    MechaAddBox(&mb, S(-legOffset, bodySize/2 - legLength/2, 0), S(0.3f, legLength, 0.3f), DARKGRAY, 1, bodySize/2 * scale, 0.0f);
+    MechaAddBox(&mb, S(legOffset, bodySize/2 - legLength/2, 0), S(0.3f, legLength, 0.3f), DARKGRAY, 2, bodySize/2 * scale, 0.0f);
+    if (type == ENEMY_BOSS) {
+        float by = bodySize * 1.5f;
+        MechaAddBox(&mb, S(0, by, -0.5f), S(1.2f, 1.2f, 0.5f), DARKGRAY, 0, 0.0f, 0.0f);
+        MechaAddBox(&mb, S(0.8f, by + 0.5f, -0.3f), S(0.2f, 0.2f, 1.0f), COL_NEON_ORANGE, 0, 0.0f, 0.0f);
+        MechaAddBox(&mb, S(-0.8f, by + 0.5f, -0.3f), S(0.2f, 0.2f, 1.0f), COL_NEON_ORANGE, 0, 0.0f, 0.0f);
+    }
+    #undef S
+    // 影は半透明なので焼き込まない（DrawMechaShadow を描画キューの半透明のパスで描く）
+
+    Mesh mesh = { 0 };
+    mesh.vertexCount = mb.vertexCount;
+    mesh.triangleCount = mb.indexCount / 3;
+    mesh.vertices = MemAlloc(mb.vertexCount * 3 * sizeof(float));
+    mesh.texcoords = MemAlloc(mb.vertexCount * 2 * sizeof(float));
+    mesh.texcoords2 = MemAlloc(mb.vertexCount * 2 * sizeof(float));
+    mesh.colors = MemAlloc(mb.vertexCount * 4);
+    mesh.indices = MemAlloc(mb.indexCount * sizeof(unsigned short));
+    memcpy(mesh.vertices, mb.pos, mb.vertexCount * 3 * sizeof(float));
+    memcpy(mesh.texcoords, mb.uv, mb.vertexCount * 2 * sizeof(float));
+    memcpy(mesh.texcoords2, mb.uv2, mb.vertexCount * 2 * sizeof(float));
+    memcpy(mesh.colors, mb.col, mb.vertexCount * 4);
+    memcpy(mesh.indices, mb.idx, mb.indexCount * sizeof(unsigned short));
+    UploadMesh(&mesh, false);
+    return mesh;
+}
+
+Shader LoadMechaShader(bool instanced) {
+    const char *vs = TextFormat("#version 330\n%s%s", instanced ? "#define INSTANCED\n" : "", MECHA_VS);
+    Shader shader = LoadShaderFromMemory(vs, MECHA_FS);
+    if (instanced) shader.locs[SHADER_LOC_MATRIX_MODEL] = GetShaderLocationAttrib(shader, "instanceTransform");
+    return shader;
+}
+
+// 起動時に一度だけ（ウィンドウ作成後）
+void InitMechaMeshes() {
+    mecha_shader = LoadMechaShader(false);
+    mecha_shader_instanced = LoadMechaShader(true);
+    if (mecha_shader.id == rlGetShaderIdDefault() || mecha_shader_instanced.id == rlGetShaderIdDefault()) {
+        TraceLog(LOG_WARNING, "MECHA: shader unavailable, falling back to immediate drawing");
+        return;
+    }
+    mecha_loc_time = GetShaderLocation(mecha_shader, "animTime");
+    mecha_loc_anim = GetShaderLocation(mecha_shader, "mechaAnim");
+    mecha_loc_anim_instanced = GetShaderLocation(mecha_shader_instanced, "mechaAnim");
+    mecha_material = LoadMaterialDefault();
+    mecha_material.shader = mecha_shader;
+    mecha_material_instanced = LoadMaterialDefault();
+    mecha_material_instanced.shader = mecha_shader_instanced;
+
+    for (int t=0; t<MECHA_TYPES; t++) {
+        float scale = (t == ENEMY_BOSS) ? 2.5f : 1.0f;
+        mecha_meshes[t] = BakeMechaMesh((EnemyType)t, true);
+        mecha_meshes_lod[t] = BakeMechaMesh((EnemyType)t, false);
+        mecha_anim_params[t] = (Vector2){ 0.1f * scale * (t == ENEMY_TANK ? 0.2f : 1.0f), 30.0f * DEG2RAD };
+    }
+    mecha_ready = true;
+}
+
+Matrix MechaTransform(Vector3 pos, float angle) {
+    return MatrixMultiply(MatrixRotateY(angle), MatrixTranslate(pos.x, pos.y, pos.z));
+}
+
+// インスタンス用：最下行に anim_time と tint を詰める
+Matrix MechaInstanceTransform(Vector3 pos, float angle, Color color, float anim_time) {
+    Matrix m = MechaTransform(pos, angle);
+    m.m3 = anim_time;
+    m.m7 = (float)((color.r << 16) | (color.g << 8) | color.b);
+    return m;
+}
+
+void DrawMechaInstanced(EnemyType type, const Matrix *transforms, int count) {
+    if (count <= 0) return;
+    rlDrawRenderBatchActive(); // 溜まっている即時描画を先に流す（メッシュは別の描画になる）
+    SetShaderValue(mecha_shader_instanced, mecha_loc_anim_instanced, &mecha_anim_params[type], SHADER_UNIFORM_VEC2);
+    const Mesh *mesh = CurrentQuality()->mecha_detail ? &mecha_meshes[type] : &mecha_meshes_lod[type];
+    DrawMeshInstanced(*mesh, mecha_material_instanced, transforms, count);
+}
+
+void DrawMecha(Vector3 pos, float angle, Color color, float anim_time, EnemyType type) {
+    if (!mecha_ready) {
+        DrawMechaImmediate(pos, angle, color, anim_time, type);
+        return;
+    }
+    rlDrawRenderBatchActive();
+    SetShaderValue(mecha_shader, mecha_loc_time, &anim_time, SHADER_UNIFORM_FLOAT);
+    SetShaderValue(mecha_shader, mecha_loc_anim, &mecha_anim_params[type], SHADER_UNIFORM_VEC2);
+    mecha_material.maps[MATERIAL_MAP_DIFFUSE].color = color;
+    const Mesh *mesh = CurrentQuality()->mecha_detail ? &mecha_meshes[type] : &mecha_meshes_lod[type];
+    DrawMesh(*mesh, mecha_material, MechaTransform(pos, angle));
+}
+
+// シェーダーが使えない環境向けの即時描画版
+void DrawMechaImmediate(Vector3 pos, float angle, Color color, float anim_time, EnemyType type) {
+    rlPushMatrix();
+    rlTranslatef(pos.x, pos.y, pos.z);
+    rlRotatef(angle * RAD2DEG, 0, 1, 0);
+    
+    float scale = (type == ENEMY_BOSS) ? 2.5f : 1.0f;
+    rlScalef(scale, scale, scale);
+
+    float bounce = sinf(anim_time * 15.0f) * 0.1f;
+    if (type == ENEMY_TANK) bounce *= 0.2f;
+    rlTranslatef(0, bounce, 0);
+
+    float bodySize = (type == ENEMY_TANK || type == ENEMY_BOSS) ? 1.5f : 0.8f;
+    
+    DrawCube((Vector3){0, bodySize, 0}, bodySize, bodySize, bodySize, color);
+    if (CurrentQuality()->mecha_detail) DrawCubeWires((Vector3){0, bodySize, 0}, bodySize, bodySize, bodySize, WHITE);
+
+    Vector3 headPos = {0, bodySize * 1.8f, 0};
+    float headSize = bodySize * 0.6f;
+    DrawCube(headPos, headSize, headSize, headSize, GRAY);
+    DrawCube((Vector3){0, headPos.y, headSize/2 + 0.05f}, headSize*0.8f, headSize*0.3f, 0.1f, COL_NEON_CYAN);
+
+    float legOffset = bodySize * 0.4f;
+    float legLength = (type == ENEMY_TANK) ? 0.8f : 1.0f;
+    float legAngle = sinf(anim_time * 15.0f) * 30.0f;
+
+    rlPushMatrix();
+    rlTranslatef(-legOffset, bodySize/2, 0);
+    rlRotatef(legAngle, 1, 0, 0);
+    DrawCube((Vector3){0, -legLength/2, 0}, 0.3f, legLength, 0.3f, DARKGRAY);
+    rlPopMatrix();
+
+    rlPushMatrix();
+    rlTranslatef(legOffset, bodySize/2, 0);
+    rlRotatef(-legAngle, 1, 0, 0);
+    DrawCube((Vector3){0, -legLength/2, 0}, 0.3f, legLength, 0.3f, DARKGRAY);
+    rlPopMatrix();
+    
+    if (type == ENEMY_BOSS) {
+        rlPushMatrix();
+        rlTranslatef(0, bodySize * 1.5f, -0.5f);
+        DrawCube((Vector3){0,0,0}, 1.2f, 1.2f, 0.5f, DARKGRAY);
+        DrawCube((Vector3){0.8f, 0.5f, 0.2f}, 0.2f, 0.2f, 1.0f, COL_NEON_ORANGE);
+        DrawCube((Vector3){-0.8f, 0.5f, 0.2f}, 0.2f, 0.2f, 1.0f, COL_NEON_ORANGE);
+        rlPopMatrix();
+    }
+    rlPopMatrix();
+}
+
+// 足元の影（拡大しない・上下動しない・常に地面の高さ）。半透明なので不透明のものより後に描く
+void DrawMechaShadow(Vector3 pos, EnemyType type) {
+    float bodySize = (type == ENEMY_TANK || type == ENEMY_BOSS) ? 1.5f : 0.8f;
+    rlBegin(RL_TRIANGLES);
+        Color shadow = (Color){0,0,0, 100};
+        float shadowSize = bodySize * 0.8f;
+        rlColor4ub(shadow.r, shadow.g, shadow.b, shadow.a);
+        rlVertex3f(pos.x - shadowSize, 0.05f, pos.z - shadowSize);
+        rlVertex3f(pos.x - shadowSize, 0.05f, pos.z + shadowSize);
+        rlVertex3f(pos.x + shadowSize, 0.05f, pos.z + shadowSize);
+        rlVertex3f(pos.x - shadowSize, 0.05f, pos.z - shadowSize);
+        rlVertex3f(pos.x + shadowSize, 0.05f, pos.z + shadowSize);
+        rlVertex3f(pos.x + shadowSize, 0.05f, pos.z - shadowSize);
+    rlEnd();
+}
+
+void UpdateGame() {
+    float dt = FrameDelta();
+
+    // ゲームオーバーからタイトルへ（リプレイには残さない）
+    if (current_state == STATE_GAMEOVER && IsKeyPressed(KEY_R)) {
+        current_state = STATE_TITLE;
+        camera_angle_rad = 0.0f;
+        return;
+    }
+
+    // 入力（照準はカメラ更新前の視点で計算）
+    PlayerInput input = { 0 };
+    if (current_state == STATE_PLAYING) {
+        input = offscreen_mode ? AutopilotInput() : ReadLocalInput();
+        if (!late_latch_enabled) UpdateFollowCamera(player.position, dt);
+    }
+    StepGame(dt, &input);
+}
+
+// 1ティック分のシミュレーション。入力はすべて引数から受け取る（リプレイの再生もここを通る）
+void StepGame(float dt, const PlayerInput *input) {
+    WorldHashTick();
+    ReplayRecordTick(dt, input, NULL);
+    game_time += dt;
+    if (current_state == STATE_GAMEOVER) return;
+    if (UpdateStageFlow(dt)) return;
+    ApplyPlayerInput(0, input, dt);
+    UpdateWorld(dt);
+    if (roam_mode) RoamUpdate();
+    if (current_state == STATE_GAMEOVER) {
+        TelemetryEmit(TELEMETRY_MATCH_END, NULL, 0, player.position, (int)((game_time - match_start_time) * 1000.0f), current_stage);
+    }
+}
+
+// ステージクリア・ボス出現演出の進行。演出中なら true
+bool UpdateStageFlow(float dt) {
+    if (current_state == STATE_STAGE_CLEAR) {
+        state_timer += dt;
+        if (state_timer > 3.0f) {
+            current_stage++;
+            ResetStage();
+            current_state = STATE_PLAYING;
+        }
+        return true;
+    }
+    if (current_state == STATE_BOSS_INTRO) {
+        AddScreenShake(0.1f); 
+        state_timer += dt;
+        if (state_timer > 2.0f) {
+            SpawnEnemy(true);
+            current_state = STATE_PLAYING;
+        }
+        return true; 
+    }
+    return false;
+}
+
+Vector3 GetGroundAimPoint(Vector2 screenPos, Camera3D cam) {
+    Ray ray = GetMouseRay(screenPos, cam);
+    float t = -ray.position.y / ray.direction.y;
+    return Vector3Add(ray.position, Vector3Scale(ray.direction, t));
+}
+
+// 視点移動
+void UpdateFollowCamera(Vector3 focus, float dt) {
+    if (IsKeyDown(KEY_E)) camera_angle_rad -= 2.0f * dt;
+    if (IsKeyDown(KEY_Q)) camera_angle_rad += 2.0f * dt;
+
+    float camDistH = 18.0f;
+    float camHeight = 25.0f;
+    float camOffsetX = sinf(camera_angle_rad) * camDistH;
+    float camOffsetZ = cosf(camera_angle_rad) * camDistH;
+
+    Vector3 targetCamPos = {
+        focus.x + camOffsetX,
+        camHeight,
+        focus.z + camOffsetZ
+    };
+
+    float shakeX = (float)GetRandomValue(-10, 10) * 0.05f * screen_shake;
+    float shakeZ = (float)GetRandomValue(-10, 10) * 0.05f * screen_shake;
+    Vector3 finalCamPos = Vector3Add(targetCamPos, (Vector3){shakeX, 0, shakeZ});
+
+    camera.position = Vector3Lerp(camera.position, finalCamPos, 0.1f);
+    camera.target = Vector3Lerp(camera.target, focus, 0.1f);
+}
+
+// キーボード・マウスから入力を作る（移動はカメラの向き基準）
+PlayerInput ReadLocalInput() {
+    PlayerInput in = { 0 };
+    Vector3 move = {0};
+    Vector3 forward = { -sinf(camera_angle_rad), 0, -cosf(camera_angle_rad) };
+    Vector3 right   = { cosf(camera_angle_rad),  0, -sinf(camera_angle_rad) };
+
+    if (IsKeyDown(KEY_W)) move = Vector3Add(move, forward);
+    if (IsKeyDown(KEY_S)) move = Vector3Subtract(move, forward);
+    if (IsKeyDown(KEY_D)) move = Vector3Add(move, right);
+    if (IsKeyDown(KEY_A)) move = Vector3Subtract(move, right);
+
+    in.move_x = move.x;
+    in.move_z = move.z;
+    in.aim_point = GetGroundAimPoint(SampledMousePosition(late_latch_enabled ? NULL : &latency_aim_sample), camera);
+    in.fire = SampledFireDown();
+    LatencyProbeInput();
+    in.dash = IsKeyPressed(KEY_SPACE) || IsKeyPressed(KEY_LEFT_SHIFT);
+    for (int w=0; w<WEAPON_COUNT; w++) if (IsKeyPressed(KEY_ONE + w)) in.weapon_select = w + 1;
+    return in;
+}
+
+// プレイヤー移動・攻撃
+void ApplyPlayerInput(int idx, const PlayerInput *in, float dt) {
+    Player *p = sim_players[idx];
+    if (p->hp <= 0) return;
+
+    Vector3 diff = Vector3Subtract(in->aim_point, p->position);
+    p->facing_angle = -atan2f(diff.z, diff.x) + PI/2;
+
+    UpdateTrail(p);
+    if (p->invincible_timer > 0) p->invincible_timer -= dt;
+    if (p->dash_cooldown > 0) p->dash_cooldown -= dt;
+
+    Vector3 move = { in->move_x, 0, in->move_z };
+    if (in->dash && p->dash_cooldown <= 0) {
+        p->dash_duration = 0.2f;
+        p->dash_cooldown = 1.5f;
+        
+        if (Vector3Length(move) > 0) {
+            p->dash_dir = Vector3Normalize(move);
+        } else {
+            if (Vector3Length(diff) > 0.1f) p->dash_dir = Vector3Normalize(diff);
+            else p->dash_dir = (Vector3){0, 0, 1};
+        }
+        SpawnExplosion(p->position, WHITE, 5);
+        AddScreenShake(0.2f);
+    }
+    
+    if (p->dash_duration > 0) {
+        p->dash_duration -= dt;
+        p->position = ArenaMove(p->position, Vector3Scale(p->dash_dir, p->speed * 3.0f * dt), PLAYER_RADIUS);
+    } else {
+        if (Vector3Length(move) > 0) {
+            move = Vector3Normalize(move);
+            p->position = ArenaMove(p->position, Vector3Scale(move, p->speed * dt), PLAYER_RADIUS);
+            p->walk_anim_timer += dt;
+        } else p->walk_anim_timer = 0;
+    }
+
+    // 武器の切り替え（解放済みのものだけ）
+    if (in->weapon_select > 0 && WeaponUnlocked(p, in->weapon_select - 1)) p->weapon_type = in->weapon_select - 1;
+
+    // 攻撃
+    if (p->beam_timer > 0) p->beam_timer -= dt;
+    if (p->shoot_cooldown > 0) p->shoot_cooldown -= dt;
+    if (in->fire && p->shoot_cooldown <= 0) {
+        Vector3 aim_dir = Vector3Normalize(Vector3Subtract(in->aim_point, p->position));
+        aim_dir.y = 0;
+        FireWeapon(idx, aim_dir);
+    }
+}
+
+Player *NearestAlivePlayer(Vector3 pos) {
+    Player *best = NULL;
+    float bestDist = 0;
+    for (int i=0; i<sim_player_count; i++) {
+        if (sim_players[i]->hp <= 0) continue;
+        float d = Vector3DistanceSqr(sim_players[i]->position, pos);
+        if (!best || d < bestDist) { best = sim_players[i]; bestDist = d; }
+    }
+    return best;
+}
+
+bool AllPlayersDown() {
+    for (int i=0; i<sim_player_count; i++) if (sim_players[i]->hp > 0) return false;
+    return true;
+}
+
+// 敵弾（弾幕）
+// 敵の弾は SoA のプールにまとめ、生きている弾を先頭に詰めて持つ。
+// 移動は分岐のないループで一括で行い（自動ベクトル化が効く）、
+// 寿命・地形・プレイヤーとの判定は水平距離の2乗だけで済ませる。消えた弾は末尾の弾と入れ替える。
+
+bool SpawnEnemyBullet(float x, float z, float vx, float vz, float life, EnemyBulletStyle style) {
+    EnemyBulletPool *pool = &enemy_bullets;
+    if (pool->count >= pool->capacity) {
+        pool->dropped++;
+        return false;
+    }
+    int i = pool->count++;
+    pool->x[i] = x; pool->z[i] = z;
+    pool->vx[i] = vx; pool->vz[i] = vz;
+    pool->life[i] = life;
+    pool->style[i] = (uint8_t)style;
+    pool->serial[i] = pool->next_serial++;
+    if (pool->count > pool->peak) pool->peak = pool->count;
+    return true;
+}
+
+// 1回分の発射。late は本来の発射時刻からの遅れで、その分だけ弾を先に進めておく
+void FireBulletPattern(const BulletPattern *pat, Vector3 origin, Vector3 target, float baseAngle, float late) {
+    float aim = atan2f(target.z - origin.z, target.x - origin.x);
+    for (int k=0; k<pat->ways; k++) {
+        float a;
+        if (pat->kind == PATTERN_AIMED_BURST) {
+            a = aim;
+            if (pat->ways > 1) a += ((float)k / (pat->ways - 1) - 0.5f) * pat->spread;
+        } else {
+            a = baseAngle + k * (2.0f * PI / pat->ways);
+        }
+        float vx = cosf(a) * pat->speed, vz = sinf(a) * pat->speed;
+        SpawnEnemyBullet(origin.x + vx * late, origin.z + vz * late, vx, vz, ENEMY_BULLET_PATTERN_LIFE - late, ENEMY_BULLET_PATTERN);
+    }
+}
+
+// ボスの弾幕。発射間隔がフレームより短くても、1フレームに複数回撃って
+// 遅れた分だけ弾をずらすので、フレームレートに関係なく同じ模様になる。
+void UpdateBossPattern(Enemy *e, Vector3 target, float dt) {
+    int setIdx = current_stage - 1;
+    if (setIdx < 0) setIdx = 0;
+    if (setIdx >= BOSS_PATTERN_SETS) setIdx = BOSS_PATTERN_SETS - 1;
+    const BossPatternSet *set = &boss_pattern_sets[setIdx];
+    const BulletPattern *pat = &set->steps[e->pattern_step % set->count];
+    float interval = pat->interval * (difficulty == MODE_HARD ? 0.7f : 1.0f);
+
+    e->pattern_timer -= dt;
+    int volleys = 0;
+    while (e->pattern_timer <= 0) {
+        if (volleys++ >= ENEMY_BULLET_MAX_VOLLEYS) { e->pattern_timer = interval; break; }
+        FireBulletPattern(pat, e->position, target, e->pattern_angle, -e->pattern_timer);
+        e->pattern_angle += pat->spin;
+        e->pattern_timer += interval;
+    }
+
+    e->pattern_time += dt;
+    if (e->pattern_time >= pat->duration) {
+        e->pattern_time = 0;
+        e->pattern_step++;
+        e->pattern_timer = BOSS_PATTERN_PAUSE;
+    }
+}
+
+void UpdateEnemyBullets(float dt) {
+    EnemyBulletPool *pool = &enemy_bullets;
+    float *x = pool->x, *z = pool->z, *vx = pool->vx, *vz = pool->vz, *life = pool->life;
+    int n = pool->count;
+
+    for (int i=0; i<n; i++) {
+        x[i] += vx[i] * dt;
+        z[i] += vz[i] * dt;
+        life[i] -= dt;
+    }
+
+    // 当たりうるプレイヤーだけを先に集めておく
+    Player *targets[MAX_NET_PLAYERS];
+    float tx[MAX_NET_PLAYERS], tz[MAX_NET_PLAYERS];
+    int targetCount = 0;
+    for (int p=0; p<sim_player_count; p++) {
+        Player *pl = sim_players[p];
+        if (pl->hp <= 0 || pl->invincible_timer > 0 || pl->dash_duration > 0) continue;
+        targets[targetCount] = pl;
+        tx[targetCount] = pl->position.x;
+        tz[targetCount] = pl->position.z;
+        targetCount++;
+    }
+
+    // 地形は弾の高さの1層だけ見る。セル座標は負を先に弾いて切り捨てで求める（floorf を呼ばない）
+    const float invVoxel = 1.0f / VOXEL_SIZE;
+    const int layer = (int)(ENEMY_BULLET_Y / VOXEL_SIZE) * ARENA_CELLS * ARENA_CELLS;
+    for (int i=0; i<n; ) {
+        bool dead = life[i] <= 0;
+        float fx = (x[i] + ARENA_HALF) * invVoxel, fz = (z[i] + ARENA_HALF) * invVoxel;
+        bool inside = fx >= 0 && fz >= 0 && fx < ARENA_CELLS && fz < ARENA_CELLS;
+        int cell = inside ? layer + (int)fz * ARENA_CELLS + (int)fx : 0;
+        if (!dead && inside && ((arena_occupancy[cell >> 6] >> (cell & 63)) & 1)) {
+            // 狙い撃ちの弾だけ遮蔽物を削る（弾幕で地形が溶けないように）
+            if (pool->style[i] == ENEMY_BULLET_SHOT) {
+                Vector3 pos = { x[i], ENEMY_BULLET_Y, z[i] };
+                ArenaHitBlock(pos);
+                SpawnExplosion(pos, LIGHTGRAY, 2);
+            }
+            dead = true;
+        }
+        if (!dead) {
+            float r2 = enemy_bullet_hit_r2[pool->style[i]];
+            for (int t=0; t<targetCount; t++) {
+                float dx = x[i] - tx[t], dz = z[i] - tz[t];
+                if (dx*dx + dz*dz >= r2) continue;
+                Player *pl = targets[t];
+                pl->hp -= 10;
+                pl->invincible_timer = 0.5f;
+                TelemetryEmit(TELEMETRY_DAMAGE, pl, TELEMETRY_DAMAGE_SHOT, pl->position, 10, pl->hp);
+                SpawnExplosion(pl->position, COL_NEON_PINK, 15);
+                AddScreenShake(0.8f);
+                if (AllPlayersDown()) current_state = STATE_GAMEOVER;
+                // 無敵になったので以降の弾とは判定しない
+                targetCount--;
+                targets[t] = targets[targetCount]; tx[t] = tx[targetCount]; tz[t] = tz[targetCount];
+                dead = true;
+                break;
+            }
+        }
+        if (!dead) { i++; continue; }
+        n--;
+        x[i] = x[n]; z[i] = z[n]; vx[i] = vx[n]; vz[i] = vz[n]; life[i] = life[n];
+        pool->style[i] = pool->style[n]; pool->serial[i] = pool->serial[n];
+    }
+    pool->count = n;
+}
+
+// 描画キューの加算合成のパスから呼ぶ。数が多いので球は低ポリゴンで描く
+void DrawEnemyBullets() {
+    const EnemyBulletPool *pool = &enemy_bullets;
+    for (int i=0; i<pool->count; i++) {
+        Vector3 pos = { pool->x[i], ENEMY_BULLET_Y, pool->z[i] };
+        float size = enemy_bullet_size[pool->style[i]];
+        DrawSphereEx(pos, size, 4, 8, COL_NEON_PINK);
+        DrawSphereEx(pos, size * 0.5f, 3, 6, WHITE);
+    }
+}
+
+// 武器
+// レールとレーザーは弾を飛ばさず、その場でレイと敵の当たり箱の交差を求める。
+// 当たり箱は敵の更新ループで作ったものを一様グリッド（CSR 形式）に入れておき、
+// レイが通るセルだけを DDA でたどって調べる。地形も同じ DDA でボクセルをたどる。
+
+bool WeaponUnlocked(const Player *p, int weapon) {
+    return weapon >= 0 && weapon < WEAPON_COUNT && p->level >= weapon_unlock_level[weapon];
+}
+
+BoundingBox EnemyHitbox(const Enemy *e) {
+    return EnemyBox(e->position, (e->type == ENEMY_BOSS) ? 2.5f : 1.0f);
+}
+
+BoundingBox EnemyBox(Vector3 pos, float hitSize) {
+    return (BoundingBox){
+        (Vector3){ pos.x - hitSize, 0, pos.z - hitSize },
+        (Vector3){ pos.x + hitSize, hitSize * 2.5f, pos.z + hitSize }
+    };
+}
+
+int HitGridCoord(float v) {
+    int c = (int)floorf((v + ARENA_HALF) / HIT_GRID_CELL);
+    return (c < 0) ? 0 : (c >= HIT_GRID_DIM ? HIT_GRID_DIM - 1 : c);
+}
+
+// 接地している敵の当たり箱をセルごとに並べ直す（数え上げ → 累積和 → 詰める）。
+// グリッドはアリーナと同じ範囲なので、探索モードで遠くにいる敵は HIT_GRID_OUTSIDE にまとめる
+void EnemyHitGridBuild() {
+    EnemyHitGrid *g = &enemy_hit_grid;
+    static int fill[HIT_GRID_OUTSIDE + 1];
+    memset(g->cell_start, 0, sizeof(g->cell_start));
+    for (int pass=0; pass<2; pass++) {
+        for (int i=0; i<enemy_slots; i++) {
+            if (!enemies[i].active || !enemies[i].is_grounded) continue;
+            if (pass == 0) g->boxes[i] = EnemyHitbox(&enemies[i]);
+            const BoundingBox *b = &g->boxes[i];
+            if (b->min.x < -ARENA_HALF || b->min.z < -ARENA_HALF || b->max.x >= ARENA_HALF || b->max.z >= ARENA_HALF) {
+                if (pass == 0) g->cell_start[HIT_GRID_OUTSIDE + 1]++;
+                else g->refs[fill[HIT_GRID_OUTSIDE]++] = (uint16_t)i;
+                continue;
+            }
+            int x0 = HitGridCoord(g->boxes[i].min.x), x1 = HitGridCoord(g->boxes[i].max.x);
+            int z0 = HitGridCoord(g->boxes[i].min.z), z1 = HitGridCoord(g->boxes[i].max.z);
+            for (int cz=z0; cz<=z1; cz++) {
+                for (int cx=x0; cx<=x1; cx++) {
+                    int cell = cz * HIT_GRID_DIM + cx;
+                    if (pass == 0) g->cell_start[cell + 1]++;
+                    else g->refs[fill[cell]++] = (uint16_t)i;
+                }
+            }
+        }
+        if (pass == 0) {
+            for (int c=0; c<=HIT_GRID_OUTSIDE; c++) {
+                g->cell_start[c + 1] += g->cell_start[c];
+                fill[c] = g->cell_start[c];
+            }
+        }
+    }
+    g->ref_count = g->cell_start[HIT_GRID_OUTSIDE + 1];
+}
+
+// XZ 平面でのレイと箱の交差（スラブ法）。inv は方向の逆数
+bool RayHitsBox2D(Vector3 origin, float invX, float invZ, BoundingBox box, float maxT, float *tHit) {
+    float tx1 = (box.min.x - origin.x) * invX, tx2 = (box.max.x - origin.x) * invX;
+    float tz1 = (box.min.z - origin.z) * invZ, tz2 = (box.max.z - origin.z) * invZ;
+    float tmin = fmaxf(fminf(tx1, tx2), fminf(tz1, tz2));
+    float tmax = fminf(fmaxf(tx1, tx2), fmaxf(tz1, tz2));
+    if (tmax < 0 || tmin > tmax || tmin > maxT) return false;
+    *tHit = (tmin > 0) ? tmin : 0;
+    return true;
+}
+
+// アリーナと同じ原点を持つ正方グリッドを、レイが通る順にセル単位でたどる
+void GridWalkBegin(GridWalk *w, Vector3 origin, Vector3 dir, float cellSize, int dim) {
+    w->dim = dim;
+    w->cx = (int)floorf((origin.x + ARENA_HALF) / cellSize);
+    w->cz = (int)floorf((origin.z + ARENA_HALF) / cellSize);
+    w->stepX = (dir.x > 0) ? 1 : -1;
+    w->stepZ = (dir.z > 0) ? 1 : -1;
+    float invX = (dir.x != 0) ? 1.0f / dir.x : 1e30f, invZ = (dir.z != 0) ? 1.0f / dir.z : 1e30f;
+    float nextX = (w->cx + (dir.x > 0 ? 1 : 0)) * cellSize - ARENA_HALF;
+    float nextZ = (w->cz + (dir.z > 0 ? 1 : 0)) * cellSize - ARENA_HALF;
+    w->tMaxX = (dir.x != 0) ? (nextX - origin.x) * invX : 1e30f;
+    w->tMaxZ = (dir.z != 0) ? (nextZ - origin.z) * invZ : 1e30f;
+    w->tDeltaX = fabsf(cellSize * invX);
+    w->tDeltaZ = fabsf(cellSize * invZ);
+    w->t = 0;
+}
+
+bool GridWalkInside(const GridWalk *w) {
+    return w->cx >= 0 && w->cz >= 0 && w->cx < w->dim && w->cz < w->dim;
+}
+
+void GridWalkStep(GridWalk *w) {
+    if (w->tMaxX < w->tMaxZ) { w->t = w->tMaxX; w->tMaxX += w->tDeltaX; w->cx += w->stepX; }
+    else { w->t = w->tMaxZ; w->tMaxZ += w->tDeltaZ; w->cz += w->stepZ; }
+}
+
+// 弾の高さの層で、最初に当たる壁までの距離。壁がなければ maxDist（*cell = -1）
+float ArenaRayDistance(Vector3 origin, Vector3 dir, float maxDist, int *cell) {
+    const int layer = (int)(ENEMY_BULLET_Y / VOXEL_SIZE);
+    GridWalk w;
+    GridWalkBegin(&w, origin, dir, VOXEL_SIZE, ARENA_CELLS);
+    *cell = -1;
+    while (w.t <= maxDist && GridWalkInside(&w)) {
+        if (ArenaSolidCell(w.cx, layer, w.cz)) {
+            *cell = ArenaIndex(w.cx, layer, w.cz);
+            return w.t;
+        }
+        GridWalkStep(&w);
+    }
+    return maxDist;
+}
+
+// レイに当たる敵を集める。firstOnly なら一番手前の1体だけを返す
+int EnemyRayQuery(Vector3 origin, Vector3 dir, float maxDist, bool firstOnly, RayHit *hits, int maxHits) {
+    EnemyHitGrid *g = &enemy_hit_grid;
+    float invX = (dir.x != 0) ? 1.0f / dir.x : 1e30f, invZ = (dir.z != 0) ? 1.0f / dir.z : 1e30f;
+    float best = maxDist;
+    int n = 0;
+    g->query++;
+
+    GridWalk w;
+    GridWalkBegin(&w, origin, dir, HIT_GRID_CELL, HIT_GRID_DIM);
+    // たどり終えたら、最後にグリッドの外の敵をまとめて調べる（ふだんは空）
+    bool outside = false;
+    while (!outside) {
+        int cell = HIT_GRID_OUTSIDE;
+        if (w.t <= best && GridWalkInside(&w)) {
+            cell = w.cz * HIT_GRID_DIM + w.cx;
+            GridWalkStep(&w);
+        } else outside = true;
+        for (int k=g->cell_start[cell]; k<g->cell_start[cell + 1]; k++) {
+            int e = g->refs[k];
+            if (g->stamp[e] == g->query) continue;
+            g->stamp[e] = g->query;
+            if (!enemies[e].active) continue;
+            float t;
+            if (!RayHitsBox2D(origin, invX, invZ, g->boxes[e], maxDist, &t)) continue;
+            if (firstOnly) {
+                if (t < best || n == 0) { best = t; hits[0] = (RayHit){ e, t }; n = 1; }
+            } else if (n < maxHits) hits[n++] = (RayHit){ e, t };
+        }
+    }
+    return n;
+}
+
+// 敵にダメージを与える（弾・レール・レーザー共通）。倒したら true
+bool DamageEnemy(int i, int damage, Vector3 push, Vector3 hitPos) {
+    Enemy *e = &enemies[i];
+    if (!e->active) return false;
+    e->hp -= damage;
+    e->flash_timer = 0.1f;
+    if (e->type != ENEMY_BOSS) e->knockback = Vector3Add(e->knockback, push);
+    SpawnExplosion(hitPos, COL_NEON_CYAN, 3);
+    SpawnDamageNumber(i, damage, hitPos);
+    if (e->hp > 0) return false;
+
+    e->active = false;
+    AddKillFeed(e->type);
+    TelemetryEmit(TELEMETRY_KILL, NULL, e->type, e->position, damage, 0);
+    SpawnExplosion(e->position, e->type == ENEMY_TANK ? COL_NEON_PURPLE : COL_NEON_ORANGE, 20);
+    AddScreenShake(0.3f);
+    if (e->type == ENEMY_BOSS) {
+        TelemetryEmit(TELEMETRY_BOSS_KILL, NULL, e->type, e->position, (int)((game_time - boss_spawn_time) * 1000.0f), 0);
+        TelemetryEmit(TELEMETRY_STAGE_CLEAR, NULL, 0, e->position, (int)((game_time - stage_start_time) * 1000.0f), 0);
+        boss_spawned = false;
+        current_state = STATE_STAGE_CLEAR;
+        state_timer = 0;
+        AddScreenShake(2.0f);
+    } else {
+        stage_kills++;
+        if (SimRandom(0, 100) < 50) SpawnItem(e->position);
+    }
+    return true;
+}
+
+// レールとレーザーの発射。ビームの長さを返す
+float FireRay(Vector3 origin, Vector3 dir, float range, bool pierce, int damage, float push) {
+    origin.y = ENEMY_BULLET_Y;
+    int cell;
+    float wall = ArenaRayDistance(origin, dir, range, &cell);
+    RayHit hits[MAX_RAY_HITS];
+    int n = EnemyRayQuery(origin, dir, wall, !pierce, hits, MAX_RAY_HITS);
+    for (int k=0; k<n; k++) {
+        DamageEnemy(hits[k].enemy, damage, Vector3Scale(dir, push), Vector3Add(origin, Vector3Scale(dir, hits[k].t)));
+    }
+    if (!pierce && n > 0) return hits[0].t;
+    if (cell >= 0) ArenaHitBlock(Vector3Add(origin, Vector3Scale(dir, wall + 0.01f)));
+    return wall;
+}
+
+void FireWeapon(int idx, Vector3 aim_dir) {
+    Player *p = sim_players[idx];
+    float cooldown = 0.15f;
+    if (p->level > 5) cooldown = 0.12f;
+    if (p->level > 10) cooldown = 0.08f;
+
+    switch (p->weapon_type) {
+        case WEAPON_SPREAD:
+            for (int k=-2; k<=2; k++) {
+                float a = k * 0.15f;
+                Vector3 d = { aim_dir.x * cosf(a) - aim_dir.z * sinf(a), 0, aim_dir.x * sinf(a) + aim_dir.z * cosf(a) };
+                int b = SpawnBullet(p->position, d, false);
+                if (b >= 0) bullets[b].owner = idx;
+            }
+            p->shoot_cooldown = cooldown * 2.5f;
+            AddScreenShake(0.15f);
+            break;
+        case WEAPON_RAIL:
+            p->beam_length = FireRay(p->position, aim_dir, RAIL_RANGE, true, p->damage * 3, 25.0f);
+            p->beam_timer = 0.15f;
+            p->shoot_cooldown = 0.8f;
+            AddScreenShake(0.4f);
+            break;
+        case WEAPON_LASER:
+            p->beam_length = FireRay(p->position, aim_dir, LASER_RANGE, false, p->damage / 2 + 1, 3.0f);
+            p->beam_timer = 0.06f;
+            p->shoot_cooldown = 0.05f;
+            break;
+        default: {
+            int b = SpawnBullet(p->position, aim_dir, false);
+            if (b >= 0) bullets[b].owner = idx;
+            p->shoot_cooldown = cooldown;
+            AddScreenShake(0.1f);
+            break;
+        }
+    }
+}
+
+// 加算合成のパスに積む。向きは facing_angle から求める（ネット越しでも同じ）
+void PushPlayerBeam(const Player *p, Color color) {
+    if (p->beam_timer <= 0 || p->beam_length <= 0) return;
+    Vector3 dir = { sinf(p->facing_angle), 0, cosf(p->facing_angle) };
+    Vector3 start = { p->position.x, ENEMY_BULLET_Y, p->position.z };
+    Vector3 end = Vector3Add(start, Vector3Scale(dir, p->beam_length));
+    float width = (p->weapon_type == WEAPON_RAIL) ? 0.3f * (p->beam_timer / 0.15f) + 0.05f : 0.2f;
+    RenderPush(RENDER_PASS_ADDITIVE, RENDER_MAT_SHAPES, &(RenderCommand){ .a = start, .b = end, .color = color, .param = width, .type = RENDER_CMD_BEAM });
+}
+
+// 敵の種類別カーネル
+// 敵は種類ごとにプールの連続した範囲へ置き（EnemyBucket）、更新と描画は種類ごとに別の関数で回す。
+// 関数はマクロのひな形から作り、種類で違うところ（当たりの大きさ・撃ち方・ノックバック・色）は
+// 引数の定数で渡す。展開したループの中には種類の分岐が残らず、同じ種類の敵だけが続けて並ぶ。
+
+// 範囲を今の中身から作り直す（ドローンは最後のドローンの次まで、タンクは最初のタンクから）
+void EnemyBucketsRebuild() {
+    int droneEnd = 0, tankStart = enemy_capacity;
+    for (int i=0; i<enemy_capacity; i++) {
+        if (!enemies[i].active) continue;
+        if (enemies[i].type == ENEMY_DRONE) droneEnd = i + 1;
+        else if (tankStart == enemy_capacity) tankStart = i;
+    }
+    enemy_buckets[ENEMY_DRONE] = (EnemyBucket){ 0, droneEnd };
+    enemy_buckets[ENEMY_TANK] = (EnemyBucket){ tankStart, enemy_capacity };
+    enemy_buckets[ENEMY_BOSS] = (EnemyBucket){ enemy_capacity, enemy_slots };
+}
+
+// 種類の範囲の空きを返す（ドローンは一番前、タンクは一番後ろ）。範囲が相手とぶつかっていて
+// 自分の側に空きがなければ -1（相手の範囲の空きは使わない）。
+// 敵は出てから倒れるまで同じ枠にいる（当たり判定のグリッド・ダメージ数字・ネットの ID が枠の番号を使う）。
+// 選ぶ枠はプールの中身だけで決まるので、リプレイで状態を戻したあとも同じ枠になる
+int AllocEnemySlot(EnemyType type) {
+    if (type != ENEMY_BOSS) EnemyBucketsRebuild();
+    return TakeEnemySlot(type);
+}
+
+// 範囲を作り直さずに空きを返す。enemy_buckets が今の中身と合っているときだけ使う
+// （返す枠に合わせて範囲を広げるので、続けて呼んでも合ったまま）
+int TakeEnemySlot(EnemyType type) {
+    if (type == ENEMY_BOSS) {
+        for (int i=enemy_capacity; i<enemy_slots; i++) if (!enemies[i].active) return i;
+        return -1;
+    }
+    EnemyBucket *drones = &enemy_buckets[ENEMY_DRONE], *tanks = &enemy_buckets[ENEMY_TANK];
+    if (type == ENEMY_DRONE) {
+        for (int i=0; i<tanks->start; i++) {
+            if (enemies[i].active) continue;
+            if (i >= drones->end) drones->end = i + 1;
+            return i;
+        }
+    } else {
+        for (int i=enemy_capacity-1; i>=drones->end; i--) {
+            if (enemies[i].active) continue;
+            if (i < tanks->start) tanks->start = i;
+            return i;
+        }
+    }
+    return -1;
+}
+
+void UpdateEnemies(float dt) {
+    EnemyBucketsRebuild();
+    UpdateDrones(enemy_buckets[ENEMY_DRONE].start, enemy_buckets[ENEMY_DRONE].end, dt);
+    UpdateTanks(enemy_buckets[ENEMY_TANK].start, enemy_buckets[ENEMY_TANK].end, dt);
+    UpdateBosses(enemy_buckets[ENEMY_BOSS].start, enemy_buckets[ENEMY_BOSS].end, dt);
+}
+
+// 撃ち方
+#define ENEMY_SHOOT_NONE 0
+#define ENEMY_SHOOT_AIMED 1     // ハードのとき、射程内なら自機狙いの単発
+#define ENEMY_SHOOT_PATTERN 2   // ボスの弾幕パターン
+
+// 更新カーネルのひな形（KNOCKBACK が 0 の種類はノックバックを受けない）
+#define DEFINE_ENEMY_UPDATE(NAME, HIT_SIZE, SHOOT, KNOCKBACK) \
+void NAME(int start, int end, float dt) { \
+    for (int i=start; i<end; i++) { \
+        Enemy *e = &enemies[i]; \
+        if (!e->active) continue; \
+        if (!e->is_grounded) { \
+            e->vertical_speed -= 40.0f * dt; \
+            e->position.y += e->vertical_speed * dt; \
+            if (e->position.y > 0) continue; \
+            e->position.y = 0; \
+            e->is_grounded = true; \
+            SpawnExplosion(e->position, LIGHTGRAY, 5); \
+        } \
+        /* 一番近い生存プレイヤーを追う */ \
+        Player *target = NearestAlivePlayer(e->position); \
+        if (!target) target = sim_players[0]; \
+        Vector3 to_player = Vector3Subtract(target->position, e->position); \
+        float dist = Vector3Length(to_player); \
+        to_player = Vector3Normalize(to_player); \
+        e->anim_timer += dt; \
+        if (dist > 1.5f) { \
+            Vector3 move = Vector3Scale(to_player, e->speed * dt); \
+            if (KNOCKBACK) move = Vector3Add(move, Vector3Scale(e->knockback, dt)); \
+            e->position = ArenaMove(e->position, move, (HIT_SIZE)); \
+        } \
+        if (KNOCKBACK) e->knockback = Vector3Scale(e->knockback, 0.85f); \
+        if (e->flash_timer > 0) e->flash_timer -= dt; \
+        if (e->shoot_cooldown > 0) e->shoot_cooldown -= dt; \
+        if ((SHOOT) == ENEMY_SHOOT_PATTERN) UpdateBossPattern(e, target->position, dt); \
+        if ((SHOOT) == ENEMY_SHOOT_AIMED && difficulty == MODE_HARD && e->shoot_cooldown <= 0 && dist < e->attack_range) { \
+            SpawnEnemyBullet(e->position.x, e->position.z, to_player.x * 20.0f, to_player.z * 20.0f, 2.0f, ENEMY_BULLET_SHOT); \
+            e->shoot_cooldown = 2.5f; \
+        } \
+        if (dist < 1.5f && target->hp > 0 && target->dash_duration <= 0 && target->invincible_timer <= 0) { \
+            target->hp -= 5; \
+            target->invincible_timer = 0.5f; \
+            TelemetryEmit(TELEMETRY_DAMAGE, target, TELEMETRY_DAMAGE_CONTACT, target->position, 5, target->hp); \
+            AddScreenShake(0.5f); \
+            if (AllPlayersDown()) current_state = STATE_GAMEOVER; \
+        } \
+        /* プレイヤーの弾との当たり判定 */ \
+        BoundingBox box = EnemyBox(e->position, (HIT_SIZE)); \
+        for (int b=0; b<bullet_capacity; b++) { \
+            if (!bullets[b].active) continue; \
+            if (!CheckCollisionBoxSphere(box, bullets[b].position, 0.5f)) continue; \
+            bullets[b].active = false; \
+            int owner = (bullets[b].owner < sim_player_count) ? bullets[b].owner : 0; \
+            Vector3 push = Vector3Scale(Vector3Normalize(bullets[b].velocity), 15.0f); \
+            if (DamageEnemy(i, sim_players[owner]->damage, push, bullets[b].position)) break; \
+        } \
+    } \
+}
+
+DEFINE_ENEMY_UPDATE(UpdateDrones, 1.0f, ENEMY_SHOOT_NONE, 1)
+DEFINE_ENEMY_UPDATE(UpdateTanks, 1.0f, ENEMY_SHOOT_AIMED, 1)
+DEFINE_ENEMY_UPDATE(UpdateBosses, 2.5f, ENEMY_SHOOT_PATTERN, 0)
+
+// 描画カーネルのひな形。描画キューに積む。transforms があればインスタンス描画用に行列を並べて
+// 数を返し（メカ本体はまとめて1つのコマンドにする）、なければ1体ずつのコマンドにする
+#define DEFINE_ENEMY_DRAW(NAME, TYPE, COLOR, BAR_WIDTH, BAR_HEIGHT) \
+int NAME(int start, int end, Matrix *transforms) { \
+    int count = 0; \
+    for (int i=start; i<end; i++) { \
+        const Enemy *e = &enemies[i]; \
+        if (!e->active) continue; \
+        Color c = (e->flash_timer > 0) ? WHITE : (COLOR); \
+        if (transforms) { \
+            transforms[count++] = MechaInstanceTransform(e->position, 0, c, e->anim_timer); \
+            RenderPush(RENDER_PASS_ALPHA, RENDER_MAT_SHAPES, &(RenderCommand){ .a = e->position, .type = RENDER_CMD_SHADOW, .sub = (TYPE) }); \
+        } else { \
+            RenderPushMecha(e->position, 0, c, e->anim_timer, (TYPE)); \
+        } \
+        if (!e->is_grounded || e->hp < e->max_hp) PushEnemyMarkers(e, (BAR_WIDTH), (BAR_HEIGHT)); \
+    } \
+    return count; \
+}
+
+DEFINE_ENEMY_DRAW(DrawDrones, ENEMY_DRONE, COL_NEON_PINK, 2.0f, 3.0f)
+DEFINE_ENEMY_DRAW(DrawTanks, ENEMY_TANK, COL_NEON_PURPLE, 2.0f, 3.0f)
+DEFINE_ENEMY_DRAW(DrawBosses, ENEMY_BOSS, COL_NEON_ORANGE, 6.0f, 7.0f)
+
+// 落下中の着地点（半透明）と、減っている HP のバー（不透明）
+void PushEnemyMarkers(const Enemy *e, float barWidth, float barHeight) {
+    if (!e->is_grounded) {
+        RenderPush(RENDER_PASS_ALPHA, RENDER_MAT_SHAPES, &(RenderCommand){ .a = e->position, .type = RENDER_CMD_DROP_MARKER });
+    }
+    if (e->hp < e->max_hp) {
+        Vector3 hpPos = e->position;
+        hpPos.y += barHeight;
+        float ratio = (float)e->hp / (float)e->max_hp;
+        if(ratio < 0) ratio = 0;
+        RenderPush(RENDER_PASS_OPAQUE, RENDER_MAT_SHAPES, &(RenderCommand){ .a = hpPos, .b = { barWidth, 0, 0 }, .param = ratio, .type = RENDER_CMD_HP_BAR });
+    }
+}
+
+// 弾・アイテム・敵・エフェクトの更新（ローカル・サーバー共通）
+void UpdateWorld(float dt) {
+    // ヒット判定
+    for (int i=0; i<bullet_capacity; i++) {
+        if (!bullets[i].active) continue;
+        bullets[i].position = Vector3Add(bullets[i].position, Vector3Scale(bullets[i].velocity, dt));
+        bullets[i].life_time -= dt;
+
+        if (bullets[i].life_time <= 0) { 
+            bullets[i].active = false;
+            continue;
+        }
+        if (ArenaHitBlock(bullets[i].position)) {
+            bullets[i].active = false;
+            SpawnExplosion(bullets[i].position, LIGHTGRAY, 2);
+            continue;
+        }
+    }
+    UpdateEnemyBullets(dt);
+
+    // アイテム取得
+    for (int i=0; i<item_capacity; i++) {
+        if (!items[i].active) continue;
+        items[i].angle += dt * 90.0f;
+        items[i].life_time -= dt;
+        if (items[i].life_time <= 0) items[i].active = false;
+        for (int p=0; p<sim_player_count; p++) {
+            Player *pl = sim_players[p];
+            if (pl->hp <= 0) continue;
+            if (Vector3Distance(pl->position, items[i].position) >= 3.0f) continue;
+            TelemetryEmit(TELEMETRY_PICKUP, pl, items[i].type == ITEM_HEAL ? 1 : 0, items[i].position, 0, 0);
+            if (items[i].type == ITEM_HEAL) {
+                pl->hp += 30;
+                if(pl->hp > pl->max_hp) pl->hp = pl->max_hp;
+                SpawnExplosion(pl->position, COL_NEON_GREEN, 10);
+            } 
+            else if (items[i].type == ITEM_EXP) {
+                pl->exp += 1;
+                
+                if (pl->exp >= pl->next_level_exp) {
+                    pl->level++;
+                    pl->exp = 0;
+                    pl->next_level_exp += 5; 
+                    pl->max_hp += 10;
+                    pl->hp = pl->max_hp;
+                    pl->damage += 5;
+                    // 新しい武器が解放されたら持ち替える
+                    for (int w=0; w<WEAPON_COUNT; w++) if (pl->level == weapon_unlock_level[w]) pl->weapon_type = w;
+                    TelemetryEmit(TELEMETRY_LEVEL_UP, pl, pl->weapon_type, pl->position, pl->level, 0);
+                    
+                    SpawnExplosion(pl->position, GOLD, 20);
+                }
+                SpawnExplosion(pl->position, COL_NEON_CYAN, 5);
+            }
+            if (roam_mode && items[i].sector) RoamPickupTaken(&items[i]);
+            items[i].active = false;
+            break;
+        }
+    }
+
+    // 敵のスポーン（このティックのレール・レーザーでボスを倒してステージクリアになっていれば出さない）
+    if (!boss_spawned && current_state == STATE_PLAYING) {
+        if (stage_kills >= kills_required_for_boss) {
+            current_state = STATE_BOSS_INTRO;
+            state_timer = 0.0f;
+            for(int i=0; i<enemy_slots; i++) if(enemies[i].active) {
+                enemies[i].hp = 0;
+                SpawnExplosion(enemies[i].position, COL_NEON_ORANGE, 5);
+                enemies[i].active = false;
+            }
+        } else {
+            enemy_spawn_timer += dt;
+            float spawnInterval = 0.5f - (current_stage * 0.05f);
+            if (spawnInterval < 0.1f) spawnInterval = 0.1f;
+            if (difficulty == MODE_HARD) spawnInterval *= 0.7f;
+
+            if (enemy_spawn_timer > spawnInterval) {
+                SpawnEnemy(false);
+                enemy_spawn_timer = 0.0f;
+            }
+        }
+    }
+
+    // 敵の制御（種類ごとのカーネル）
+    UpdateEnemies(dt);
+    // 次のティックのレール・レーザー用に当たり箱をグリッドへ
+    EnemyHitGridBuild();
+    UpdateHudEvents(dt);
+    for(int i=0; i<particle_capacity; i++){
+        if(!particles[i].active) continue;
+        particles[i].position = Vector3Add(particles[i].position, Vector3Scale(particles[i].velocity, dt));
+        particles[i].life -= dt;
+        if(particles[i].life <= 0) particles[i].active = false;
+    }
+}
+
+// ２人対戦
+void UpdateGamePvP() {
+    float dt = FrameDelta();
+    if (current_state == STATE_PVP_RESULT) {
+        if (IsKeyPressed(KEY_R)) {
+            current_state = STATE_TITLE;
+            camera_angle_rad = 0.0f;
+        }
+        return;
+    }
+
+    PlayerInput input[2] = { ReadPvPInput(0), ReadPvPInput(1) };
+    StepPvP(dt, input);
+    UpdatePvPCameras();
+}
+
+// 対戦の入力。移動はワールド座標のまま（視点は回らない）。
+// P1 の照準は左画面のマウス位置、P2 はオートエイムなので照準を持たない
+PlayerInput ReadPvPInput(int idx) {
+    PlayerInput in = { 0 };
+    if (idx == 0) {
+        if (IsKeyDown(KEY_W)) in.move_z -= 1; if (IsKeyDown(KEY_S)) in.move_z += 1;
+        if (IsKeyDown(KEY_A)) in.move_x -= 1; if (IsKeyDown(KEY_D)) in.move_x += 1;
+        in.dash = IsKeyPressed(KEY_SPACE);
+        in.fire = IsMouseButtonDown(MOUSE_LEFT_BUTTON);
+
+        Vector2 mousePos = GetMousePosition();
+        float screenW = (float)GetScreenWidth();
+        if (mousePos.x > screenW / 2.0f) mousePos.x = screenW / 2.0f;
+        mousePos.x *= 2.0f;
+        in.aim_point = GetGroundAimPoint(mousePos, camera);
+    } else {
+        if (IsKeyDown(KEY_UP)) in.move_z -= 1; if (IsKeyDown(KEY_DOWN)) in.move_z += 1;
+        if (IsKeyDown(KEY_LEFT)) in.move_x -= 1; if (IsKeyDown(KEY_RIGHT)) in.move_x += 1;
+        in.dash = IsKeyPressed(KEY_ENTER);
+        in.fire = IsKeyDown(KEY_RIGHT_SHIFT);
+    }
+    return in;
+}
+
+// 対戦のプレイヤー1人分（1人用の ApplyPlayerInput とは武器・ダッシュの扱いが違う）
+void ApplyPvPInput(Player *p, const PlayerInput *in, Vector3 aim, Vector3 defaultDash, bool isP2, float dt) {
+    UpdateTrail(p);
+    if (p->invincible_timer > 0) p->invincible_timer -= dt;
+    Vector3 move = { in->move_x, 0, in->move_z };
+    if (in->dash && p->dash_cooldown <= 0) {
+        p->dash_duration = 0.2f; p->dash_cooldown = 1.5f;
+        if (Vector3Length(move) > 0) p->dash_dir = Vector3Normalize(move);
+        else p->dash_dir = defaultDash;
+        AddScreenShake(0.2f);
+    }
+    if (p->dash_duration > 0) {
+        p->dash_duration -= dt;
+        p->position = ArenaMove(p->position, Vector3Scale(p->dash_dir, p->speed * 3.0f * dt), PLAYER_RADIUS);
+    } else {
+        if (Vector3Length(move) > 0) {
+            move = Vector3Normalize(move);
+            p->position = ArenaMove(p->position, Vector3Scale(move, p->speed * dt), PLAYER_RADIUS);
+            p->walk_anim_timer += dt;
+        } else p->walk_anim_timer = 0;
+    }
+    if (p->dash_cooldown > 0) p->dash_cooldown -= dt;
+
+    Vector3 d = Vector3Subtract(aim, p->position);
+    d.y = 0;
+    p->facing_angle = -atan2f(d.z, d.x) + PI/2;
+    if (p->shoot_cooldown > 0) p->shoot_cooldown -= dt;
+    if (in->fire && p->shoot_cooldown <= 0) {
+        SpawnBullet(p->position, Vector3Normalize(d), isP2);
+        p->shoot_cooldown = 0.3f;
+    }
+}
+
+// 対戦の1ティック分
+void StepPvP(float dt, const PlayerInput input[2]) {
+    WorldHashTick();
+    ReplayRecordTick(dt, &input[0], &input[1]);
+    ApplyPvPInput(&player, &input[0], input[0].aim_point, (Vector3){0, 0, -1}, false, dt);
+    // P2 は（動いた後の）P1 を狙う
+    ApplyPvPInput(&player2, &input[1], player.position, (Vector3){0, 0, 1}, true, dt);
+
+    for (int i=0; i<bullet_capacity; i++) {
+        if (!bullets[i].active) continue;
+        bullets[i].position = Vector3Add(bullets[i].position, Vector3Scale(bullets[i].velocity, dt));
+        bullets[i].life_time -= dt;
+        if (bullets[i].life_time <= 0) { bullets[i].active = false; continue; }
+        if (ArenaHitBlock(bullets[i].position)) {
+            bullets[i].active = false;
+            SpawnExplosion(bullets[i].position, LIGHTGRAY, 2);
+            continue;
+        }
+
+        Vector3 p1Center = {player.position.x, 1, player.position.z};
+        Vector3 p2Center = {player2.position.x, 1, player2.position.z};
+
+        if (current_state == STATE_PVP_RESULT) continue;
+
+        if (bullets[i].is_p2_bullet && player.invincible_timer <= 0 && player.dash_duration <= 0) {
+            if (Vector3Distance(bullets[i].position, p1Center) < 2.0f) {
+                player.hp -= 5; player.invincible_timer = 0.5f;
+                bullets[i].active = false;
+                SpawnExplosion(player.position, COL_NEON_PINK, 10);
+                AddScreenShake(0.5f);
+                TelemetryEmit(TELEMETRY_DAMAGE, &player, TELEMETRY_DAMAGE_PVP, player.position, 5, player.hp);
+                if (player.hp <= 0) {
+                    current_state = STATE_PVP_RESULT; winner_id = 2;
+                    TelemetryEmit(TELEMETRY_MATCH_END, &player2, 1, player2.position, (int)((game_time - match_start_time) * 1000.0f), current_stage);
+                }
+            }
+        }
+        else if (!bullets[i].is_p2_bullet && player2.invincible_timer <= 0 && player2.dash_duration <= 0) {
+            if (Vector3Distance(bullets[i].position, p2Center) < 2.0f) {
+                player2.hp -= 5; player2.invincible_timer = 0.5f;
+                bullets[i].active = false;
+                SpawnExplosion(player2.position, COL_NEON_PINK, 10);
+                AddScreenShake(0.5f);
+                TelemetryEmit(TELEMETRY_DAMAGE, &player2, TELEMETRY_DAMAGE_PVP, player2.position, 5, player2.hp);
+                if (player2.hp <= 0) {
+                    current_state = STATE_PVP_RESULT; winner_id = 1;
+                    TelemetryEmit(TELEMETRY_MATCH_END, &player, 1, player.position, (int)((game_time - match_start_time) * 1000.0f), current_stage);
+                }
+            }
+        }
+    }
+    for(int i=0; i<particle_capacity; i++){
+        if(!particles[i].active) continue;
+        particles[i].position = Vector3Add(particles[i].position, Vector3Scale(particles[i].velocity, dt));
+        particles[i].life -= dt;
+        if(particles[i].life <= 0) particles[i].active = false;
+    }
+}
+
+// 対戦のカメラ（見た目だけなのでリプレイの再生でもここで動かす）
+void UpdatePvPCameras() {
+    Vector3 p1CamBase = Vector3Add(player.position, (Vector3){0, 20, 15});
+    Vector3 p2CamBase = Vector3Add(player2.position, (Vector3){0, 20, 15});
+    float shakeX = (float)GetRandomValue(-10, 10) * 0.05f * screen_shake;
+    float shakeZ = (float)GetRandomValue(-10, 10) * 0.05f * screen_shake;
+    camera.target = player.position;
+    camera.position = Vector3Add(p1CamBase, (Vector3){shakeX, 0, shakeZ});
+    camera2.target = player2.position;
+    camera2.position = Vector3Add(p2CamBase, (Vector3){shakeX, 0, shakeZ});
+}
+
+// HUD
+// 文字列を毎フレーム作って1文字ずつ描く代わりに、ウィジェットごとに描いた絵を1枚の
+// アトラス（RenderTexture）に持っておき、HudSet で渡した値が変わったときだけその区画を
+// 描き直す。画面にはアトラスから四角を貼るだけなので、同じテクスチャの描画として
+// 1回にまとまる。ダメージ数字は 0〜9 を1度だけ描いておき、桁ごとに貼って作る。
+// アトラスは乗算済みアルファで持ち、貼るときの色も HudTint で乗算済みにする。
+
+void InitHud() {
+    hud_atlas = LoadRenderTexture(HUD_ATLAS_WIDTH, HUD_ATLAS_HEIGHT);
+    // 棚詰め（横に並べ、はみ出したら次の段へ。隣の絵がにじまないよう隙間を空ける）
+    int x = 0, y = 0, rowH = 0;
+    for (int i=0; i<HUD_WIDGET_COUNT; i++) {
+        int w = hud_widget_size[i][0], h = hud_widget_size[i][1];
+        if (x + w > HUD_ATLAS_WIDTH) { x = 0; y += rowH + 2; rowH = 0; }
+        hud_widgets[i] = (HudWidget){ .slot = { (float)x, (float)y, (float)w, (float)h } };
+        x += w + 2;
+        if (h > rowH) rowH = h;
+    }
+    for (int d=0; d<10; d++) hud_digit_width[d] = MeasureText(TextFormat("%d", d), HUD_DIGIT_SIZE);
+    BeginTextureMode(hud_atlas);
+    ClearBackground(BLANK);
+    EndTextureMode();
+}
+
+void HudSet(HudWidgetId id, int a, int b, int c) {
+    HudWidget *w = &hud_widgets[id];
+    if (w->valid && w->value[0] == a && w->value[1] == b && w->value[2] == c) return;
+    w->value[0] = a; w->value[1] = b; w->value[2] = c;
+    w->dirty = true;
+}
+
+// 区画の左上 (x, y)、幅 w に、ウィジェットの値から絵を描く
+void HudRedraw(HudWidgetId id, int x, int y, int w) {
+    const int *v = hud_widgets[id].value;
+    const char *text = NULL;
+    int size = 0;
+    Color color = WHITE;
+    switch (id) {
+        case HUD_STAGE: DrawText(TextFormat("STAGE %d", v[0]), x, y, 30, WHITE); break;
+        case HUD_HP: DrawText(TextFormat("HP: %d/%d", v[0], v[1]), x, y, 40, (v[0] < 30 ? COL_NEON_PINK : COL_NEON_GREEN)); break;
+        case HUD_LEVEL: DrawText(TextFormat("LV. %d", v[0]), x, y, 40, GOLD); break;
+        case HUD_WEAPON:
+            DrawText(TextFormat("WEAPON: %s", weapon_names[v[0]]), x, y, 20, COL_NEON_CYAN);
+            for (int k=0; k<WEAPON_COUNT; k++) {
+                Color c = (v[1] & (1 << k)) ? (k == v[0] ? COL_NEON_CYAN : GRAY) : DARKGRAY;
+                DrawText(TextFormat("[%d]", k + 1), x + k * 32, y + 25, 20, c);
+            }
+            break;
+        case HUD_EXP: {
+            float expRatio = (float)v[0] / (float)v[1];
+            if (expRatio > 1.0f) expRatio = 1.0f;
+            DrawRectangle(x, y, 200, 20, (Color){ 50, 40, 0, 200 });
+            DrawRectangle(x, y, (int)(200 * expRatio), 20, GOLD);
+            DrawRectangleLines(x, y, 200, 20, WHITE);
+            DrawText(TextFormat("EXP: %d/%d", v[0], v[1]), x + 10, y + 2, 10, BLACK);
+            break;
+        }
+        case HUD_BOSS_BAR:
+            DrawRectangle(x, y, 300, 20, DARKGRAY);
+            DrawRectangle(x, y, v[0], 20, COL_NEON_ORANGE);
+            DrawRectangleLines(x, y, 300, 20, WHITE);
+            break;
+        case HUD_BOSS_WARNING: DrawText("!! WARNING: BOSS ACTIVE !!", x, y, 30, COL_NEON_PINK); break;
+        case HUD_BANNER_WARNING: text = "WARNING"; size = 50; color = COL_NEON_PINK; break;
+        case HUD_BANNER_CLEAR: text = "STAGE CLEAR!"; size = 50; color = GOLD; break;
+        case HUD_BANNER_GAMEOVER: text = "GAME OVER"; size = 80; color = COL_NEON_PINK; break;
+        case HUD_RETURN_PROMPT: text = "PRESS 'R' TO RETURN TITLE"; size = 20; break;      // 色は貼るときに付ける
+        case HUD_PVP_P1:
+        case HUD_PVP_P2:
+            DrawText(id == HUD_PVP_P1 ? "P1" : "P2", x, y, 30, id == HUD_PVP_P1 ? COL_NEON_CYAN : COL_NEON_ORANGE);
+            DrawText(TextFormat("HP: %d", v[0]), x, y + 40, 30, COL_NEON_GREEN);
+            break;
+        case HUD_PVP_RESULT:
+            text = (v[0] == 1) ? "PLAYER 1 WINS!" : "PLAYER 2 WINS!";
+            size = 40;
+            color = (v[0] == 1) ? COL_NEON_CYAN : COL_NEON_ORANGE;
+            break;
+        case HUD_ROAM:
+            DrawText(TextFormat("SECTOR %d, %d   %d m", v[0], v[1], v[2]), x, y, 20, COL_NEON_CYAN);
+            break;
+        case HUD_DIGITS:
+            for (int d=0; d<10; d++) DrawText(TextFormat("%d", d), x + d * HUD_DIGIT_CELL + 2, y + 2, HUD_DIGIT_SIZE, WHITE);
+            break;
+        default: {
+            // キルフィードは右寄せ
+            const KillFeedEntry *f = &kill_feed[id - HUD_FEED];
+            DrawText(f->text, x + w - MeasureText(f->text, 20), y + 1, 20, f->color);
+            break;
+        }
+    }
+    if (text) DrawText(text, x + (w - MeasureText(text, size)) / 2, y, size, color);
+}
+
+// 値が変わったウィジェットだけアトラスに描き直す
+void HudFlush() {
+    int dirty = 0;
+    for (int i=0; i<HUD_WIDGET_COUNT; i++) if (hud_widgets[i].dirty) dirty++;
+    if (dirty == 0 || hud_atlas.id == 0) return;
+
+    // 静止画面を描いている途中なら一度抜けて戻る（RenderTexture は入れ子にできない）
+    if (frozen_frame_capturing) EndTextureMode();
+    BeginTextureMode(hud_atlas);
+    // 色はアルファを掛けて重ね、アルファはそのまま重ねる（＝乗算済みアルファで残る）
+    rlSetBlendFactorsSeparate(RL_SRC_ALPHA, RL_ONE_MINUS_SRC_ALPHA, RL_ONE, RL_ONE_MINUS_SRC_ALPHA, RL_FUNC_ADD, RL_FUNC_ADD);
+    BeginBlendMode(BLEND_CUSTOM_SEPARATE);
+    for (int i=0; i<HUD_WIDGET_COUNT; i++) {
+        HudWidget *w = &hud_widgets[i];
+        if (!w->dirty) continue;
+        BeginScissorMode((int)w->slot.x, (int)w->slot.y, (int)w->slot.width, (int)w->slot.height);
+        ClearBackground(BLANK);
+        HudRedraw((HudWidgetId)i, (int)w->slot.x, (int)w->slot.y, (int)w->slot.width);
+        EndScissorMode();
+        w->dirty = false;
+        w->valid = true;
+    }
+    EndBlendMode();
+    EndTextureMode();
+    if (frozen_frame_capturing) BeginTextureMode(frozen_frame);
+    hud_redraws += dirty;
+}
+
+void HudBegin() {
+    HudFlush();
+    BeginBlendMode(BLEND_ALPHA_PREMULTIPLY);
+}
+
+void HudEnd() {
+    EndBlendMode();
+}
+
+// RenderTexture は上下が逆なので、区画を下から数えて反転して貼る
+void HudDraw(HudWidgetId id, float x, float y, Color tint) {
+    const HudWidget *w = &hud_widgets[id];
+    if (!w->valid || hud_atlas.id == 0) return;
+    Rectangle src = { w->slot.x, HUD_ATLAS_HEIGHT - w->slot.y - w->slot.height, w->slot.width, -w->slot.height };
+    DrawTexturePro(hud_atlas.texture, src, (Rectangle){ x, y, w->slot.width, w->slot.height }, (Vector2){ 0, 0 }, 0.0f, tint);
+}
+
+void HudDrawCentered(HudWidgetId id, float cx, float y, Color tint) {
+    HudDraw(id, cx - hud_widgets[id].slot.width / 2, y, tint);
+}
+
+// 乗算済みアルファ用の色
+Color HudTint(Color c, float alpha) {
+    float a = alpha * c.a / 255.0f;
+    return (Color){ (unsigned char)(c.r * a), (unsigned char)(c.g * a), (unsigned char)(c.b * a), (unsigned char)(255 * a) };
+}
+
+// (cx, cy) を中心に数字を貼る
+void HudDrawNumber(int value, float cx, float cy, float scale, Color tint) {
+    const HudWidget *w = &hud_widgets[HUD_DIGITS];
+    if (!w->valid || hud_atlas.id == 0) return;
+    int digits[10], n = 0;
+    do { digits[n++] = value % 10; value /= 10; } while (value > 0 && n < 10);
+    float width = 0;
+    for (int k=0; k<n; k++) width += (hud_digit_width[digits[k]] + 2) * scale;
+    float x = cx - width / 2, h = HUD_DIGIT_SIZE * scale;
+    for (int k=n-1; k>=0; k--) {
+        int d = digits[k];
+        Rectangle src = { w->slot.x + d * HUD_DIGIT_CELL + 2, HUD_ATLAS_HEIGHT - w->slot.y - 2 - HUD_DIGIT_SIZE,
+                          (float)hud_digit_width[d], -(float)HUD_DIGIT_SIZE };
+        DrawTexturePro(hud_atlas.texture, src, (Rectangle){ x, cy - h / 2, hud_digit_width[d] * scale, h }, (Vector2){ 0, 0 }, 0.0f, tint);
+        x += (hud_digit_width[d] + 2) * scale;
+    }
+}
+
+void ClearHudEvents() {
+    for (int i=0; i<HUD_FEED_ENTRIES; i++) kill_feed[i].active = false;
+    for (int i=0; i<MAX_DAMAGE_NUMBERS; i++) damage_numbers[i].active = false;
+}
+
+void UpdateHudEvents(float dt) {
+    for (int i=0; i<HUD_FEED_ENTRIES; i++) {
+        if (!kill_feed[i].active) continue;
+        kill_feed[i].age += dt;
+        if (kill_feed[i].age > HUD_FEED_SECONDS) kill_feed[i].active = false;
+    }
+    for (int i=0; i<MAX_DAMAGE_NUMBERS; i++) {
+        if (!damage_numbers[i].active) continue;
+        damage_numbers[i].age += dt;
+        if (damage_numbers[i].age > DAMAGE_NUMBER_SECONDS) damage_numbers[i].active = false;
+    }
+}
+
+// 撃破ごとに1行。描き直すのはその行のウィジェットだけ
+void AddKillFeed(EnemyType type) {
+    KillFeedEntry *f = &kill_feed[kill_feed_next];
+    snprintf(f->text, sizeof(f->text), "%s DOWN", enemy_names[type]);
+    f->color = (type == ENEMY_BOSS) ? COL_NEON_PINK : (type == ENEMY_TANK ? COL_NEON_PURPLE : COL_NEON_ORANGE);
+    f->age = 0;
+    f->serial = ++kill_feed_serial;
+    f->active = true;
+    HudSet((HudWidgetId)(HUD_FEED + kill_feed_next), f->serial, 0, 0);
+    kill_feed_next = (kill_feed_next + 1) % HUD_FEED_ENTRIES;
+}
+
+// 同じ敵への連続ヒット（レーザーなど）は直前の数字に足す。空きがなければ一番古いものを使う
+void SpawnDamageNumber(int enemy, int damage, Vector3 pos) {
+    int slot = 0;
+    for (int i=0; i<MAX_DAMAGE_NUMBERS; i++) {
+        DamageNumber *d = &damage_numbers[i];
+        if (d->active && d->enemy == enemy && d->age < DAMAGE_NUMBER_MERGE) {
+            d->value += damage;
+            d->age = 0;
+            return;
+        }
+        if (damage_numbers[slot].active && (!d->active || d->age > damage_numbers[slot].age)) slot = i;
+    }
+    damage_numbers[slot] = (DamageNumber){ pos, damage, enemy, 0.0f, true };
+}
+
+void DrawDamageNumbers(Camera3D cam) {
+    for (int i=0; i<MAX_DAMAGE_NUMBERS; i++) {
+        const DamageNumber *d = &damage_numbers[i];
+        if (!d->active) continue;
+        float t = d->age / DAMAGE_NUMBER_SECONDS;
+        Vector3 p = { d->position.x, d->position.y + 1.5f + t * 2.0f, d->position.z };
+        Vector2 sp = GetWorldToScreen(p, cam);
+        float pop = 1.0f - d->age / 0.1f;
+        float scale = 1.0f + 0.6f * (pop > 0 ? pop : 0);
+        float alpha = (t > 0.6f) ? (1.0f - t) / 0.4f : 1.0f;
+        HudDrawNumber(d->value, sp.x, sp.y, scale, HudTint(d->value >= 30 ? GOLD : WHITE, alpha));
+    }
+}
+
+// 新しいものを上に、右上へ並べる。消える前の 0.5 秒で薄くする
+void DrawKillFeed(int screenW) {
+    int row = 0;
+    for (int k=1; k<=HUD_FEED_ENTRIES; k++) {
+        int i = (kill_feed_next - k + HUD_FEED_ENTRIES) % HUD_FEED_ENTRIES;
+        if (!kill_feed[i].active) continue;
+        float fade = (HUD_FEED_SECONDS - kill_feed[i].age) / 0.5f;
+        HudDraw((HudWidgetId)(HUD_FEED + i), screenW - 20 - hud_widget_size[HUD_FEED][0], HUD_FEED_Y + row * HUD_FEED_ROW, HudTint(WHITE, fade < 1 ? fade : 1));
+        row++;
+    }
+}
+
+// レーダー
+// 敵・敵弾・アイテムを1体ずつ印で描く代わりに、自分の周りの RADAR_GRID 四方の格子に
+// 種類ごとの数を数え、色を重ねた画素を毎フレーム1回だけテクスチャに上げて貼る。
+// 格子は視点に合わせて回す（上が画面の奥）。敵弾は SoA の列のまま数える
+
+void InitRadar() {
+    for (int v=0; v<RADAR_VIEWS; v++) {
+        Image img = { .data = radars[v].pixels, .width = RADAR_GRID, .height = RADAR_GRID, .mipmaps = 1,
+                      .format = PIXELFORMAT_UNCOMPRESSED_R8G8B8A8 };
+        radars[v].texture = LoadTextureFromImage(img);
+        SetTextureFilter(radars[v].texture, TEXTURE_FILTER_BILINEAR);
+    }
+}
+
+// ワールドの位置からセルの座標への変換（カメラの前方向を上にする）
+RadarBasis RadarMakeBasis(Vector3 center, Camera3D cam) {
+    float fx = cam.target.x - cam.position.x, fz = cam.target.z - cam.position.z;
+    float len = sqrtf(fx * fx + fz * fz);
+    if (len < 0.001f) { fx = 0; fz = -1; }
+    else { fx /= len; fz /= len; }
+    float scale = RADAR_GRID / (2.0f * RADAR_RANGE);
+    return (RadarBasis){ center.x, center.z, -fz * scale, fx * scale, -fx * scale, -fz * scale };
+}
+
+// 1つ数える。範囲の外は数えない
+void RadarAdd(uint16_t *counts, float x, float z, const RadarBasis *b) {
+    float dx = x - b->cx, dz = z - b->cz;
+    float u = dx * b->ux + dz * b->uz + RADAR_GRID * 0.5f;
+    float v = dx * b->vx + dz * b->vz + RADAR_GRID * 0.5f;
+    if (u < 0 || u >= RADAR_GRID || v < 0 || v >= RADAR_GRID) return;
+    counts[(int)v * RADAR_GRID + (int)u]++;
+}
+
+// 敵弾のプールの列をそのまま数える
+void RadarBin(uint16_t *counts, const float *x, const float *z, int n, const RadarBasis *b) {
+    for (int i=0; i<n; i++) RadarAdd(counts, x[i], z[i], b);
+}
+
+void UpdateRadar(Radar *r, const Player *self, Camera3D cam) {
+    RadarBasis b = RadarMakeBasis(self->position, cam);
+    memset(r->counts, 0, sizeof(r->counts));
+    RadarBin(r->counts[RADAR_ENEMY_BULLET], enemy_bullets.x, enemy_bullets.z, enemy_bullets.count, &b);
+
+    // 上から降ってくる敵は別に数えて点滅させる
+    for (int i=0; i<enemy_slots; i++) {
+        if (!enemies[i].active) continue;
+        RadarAdd(r->counts[enemies[i].is_grounded ? RADAR_ENEMY : RADAR_SKYFALL], enemies[i].position.x, enemies[i].position.z, &b);
+    }
+    for (int i=0; i<item_capacity; i++) {
+        if (items[i].active) RadarAdd(r->counts[RADAR_ITEM], items[i].position.x, items[i].position.z, &b);
+    }
+
+    // 対戦では相手と相手の弾、協力プレイでは他のプレイヤー
+    if (current_state == STATE_PVP || current_state == STATE_PVP_RESULT) {
+        bool isP2 = (self == &player2);
+        const Player *other = isP2 ? &player : &player2;
+        RadarAdd(r->counts[RADAR_OTHER], other->position.x, other->position.z, &b);
+        for (int i=0; i<bullet_capacity; i++) {
+            if (bullets[i].active && bullets[i].is_p2_bullet != isP2) {
+                RadarAdd(r->counts[RADAR_ENEMY_BULLET], bullets[i].position.x, bullets[i].position.z, &b);
+            }
+        }
+    }
+    else if (net_mode == NET_MODE_CLIENT) {
+        for (int s=0; s<MAX_NET_PLAYERS; s++) {
+            if (!net_player_present[s] || s == net_client.slot || net_players[s].hp <= 0) continue;
+            RadarAdd(r->counts[RADAR_OTHER], net_players[s].position.x, net_players[s].position.z, &b);
+        }
+    }
+}
+
+// 数を種類ごとの色に寄せて重ねる（後の種類ほど上）。数は飽和する数で割って 0〜1 にする
+void RadarPixels(Radar *r, float blink) {
+    static const RadarChannel order[RADAR_CHANNELS] = { RADAR_ENEMY_BULLET, RADAR_ITEM, RADAR_ENEMY, RADAR_SKYFALL, RADAR_OTHER };
+    const Color colors[RADAR_CHANNELS] = {
+        [RADAR_ENEMY] = COL_NEON_ORANGE, [RADAR_SKYFALL] = RED, [RADAR_ENEMY_BULLET] = COL_NEON_PINK,
+        [RADAR_ITEM] = COL_NEON_GREEN, [RADAR_OTHER] = WHITE,
+    };
+    const float saturate[RADAR_CHANNELS] = {
+        [RADAR_ENEMY] = 3.0f, [RADAR_SKYFALL] = 1.0f, [RADAR_ENEMY_BULLET] = 12.0f, [RADAR_ITEM] = 1.0f, [RADAR_OTHER] = 1.0f,
+    };
+    float cr[RADAR_GRID * RADAR_GRID], cg[RADAR_GRID * RADAR_GRID], cb[RADAR_GRID * RADAR_GRID], ca[RADAR_GRID * RADAR_GRID];
+    for (int i=0; i<RADAR_GRID * RADAR_GRID; i++) {
+        cr[i] = 10; cg[i] = 14; cb[i] = 30; ca[i] = 150;
+    }
+    for (int k=0; k<RADAR_CHANNELS; k++) {
+        RadarChannel ch = order[k];
+        const uint16_t *counts = r->counts[ch];
+        float inv = 1.0f / saturate[ch];
+        float gain = (ch == RADAR_SKYFALL) ? blink : 1.0f;
+        Color c = colors[ch];
+        // 分岐のないループで一括で行う（自動ベクトル化が効く）
+        for (int i=0; i<RADAR_GRID * RADAR_GRID; i++) {
+            float t = counts[i] * inv;
+            t = (t > 1.0f ? 1.0f : t) * gain;
+            cr[i] += (c.r - cr[i]) * t;
+            cg[i] += (c.g - cg[i]) * t;
+            cb[i] += (c.b - cb[i]) * t;
+            ca[i] += (255.0f - ca[i]) * t;
+        }
+    }
+    for (int i=0; i<RADAR_GRID * RADAR_GRID; i++) {
+        r->pixels[i] = (Color){ (unsigned char)cr[i], (unsigned char)cg[i], (unsigned char)cb[i], (unsigned char)ca[i] };
+    }
+}
+
+// (x, y) を左上に描く。中心が自分、輪が敵の出てくる距離
+void DrawRadar(int view, const Player *self, Camera3D cam, int x, int y) {
+    Radar *r = &radars[view];
+    if (!radar_enabled || r->texture.id == 0) return;
+    UpdateRadar(r, self, cam);
+    RadarPixels(r, 0.55f + 0.45f * sinf((float)AnimTime() * 10.0f));
+    UpdateTexture(r->texture, r->pixels);
+
+    DrawTexturePro(r->texture, (Rectangle){ 0, 0, RADAR_GRID, RADAR_GRID }, (Rectangle){ (float)x, (float)y, RADAR_SIZE, RADAR_SIZE },
+                   (Vector2){ 0, 0 }, 0, WHITE);
+    DrawRectangleLines(x, y, RADAR_SIZE, RADAR_SIZE, ColorAlpha(COL_NEON_CYAN, 0.6f));
+    int cx = x + RADAR_SIZE / 2, cy = y + RADAR_SIZE / 2;
+    DrawCircleLines(cx, cy, RADAR_SPAWN_RING / RADAR_RANGE * RADAR_SIZE * 0.5f, ColorAlpha(COL_NEON_PURPLE, 0.5f));
+    DrawTriangle((Vector2){ (float)cx, cy - 5.0f }, (Vector2){ cx - 4.0f, cy + 4.0f }, (Vector2){ cx + 4.0f, cy + 4.0f }, WHITE);
+}
+
+// UI
+void DrawGame() {
+    int w = GetScreenWidth();
+    int h = GetScreenHeight();
+    ClearBackground(COL_DARK_BG);
+
+    BeginSceneTarget();
+    LateLatchView();
+    BeginMode3D(camera);
+    DrawScene(camera, true);
+    EndMode3D();
+    EndSceneTarget();
+    late_latch.valid = false;
+
+    // HUD は値を渡すだけ（変わったものだけ描き直され、アトラスからまとめて貼られる）
+    int unlocked = 0;
+    for (int k=0; k<WEAPON_COUNT; k++) if (WeaponUnlocked(&player, k)) unlocked |= 1 << k;
+    float progress = (float)stage_kills / kills_required_for_boss;
+    if (progress > 1.0f) progress = 1.0f;
+    HudSet(HUD_STAGE, current_stage, 0, 0);
+    HudSet(HUD_HP, player.hp, player.max_hp, 0);
+    HudSet(HUD_LEVEL, player.level, 0, 0);
+    HudSet(HUD_WEAPON, player.weapon_type, unlocked, 0);
+    HudSet(HUD_EXP, player.exp, player.next_level_exp, 0);
+    if (!boss_spawned) HudSet(HUD_BOSS_BAR, (int)(300 * progress), 0, 0);
+    else HudSet(HUD_BOSS_WARNING, 0, 0, 0);
+    if (roam_mode) {
+        // ワールドでの位置は原点のセクターとローカル座標を足して double で求める
+        double wx = roam.origin_x * (double)ROAM_SECTOR_SIZE + player.position.x;
+        double wz = roam.origin_z * (double)ROAM_SECTOR_SIZE + player.position.z;
+        HudSet(HUD_ROAM, RoamSectorOf(player.position.x, roam.origin_x), RoamSectorOf(player.position.z, roam.origin_z),
+               (int)sqrt(wx * wx + wz * wz));
+    }
+
+    HudBegin();
+    HudDraw(HUD_STAGE, 20, 20, WHITE);
+    HudDraw(HUD_HP, 20, 60, WHITE);
+    HudDraw(HUD_LEVEL, 20, 110, WHITE);
+    HudDraw(HUD_WEAPON, 20, 155, WHITE);
+    HudDraw(HUD_EXP, 140, 120, WHITE);
+    if (!boss_spawned) HudDraw(HUD_BOSS_BAR, w/2 - 150, 50, WHITE);
+    else HudDraw(HUD_BOSS_WARNING, w/2 - 200, 30, WHITE);
+    if (roam_mode) HudDraw(HUD_ROAM, 20, h - RADAR_SIZE - 48, WHITE);
+    DrawDamageNumbers(camera);
+    DrawKillFeed(w);
+    HudEnd();
+    DrawRadar(0, &player, camera, 20, h - RADAR_SIZE - 20);
+
+    // 演出の帯は HUD の上に重ねる
+    if (current_state == STATE_BOSS_INTRO) {
+        DrawRectangle(0, h/2 - 60, w, 120, (Color){0,0,0,150});
+        HudSet(HUD_BANNER_WARNING, 0, 0, 0);
+        HudBegin();
+        HudDrawCentered(HUD_BANNER_WARNING, w/2, h/2 - 40, WHITE);
+        HudEnd();
+    }
+    if (current_state == STATE_STAGE_CLEAR) {
+        DrawRectangle(0, h/2 - 60, w, 120, (Color){255,255,255,150});
+        HudSet(HUD_BANNER_CLEAR, 0, 0, 0);
+        HudBegin();
+        HudDrawCentered(HUD_BANNER_CLEAR, w/2, h/2 - 20, WHITE);
+        HudEnd();
+    }
+    if (current_state == STATE_GAMEOVER) {
+        DrawRectangle(0, 0, w, h, (Color){0,0,0,200});
+        HudSet(HUD_BANNER_GAMEOVER, 0, 0, 0);
+        HudSet(HUD_RETURN_PROMPT, 0, 0, 0);
+        HudBegin();
+        HudDrawCentered(HUD_BANNER_GAMEOVER, w/2, h/2 - 50, WHITE);
+        HudDrawCentered(HUD_RETURN_PROMPT, w/2, h/2 + 50, HudTint(GRAY, 1.0f));
+        HudEnd();
+    }
+}
+
+void DrawGamePvP() {
+    int screenW = GetScreenWidth();
+    int screenH = GetScreenHeight();
+    
+    ClearBackground(COL_DARK_BG);
+    BeginSceneTarget();
+    
+    // P1
+    BeginSceneView(0, screenW/2);
+        ClearBackground(COL_DARK_BG);
+        BeginMode3D(camera);
+            DrawScene(camera, true);
+        EndMode3D();
+    EndSceneView();
+
+    // P2
+    BeginSceneView(screenW/2, screenW/2);
+        ClearBackground(COL_DARK_BG);
+        BeginMode3D(camera2);
+            DrawScene(camera2, false);
+        EndMode3D();
+    EndSceneView();
+    EndSceneTarget();
+
+    // UI
+    DrawRectangleLines(0, 0, screenW/2, screenH, COL_NEON_CYAN);
+    DrawRectangleLines(screenW/2, 0, screenW/2, screenH, COL_NEON_ORANGE);
+    DrawLine(screenW/2, 0, screenW/2, screenH, WHITE);
+
+    HudSet(HUD_PVP_P1, player.hp, 0, 0);
+    HudSet(HUD_PVP_P2, player2.hp, 0, 0);
+    HudBegin();
+    HudDraw(HUD_PVP_P1, 20, 20, WHITE);
+    HudDraw(HUD_PVP_P2, screenW/2 + 20, 20, WHITE);
+    HudEnd();
+    DrawRadar(0, &player, camera, 20, screenH - RADAR_SIZE - 20);
+    DrawRadar(1, &player2, camera2, screenW/2 + 20, screenH - RADAR_SIZE - 20);
+    
+    if (current_state == STATE_PVP_RESULT) {
+        DrawRectangle(0, screenH/2 - 60, screenW, 120, (Color){0,0,0,220});
+        HudSet(HUD_PVP_RESULT, winner_id, 0, 0);
+        HudSet(HUD_RETURN_PROMPT, 0, 0, 0);
+        HudBegin();
+        HudDrawCentered(HUD_PVP_RESULT, screenW/2, screenH/2 - 20, WHITE);
+        HudDrawCentered(HUD_RETURN_PROMPT, screenW/2, screenH/2 + 30, WHITE);
+        HudEnd();
+    }
+}
+
+// 描画キュー
+// コマンドは一時領域に積み、キーだけを基数ソートする（キーの下位ビットがコマンドの番号）。
+// 深度はカメラの前方向の距離を量子化したもの。半透明と加算合成では反転して奥から並べる
+
+// DrawScene 1回で積むコマンドの上限（敵弾はプールごと1つ）
+int RenderQueueCapacity() {
+    return enemy_slots * 3 + MECHA_TYPES + bullet_capacity + item_capacity + particle_capacity +
+           (2 + MAX_NET_PLAYERS) * (2 + TRAIL_LENGTH / 2) + 8;
+}
+
+// 取れなければ容量 0 のまま（積もうとしたコマンドはその場で描く）
+void RenderQueueBegin(Camera3D cam, int capacity) {
+    RenderQueue *q = &render_queue;
+    if (capacity > (1 << RENDER_INDEX_BITS)) capacity = 1 << RENDER_INDEX_BITS;
+    q->count = 0;
+    q->cmds = FrameAlloc(capacity * sizeof(RenderCommand));
+    q->keys = FrameAlloc(capacity * sizeof(uint64_t));
+    q->scratch = FrameAlloc(capacity * sizeof(uint64_t));
+    q->capacity = (q->cmds && q->keys && q->scratch) ? capacity : 0;
+    q->eye = cam.position;
+    q->forward = Vector3Normalize(Vector3Subtract(cam.target, cam.position));
+    for (int t=0; t<MECHA_TYPES; t++) {
+        q->instance_transforms[t] = NULL;
+        q->instance_counts[t] = 0;
+    }
+}
+
+void RenderPush(RenderPass pass, RenderMaterial material, const RenderCommand *cmd) {
+    RenderQueue *q = &render_queue;
+    if (q->count >= q->capacity) {
+        q->overflows++;
+        RenderSetPass(pass);
+        RenderExecute(cmd);
+        RenderSetPass(RENDER_PASS_OPAQUE);
+        return;
+    }
+    float depth = Vector3DotProduct(Vector3Subtract(cmd->a, q->eye), q->forward);
+    if (depth < 0) depth = 0;
+    if (depth > RENDER_QUEUE_FAR) depth = RENDER_QUEUE_FAR;
+    uint64_t d = (uint64_t)(depth * (((1 << RENDER_DEPTH_BITS) - 1) / RENDER_QUEUE_FAR));
+    if (pass != RENDER_PASS_OPAQUE) d = ((1 << RENDER_DEPTH_BITS) - 1) - d;
+
+    // 不透明と加算合成は材質が先（状態の切り替えを減らす）、半透明は深度が先（奥から順に重ねる）
+    uint64_t key = (uint64_t)pass << RENDER_PASS_SHIFT;
+    if (pass == RENDER_PASS_ALPHA) {
+        key |= (d << (RENDER_INDEX_BITS + RENDER_MATERIAL_BITS)) | ((uint64_t)material << RENDER_INDEX_BITS);
+    } else {
+        key |= ((uint64_t)material << (RENDER_INDEX_BITS + RENDER_DEPTH_BITS)) | (d << RENDER_INDEX_BITS);
+    }
+    q->cmds[q->count] = *cmd;
+    q->keys[q->count] = key | (uint64_t)q->count;
+    q->count++;
+}
+
+// メカ本体（不透明）と足元の影（半透明）
+void RenderPushMecha(Vector3 pos, float angle, Color color, float anim_time, EnemyType type) {
+    RenderPush(RENDER_PASS_OPAQUE, (RenderMaterial)(RENDER_MAT_MECHA + type),
+               &(RenderCommand){ .a = pos, .color = color, .angle = angle, .param = anim_time, .type = RENDER_CMD_MECHA, .sub = type });
+    RenderPush(RENDER_PASS_ALPHA, RENDER_MAT_SHAPES, &(RenderCommand){ .a = pos, .type = RENDER_CMD_SHADOW, .sub = type });
+}
+
+// 8ビットずつの LSD 基数ソート。下位の番号の桁は積んだ順のまま（安定なので並べなくてよい）。
+// 全部のキーで同じ値の桁（パスが1つだけのときなど）は飛ばす
+void RenderQueueSort(uint64_t *keys, uint64_t *scratch, int n) {
+    const int firstByte = RENDER_INDEX_BITS / 8;
+    int counts[RENDER_KEY_BYTES - RENDER_INDEX_BITS / 8][256];
+    memset(counts, 0, sizeof(counts));
+    for (int i=0; i<n; i++) {
+        uint64_t k = keys[i];
+        for (int b=firstByte; b<RENDER_KEY_BYTES; b++) counts[b - firstByte][(k >> (b * 8)) & 0xFF]++;
+    }
+    uint64_t *src = keys, *dst = scratch;
+    int passes = 0;
+    for (int b=firstByte; b<RENDER_KEY_BYTES; b++) {
+        int *c = counts[b - firstByte];
+        if (n == 0 || c[(src[0] >> (b * 8)) & 0xFF] == n) continue;
+        int offset = 0;
+        for (int v=0; v<256; v++) {
+            int k = c[v];
+            c[v] = offset;
+            offset += k;
+        }
+        for (int i=0; i<n; i++) dst[c[(src[i] >> (b * 8)) & 0xFF]++] = src[i];
+        uint64_t *t = src; src = dst; dst = t;
+        passes++;
+    }
+    if (src != keys) memcpy(keys, src, n * sizeof(uint64_t));
+    render_queue.last_sort_passes = passes;
+}
+
+// パスごとの状態。切り替える前に溜まっている即時描画を流す（深度の書き込みはバッチの描画時に効く）
+void RenderSetPass(RenderPass pass) {
+    rlDrawRenderBatchActive();
+    if (pass == RENDER_PASS_OPAQUE) {
+        EndBlendMode();
+        rlEnableDepthMask();
+    } else {
+        rlDisableDepthMask();
+        BeginBlendMode(pass == RENDER_PASS_ALPHA ? BLEND_ALPHA : BLEND_ADDITIVE);
+    }
+}
+
+void RenderExecute(const RenderCommand *cmd) {
+    switch (cmd->type) {
+        case RENDER_CMD_MECHA:
+            DrawMecha(cmd->a, cmd->angle, cmd->color, cmd->param, (EnemyType)cmd->sub);
+            break;
+        case RENDER_CMD_MECHA_INSTANCED:
+            DrawMechaInstanced((EnemyType)cmd->sub, render_queue.instance_transforms[cmd->sub], render_queue.instance_counts[cmd->sub]);
+            break;
+        case RENDER_CMD_SHADOW:
+            DrawMechaShadow(cmd->a, (EnemyType)cmd->sub);
+            break;
+        case RENDER_CMD_CUBE:
+            DrawCube(cmd->a, cmd->b.x, cmd->b.y, cmd->b.z, cmd->color);
+            break;
+        case RENDER_CMD_HP_BAR:
+            DrawCube(cmd->a, cmd->b.x, 0.3f, 0.2f, BLACK);
+            DrawCube(cmd->a, cmd->b.x * cmd->param, 0.35f, 0.25f, COL_NEON_GREEN);
+            break;
+        case RENDER_CMD_DROP_MARKER:
+            DrawLine3D(cmd->a, (Vector3){cmd->a.x, 0, cmd->a.z}, ColorAlpha(RED, 0.5f));
+            DrawCircle3D((Vector3){cmd->a.x, 0.1f, cmd->a.z}, 1.0f, (Vector3){1,0,0}, 90, ColorAlpha(RED, 0.3f));
+            break;
+        case RENDER_CMD_BULLET:
+            DrawSphere(cmd->a, cmd->param, cmd->color);
+            DrawSphere(cmd->a, cmd->param * 0.5f, WHITE);
+            break;
+        case RENDER_CMD_ENEMY_BULLETS:
+            DrawEnemyBullets();
+            break;
+        case RENDER_CMD_BEAM:
+            DrawCylinderEx(cmd->a, cmd->b, cmd->param, cmd->param, 6, cmd->color);
+            DrawCylinderEx(cmd->a, cmd->b, cmd->param * 0.4f, cmd->param * 0.4f, 6, WHITE);
+            break;
+        case RENDER_CMD_ITEM:
+            rlPushMatrix();
+            rlTranslatef(cmd->a.x, cmd->a.y, cmd->a.z);
+            rlRotatef(cmd->angle, 0, 1, 0);
+            DrawCube((Vector3){0,0,0}, 0.8f, 0.8f, 0.8f, cmd->color);
+            DrawCubeWires((Vector3){0,0,0}, 0.8f, 0.8f, 0.8f, WHITE);
+            rlPopMatrix();
+            break;
+        case RENDER_CMD_CURSOR:
+            rlPushMatrix();
+            rlTranslatef(cmd->a.x, 0.1f, cmd->a.z);
+            rlRotatef(cmd->angle, 0, 1, 0);
+            DrawCubeWires((Vector3){0,0,0}, 2.0f, 0.0f, 2.0f, ColorAlpha(COL_NEON_CYAN, 0.8f));
+            DrawCube((Vector3){0,0,0}, 0.3f, 0.3f, 0.3f, WHITE);
+            rlPopMatrix();
+            DrawLine3D(cmd->b, cmd->a, ColorAlpha(COL_NEON_CYAN, 0.3f));
+            break;
+    }
+}
+
+// 並べ替えて描く。パスが変わるところでだけ状態を切り替え、最後は不透明の状態に戻す
+void RenderQueueFlush() {
+    RenderQueue *q = &render_queue;
+    RenderQueueSort(q->keys, q->scratch, q->count);
+    int pass = RENDER_PASS_OPAQUE;
+    for (int i=0; i<q->count; i++) {
+        uint64_t key = q->keys[i];
+        int p = (int)(key >> RENDER_PASS_SHIFT);
+        if (p != pass) {
+            RenderSetPass((RenderPass)p);
+            pass = p;
+        }
+        RenderExecute(&q->cmds[key & ((1u << RENDER_INDEX_BITS) - 1)]);
+    }
+    if (pass != RENDER_PASS_OPAQUE) RenderSetPass(RENDER_PASS_OPAQUE);
+    q->last_count = q->count;
+    q->count = 0;
+}
+
+void DrawScene(Camera3D cam, bool draw_cursor) {
+    // 地面の描画（床はキューより先に描く）
+    DrawCyberGrid(cam.target);
+    ArenaDraw();
+
+    size_t frameMark = FrameMark();
+    RenderQueueBegin(cam, RenderQueueCapacity());
+
+    // マウスカーソル
+    if (draw_cursor) {
+        Ray ray = GetMouseRay(GetMousePosition(), cam);
+        if (late_latch.valid || ray.direction.y != 0) {
+            float t = -ray.position.y / ray.direction.y;
+            Vector3 aimPos = late_latch.valid ? late_latch.aim : Vector3Add(ray.position, Vector3Scale(ray.direction, t));
+            RenderPush(RENDER_PASS_ALPHA, RENDER_MAT_SHAPES,
+                       &(RenderCommand){ .a = aimPos, .b = player.position, .angle = AnimTime() * 90.0f, .type = RENDER_CMD_CURSOR });
+        }
+    }
+
+    // P1
+    Color p1Color = (player.dash_duration > 0) ? COL_NEON_CYAN : BLUE;
+    if (player.invincible_timer > 0 && (int)(AnimTime()*20)%2 == 0) p1Color = WHITE;
+    RenderPushMecha(player.position, late_latch.valid ? late_latch.facing : player.facing_angle, p1Color, player.walk_anim_timer, ENEMY_DRONE);
+    
+    // P1のダッシュの残像
+    if(player.dash_duration > 0){
+        for(int i=0; i<TRAIL_LENGTH; i+=2) {
+            if(player.trail_pos[i].x != 0) {
+                Color trailColor = ColorAlpha(COL_NEON_CYAN, 0.3f);
+                RenderPush(RENDER_PASS_ALPHA, RENDER_MAT_SHAPES,
+                           &(RenderCommand){ .a = player.trail_pos[i], .b = { 0.8f, 0.8f, 0.8f }, .color = trailColor, .type = RENDER_CMD_CUBE });
+            }
+        }
+    }
+
+    // P2
+    if (current_state == STATE_PVP || current_state == STATE_PVP_RESULT || (current_state == STATE_PAUSED && previous_state == STATE_PVP)) {
+        Color p2Color = (player2.dash_duration > 0) ? COL_NEON_ORANGE : ORANGE;
+        if (player2.invincible_timer > 0 && (int)(AnimTime()*20)%2 == 0) p2Color = WHITE;
+        RenderPushMecha(player2.position, player2.facing_angle, p2Color, player2.walk_anim_timer, ENEMY_TANK);
+        
+        // P2のダッシュの残像
+        if(player2.dash_duration > 0){
+            for(int i=0; i<TRAIL_LENGTH; i+=2) {
+                if(player2.trail_pos[i].x != 0) {
+                    Color trailColor = ColorAlpha(COL_NEON_ORANGE, 0.3f);
+                    RenderPush(RENDER_PASS_ALPHA, RENDER_MAT_SHAPES,
+                               &(RenderCommand){ .a = player2.trail_pos[i], .b = { 1.2f, 1.2f, 1.2f }, .color = trailColor, .type = RENDER_CMD_CUBE });
+                }
+            }
+        }
+    }
+
+    // 協力プレイの他プレイヤー
+    if (net_mode == NET_MODE_CLIENT) {
+        const Color netColors[MAX_NET_PLAYERS] = { BLUE, ORANGE, COL_NEON_GREEN, COL_NEON_PURPLE, YELLOW, SKYBLUE, RED, LIME };
+        for (int s=0; s<MAX_NET_PLAYERS; s++) {
+            if (!net_player_present[s] || s == net_client.slot || net_players[s].hp <= 0) continue;
+            Color c = (net_players[s].dash_duration > 0) ? WHITE : netColors[s];
+            RenderPushMecha(net_players[s].position, net_players[s].facing_angle, c, net_players[s].walk_anim_timer, ENEMY_DRONE);
+        }
+    }
+
+    // 敵（タイプごとにまとめてインスタンス描画）
+    // 変換行列はフレームの一時領域に置く（取れなければ1体ずつ描く）
+    Matrix *enemyTransforms[MECHA_TYPES];
+    bool instanced = mecha_ready;
+    for (int t=0; t<MECHA_TYPES; t++) {
+        const EnemyBucket *b = &enemy_buckets[t];
+        enemyTransforms[t] = FrameAlloc((b->end > b->start ? b->end - b->start : 1) * sizeof(Matrix));
+        if (!enemyTransforms[t]) instanced = false;
+    }
+    if (!instanced) for (int t=0; t<MECHA_TYPES; t++) enemyTransforms[t] = NULL;
+    RenderQueue *q = &render_queue;
+    q->instance_counts[ENEMY_DRONE] = DrawDrones(enemy_buckets[ENEMY_DRONE].start, enemy_buckets[ENEMY_DRONE].end, enemyTransforms[ENEMY_DRONE]);
+    q->instance_counts[ENEMY_TANK] = DrawTanks(enemy_buckets[ENEMY_TANK].start, enemy_buckets[ENEMY_TANK].end, enemyTransforms[ENEMY_TANK]);
+    q->instance_counts[ENEMY_BOSS] = DrawBosses(enemy_buckets[ENEMY_BOSS].start, enemy_buckets[ENEMY_BOSS].end, enemyTransforms[ENEMY_BOSS]);
+    if (instanced) {
+        // 1種類で1つのコマンド（深度は近いものとして材質の先頭に来る）
+        for (int t=0; t<MECHA_TYPES; t++) {
+            if (q->instance_counts[t] == 0) continue;
+            q->instance_transforms[t] = enemyTransforms[t];
+            RenderPush(RENDER_PASS_OPAQUE, (RenderMaterial)(RENDER_MAT_MECHA + t), &(RenderCommand){ .a = q->eye, .type = RENDER_CMD_MECHA_INSTANCED, .sub = t });
+        }
+    }
+    
+    // ここからは加算合成（弾・レーザー・アイテム・爆発）
+
+    // 弾
+    for (int i=0; i<bullet_capacity; i++) {
+        if (bullets[i].active) {
+            Color bColor = bullets[i].is_p2_bullet ? COL_NEON_ORANGE : COL_NEON_CYAN;
+            float bSize = bullets[i].is_p2_bullet ? 0.6f : 0.4f;
+            RenderPush(RENDER_PASS_ADDITIVE, RENDER_MAT_SHAPES,
+                       &(RenderCommand){ .a = bullets[i].position, .color = bColor, .param = bSize, .type = RENDER_CMD_BULLET });
+        }
+    }
+    // 敵弾は数が多く、順番も関係ないのでプールごと1つ
+    if (enemy_bullets.count > 0) {
+        RenderPush(RENDER_PASS_ADDITIVE, RENDER_MAT_ENEMY_BULLETS, &(RenderCommand){ .a = cam.target, .type = RENDER_CMD_ENEMY_BULLETS });
+    }
+
+    // レール・レーザー
+    PushPlayerBeam(&player, COL_NEON_CYAN);
+    if (net_mode == NET_MODE_CLIENT) {
+        for (int s=0; s<MAX_NET_PLAYERS; s++) {
+            if (net_player_present[s] && s != net_client.slot) PushPlayerBeam(&net_players[s], COL_NEON_GREEN);
+        }
+    }
+
+    // アイテム
+    for (int i=0; i<item_capacity; i++) {
+        if(items[i].active) {
+            Vector3 pos = { items[i].position.x, 1.0f + sinf(AnimTime()*3)*0.2f, items[i].position.z };
+            Color itemColor = (items[i].type == ITEM_HEAL) ? COL_NEON_GREEN : COL_NEON_CYAN;
+            RenderPush(RENDER_PASS_ADDITIVE, RENDER_MAT_SHAPES,
+                       &(RenderCommand){ .a = pos, .color = itemColor, .angle = items[i].angle, .type = RENDER_CMD_ITEM });
+        }
+    }
+
+    // 爆発
+    for (int i=0; i<particle_capacity; i++) {
+        if (particles[i].active) {
+            float alpha = particles[i].life / particles[i].max_life;
+            Color pColor = ColorAlpha(particles[i].color, alpha);
+            float size = particles[i].size;
+            RenderPush(RENDER_PASS_ADDITIVE, RENDER_MAT_SHAPES,
+                       &(RenderCommand){ .a = particles[i].position, .b = { size, size, size }, .color = pColor, .type = RENDER_CMD_CUBE });
+        }
+    }
+
+    RenderQueueFlush();
+    FrameRewind(frameMark);
+}
+int SpawnBullet(Vector3 pos, Vector3 direction, bool is_p2) {
+    for (int i=0; i<bullet_capacity; i++) {
+        if (!bullets[i].active) {
+            bullets[i].active = true;
+            bullets[i].position = (Vector3){pos.x, 1.5f, pos.z};
+            float spd = is_p2 ? 20.0f : 35.0f;
+            bullets[i].velocity = Vector3Scale(direction, spd);
+            bullets[i].life_time = 2.0f;
+            bullets[i].is_p2_bullet = is_p2;
+            bullets[i].owner = 0;
+            return i;
+        }
+    }
+    PoolSpawnFailed(POOL_BULLETS, 1);
+    return -1;
+}
+
+void SpawnEnemy(bool force_boss) {
+    // 協力プレイ時は生存プレイヤーの誰かの周囲に出す
+    Vector3 anchor = sim_players[0]->position;
+    if (sim_player_count > 1) {
+        Player *alive[MAX_NET_PLAYERS];
+        int n = 0;
+        for (int p=0; p<sim_player_count; p++) if (sim_players[p]->hp > 0) alive[n++] = sim_players[p];
+        if (n > 0) anchor = alive[SimRandom(0, n - 1)]->position;
+    }
+    // 置く枠は種類で決まるので、先に中身を作ってから種類の範囲に入れる
+    Enemy e;
+    if (force_boss) {
+        e = NewEnemy(ENEMY_BOSS);
+        e.position = ArenaFindFree((Vector3){anchor.x, 30.0f, anchor.z + 10.0f}, 2.5f); 
+    } else {
+        float angle = SimRandom(0, 360) * DEG2RAD;
+        float dist = 35.0f;
+        bool skyfall = (difficulty == MODE_HARD || current_stage > 2) && SimRandom(0, 100) < 40;
+        Vector3 pos;
+        if (skyfall) {
+            pos = (Vector3){
+                anchor.x + (float)SimRandom(-15, 15),
+                25.0f, anchor.z + (float)SimRandom(-15, 15)
+            };
+        } else {
+            pos = (Vector3){ anchor.x + cosf(angle) * dist, 0, anchor.z + sinf(angle) * dist };
+        }
+        e = NewEnemy((current_stage > 1 && SimRandom(0, 100) < 30) ? ENEMY_TANK : ENEMY_DRONE);
+        e.position = ArenaFindFree(pos, 1.0f);
+        e.is_grounded = !skyfall;
+    }
+
+    if (!AddEnemy(&e)) return;
+    if (force_boss) {
+        boss_spawned = true;
+        boss_spawn_time = game_time;
+    }
+}
+
+// 種類ごとの初期値（ステージが進むほど硬くなる）。位置は呼ぶ側で決める
+Enemy NewEnemy(EnemyType type) {
+    Enemy e = { 0 };
+    e.active = true;
+    e.type = type;
+    e.shoot_cooldown = 2.0f; e.attack_range = 20.0f;
+    e.pattern_timer = 1.0f;
+    e.is_grounded = true;
+    if (type == ENEMY_BOSS) {
+        e.is_grounded = false;
+        e.speed = 4.0f + (current_stage * 0.5f);
+        e.max_hp = 300 + (current_stage * 100);
+    } else if (type == ENEMY_TANK) {
+        e.speed = 3.0f;
+        e.max_hp = 60 + (current_stage * 10);
+        e.attack_range = 15.0f;
+    } else {
+        e.speed = 6.0f;
+        e.max_hp = 20 + (current_stage * 5);
+        e.attack_range = 5.0f; 
+    }
+    e.hp = e.max_hp;
+    return e;
+}
+
+// 種類の範囲の空き枠に入れる。空きがなければ false
+bool AddEnemy(const Enemy *e) {
+    int slot = AllocEnemySlot(e->type);
+    if (slot < 0) {
+        PoolSpawnFailed(POOL_ENEMIES, 1);
+        return false;
+    }
+    enemies[slot] = *e;
+    return true;
+}
+
+// まとめて入れる（範囲の作り直しは1回だけ）。入らなかった敵は数えて捨てる。入れた数を返す
+int AddEnemies(const Enemy *list, int n) {
+    EnemyBucketsRebuild();
+    int added = 0;
+    for (int i=0; i<n; i++) {
+        int slot = TakeEnemySlot(list[i].type);
+        if (slot < 0) {
+            PoolSpawnFailed(POOL_ENEMIES, 1);
+            continue;
+        }
+        enemies[slot] = list[i];
+        added++;
+    }
+    return added;
+}
+
+void SpawnItem(Vector3 pos) {
+    for (int i=0; i<item_capacity; i++) {
+        if (!items[i].active) {
+            items[i].active = true; 
+            items[i].sector = 0;
+            items[i].position = pos;
+            items[i].type = (SimRandom(0, 100) < 70) ? ITEM_EXP : ITEM_HEAL; 
+            items[i].life_time = 15.0f; 
+            items[i].angle = 0;
+            return;
+        }
+    }
+    PoolSpawnFailed(POOL_ITEMS, 1);
+}
+
+// 探索モード
+// 外周のない平地をどこまでも歩ける。float の座標は原点から離れるほど粗くなるので、
+// プレイヤーが原点から離れたら全部の座標をセクターの大きさの倍数だけずらし、原点の近くへ戻す（浮動原点）。
+// ワールドでの位置は「原点のセクター × ROAM_SECTOR_SIZE + ローカル座標」で、桁は整数のセクター座標が持つ。
+// 周りのセクターの出現群とアイテムはシードから決まる中身を先回りして作り、決まった数の枠に入れて、遠くなったら捨てる。
+// 原点の移動はプールを1回なめるだけ、読み込みは1ティックに ROAM_GENERATE_PER_TICK セクターまで、
+// 敵を出すのは1ティックに ROAM_SPAWNS_PER_TICK 体までなので、まとめて止まることはない
+
+void RoamReset() {
+    memset(&roam, 0, sizeof(roam));
+    roam.seed = sim_rng * 0x9E3779B1u;
+    if (!roam_mode) return;
+    // 始めの周りだけは開始時にまとめて作る
+    RoamStream(ROAM_SECTOR_SLOTS);
+}
+
+// ローカル座標が入っているセクター（原点のセクターの中心がローカル座標の 0）
+int32_t RoamSectorOf(float v, int32_t origin) {
+    return origin + (int32_t)floorf(v / ROAM_SECTOR_SIZE + 0.5f);
+}
+
+uint32_t RoamSectorSeed(int32_t x, int32_t z) {
+    uint32_t h = roam.seed ^ ((uint32_t)x * 0x9E3779B1u) ^ ((uint32_t)z * 0x85EBCA77u);
+    h ^= h >> 16; h *= 0x7FEB352Du;
+    h ^= h >> 15; h *= 0x846CA68Bu;
+    h ^= h >> 16;
+    return h ? h : 1;       // xorshift は 0 から抜けない
+}
+
+// 座標を持つものを全部 (dx, dz) だけずらす
+void RoamShiftWorld(float dx, float dz) {
+    Vector3 d = { dx, 0, dz };
+    for (int p=0; p<sim_player_count; p++) {
+        Player *pl = sim_players[p];
+        pl->position = Vector3Subtract(pl->position, d);
+        for (int k=0; k<TRAIL_LENGTH; k++) pl->trail_pos[k] = Vector3Subtract(pl->trail_pos[k], d);
+    }
+    for (int i=0; i<enemy_slots; i++) enemies[i].position = Vector3Subtract(enemies[i].position, d);
+    for (int i=0; i<bullet_capacity; i++) bullets[i].position = Vector3Subtract(bullets[i].position, d);
+    for (int i=0; i<item_capacity; i++) items[i].position = Vector3Subtract(items[i].position, d);
+    for (int i=0; i<particle_capacity; i++) particles[i].position = Vector3Subtract(particles[i].position, d);
+    for (int i=0; i<MAX_DAMAGE_NUMBERS; i++) damage_numbers[i].position = Vector3Subtract(damage_numbers[i].position, d);
+    // 敵弾は列ごとに、分岐のないループで一括で行う（自動ベクトル化が効く）
+    float *x = enemy_bullets.x, *z = enemy_bullets.z;
+    int n = enemy_bullets.count;
+    for (int i=0; i<n; i++) x[i] -= dx;
+    for (int i=0; i<n; i++) z[i] -= dz;
+    for (int i=0; i<roam.pending_count; i++) roam.pending[i].center = Vector3Subtract(roam.pending[i].center, d);
+    camera.position = Vector3Subtract(camera.position, d);
+    camera.target = Vector3Subtract(camera.target, d);
+}
+
+// プレイヤーが原点から離れたら、原点をプレイヤーのいるセクターへ移す。移したら true。
+// ずらす量は 2 の累乗の倍数なので近くの座標は誤差なく移る。遠くに置き去りの敵と落ちたアイテムはここで消す
+bool RoamRebase() {
+    Vector3 p = player.position;
+    if (fabsf(p.x) <= ROAM_REBASE_DISTANCE && fabsf(p.z) <= ROAM_REBASE_DISTANCE) return false;
+    int32_t sx = RoamSectorOf(p.x, 0), sz = RoamSectorOf(p.z, 0);
+    RoamShiftWorld(sx * ROAM_SECTOR_SIZE, sz * ROAM_SECTOR_SIZE);
+    roam.origin_x += sx;
+    roam.origin_z += sz;
+    for (int i=0; i<enemy_slots; i++) {
+        if (!enemies[i].active || enemies[i].type == ENEMY_BOSS) continue;
+        float dx = enemies[i].position.x - player.position.x, dz = enemies[i].position.z - player.position.z;
+        if (dx * dx + dz * dz > ROAM_DROP_DISTANCE * ROAM_DROP_DISTANCE) enemies[i].active = false;
+    }
+    for (int i=0; i<item_capacity; i++) {
+        if (!items[i].active || items[i].sector) continue;
+        float dx = items[i].position.x - player.position.x, dz = items[i].position.z - player.position.z;
+        if (dx * dx + dz * dz > ROAM_DROP_DISTANCE * ROAM_DROP_DISTANCE) items[i].active = false;
+    }
+    EnemyHitGridBuild();
+    roam.rebases++;
+    return true;
+}
+
+int RoamFindSector(int32_t x, int32_t z) {
+    for (int i=0; i<ROAM_SECTOR_SLOTS; i++) {
+        const RoamSector *s = &roam.sectors[i];
+        if (s->used && s->x == x && s->z == z) return i;
+    }
+    return -1;
+}
+
+RoamMemory *RoamRecall(int32_t x, int32_t z) {
+    for (int i=0; i<roam.memory_count; i++) {
+        if (roam.memory[i].x == x && roam.memory[i].z == z) return &roam.memory[i];
+    }
+    return NULL;
+}
+
+// セクターの中身を作る。開始地点から遠いほどタンクが混ざる
+void RoamGenerate(RoamSector *s, int32_t x, int32_t z) {
+    uint32_t rng = RoamSectorSeed(x, z);
+    int ring = abs(x) > abs(z) ? abs(x) : abs(z);
+    int maxTanks = ring < 3 ? ring : 3;
+    const int edge = (int)(ROAM_SECTOR_SIZE * 0.5f) - 6;
+    *s = (RoamSector){ .x = x, .z = z, .used = true };
+
+    // 開始地点のセクターには出現群を置かない
+    s->set_count = (ring == 0) ? 0 : (uint8_t)XorshiftRandom(&rng, 1, ROAM_SETS);
+    for (int k=0; k<s->set_count; k++) {
+        RoamSpawnSet *set = &s->sets[k];
+        set->x = (float)XorshiftRandom(&rng, -edge, edge);
+        set->z = (float)XorshiftRandom(&rng, -edge, edge);
+        set->tanks = (uint8_t)XorshiftRandom(&rng, 0, maxTanks);
+        set->drones = (uint8_t)XorshiftRandom(&rng, 3, ROAM_SET_ENEMIES - set->tanks);
+    }
+    s->pickup_count = (uint8_t)XorshiftRandom(&rng, 1, ROAM_PICKUPS);
+    for (int k=0; k<s->pickup_count; k++) {
+        RoamPickup *pk = &s->pickups[k];
+        pk->x = (float)XorshiftRandom(&rng, -edge, edge);
+        pk->z = (float)XorshiftRandom(&rng, -edge, edge);
+        pk->type = (XorshiftRandom(&rng, 0, 99) < 25) ? ITEM_HEAL : ITEM_EXP;
+    }
+
+    const RoamMemory *m = RoamRecall(x, z);
+    if (m) {
+        s->sets_done = m->sets_done;
+        s->pickups_taken = m->pickups_taken;
+    }
+    roam.generated++;
+}
+
+// 置いているアイテムを片付ける
+void RoamRemovePickups(int slot) {
+    if (!roam.sectors[slot].pickups_placed) return;
+    for (int i=0; i<item_capacity; i++) {
+        if (items[i].active && items[i].sector == slot + 1) items[i].active = false;
+    }
+    roam.sectors[slot].pickups_placed = 0;
+}
+
+// 枠を空ける。手を付けたセクターは覚えておく
+void RoamEvict(int slot) {
+    RoamSector *s = &roam.sectors[slot];
+    RoamRemovePickups(slot);
+    if (s->sets_done || s->pickups_taken) {
+        RoamMemory *m = RoamRecall(s->x, s->z);
+        if (!m) {
+            m = &roam.memory[roam.memory_next];
+            roam.memory_next = (roam.memory_next + 1) % ROAM_MEMORY;
+            if (roam.memory_count < ROAM_MEMORY) roam.memory_count++;
+        }
+        *m = (RoamMemory){ s->x, s->z, s->sets_done, s->pickups_taken };
+    }
+    s->used = false;
+    roam.evicted++;
+}
+
+// プレイヤーのいるセクターが変わったら遠いものを捨て、周りの足りないセクターを近い順に budget 個まで作る
+void RoamStream(int budget) {
+    int32_t px = RoamSectorOf(player.position.x, roam.origin_x), pz = RoamSectorOf(player.position.z, roam.origin_z);
+    if (px != roam.center_x || pz != roam.center_z) {
+        roam.center_x = px;
+        roam.center_z = pz;
+        roam.streamed = false;
+        for (int i=0; i<ROAM_SECTOR_SLOTS; i++) {
+            const RoamSector *s = &roam.sectors[i];
+            if (!s->used) continue;
+            int d = abs(s->x - px) > abs(s->z - pz) ? abs(s->x - px) : abs(s->z - pz);
+            // 1つ外側までは残す（境目を行き来しても作り直さない）。アイテムは出す範囲の1つ外側で片付ける
+            if (d > ROAM_STREAM_RADIUS + 1) RoamEvict(i);
+            else if (d > ROAM_ACTIVE_RADIUS + 1) RoamRemovePickups(i);
+        }
+    }
+    if (roam.streamed) return;
+    for (int r=0; r<=ROAM_STREAM_RADIUS; r++) {
+        for (int dz=-r; dz<=r; dz++) {
+            for (int dx=-r; dx<=r; dx++) {
+                if (abs(dx) != r && abs(dz) != r) continue;
+                if (RoamFindSector(px + dx, pz + dz) >= 0) continue;
+                if (budget-- <= 0) return;
+                int slot = 0;
+                while (slot < ROAM_SECTOR_SLOTS && roam.sectors[slot].used) slot++;
+                if (slot == ROAM_SECTOR_SLOTS) return;
+                RoamGenerate(&roam.sectors[slot], px + dx, pz + dz);
+            }
+        }
+    }
+    roam.streamed = true;
+}
+
+// 近くのセクターのアイテムを置き、近づいた出現群を待ち行列に入れる
+void RoamActivate() {
+    bool spawning = current_state == STATE_PLAYING && !boss_spawned;
+    for (int i=0; i<ROAM_SECTOR_SLOTS; i++) {
+        RoamSector *s = &roam.sectors[i];
+        if (!s->used || abs(s->x - roam.center_x) > ROAM_ACTIVE_RADIUS || abs(s->z - roam.center_z) > ROAM_ACTIVE_RADIUS) continue;
+        float cx = (s->x - roam.origin_x) * ROAM_SECTOR_SIZE, cz = (s->z - roam.origin_z) * ROAM_SECTOR_SIZE;
+        for (int k=0; k<s->pickup_count; k++) {
+            uint8_t bit = (uint8_t)(1 << k);
+            if ((s->pickups_taken | s->pickups_placed) & bit) continue;
+            if (RoamPlacePickup(i, k, (Vector3){ cx + s->pickups[k].x, 0, cz + s->pickups[k].z })) s->pickups_placed |= bit;
+        }
+        if (!spawning) continue;
+        for (int k=0; k<s->set_count; k++) {
+            uint8_t bit = (uint8_t)(1 << k);
+            if (s->sets_done & bit) continue;
+            Vector3 center = { cx + s->sets[k].x, 0, cz + s->sets[k].z };
+            float dx = center.x - player.position.x, dz = center.z - player.position.z;
+            if (dx * dx + dz * dz > ROAM_TRIGGER_RADIUS * ROAM_TRIGGER_RADIUS) continue;
+            if (roam.pending_count == ROAM_PENDING) break;      // 次のティックでまた見る
+            roam.pending[roam.pending_count++] = (RoamPendingSpawn){ s->sets[k], center, 0 };
+            s->sets_done |= bit;
+            roam.sets_triggered++;
+        }
+    }
+}
+
+// 待ち行列の前から ROAM_SPAWNS_PER_TICK 体まで、出現群の中心の周りに輪にして出す
+// （探索モードに地形はないので空きは探さない）。範囲の作り直しは1ティックに1回。出したら true
+bool RoamSpawnPending() {
+    if (current_state != STATE_PLAYING || boss_spawned) return false;
+    Enemy list[ROAM_SPAWNS_PER_TICK];
+    int n = 0, done = 0;
+    while (done < roam.pending_count && n < ROAM_SPAWNS_PER_TICK) {
+        RoamPendingSpawn *ps = &roam.pending[done];
+        int total = ps->set.drones + ps->set.tanks;
+        while (ps->next < total && n < ROAM_SPAWNS_PER_TICK) {
+            int k = ps->next++;
+            float a = k * 2.0f * PI / total;
+            list[n] = NewEnemy(k < ps->set.tanks ? ENEMY_TANK : ENEMY_DRONE);
+            list[n].position = (Vector3){ ps->center.x + cosf(a) * 4.0f, 0, ps->center.z + sinf(a) * 4.0f };
+            n++;
+        }
+        if (ps->next < total) break;
+        done++;
+    }
+    roam.pending_count -= done;
+    memmove(roam.pending, roam.pending + done, roam.pending_count * sizeof(RoamPendingSpawn));
+    return n > 0 && AddEnemies(list, n) > 0;
+}
+
+// 空きがなければ false（次のティックでまた置く）
+bool RoamPlacePickup(int slot, int k, Vector3 pos) {
+    for (int i=0; i<item_capacity; i++) {
+        if (items[i].active) continue;
+        items[i] = (Item){ .position = pos, .active = true, .sector = (uint8_t)(slot + 1), .pickup = (uint8_t)k,
+                           .type = roam.sectors[slot].pickups[k].type, .life_time = ROAM_PICKUP_LIFE };
+        return true;
+    }
+    return false;
+}
+
+void RoamPickupTaken(const Item *it) {
+    RoamSector *s = &roam.sectors[it->sector - 1];
+    s->pickups_taken |= (uint8_t)(1 << it->pickup);
+    s->pickups_placed &= (uint8_t)~(1 << it->pickup);
+    roam.pickups_taken++;
+}
+
+// 1ティックの終わりに呼ぶ（原点の移動 → 読み込み → 中身を出す）。
+// 敵を出したら当たり判定のグリッドを作り直す（空いた枠に入った敵が前の持ち主の箱で当たらないように）
+void RoamUpdate() {
+    double t0 = NetNow();
+    bool rebased = RoamRebase();
+    double t1 = NetNow();
+    RoamStream(ROAM_GENERATE_PER_TICK);
+    RoamActivate();
+    if (RoamSpawnPending()) EnemyHitGridBuild();
+    double t2 = NetNow();
+    if (rebased && t1 - t0 > roam.rebase_sec_max) roam.rebase_sec_max = t1 - t0;
+    roam.stream_sec = t2 - t1;
+    if (roam.stream_sec > roam.stream_sec_max) roam.stream_sec_max = roam.stream_sec;
+    roam.sec += t2 - t0;
+}
+
+void SpawnExplosion(Vector3 pos, Color color, int count) {
+    const QualityPreset *q = CurrentQuality();
+    count = (int)ceilf(count * q->particle_ratio);
+    int spawned = 0;
+    int cap = (q->particle_cap < particle_capacity) ? q->particle_cap : particle_capacity;
+    for (int i=0; i<cap; i++) {
+        if (!particles[i].active) {
+            particles[i].active = true;
+            particles[i].position = pos;
+            particles[i].color = color;
+            particles[i].max_life = 0.6f;
+            particles[i].life = particles[i].max_life;
+            particles[i].size = (float)GetRandomValue(3, 8) / 10.0f;
+            
+            Vector3 rndVec = {
+                (float)GetRandomValue(-100, 100),
+                (float)GetRandomValue(-100, 100),
+                (float)GetRandomValue(-100, 100)
+            };
+            rndVec = Vector3Normalize(rndVec);
+            float speed = (float)GetRandomValue(10, 40) / 2.0f;
+            particles[i].velocity = Vector3Scale(rndVec, speed);
+            
+            spawned++;
+            if (spawned >= count) break;
+        }
+    }
+    // 画質の段階で絞った分も含めて、出せなかった数を数える
+    if (spawned < count) PoolSpawnFailed(POOL_PARTICLES, count - spawned);
+}
+// ネットワーク協力プレイ
+// 権威サーバーが固定ティックで UpdateWorld() を回し、クライアントごとに
+// 周囲のエンティティだけを量子化・差分圧縮したスナップショットで送る。
+// クライアントは受信した最新スナップショットの tick を入力パケットで返し（ACK）、
+// サーバーはそれを差分の基準にする。UDP（localhost での検証用）。
+
+double NetNow() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+void NetSleepUntil(double t) {
+    double wait = t - NetNow();
+    if (wait <= 0) return;
+    struct timespec ts = { (time_t)wait, (long)((wait - (time_t)wait) * 1e9) };
+    nanosleep(&ts, NULL);
+}
+
+void NetHandleSignal(int sig) { (void)sig; net_quit = 1; }
+
+void NetPutU8(NetBuf *b, uint8_t v) {
+    if (b->len + 1 > b->cap) { b->overflow = true; return; }
+    b->data[b->len++] = v;
+}
+void NetPutU16(NetBuf *b, uint16_t v) { NetPutU8(b, v & 0xFF); NetPutU8(b, v >> 8); }
+void NetPutU32(NetBuf *b, uint32_t v) { NetPutU16(b, v & 0xFFFF); NetPutU16(b, v >> 16); }
+void NetPutF32(NetBuf *b, float f) { uint32_t u; memcpy(&u, &f, 4); NetPutU32(b, u); }
+
+uint8_t NetGetU8(NetBuf *b) {
+    if (b->pos + 1 > b->len) { b->overflow = true; return 0; }
+    return b->data[b->pos++];
+}
+uint16_t NetGetU16(NetBuf *b) { uint16_t lo = NetGetU8(b); return lo | (uint16_t)(NetGetU8(b) << 8); }
+uint32_t NetGetU32(NetBuf *b) { uint32_t lo = NetGetU16(b); return lo | ((uint32_t)NetGetU16(b) << 16); }
+float NetGetF32(NetBuf *b) { uint32_t u = NetGetU32(b); float f; memcpy(&f, &u, 4); return f; }
+
+int16_t NetQuantize(float v) {
+    float q = v * 16.0f;
+    if (q > 32767.0f) q = 32767.0f;
+    if (q < -32768.0f) q = -32768.0f;
+    return (int16_t)lrintf(q);
+}
+
+uint8_t NetQuantizeAngle(float rad) {
+    return (uint8_t)((int)floorf(rad * 256.0f / (2.0f * PI)) & 255);
+}
+
+uint16_t NetClampHp(int hp) { return (uint16_t)(hp < 0 ? 0 : (hp > 65535 ? 65535 : hp)); }
+
+int NetOpenSocket(int port) {
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sock < 0) return -1;
+    struct sockaddr_in addr = { 0 };
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons((uint16_t)port);
+    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) { close(sock); return -1; }
+    int bufSize = 1 << 20;
+    setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &bufSize, sizeof(bufSize));
+    setsockopt(sock, SOL_SOCKET, SO_SNDBUF, &bufSize, sizeof(bufSize));
+    fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
+    return sock;
+}
+
+int NetSocketPort(int sock) {
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    if (getsockname(sock, (struct sockaddr *)&addr, &len) < 0) return 0;
+    return ntohs(addr.sin_port);
+}
+
+NetEntity NetEntityFromPlayer(int slot, const Player *p) {
+    NetEntity e = { 0 };
+    e.id = NET_ID_PLAYER + slot;
+    e.kind = NET_KIND_PLAYER;
+    e.sub = (uint8_t)slot;
+    e.x = NetQuantize(p->position.x); e.y = NetQuantize(p->position.y); e.z = NetQuantize(p->position.z);
+    e.angle = NetQuantizeAngle(p->facing_angle);
+    if (p->dash_duration > 0) e.flags |= NET_EF_DASH;
+    if (p->invincible_timer > 0) e.flags |= NET_EF_INVINCIBLE;
+    e.hp = NetClampHp(p->hp); e.max_hp = NetClampHp(p->max_hp);
+    e.level = (uint8_t)(p->level > 255 ? 255 : p->level);
+    e.exp = NetClampHp(p->exp); e.next_exp = NetClampHp(p->next_level_exp);
+    e.weapon = (uint8_t)p->weapon_type;
+    if (p->beam_timer > 0) e.beam = (uint8_t)Clamp(p->beam_length * 4.0f, 1.0f, 255.0f);
+    return e;
+}
+
+// 注目点の周囲にあるエンティティを ID 昇順で集める（プレイヤーは常に含める）
+int NetCollectEntities(NetEntity *out, int max, Vector3 center) {
+    int n = 0;
+    float r2 = NET_INTEREST_RADIUS * NET_INTEREST_RADIUS;
+    for (int s=0; s<MAX_NET_PLAYERS && n < max; s++) {
+        if (!net_slots[s].connected) continue;
+        out[n++] = NetEntityFromPlayer(s, &net_players[s]);
+    }
+    for (int i=0; i<enemy_slots && n < max; i++) {
+        if (!enemies[i].active) continue;
+        float dx = enemies[i].position.x - center.x, dz = enemies[i].position.z - center.z;
+        if (dx*dx + dz*dz > r2) continue;
+        NetEntity e = { 0 };
+        e.id = NET_ID_ENEMY + i;
+        e.kind = NET_KIND_ENEMY;
+        e.sub = (uint8_t)enemies[i].type;
+        e.x = NetQuantize(enemies[i].position.x); e.y = NetQuantize(enemies[i].position.y); e.z = NetQuantize(enemies[i].position.z);
+        if (enemies[i].flash_timer > 0) e.flags |= NET_EF_FLASH;
+        if (!enemies[i].is_grounded) e.flags |= NET_EF_AIRBORNE;
+        e.hp = NetClampHp(enemies[i].hp); e.max_hp = NetClampHp(enemies[i].max_hp);
+        out[n++] = e;
+    }
+    for (int i=0; i<bullet_capacity && n < max; i++) {
+        if (!bullets[i].active) continue;
+        float dx = bullets[i].position.x - center.x, dz = bullets[i].position.z - center.z;
+        if (dx*dx + dz*dz > r2) continue;
+        NetEntity e = { 0 };
+        e.id = NET_ID_BULLET + i;
+        e.kind = NET_KIND_BULLET;
+        e.sub = bullets[i].is_p2_bullet ? 2 : 0;
+        e.x = NetQuantize(bullets[i].position.x); e.y = NetQuantize(bullets[i].position.y); e.z = NetQuantize(bullets[i].position.z);
+        out[n++] = e;
+    }
+    for (int i=0; i<item_capacity && n < max; i++) {
+        if (!items[i].active) continue;
+        float dx = items[i].position.x - center.x, dz = items[i].position.z - center.z;
+        if (dx*dx + dz*dz > r2) continue;
+        NetEntity e = { 0 };
+        e.id = NET_ID_ITEM + i;
+        e.kind = NET_KIND_ITEM;
+        e.sub = (uint8_t)items[i].type;
+        e.x = NetQuantize(items[i].position.x); e.y = NetQuantize(items[i].position.y); e.z = NetQuantize(items[i].position.z);
+        e.angle = (uint8_t)((int)(items[i].angle * 256.0f / 360.0f) & 255);
+        out[n++] = e;
+    }
+    int bulletMax = max - n;
+    if (bulletMax > NET_MAX_SNAPSHOT_ENEMY_BULLETS) bulletMax = NET_MAX_SNAPSHOT_ENEMY_BULLETS;
+    n += NetCollectEnemyBullets(out + n, bulletMax, center);
+    return n;
+}
+
+int NetCompareEntityId(const void *a, const void *b) {
+    return (int)((const NetEntity *)a)->id - (int)((const NetEntity *)b)->id;
+}
+
+// 敵弾は数が多いので近いものから max 個だけ送る。
+// 距離の2乗で等面積のリングに振り分け、内側のリングから埋める（ソート不要で O(n)）。
+int NetCollectEnemyBullets(NetEntity *out, int max, Vector3 center) {
+    const EnemyBulletPool *pool = &enemy_bullets;
+    const int rings = 16;
+    float r2 = NET_INTEREST_RADIUS * NET_INTEREST_RADIUS;
+    int hist[16] = { 0 };
+    if (max <= 0) return 0;
+    for (int i=0; i<pool->count; i++) {
+        float dx = pool->x[i] - center.x, dz = pool->z[i] - center.z;
+        float d2 = dx*dx + dz*dz;
+        if (d2 <= r2) hist[(int)(d2 / r2 * (rings - 1))]++;
+    }
+    int limitRing = rings - 1, sum = 0;
+    for (int r=0; r<rings; r++) {
+        if (sum + hist[r] > max) { limitRing = r; break; }
+        sum += hist[r];
+    }
+    int n = 0;
+    for (int i=0; i<pool->count && n < max; i++) {
+        float dx = pool->x[i] - center.x, dz = pool->z[i] - center.z;
+        float d2 = dx*dx + dz*dz;
+        if (d2 > r2 || (int)(d2 / r2 * (rings - 1)) > limitRing) continue;
+        NetEntity e = { 0 };
+        e.id = (uint16_t)(NET_ID_ENEMY_BULLET + pool->serial[i] % NET_ENEMY_BULLET_IDS);
+        e.kind = NET_KIND_ENEMY_BULLET;
+        e.sub = pool->style[i];
+        e.x = NetQuantize(pool->x[i]); e.y = NetQuantize(ENEMY_BULLET_Y); e.z = NetQuantize(pool->z[i]);
+        out[n++] = e;
+    }
+    // 差分エンコードは ID 昇順が前提。通し番号が一周して重複したものは捨てる
+    qsort(out, n, sizeof(NetEntity), NetCompareEntityId);
+    int m = 0;
+    for (int k=0; k<n; k++) if (m == 0 || out[m - 1].id != out[k].id) out[m++] = out[k];
+    return m;
+}
+
+int NetDiffMask(const NetEntity *a, const NetEntity *b) {
+    int mask = 0;
+    if (a->x != b->x || a->y != b->y || a->z != b->z) mask |= NET_F_POS;
+    if (a->angle != b->angle) mask |= NET_F_ANGLE;
+    if (a->flags != b->flags) mask |= NET_F_FLAGS;
+    if (a->hp != b->hp) mask |= NET_F_HP;
+    if (a->kind != b->kind || a->sub != b->sub || a->max_hp != b->max_hp) mask |= NET_F_KIND;
+    if (a->level != b->level || a->exp != b->exp || a->next_exp != b->next_exp) mask |= NET_F_STATS;
+    if (a->weapon != b->weapon || a->beam != b->beam) mask |= NET_F_WEAPON;
+    return mask;
+}
+
+void NetWriteEntity(NetBuf *b, const NetEntity *e, int mask) {
+    NetPutU16(b, e->id);
+    NetPutU8(b, (uint8_t)mask);
+    if (mask & NET_F_POS) { NetPutU16(b, (uint16_t)e->x); NetPutU16(b, (uint16_t)e->y); NetPutU16(b, (uint16_t)e->z); }
+    if (mask & NET_F_ANGLE) NetPutU8(b, e->angle);
+    if (mask & NET_F_FLAGS) NetPutU8(b, e->flags);
+    if (mask & NET_F_HP) NetPutU16(b, e->hp);
+    if (mask & NET_F_KIND) { NetPutU8(b, e->kind); NetPutU8(b, e->sub); NetPutU16(b, e->max_hp); }
+    if (mask & NET_F_STATS) { NetPutU8(b, e->level); NetPutU16(b, e->exp); NetPutU16(b, e->next_exp); }
+    if (mask & NET_F_WEAPON) { NetPutU8(b, e->weapon); NetPutU8(b, e->beam); }
+}
+
+// base からの差分を書き出す（削除ID一覧 → 変更エンティティ一覧の順）
+void NetWriteDelta(NetBuf *b, const NetSnapshot *base, const NetSnapshot *cur) {
+    int countPos = b->len;
+    int removed = 0;
+    NetPutU16(b, 0);
+    for (int bi=0, ci=0; bi < base->count; ) {
+        if (ci < cur->count && cur->ents[ci].id < base->ents[bi].id) { ci++; continue; }
+        if (ci < cur->count && cur->ents[ci].id == base->ents[bi].id) { ci++; bi++; continue; }
+        NetPutU16(b, base->ents[bi].id);
+        removed++; bi++;
+    }
+    if (!b->overflow) { b->data[countPos] = removed & 0xFF; b->data[countPos + 1] = removed >> 8; }
+
+    countPos = b->len;
+    int updated = 0;
+    NetPutU16(b, 0);
+    for (int ci=0, bi=0; ci < cur->count; ci++) {
+        while (bi < base->count && base->ents[bi].id < cur->ents[ci].id) bi++;
+        int mask = NET_F_ALL;
+        if (bi < base->count && base->ents[bi].id == cur->ents[ci].id) mask = NetDiffMask(&base->ents[bi], &cur->ents[ci]);
+        if (mask == 0) continue;
+        NetWriteEntity(b, &cur->ents[ci], mask);
+        updated++;
+    }
+    if (!b->overflow && b->len >= countPos + 2) { b->data[countPos] = updated & 0xFF; b->data[countPos + 1] = updated >> 8; }
+}
+
+// base に差分を適用して out を作る。壊れたパケットなら false
+bool NetReadDelta(NetBuf *b, const NetSnapshot *base, NetSnapshot *out) {
+    static uint16_t removed[NET_MAX_SNAPSHOT_ENTITIES];
+    int removedCount = NetGetU16(b);
+    if (removedCount > NET_MAX_SNAPSHOT_ENTITIES) return false;
+    for (int i=0; i<removedCount; i++) removed[i] = NetGetU16(b);
+
+    int updates = NetGetU16(b);
+    int bi = 0, ri = 0;
+    out->count = 0;
+    for (int u=0; u<updates && !b->overflow; u++) {
+        uint16_t id = NetGetU16(b);
+        int mask = NetGetU8(b);
+        while (bi < base->count && base->ents[bi].id < id) {
+            while (ri < removedCount && removed[ri] < base->ents[bi].id) ri++;
+            bool gone = (ri < removedCount && removed[ri] == base->ents[bi].id);
+            if (!gone) {
+                if (out->count >= NET_MAX_SNAPSHOT_ENTITIES) return false;
+                out->ents[out->count++] = base->ents[bi];
+            }
+            bi++;
+        }
+        NetEntity e = { 0 };
+        e.id = id;
+        if (bi < base->count && base->ents[bi].id == id) e = base->ents[bi++];
+        else if (!(mask & NET_F_KIND)) return false;
+        if (mask & NET_F_POS) { e.x = (int16_t)NetGetU16(b); e.y = (int16_t)NetGetU16(b); e.z = (int16_t)NetGetU16(b); }
+        if (mask & NET_F_ANGLE) e.angle = NetGetU8(b);
+        if (mask & NET_F_FLAGS) e.flags = NetGetU8(b);
+        if (mask & NET_F_HP) e.hp = NetGetU16(b);
+        if (mask & NET_F_KIND) { e.kind = NetGetU8(b); e.sub = NetGetU8(b); e.max_hp = NetGetU16(b); }
+        if (mask & NET_F_STATS) { e.level = NetGetU8(b); e.exp = NetGetU16(b); e.next_exp = NetGetU16(b); }
+        if (mask & NET_F_WEAPON) { e.weapon = NetGetU8(b); e.beam = NetGetU8(b); }
+        if (out->count >= NET_MAX_SNAPSHOT_ENTITIES) return false;
+        out->ents[out->count++] = e;
+    }
+    for (; bi < base->count; bi++) {
+        while (ri < removedCount && removed[ri] < base->ents[bi].id) ri++;
+        if (ri < removedCount && removed[ri] == base->ents[bi].id) continue;
+        if (out->count >= NET_MAX_SNAPSHOT_ENTITIES) return false;
+        out->ents[out->count++] = base->ents[bi];
+    }
+    return !b->overflow;
+}
+
+// サーバー
+void NetUpdatePlayerCount() {
+    sim_player_count = 0;
+    for (int s=0; s<MAX_NET_PLAYERS; s++) {
+        sim_players[s] = &net_players[s];
+        if (net_slots[s].connected) sim_player_count = s + 1;
+    }
+}
+
+Vector3 NetSpawnPoint(int slot) {
+    float a = slot * (2.0f * PI / MAX_NET_PLAYERS);
+    return (Vector3){ cosf(a) * 4.0f, 0, sinf(a) * 4.0f };
+}
+
+void NetServerRestart() {
+    current_stage = 1;
+    ResetStage();
+    for (int s=0; s<MAX_NET_PLAYERS; s++) {
+        if (net_slots[s].connected) InitPlayer(&net_players[s], NetSpawnPoint(s));
+    }
+    current_state = STATE_PLAYING;
+    state_timer = 0.0f;
+    TelemetryMatchStart();
+}
+
+bool NetServerStart(int port) {
+    net_socket = NetOpenSocket(port);
+    if (net_socket < 0) return false;
+    net_mode = NET_MODE_SERVER;
+    net_tick = 0;
+    memset(net_slots, 0, sizeof(net_slots));
+    memset(net_players, 0, sizeof(net_players));
+    difficulty = MODE_NORMAL;
+    NetUpdatePlayerCount();
+    NetServerRestart();
+    return true;
+}
+
+void NetServerStop() {
+    if (net_socket >= 0) close(net_socket);
+    net_socket = -1;
+    net_mode = NET_MODE_OFFLINE;
+    sim_players[0] = &player;
+    sim_player_count = 1;
+}
+
+void NetServerSend(int slot, const uint8_t *data, int len) {
+    NetClientSlot *c = &net_slots[slot];
+    sendto(net_socket, data, len, 0, (struct sockaddr *)&c->addr, sizeof(c->addr));
+    c->bytes_out += len;
+    c->total_out += len;
+}
+
+void NetServerReceive() {
+    uint8_t data[NET_MAX_PACKET];
+    struct sockaddr_in from;
+    socklen_t fromLen = sizeof(from);
+    int len;
+    while ((len = (int)recvfrom(net_socket, data, sizeof(data), 0, (struct sockaddr *)&from, &fromLen)) > 0) {
+        NetBuf b = { data, len, len, 0, false };
+        uint8_t type = NetGetU8(&b);
+        int slot = -1;
+        for (int s=0; s<MAX_NET_PLAYERS; s++) {
+            if (net_slots[s].connected && net_slots[s].addr.sin_addr.s_addr == from.sin_addr.s_addr &&
+                net_slots[s].addr.sin_port == from.sin_port) { slot = s; break; }
+        }
+        if (type == NET_MSG_HELLO) {
+            if (NetGetU32(&b) != NET_MAGIC) continue;
+            if (slot < 0) {
+                for (int s=0; s<MAX_NET_PLAYERS; s++) if (!net_slots[s].connected) { slot = s; break; }
+                if (slot < 0) continue;
+                NetClientSlot *c = &net_slots[slot];
+                memset(c, 0, sizeof(*c));
+                c->connected = true;
+                c->addr = from;
+                InitPlayer(&net_players[slot], NetSpawnPoint(slot));
+                NetUpdatePlayerCount();
+                printf("[server] P%d joined from %s:%d\n", slot + 1, inet_ntoa(from.sin_addr), ntohs(from.sin_port));
+            }
+            net_slots[slot].last_heard = NetNow();
+            uint8_t reply[8];
+            NetBuf r = { reply, 0, sizeof(reply), 0, false };
+            NetPutU8(&r, NET_MSG_WELCOME);
+            NetPutU8(&r, (uint8_t)slot);
+            NetPutU16(&r, NET_TICK_RATE);
+            NetServerSend(slot, reply, r.len);
+            continue;
+        }
+        if (slot < 0) continue;
+        NetClientSlot *c = &net_slots[slot];
+        c->last_heard = NetNow();
+        c->bytes_in += len;
+        c->total_in += len;
+        if (type == NET_MSG_INPUT) {
+            uint32_t ack = NetGetU32(&b);
+            PlayerInput in = { 0 };
+            in.move_x = NetGetF32(&b);
+            in.move_z = NetGetF32(&b);
+            in.aim_point.x = NetGetF32(&b);
+            in.aim_point.z = NetGetF32(&b);
+            uint8_t buttons = NetGetU8(&b);
+            if (b.overflow) continue;
+            in.fire = (buttons & 1) != 0;
+            in.dash = (buttons & 2) != 0;
+            in.weapon_select = (buttons >> 2) & 7;
+            c->input = in;
+            c->pending_dash |= in.dash;
+            if (in.weapon_select) c->pending_weapon = in.weapon_select;
+            if (ack > c->ack_tick && ack <= net_tick) c->ack_tick = ack;
+        } else if (type == NET_MSG_BYE) {
+            c->connected = false;
+            net_players[slot].hp = 0;
+            NetUpdatePlayerCount();
+            printf("[server] P%d left\n", slot + 1);
+        }
+    }
+}
+
+void NetServerTick(float dt) {
+    net_tick++;
+    game_time += dt;
+
+    // 無応答のクライアントを切断
+    double now = NetNow();
+    for (int s=0; s<MAX_NET_PLAYERS; s++) {
+        if (net_slots[s].connected && now - net_slots[s].last_heard > 5.0) {
+            net_slots[s].connected = false;
+            net_players[s].hp = 0;
+            NetUpdatePlayerCount();
+            printf("[server] P%d timed out\n", s + 1);
+        }
+    }
+    if (sim_player_count == 0) return;
+
+    if (current_state == STATE_GAMEOVER) {
+        state_timer += dt;
+        if (state_timer > 5.0f) NetServerRestart();
+        return;
+    }
+    if (UpdateStageFlow(dt)) return;
+
+    for (int s=0; s<sim_player_count; s++) {
+        if (!net_slots[s].connected) continue;
+        PlayerInput in = net_slots[s].input;
+        in.dash = net_slots[s].pending_dash;
+        in.weapon_select = net_slots[s].pending_weapon;
+        net_slots[s].pending_dash = false;
+        net_slots[s].pending_weapon = 0;
+        ApplyPlayerInput(s, &in, dt);
+    }
+    UpdateWorld(dt);
+    if (current_state == STATE_GAMEOVER) {
+        state_timer = 0.0f;
+        TelemetryEmit(TELEMETRY_MATCH_END, NULL, 2, (Vector3){ 0 }, (int)((game_time - match_start_time) * 1000.0f), current_stage);
+    }
+}
+
+void NetServerSendSnapshots() {
+    static uint8_t data[NET_MAX_PACKET];
+    for (int s=0; s<MAX_NET_PLAYERS; s++) {
+        NetClientSlot *c = &net_slots[s];
+        if (!c->connected) continue;
+        NetSnapshot *cur = &c->history[net_tick % NET_HISTORY];
+        cur->tick = net_tick;
+        cur->count = NetCollectEntities(cur->ents, NET_MAX_SNAPSHOT_ENTITIES, net_players[s].position);
+        c->entity_count = cur->count;
+
+        const NetSnapshot *base = &net_empty_snapshot;
+        uint32_t baseTick = 0;
+        if (c->ack_tick > 0 && net_tick - c->ack_tick < NET_HISTORY &&
+            c->history[c->ack_tick % NET_HISTORY].tick == c->ack_tick) {
+            base = &c->history[c->ack_tick % NET_HISTORY];
+            baseTick = c->ack_tick;
+        }
+
+        NetBuf b = { data, 0, sizeof(data), 0, false };
+        NetPutU8(&b, NET_MSG_SNAPSHOT);
+        NetPutU32(&b, net_tick);
+        NetPutU32(&b, baseTick);
+        NetPutU8(&b, (uint8_t)current_state);
+        NetPutU8(&b, (uint8_t)current_stage);
+        NetPutU16(&b, (uint16_t)stage_kills);
+        NetPutU16(&b, (uint16_t)kills_required_for_boss);
+        NetPutU8(&b, boss_spawned ? 1 : 0);
+
+        // 基準スナップショット以降に壊れたブロック
+        int from = 0;
+        if (base != &net_empty_snapshot && base->arena_epoch == arena_epoch) from = base->arena_log;
+        int cells = arena_destroyed_count - from;
+        if (cells > NET_MAX_ARENA_CELLS) cells = NET_MAX_ARENA_CELLS;
+        cur->arena_epoch = arena_epoch;
+        cur->arena_log = from + cells;
+        NetPutU8(&b, (uint8_t)arena_epoch);
+        NetPutU16(&b, (uint16_t)cells);
+        for (int k=0; k<cells; k++) NetPutU16(&b, arena_destroyed[from + k]);
+
+        NetWriteDelta(&b, base, cur);
+        if (b.overflow) continue;
+        NetServerSend(s, data, b.len);
+    }
+}
+
+void NetServerReport(double tickAvgMs, double tickMaxMs, double interval) {
+    int enemyCount = 0, bulletCount = 0;
+    for (int i=0; i<enemy_slots; i++) if (enemies[i].active) enemyCount++;
+    for (int i=0; i<bullet_capacity; i++) if (bullets[i].active) bulletCount++;
+    printf("[server] tick %u players %d enemies %d bullets %d enemy bullets %d (peak %d dropped %d) | tick avg %.3f ms max %.3f ms (budget %.1f ms)\n",
+           net_tick, sim_player_count, enemyCount, bulletCount, enemy_bullets.count, enemy_bullets.peak, enemy_bullets.dropped,
+           tickAvgMs, tickMaxMs, 1000.0 / NET_TICK_RATE);
+    for (int s=0; s<MAX_NET_PLAYERS; s++) {
+        NetClientSlot *c = &net_slots[s];
+        if (!c->connected) continue;
+        printf("  P%d %s:%d out %.2f KB/s in %.2f KB/s ents %d\n", s + 1, inet_ntoa(c->addr.sin_addr), ntohs(c->addr.sin_port),
+               c->bytes_out / 1024.0 / interval, c->bytes_in / 1024.0 / interval, c->entity_count);
+        c->bytes_out = 0;
+        c->bytes_in = 0;
+    }
+    fflush(stdout);
+}
+
+// ヘッドレスサーバー（Ctrl+C で終了）
+int RunServer(int port) {
+    if (port <= 0) port = NET_DEFAULT_PORT;
+    if (!NetServerStart(port)) {
+        fprintf(stderr, "[server] cannot bind UDP port %d: %s\n", port, strerror(errno));
+        return 1;
+    }
+    signal(SIGINT, NetHandleSignal);
+    signal(SIGTERM, NetHandleSignal);
+    printf("[server] listening on UDP %d, %d Hz\n", port, NET_TICK_RATE);
+    StartTelemetry();
+    TelemetryMatchStart();
+
+    const float dt = 1.0f / NET_TICK_RATE;
+    double nextTick = NetNow();
+    double reportAt = nextTick + 5.0;
+    double tickSum = 0, tickMax = 0;
+    int tickCount = 0;
+    while (!net_quit) {
+        WorldFrameReset();
+        NetServerReceive();
+        double t0 = NetNow();
+        NetServerTick(dt);
+        NetServerSendSnapshots();
+        double cost = (NetNow() - t0) * 1000.0;
+        tickSum += cost; tickCount++;
+        if (cost > tickMax) tickMax = cost;
+
+        double now = NetNow();
+        if (now >= reportAt) {
+            NetServerReport(tickSum / tickCount, tickMax, 5.0);
+            tickSum = 0; tickMax = 0; tickCount = 0;
+            reportAt = now + 5.0;
+        }
+        nextTick += dt;
+        if (now - nextTick > 0.25) nextTick = now;  // 大きく遅れたら追いつこうとしない
+        NetSleepUntil(nextTick);
+    }
+    NetServerStop();
+    printf("[server] stopped\n");
+    StopTelemetry();
+    PrintMemoryReport();
+    return 0;
+}
+
+// クライアント
+bool NetClientOpen(NetClient *c, const char *host, int port) {
+    c->sock = NetOpenSocket(0);
+    if (c->sock < 0) return false;
+    memset(&c->server, 0, sizeof(c->server));
+    c->server.sin_family = AF_INET;
+    c->server.sin_port = htons((uint16_t)port);
+    if (inet_pton(AF_INET, host, &c->server.sin_addr) != 1) { close(c->sock); c->sock = -1; return false; }
+    c->slot = -1;
+    c->latest_tick = 0;
+    c->arena_epoch = -1;
+    c->bytes_in = c->bytes_out = 0;
+    if (!c->history) c->history = calloc(NET_HISTORY, sizeof(NetSnapshot));
+    else memset(c->history, 0, NET_HISTORY * sizeof(NetSnapshot));
+    return c->history != NULL;
+}
+
+void NetClientClose(NetClient *c) {
+    if (c->sock >= 0) {
+        uint8_t bye = NET_MSG_BYE;
+        sendto(c->sock, &bye, 1, 0, (struct sockaddr *)&c->server, sizeof(c->server));
+        close(c->sock);
+    }
+    c->sock = -1;
+    free(c->history);
+    c->history = NULL;
+}
+
+void NetClientSendHello(NetClient *c) {
+    uint8_t data[8];
+    NetBuf b = { data, 0, sizeof(data), 0, false };
+    NetPutU8(&b, NET_MSG_HELLO);
+    NetPutU32(&b, NET_MAGIC);
+    sendto(c->sock, data, b.len, 0, (struct sockaddr *)&c->server, sizeof(c->server));
+    c->bytes_out += b.len;
+}
+
+void NetClientSendInput(NetClient *c, const PlayerInput *in) {
+    uint8_t data[32];
+    NetBuf b = { data, 0, sizeof(data), 0, false };
+    NetPutU8(&b, NET_MSG_INPUT);
+    NetPutU32(&b, c->latest_tick);
+    NetPutF32(&b, in->move_x);
+    NetPutF32(&b, in->move_z);
+    NetPutF32(&b, in->aim_point.x);
+    NetPutF32(&b, in->aim_point.z);
+    NetPutU8(&b, (in->fire ? 1 : 0) | (in->dash ? 2 : 0) | ((in->weapon_select & 7) << 2));
+    sendto(c->sock, data, b.len, 0, (struct sockaddr *)&c->server, sizeof(c->server));
+    c->bytes_out += b.len;
+}
+
+// 届いたパケットをすべて処理し、新しいスナップショットがあれば返す
+const NetSnapshot *NetClientReceive(NetClient *c) {
+    static uint8_t data[NET_MAX_PACKET];
+    const NetSnapshot *latest = NULL;
+    int len;
+    while ((len = (int)recv(c->sock, data, sizeof(data), 0)) > 0) {
+        c->bytes_in += len;
+        NetBuf b = { data, len, len, 0, false };
+        uint8_t type = NetGetU8(&b);
+        if (type == NET_MSG_WELCOME) {
+            c->slot = NetGetU8(&b);
+            continue;
+        }
+        if (type != NET_MSG_SNAPSHOT) continue;
+        uint32_t tick = NetGetU32(&b);
+        uint32_t baseTick = NetGetU32(&b);
+        uint8_t state = NetGetU8(&b), stage = NetGetU8(&b);
+        uint16_t kills = NetGetU16(&b), required = NetGetU16(&b);
+        uint8_t boss = NetGetU8(&b);
+        uint16_t cells[NET_MAX_ARENA_CELLS];
+        uint8_t epoch = NetGetU8(&b);
+        int cellCount = NetGetU16(&b);
+        if (cellCount > NET_MAX_ARENA_CELLS) continue;
+        for (int k=0; k<cellCount; k++) cells[k] = NetGetU16(&b);
+        if (b.overflow || tick <= c->latest_tick) continue;
+
+        const NetSnapshot *base = &net_empty_snapshot;
+        if (baseTick != 0) {
+            base = &c->history[baseTick % NET_HISTORY];
+            if (base->tick != baseTick) continue;  // 基準を持っていない：次の差分を待つ
+        }
+        NetSnapshot *out = &c->history[tick % NET_HISTORY];
+        if (out == base) continue;
+        if (!NetReadDelta(&b, base, out)) { out->tick = 0; continue; }
+        out->tick = tick;
+        out->arena_epoch = epoch;
+        c->latest_tick = tick;
+        if (net_mode == NET_MODE_CLIENT) {
+            if (epoch != c->arena_epoch) { ArenaGenerate(stage); c->arena_epoch = epoch; }
+            for (int k=0; k<cellCount; k++) if (cells[k] < ARENA_VOXELS) ArenaDestroyCell(cells[k]);
+        }
+        c->state = state; c->stage = stage; c->kills = kills; c->kills_required = required; c->boss = boss;
+        latest = out;
+    }
+    return latest;
+}
+
+// 受信したスナップショットを描画用のグローバルに反映する
+void NetApplySnapshot(const NetClient *c, const NetSnapshot *snap, float snapDt) {
+    for (int i=0; i<enemy_slots; i++) enemies[i].active = false;
+    for (int i=0; i<bullet_capacity; i++) bullets[i].active = false;
+    for (int i=0; i<item_capacity; i++) items[i].active = false;
+    for (int s=0; s<MAX_NET_PLAYERS; s++) net_player_present[s] = false;
+    enemy_bullets.count = 0;
+
+    for (int k=0; k<snap->count; k++) {
+        const NetEntity *e = &snap->ents[k];
+        Vector3 pos = { e->x / 16.0f, e->y / 16.0f, e->z / 16.0f };
+        if (e->kind == NET_KIND_PLAYER && e->id - NET_ID_PLAYER < MAX_NET_PLAYERS) {
+            int s = e->id - NET_ID_PLAYER;
+            Player *p = &net_players[s];
+            if (Vector3DistanceSqr(p->position, pos) > 0.0001f) p->walk_anim_timer += snapDt;
+            else p->walk_anim_timer = 0;
+            p->position = pos;
+            p->facing_angle = e->angle * (2.0f * PI / 256.0f);
+            p->dash_duration = (e->flags & NET_EF_DASH) ? 0.1f : 0.0f;
+            p->invincible_timer = (e->flags & NET_EF_INVINCIBLE) ? 0.1f : 0.0f;
+            p->hp = e->hp; p->max_hp = e->max_hp;
+            p->level = e->level; p->exp = e->exp; p->next_level_exp = e->next_exp;
+            p->weapon_type = (e->weapon < WEAPON_COUNT) ? e->weapon : WEAPON_BLASTER;
+            p->beam_timer = e->beam ? 0.1f : 0.0f;
+            p->beam_length = e->beam / 4.0f;
+            if (p->dash_duration > 0) UpdateTrail(p);
+            net_player_present[s] = true;
+        } else if (e->kind == NET_KIND_ENEMY && e->id - NET_ID_ENEMY < enemy_slots &&
+                   (e->sub == ENEMY_BOSS) == (e->id - NET_ID_ENEMY >= enemy_capacity)) {
+            // 種類の範囲はサーバーと同じ並びになる（容量が違って範囲に合わないものは捨てる）
+            Enemy *en = &enemies[e->id - NET_ID_ENEMY];
+            en->active = true;
+            en->position = pos;
+            en->type = (EnemyType)e->sub;
+            en->hp = e->hp; en->max_hp = e->max_hp;
+            en->flash_timer = (e->flags & NET_EF_FLASH) ? 0.1f : 0.0f;
+            en->is_grounded = !(e->flags & NET_EF_AIRBORNE);
+            en->anim_timer += snapDt;
+        } else if (e->kind == NET_KIND_BULLET && e->id - NET_ID_BULLET < bullet_capacity) {
+            Bullet *b = &bullets[e->id - NET_ID_BULLET];
+            b->active = true;
+            b->position = pos;
+            b->is_p2_bullet = (e->sub & 2) != 0;
+        } else if (e->kind == NET_KIND_ENEMY_BULLET) {
+            SpawnEnemyBullet(pos.x, pos.z, 0, 0, 1.0f, e->sub == ENEMY_BULLET_SHOT ? ENEMY_BULLET_SHOT : ENEMY_BULLET_PATTERN);
+        } else if (e->kind == NET_KIND_ITEM && e->id - NET_ID_ITEM < item_capacity) {
+            Item *it = &items[e->id - NET_ID_ITEM];
+            it->active = true;
+            it->position = pos;
+            it->type = (ItemType)e->sub;
+            it->angle = e->angle * (360.0f / 256.0f);
+        }
+    }
+    if (c->slot >= 0 && net_player_present[c->slot]) player = net_players[c->slot];
+    current_state = (GameState)c->state;
+    current_stage = c->stage;
+    stage_kills = c->kills;
+    kills_required_for_boss = c->kills_required;
+    boss_spawned = c->boss != 0;
+    EnemyBucketsRebuild();
+}
+
+int RunNetClient(const char *host, int port) {
+    if (port <= 0) port = NET_DEFAULT_PORT;
+    if (!NetClientOpen(&net_client, host, port)) {
+        fprintf(stderr, "[client] cannot reach %s:%d\n", host, port);
+        return 1;
+    }
+    net_mode = NET_MODE_CLIENT;
+    InitGameWindow();
+    InitGame(true);
+    current_state = STATE_PLAYING;
+
+    double helloAt = 0;
+    while (!WindowShouldClose()) {
+        FrameLimiterWait();
+        WorldFrameReset();
+        double frameStart = GetTime();
+        float dt = GetFrameTime();
+        game_time += dt;
+        if (screen_shake > 0) screen_shake -= dt * 30.0f;
+        if (screen_shake < 0) screen_shake = 0;
+
+        if (net_client.slot < 0 && GetTime() > helloAt) {
+            NetClientSendHello(&net_client);
+            helloAt = GetTime() + 0.5;
+        }
+        const NetSnapshot *snap = NetClientReceive(&net_client);
+        if (snap) NetApplySnapshot(&net_client, snap, 1.0f / NET_TICK_RATE);
+
+        CheckInputSampler();
+        PlayerInput input = ReadLocalInput();
+        if (!late_latch_enabled) UpdateFollowCamera(player.position, dt);
+        if (net_client.slot >= 0) NetClientSendInput(&net_client, &input);
+        if (IsKeyPressed(KEY_F3)) quality.show = !quality.show;
+        if (IsKeyPressed(KEY_F4)) bloom_enabled = !bloom_enabled;
+        if (IsKeyPressed(KEY_F5)) radar_enabled = !radar_enabled;
+        if (IsKeyPressed(KEY_F9)) ToggleCapture(NULL);
+        double simEnd = GetTime();
+
+        BeginDrawing();
+        DrawGame();
+        if (net_client.slot < 0) {
+            const char *msg = TextFormat("CONNECTING TO %s:%d ...", host, port);
+            DrawText(msg, GetScreenWidth()/2 - MeasureText(msg, 20)/2, GetScreenHeight() - 40, 20, COL_NEON_CYAN);
+        }
+        CapturePresentedFrame();
+        DrawQualityOverlay();
+        double drawEnd = GetTime();
+        EndDrawing();
+        LatencyProbePresent();
+        UpdateQuality((float)(simEnd - frameStart), (float)(drawEnd - simEnd));
+    }
+    NetClientClose(&net_client);
+    CloseGameWindow();
+    return 0;
+}
+
+// 状態のハッシュ
+// 毎ティックの始めに、ゲームの状態を項目ごとに 32 ビットずつ2つの和（語の和と、その途中の和の和）に
+// 足していく。足し算だけなので速く、1語でも違えば語の和が、並びが違えば途中の和の和が変わる。
+// 浮動小数点はビットのまま足すので、最適化や並列化で計算の順番が変わっただけでも分かる。
+// 最後に項目ごとの2つの和を掛け算で混ぜて1つにする。全体の値の下位32ビットはリプレイの
+// ティックにも入れ、再生で毎ティック比べる。--hash-trace は項目ごとの値を書き出し、
+// --hash-compare で2つのビルド（最適化なしと最適化ありなど）の出力を並べて、
+// 最初に食い違ったティックと項目を示す
+
+void HashWord(HashSum *h, uint32_t w) {
+    h->sum += w;
+    h->weighted += h->sum;
+}
+
+void HashFloat(HashSum *h, float f) {
+    uint32_t w;
+    memcpy(&w, &f, sizeof(w));
+    HashWord(h, w);
+}
+
+void HashVector3(HashSum *h, Vector3 v) {
+    HashFloat(h, v.x);
+    HashFloat(h, v.y);
+    HashFloat(h, v.z);
+}
+
+// 連続した列（SoA の列など）。4本に分けて足し、最後に本ごとに h に足す（端数の語は 0 で埋める）
+void HashColumn(HashSum *h, const void *data, size_t bytes) {
+    const uint8_t *p = data;
+    uint64_t sum[4] = { 0 }, weighted[4] = { 0 };
+    size_t words = bytes / 4, i = 0;
+    for (; i + 4 <= words; i += 4) {
+        for (int k=0; k<4; k++) {
+            uint32_t w;
+            memcpy(&w, p + (i + k) * 4, sizeof(w));
+            sum[k] += w;
+            weighted[k] += sum[k];
+        }
+    }
+    uint32_t tail[4] = { 0 };
+    memcpy(tail, p + i * 4, bytes - i * 4);
+    for (int k=0; i * 4 + k * 4 < bytes; k++) {
+        sum[k] += tail[k];
+        weighted[k] += sum[k];
+    }
+    HashWord(h, (uint32_t)bytes);
+    for (int k=0; k<4; k++) {
+        h->sum += sum[k];
+        h->weighted += h->sum + weighted[k];
+    }
+}
+
+uint64_t HashFinish(const HashSum *h) {
+    uint64_t x = (h->sum * HASH_MULTIPLIER) ^ h->weighted;
+    x *= HASH_MULTIPLIER;
+    return x ^ (x >> 32);
+}
+
+void WorldHashCompute(WorldHash *wh) {
+    HashSum f[HASH_FIELD_COUNT];
+    memset(f, 0, sizeof(f));
+
+    HashWord(&f[HASH_PROGRESS], (uint32_t)current_state);
+    HashWord(&f[HASH_PROGRESS], (uint32_t)difficulty);
+    HashWord(&f[HASH_PROGRESS], (uint32_t)winner_id);
+    HashWord(&f[HASH_PROGRESS], (uint32_t)current_stage);
+    HashWord(&f[HASH_PROGRESS], (uint32_t)stage_kills);
+    HashWord(&f[HASH_PROGRESS], (uint32_t)kills_required_for_boss);
+    HashWord(&f[HASH_PROGRESS], boss_spawned);
+    HashFloat(&f[HASH_TIMERS], game_time);
+    HashFloat(&f[HASH_TIMERS], state_timer);
+    HashFloat(&f[HASH_TIMERS], enemy_spawn_timer);
+    HashWord(&f[HASH_RNG], sim_rng);
+    HashWord(&f[HASH_ARENA], (uint32_t)arena_seed);
+    HashColumn(&f[HASH_ARENA], arena_destroyed, (size_t)arena_destroyed_count * sizeof(uint16_t));
+
+    const Player *players[2] = { &player, &player2 };
+    for (int k=0; k<2; k++) {
+        const Player *p = players[k];
+        HashSum *pf = &f[HASH_P1_POSITION + k * HASH_PLAYER_FIELDS];
+        HashVector3(&pf[0], p->position);
+        HashWord(&pf[1], (uint32_t)p->hp);
+        HashWord(&pf[1], (uint32_t)p->max_hp);
+        HashWord(&pf[1], (uint32_t)p->level);
+        HashWord(&pf[1], (uint32_t)p->exp);
+        HashWord(&pf[1], (uint32_t)p->next_level_exp);
+        HashWord(&pf[1], (uint32_t)p->damage);
+        HashWord(&pf[1], (uint32_t)p->weapon_type);
+        HashFloat(&pf[1], p->speed);
+        HashFloat(&pf[2], p->shoot_cooldown);
+        HashFloat(&pf[2], p->dash_cooldown);
+        HashFloat(&pf[2], p->dash_duration);
+        HashFloat(&pf[2], p->invincible_timer);
+        HashFloat(&pf[2], p->beam_timer);
+        HashFloat(&pf[2], p->beam_length);
+        HashVector3(&pf[3], p->dash_dir);
+        HashFloat(&pf[3], p->facing_angle);
+    }
+
+    // 空きの枠は active だけ（中身は前に使ったときのまま残っている）。
+    // 和はループの間だけ局所変数に持つ（配列のままだと足すたびにメモリを読み書きする）
+    HashSum active = { 0 }, pos = { 0 }, hp = { 0 }, motion = { 0 }, attack = { 0 };
+    for (int i=0; i<enemy_slots; i++) {
+        const Enemy *e = &enemies[i];
+        HashWord(&active, e->active);
+        if (!e->active) continue;
+        HashWord(&active, (uint32_t)e->type);
+        HashVector3(&pos, e->position);
+        HashWord(&hp, (uint32_t)e->hp);
+        HashWord(&hp, (uint32_t)e->max_hp);
+        HashVector3(&motion, e->knockback);
+        HashFloat(&motion, e->vertical_speed);
+        HashFloat(&motion, e->speed);
+        HashWord(&motion, e->is_grounded);
+        HashFloat(&attack, e->shoot_cooldown);
+        HashFloat(&attack, e->attack_range);
+        HashWord(&attack, (uint32_t)e->pattern_step);
+        HashFloat(&attack, e->pattern_time);
+        HashFloat(&attack, e->pattern_timer);
+        HashFloat(&attack, e->pattern_angle);
+    }
+    f[HASH_ENEMY_ACTIVE] = active;
+    f[HASH_ENEMY_POSITION] = pos;
+    f[HASH_ENEMY_HP] = hp;
+    f[HASH_ENEMY_MOTION] = motion;
+    f[HASH_ENEMY_ATTACK] = attack;
+
+    HashSum velocity = { 0 }, life = { 0 };
+    active = pos = (HashSum){ 0 };
+    for (int i=0; i<bullet_capacity; i++) {
+        const Bullet *b = &bullets[i];
+        HashWord(&active, b->active);
+        if (!b->active) continue;
+        HashWord(&active, (uint32_t)b->owner);
+        HashWord(&active, b->is_p2_bullet);
+        HashVector3(&pos, b->position);
+        HashVector3(&velocity, b->velocity);
+        HashFloat(&life, b->life_time);
+    }
+    f[HASH_BULLET_ACTIVE] = active;
+    f[HASH_BULLET_POSITION] = pos;
+    f[HASH_BULLET_VELOCITY] = velocity;
+    f[HASH_BULLET_LIFE] = life;
+
+    // 敵弾は生きている分が先頭に詰まっているので、列ごとにまとめて足す
+    const EnemyBulletPool *pool = &enemy_bullets;
+    size_t n = (size_t)pool->count;
+    HashWord(&f[HASH_ENEMY_BULLET_COUNT], (uint32_t)n);
+    HashWord(&f[HASH_ENEMY_BULLET_COUNT], pool->next_serial);
+    HashColumn(&f[HASH_ENEMY_BULLET_COUNT], pool->serial, n * sizeof(uint16_t));
+    HashColumn(&f[HASH_ENEMY_BULLET_POSITION], pool->x, n * sizeof(float));
+    HashColumn(&f[HASH_ENEMY_BULLET_POSITION], pool->z, n * sizeof(float));
+    HashColumn(&f[HASH_ENEMY_BULLET_VELOCITY], pool->vx, n * sizeof(float));
+    HashColumn(&f[HASH_ENEMY_BULLET_VELOCITY], pool->vz, n * sizeof(float));
+    HashColumn(&f[HASH_ENEMY_BULLET_LIFE], pool->life, n * sizeof(float));
+    HashColumn(&f[HASH_ENEMY_BULLET_LIFE], pool->style, n);
+
+    active = pos = life = (HashSum){ 0 };
+    for (int i=0; i<item_capacity; i++) {
+        const Item *it = &items[i];
+        HashWord(&active, it->active);
+        if (!it->active) continue;
+        HashWord(&active, (uint32_t)it->type);
+        HashVector3(&pos, it->position);
+        HashFloat(&life, it->life_time);
+        HashFloat(&life, it->angle);
+    }
+    f[HASH_ITEM_ACTIVE] = active;
+    f[HASH_ITEM_POSITION] = pos;
+    f[HASH_ITEM_LIFE] = life;
+
+    uint64_t total = HASH_FIELD_COUNT;
+    for (int k=0; k<HASH_FIELD_COUNT; k++) {
+        wh->field[k] = HashFinish(&f[k]);
+        total = (total ^ wh->field[k]) * HASH_MULTIPLIER;
+    }
+    wh->total = total ^ (total >> 32);
+}
+
+// シミュレーションの各ティックの先頭で呼ぶ
+void WorldHashTick() {
+    double t0 = NetNow();
+    WorldHashCompute(&world_hash);
+    world_hash_sec += NetNow() - t0;
+    if (hash_trace_file) {
+        HashTraceRecord r = { .tick = world_hash_ticks, .game_time = game_time, .total = world_hash.total };
+        memcpy(r.field, world_hash.field, sizeof(r.field));
+        fwrite(&r, sizeof(r), 1, hash_trace_file);
+    }
+    world_hash_ticks++;
+}
+
+// トレースに残すビルドの説明
+const char *HashTraceBuild() {
+#if defined(__OPTIMIZE__)
+    const char *opt = "optimized";
+#else
+    const char *opt = "not optimized";
+#endif
+#if defined(__FAST_MATH__)
+    const char *math = ", fast-math";
+#else
+    const char *math = "";
+#endif
+    return TextFormat("%s, %s%s", __VERSION__, opt, math);
+}
+
+// --hash-trace <出力.vht> [リプレイ.vsr]
+// リプレイ（なければ固定の種で自動操縦の試合）をシミュレーションし、ティックごとの項目別の
+// ハッシュを書き出す。リプレイではキーフレームごとに状態を戻すので、食い違いはその区間の中で見つかる
+int RunHashTrace(const char *outPath, const char *replayPath) {
+    static ReplayPlayer rp;
+    if (replayPath && !ReplayOpen(&rp, replayPath)) {
+        fprintf(stderr, "hash-trace: cannot open %s\n", replayPath);
+        return 1;
+    }
+    FILE *f = fopen(outPath, "wb");
+    if (!f) {
+        fprintf(stderr, "hash-trace: cannot write %s\n", outPath);
+        if (replayPath) ReplayClose(&rp);
+        return 1;
+    }
+    HashTraceHeader h = { .magic = HASH_TRACE_MAGIC, .version = HASH_TRACE_VERSION, .field_count = HASH_FIELD_COUNT,
+                          .record_size = sizeof(HashTraceRecord) };
+    snprintf(h.build, sizeof(h.build), "%s", HashTraceBuild());
+    snprintf(h.source, sizeof(h.source), "%s", replayPath ? replayPath : "autopilot");
+    fwrite(&h, sizeof(h), 1, f);
+
+    hash_trace_file = f;
+    world_hash_ticks = 0;
+    world_hash_sec = 0;
+    uint64_t ticks = 0;
+    double t0 = NetNow();
+    if (replayPath) {
+        difficulty = (DifficultyMode)rp.header->difficulty;
+        InitGame(true);
+        ReplayRestoreSegment(&rp, 0);
+        while (ReplayStep(&rp)) ticks++;
+    } else {
+        const float dt = 1.0f / 60.0f;
+        uint64_t total = (uint64_t)HASH_TRACE_MINUTES * 60 * 60;
+        SetRandomSeed(1);
+        difficulty = MODE_HARD;
+        InitGame(true);
+        current_state = STATE_PLAYING;
+        for (; ticks<total; ticks++) {
+            // 倒れないよう回復して続ける（どちらのビルドでも同じ状態のときに起きる）
+            if (player.hp < player.max_hp / 2 || current_state == STATE_GAMEOVER) {
+                player.hp = player.max_hp;
+                if (current_state == STATE_GAMEOVER) current_state = STATE_PLAYING;
+            }
+            PlayerInput in = { 0 };
+            if (current_state == STATE_PLAYING) in = AutopilotInput();
+            StepGame(dt, &in);
+        }
+    }
+    double sec = NetNow() - t0;
+    WorldHashTick();    // 最後のティックのあとの状態
+    hash_trace_file = NULL;
+    fclose(f);
+
+    printf("%s: %llu ticks of %s, stage %d, final hash %016llx\n", outPath, (unsigned long long)ticks, h.source,
+           current_stage, (unsigned long long)world_hash.total);
+    printf("build: %s\n", h.build);
+    if (ticks > 0) {
+        printf("hash %.2f us/tick of %.2f us/tick (%.1f%%)\n", world_hash_sec * 1e6 / ticks, sec * 1e6 / ticks,
+               world_hash_sec * 100.0 / sec);
+    }
+    if (replayPath) {
+        if (rp.tick_desyncs > 0) {
+            printf("%d ticks did not match the hash recorded in the replay (first at tick %llu)\n", rp.tick_desyncs,
+                   (unsigned long long)rp.first_desync_tick);
+        }
+        ReplayClose(&rp);
+    }
+    return 0;
+}
+
+// --hash-compare a.vht b.vht
+// 最初に全体の値が食い違ったティックと、そのティックで食い違っている項目を表示する（同じなら 0 で終わる）
+int RunHashCompare(const char *pathA, const char *pathB) {
+    const char *paths[2] = { pathA, pathB };
+    FILE *f[2] = { NULL, NULL };
+    HashTraceHeader h[2];
+    for (int k=0; k<2; k++) {
+        f[k] = fopen(paths[k], "rb");
+        if (!f[k] || fread(&h[k], sizeof(h[k]), 1, f[k]) != 1 || h[k].magic != HASH_TRACE_MAGIC ||
+            h[k].version != HASH_TRACE_VERSION || h[k].field_count != HASH_FIELD_COUNT || h[k].record_size != sizeof(HashTraceRecord)) {
+            fprintf(stderr, "hash-compare: %s is not a hash trace of this version\n", paths[k]);
+            for (int j=0; j<=k; j++) if (f[j]) fclose(f[j]);
+            return 1;
+        }
+        printf("%s: %s (%s)\n", paths[k], h[k].source, h[k].build);
+    }
+    if (strcmp(h[0].source, h[1].source) != 0) printf("warning: the traces come from different inputs\n");
+
+    HashTraceRecord r[2];
+    uint64_t same = 0;
+    int result = 0;
+    for (;;) {
+        size_t got0 = fread(&r[0], sizeof(r[0]), 1, f[0]);
+        size_t got1 = fread(&r[1], sizeof(r[1]), 1, f[1]);
+        if (got0 != 1 || got1 != 1) {
+            if (got0 != got1) {
+                printf("identical for %llu ticks, then %s ends\n", (unsigned long long)same, got0 != 1 ? pathA : pathB);
+                result = 1;
+            }
+            else printf("identical: %llu ticks\n", (unsigned long long)same);
+            break;
+        }
+        if (r[0].total == r[1].total) {
+            same++;
+            continue;
+        }
+        printf("first divergence at tick %u (game time %.3f s / %.3f s), after %llu identical ticks\n", r[0].tick,
+               r[0].game_time, r[1].game_time, (unsigned long long)same);
+        for (int k=0; k<HASH_FIELD_COUNT; k++) {
+            if (r[0].field[k] != r[1].field[k]) printf("  %-24s %016llx  %016llx\n", hash_field_names[k],
+                                                       (unsigned long long)r[0].field[k], (unsigned long long)r[1].field[k]);
+        }
+        result = 1;
+        break;
+    }
+    fclose(f[0]);
+    fclose(f[1]);
+    return result;
+}
+
+// リプレイ
+// 試合中の入力を1ティックずつファイルに書き、REPLAY_KEYFRAME_TICKS ごとにその時点の状態を
+// キーフレームとして挟む。閉じるときに各セグメントの位置と開始時刻の索引を末尾に足すので、
+// 再生側はファイルを mmap し、シーク先を索引の二分探索で見つけて（O(log n)）、
+// 手前のキーフレームを戻してから残りのティック（最大で1区間分）だけをシミュレーションし直す。
+// 進行用の乱数（sim_rng）もキーフレームに入るので、同じビルドなら入力だけで同じ展開になる。
+// 再生でキーフレームに着いたときは、シミュレーションした状態と突き合わせて食い違いを数える。
+
+// 固定長部分の後ろに敵弾と壊れたブロックを続けたときの大きさ（8バイト境界に切り上げ）
+uint32_t ReplayCaptureState(ReplayState *st) {
+    memset(st, 0, sizeof(*st));
+    st->state = current_state;
+    st->difficulty = difficulty;
+    st->winner_id = winner_id;
+    st->current_stage = current_stage;
+    st->stage_kills = stage_kills;
+    st->kills_required_for_boss = kills_required_for_boss;
+    st->boss_spawned = boss_spawned;
+    st->state_timer = state_timer;
+    st->enemy_spawn_timer = enemy_spawn_timer;
+    st->game_time = game_time;
+    st->sim_rng = sim_rng;
+    st->player = player;
+    st->player2 = player2;
+    memcpy(st->enemies, enemies, enemy_slots * sizeof(Enemy));
+    memcpy(st->bullets, bullets, bullet_capacity * sizeof(Bullet));
+    memcpy(st->items, items, item_capacity * sizeof(Item));
+    memcpy(st->arena_block_hp, arena_block_hp, sizeof(arena_block_hp));
+    st->arena_seed = arena_seed;
+    st->arena_destroyed_count = arena_destroyed_count;
+    st->enemy_bullet_count = enemy_bullets.count;
+    st->enemy_bullet_next_serial = enemy_bullets.next_serial;
+
+    size_t n = (size_t)enemy_bullets.count;
+    size_t bytes = sizeof(ReplayState) + n * REPLAY_BULLET_BYTES + (size_t)arena_destroyed_count * sizeof(uint16_t);
+    return (uint32_t)((bytes + 7) & ~(size_t)7);
+}
+
+void ReplayWriteState(FILE *f, const ReplayState *st) {
+    const EnemyBulletPool *pool = &enemy_bullets;
+    size_t n = (size_t)st->enemy_bullet_count;
+    fwrite(st, sizeof(*st), 1, f);
+    fwrite(pool->x, sizeof(float), n, f);
+    fwrite(pool->z, sizeof(float), n, f);
+    fwrite(pool->vx, sizeof(float), n, f);
+    fwrite(pool->vz, sizeof(float), n, f);
+    fwrite(pool->life, sizeof(float), n, f);
+    fwrite(pool->serial, sizeof(uint16_t), n, f);
+    fwrite(arena_destroyed, sizeof(uint16_t), (size_t)st->arena_destroyed_count, f);
+    fwrite(pool->style, sizeof(uint8_t), n, f);
+    size_t bytes = sizeof(*st) + n * REPLAY_BULLET_BYTES + (size_t)st->arena_destroyed_count * sizeof(uint16_t);
+    static const uint8_t zero[8] = { 0 };
+    if (bytes & 7) fwrite(zero, 1, 8 - (bytes & 7), f);
+}
+
+// p はキーフレームの先頭（mmap 上、8バイト境界）
+void ReplayRestoreState(const uint8_t *p) {
+    const ReplayState *st = (const ReplayState *)p;
+    current_state = st->state;
+    difficulty = st->difficulty;
+    winner_id = st->winner_id;
+    current_stage = st->current_stage;
+    stage_kills = st->stage_kills;
+    kills_required_for_boss = st->kills_required_for_boss;
+    boss_spawned = st->boss_spawned;
+    state_timer = st->state_timer;
+    enemy_spawn_timer = st->enemy_spawn_timer;
+    game_time = st->game_time;
+    sim_rng = st->sim_rng;
+    player = st->player;
+    player2 = st->player2;
+    memcpy(enemies, st->enemies, enemy_slots * sizeof(Enemy));
+    memcpy(bullets, st->bullets, bullet_capacity * sizeof(Bullet));
+    memcpy(items, st->items, item_capacity * sizeof(Item));
+
+    EnemyBulletPool *pool = &enemy_bullets;
+    size_t n = (size_t)st->enemy_bullet_count;
+    const uint8_t *q = p + sizeof(*st);
+    memcpy(pool->x, q, n * sizeof(float)); q += n * sizeof(float);
+    memcpy(pool->z, q, n * sizeof(float)); q += n * sizeof(float);
+    memcpy(pool->vx, q, n * sizeof(float)); q += n * sizeof(float);
+    memcpy(pool->vz, q, n * sizeof(float)); q += n * sizeof(float);
+    memcpy(pool->life, q, n * sizeof(float)); q += n * sizeof(float);
+    memcpy(pool->serial, q, n * sizeof(uint16_t)); q += n * sizeof(uint16_t);
+    const uint8_t *destroyed = q;
+    q += (size_t)st->arena_destroyed_count * sizeof(uint16_t);
+    memcpy(pool->style, q, n);
+    pool->count = (int)n;
+    pool->next_serial = st->enemy_bullet_next_serial;
+
+    // アリーナは壊れ方が違うときだけ作り直す（メッシュの作り直しが起きるため）
+    size_t destroyedBytes = (size_t)st->arena_destroyed_count * sizeof(uint16_t);
+    if (arena_seed != st->arena_seed || arena_destroyed_count != st->arena_destroyed_count ||
+        memcmp(arena_destroyed, destroyed, destroyedBytes) != 0) {
+        ArenaGenerate(st->arena_seed);
+        for (int i=0; i<st->arena_destroyed_count; i++) ArenaDestroyCell(((const uint16_t *)destroyed)[i]);
+    }
+    memcpy(arena_block_hp, st->arena_block_hp, sizeof(arena_block_hp));
+
+    sim_players[0] = &player;
+    sim_player_count = 1;
+    for (int i=0; i<particle_capacity; i++) particles[i].active = false;
+    EnemyBucketsRebuild();
+    EnemyHitGridBuild();
+    ClearHudEvents();
+    frozen_frame_valid = false;
+}
+
+// 食い違いの検出用。進行・プレイヤー・敵・弾数を比べる（浮動小数点はビット単位で）
+bool ReplayStateMatches(const ReplayState *a, const ReplayState *b) {
+    if (a->sim_rng != b->sim_rng || a->state != b->state || a->current_stage != b->current_stage ||
+        a->stage_kills != b->stage_kills || a->boss_spawned != b->boss_spawned) return false;
+    if (memcmp(&a->game_time, &b->game_time, sizeof(float)) != 0) return false;
+    const Player *pa[2] = { &a->player, &a->player2 }, *pb[2] = { &b->player, &b->player2 };
+    for (int k=0; k<2; k++) {
+        if (pa[k]->hp != pb[k]->hp || pa[k]->level != pb[k]->level || pa[k]->exp != pb[k]->exp) return false;
+        if (memcmp(&pa[k]->position, &pb[k]->position, sizeof(Vector3)) != 0) return false;
+    }
+    for (int i=0; i<enemy_slots; i++) {
+        if (a->enemies[i].active != b->enemies[i].active) return false;
+        if (!a->enemies[i].active) continue;
+        if (a->enemies[i].hp != b->enemies[i].hp || memcmp(&a->enemies[i].position, &b->enemies[i].position, sizeof(Vector3)) != 0) return false;
+    }
+    return a->enemy_bullet_count == b->enemy_bullet_count && a->arena_destroyed_count == b->arena_destroyed_count;
+}
+
+bool ReplayStartRecording(const char *path, int mode) {
+    ReplayRecorder *r = &replay_recorder;
+    ReplayStopRecording();
+    FILE *f = fopen(path, "wb");
+    if (!f) return false;
+    memset(r, 0, sizeof(*r));
+    r->file = f;
+    snprintf(r->path, sizeof(r->path), "%s", path);
+    r->header = (ReplayHeader){
+        .magic = REPLAY_MAGIC, .version = REPLAY_VERSION,
+        .state_size = sizeof(ReplayState), .tick_size = sizeof(ReplayTick),
+        .player_size = sizeof(Player), .enemy_size = sizeof(Enemy),
+        .pool_capacity = { enemy_capacity, bullet_capacity, item_capacity, enemy_bullet_capacity },
+        .mode = mode, .difficulty = difficulty, .keyframe_ticks = REPLAY_KEYFRAME_TICKS,
+    };
+    fwrite(&r->header, sizeof(r->header), 1, f);
+    r->active = true;
+    ReplayWriteKeyframe(r);
+    return true;
+}
+
+// 今の状態で新しいセグメントを始める
+void ReplayWriteKeyframe(ReplayRecorder *r) {
+    if ((int)r->header.segment_count >= r->index_cap) {
+        r->index_cap = r->index_cap ? r->index_cap * 2 : 256;
+        r->index = realloc(r->index, (size_t)r->index_cap * sizeof(ReplayIndexEntry));
+    }
+    uint32_t bytes = ReplayCaptureState(&replay_scratch);
+    ReplayIndexEntry *e = &r->index[r->header.segment_count++];
+    *e = (ReplayIndexEntry){ .first_tick = r->tick, .start_time = r->time, .offset = (uint64_t)ftell(r->file), .state_bytes = bytes };
+    ReplaySegmentHeader sh = { .magic = REPLAY_SEGMENT_MAGIC, .state_bytes = bytes, .first_tick = r->tick, .start_time = r->time };
+    fwrite(&sh, sizeof(sh), 1, r->file);
+    ReplayWriteState(r->file, &replay_scratch);
+    r->segment_ticks = 0;
+}
+
+// シミュレーションの各ティックの先頭で呼ぶ（p2 は対戦のときだけ）
+void ReplayRecordTick(float dt, const PlayerInput *p1, const PlayerInput *p2) {
+    ReplayRecorder *r = &replay_recorder;
+    if (!r->active) return;
+    if (r->segment_ticks >= r->header.keyframe_ticks) ReplayWriteKeyframe(r);
+    ReplayTick t;
+    memset(&t, 0, sizeof(t));
+    t.dt = dt;
+    t.hash = (uint32_t)world_hash.total;
+    t.input[0] = *p1;
+    if (p2) t.input[1] = *p2;
+    fwrite(&t, sizeof(t), 1, r->file);
+    r->index[r->header.segment_count - 1].tick_count++;
+    r->segment_ticks++;
+    r->tick++;
+    r->time += dt;
+}
+
+// 索引を書き、ヘッダーを埋め直して閉じる
+void ReplayStopRecording() {
+    ReplayRecorder *r = &replay_recorder;
+    if (!r->active) return;
+    r->header.index_offset = (uint64_t)ftell(r->file);
+    fwrite(r->index, sizeof(ReplayIndexEntry), r->header.segment_count, r->file);
+    r->header.tick_count = r->tick;
+    r->header.duration = r->time;
+    fseek(r->file, 0, SEEK_SET);
+    fwrite(&r->header, sizeof(r->header), 1, r->file);
+    fclose(r->file);
+    free(r->index);
+    TraceLog(LOG_INFO, "REPLAY: saved %s (%s, %u keyframes)", r->path, FormatReplayTime(r->time), r->header.segment_count);
+    memset(r, 0, sizeof(*r));
+}
+
+// --record のとき、始まった試合ごとに日時と通し番号で名前を付けて記録する
+void ReplayAutoStart() {
+    if (!replay_record_enabled) return;
+    // キーフレームに原点とセクターを持たないので、探索モードは記録しない
+    if (roam_mode) {
+        TraceLog(LOG_INFO, "REPLAY: roam mode is not recorded");
+        return;
+    }
+    char stamp[32], name[64];
+    time_t now = time(NULL);
+    strftime(stamp, sizeof(stamp), "%Y%m%d_%H%M%S", localtime(&now));
+    snprintf(name, sizeof(name), "replay_%s_%d.vsr", stamp, ++replay_match_count);
+    if (ReplayStartRecording(name, current_state == STATE_PVP ? 1 : 0)) TraceLog(LOG_INFO, "REPLAY: recording %s", name);
+    else TraceLog(LOG_WARNING, "REPLAY: cannot record to %s", name);
+}
+
+bool ReplayOpen(ReplayPlayer *rp, const char *path) {
+    memset(rp, 0, sizeof(*rp));
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+    struct stat sb;
+    if (fstat(fd, &sb) != 0 || (size_t)sb.st_size < sizeof(ReplayHeader)) {
+        close(fd);
+        return false;
+    }
+    void *map = mmap(NULL, (size_t)sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return false;
+    rp->data = map;
+    rp->size = (size_t)sb.st_size;
+    rp->header = map;
+
+    const ReplayHeader *h = rp->header;
+    if (h->magic != REPLAY_MAGIC || h->version != REPLAY_VERSION || h->state_size != sizeof(ReplayState) ||
+        h->tick_size != sizeof(ReplayTick) || h->player_size != sizeof(Player) || h->enemy_size != sizeof(Enemy)) {
+        fprintf(stderr, "replay: %s is not a replay from this build\n", path);
+        ReplayClose(rp);
+        return false;
+    }
+    if (h->pool_capacity[0] != enemy_capacity || h->pool_capacity[1] != bullet_capacity ||
+        h->pool_capacity[2] != item_capacity || h->pool_capacity[3] != enemy_bullet_capacity) {
+        fprintf(stderr, "replay: %s was recorded with --budget enemies=%d,bullets=%d,items=%d,enemy-bullets=%d\n", path,
+                h->pool_capacity[0], h->pool_capacity[1], h->pool_capacity[2], h->pool_capacity[3]);
+        ReplayClose(rp);
+        return false;
+    }
+
+    if (h->index_offset != 0 && h->index_offset + (uint64_t)h->segment_count * sizeof(ReplayIndexEntry) <= rp->size) {
+        rp->index = (const ReplayIndexEntry *)(rp->data + h->index_offset);
+        rp->segment_count = (int)h->segment_count;
+    } else {
+        // 途中で終わったファイル（クラッシュなど）。セグメントを先頭から辿り、
+        // 入力の並びは次のセグメントの印か、ファイルの終わりまでとする
+        int cap = 0;
+        size_t off = sizeof(ReplayHeader);
+        while (off + sizeof(ReplaySegmentHeader) <= rp->size) {
+            const ReplaySegmentHeader *sh = (const ReplaySegmentHeader *)(rp->data + off);
+            if (sh->magic != REPLAY_SEGMENT_MAGIC || off + sizeof(*sh) + sh->state_bytes > rp->size) break;
+            ReplayIndexEntry e = { .first_tick = sh->first_tick, .start_time = sh->start_time, .offset = off, .state_bytes = sh->state_bytes };
+            size_t p = off + sizeof(*sh) + sh->state_bytes;
+            while (p + sizeof(ReplayTick) <= rp->size && *(const uint32_t *)(rp->data + p) != REPLAY_SEGMENT_MAGIC) {
+                p += sizeof(ReplayTick);
+                e.tick_count++;
+            }
+            if (rp->segment_count >= cap) {
+                cap = cap ? cap * 2 : 256;
+                rp->scanned = realloc(rp->scanned, (size_t)cap * sizeof(ReplayIndexEntry));
+            }
+            rp->scanned[rp->segment_count++] = e;
+            off = p;
+        }
+        rp->index = rp->scanned;
+        fprintf(stderr, "replay: %s has no index (recovered %d keyframes)\n", path, rp->segment_count);
+    }
+    if (rp->segment_count == 0) {
+        ReplayClose(rp);
+        return false;
+    }
+
+    // 長さは最後のセグメントの入力を足して求める（索引のないファイルはヘッダーが空のため）
+    const ReplayIndexEntry *last = &rp->index[rp->segment_count - 1];
+    rp->tick_count = last->first_tick + last->tick_count;
+    rp->duration = last->start_time;
+    const ReplayTick *ticks = (const ReplayTick *)(rp->data + last->offset + sizeof(ReplaySegmentHeader) + last->state_bytes);
+    for (uint32_t i=0; i<last->tick_count; i++) rp->duration += ticks[i].dt;
+    return true;
+}
+
+void ReplayClose(ReplayPlayer *rp) {
+    if (rp->data) munmap((void *)rp->data, rp->size);
+    free(rp->scanned);
+    memset(rp, 0, sizeof(*rp));
+}
+
+// 開始時刻が t 以下の最後のセグメント
+int ReplayFindSegment(const ReplayPlayer *rp, double t) {
+    int lo = 0, hi = rp->segment_count - 1;
+    while (lo < hi) {
+        int mid = (lo + hi + 1) / 2;
+        if (rp->index[mid].start_time <= t) lo = mid;
+        else hi = mid - 1;
+    }
+    return lo;
+}
+
+// 次に進めるティックの入力（終わりなら NULL）
+const ReplayTick *ReplayNextTick(const ReplayPlayer *rp) {
+    int seg = rp->segment;
+    const ReplayIndexEntry *e = &rp->index[seg];
+    if (rp->tick >= e->first_tick + e->tick_count) {
+        if (seg + 1 >= rp->segment_count) return NULL;
+        e = &rp->index[++seg];
+        if (rp->tick >= e->first_tick + e->tick_count) return NULL;
+    }
+    const ReplayTick *ticks = (const ReplayTick *)(rp->data + e->offset + sizeof(ReplaySegmentHeader) + e->state_bytes);
+    return &ticks[rp->tick - e->first_tick];
+}
+
+void ReplayRestoreSegment(ReplayPlayer *rp, int seg) {
+    const ReplayIndexEntry *e = &rp->index[seg];
+    ReplayRestoreState(rp->data + e->offset + sizeof(ReplaySegmentHeader));
+    rp->segment = seg;
+    rp->tick = e->first_tick;
+    rp->time = e->start_time;
+}
+
+// 1ティック進める。セグメントの終わりでは次のキーフレームと突き合わせてから、そこから続ける
+bool ReplayStep(ReplayPlayer *rp) {
+    const ReplayIndexEntry *e = &rp->index[rp->segment];
+    if (rp->tick >= e->first_tick + e->tick_count) {
+        if (rp->segment + 1 >= rp->segment_count) return false;
+        const ReplayIndexEntry *next = e + 1;
+        ReplayCaptureState(&replay_scratch);
+        if (!ReplayStateMatches(&replay_scratch, (const ReplayState *)(rp->data + next->offset + sizeof(ReplaySegmentHeader)))) rp->desyncs++;
+        ReplayRestoreSegment(rp, rp->segment + 1);
+    }
+    const ReplayTick *t = ReplayNextTick(rp);
+    if (!t) return false;
+    if (rp->header->mode == 1) StepPvP(t->dt, t->input);
+    else StepGame(t->dt, &t->input[0]);
+    // 進める前の状態のハッシュ（StepGame の先頭で計算したもの）を記録と比べる
+    if ((uint32_t)world_hash.total != t->hash && rp->tick_desyncs++ == 0) rp->first_desync_tick = rp->tick;
+    rp->tick++;
+    rp->time += t->dt;
+    return true;
+}
+
+// t 秒の時点に移る。シミュレーションし直したティック数を返す
+int ReplaySeek(ReplayPlayer *rp, double t) {
+    ReplayRestoreSegment(rp, ReplayFindSegment(rp, t));
+    const ReplayIndexEntry *e = &rp->index[rp->segment];
+    int steps = 0;
+    while (rp->tick < e->first_tick + e->tick_count) {
+        const ReplayTick *k = ReplayNextTick(rp);
+        if (rp->time + k->dt > t) break;
+        ReplayStep(rp);
+        steps++;
+    }
+    return steps;
+}
+
+// 再生（--replay）。SPACE で一時停止、左右で10秒（SHIFT で60秒）、上下で速度、
+// タイムラインをクリック・ドラッグでシーク
+int RunReplay(const char *path) {
+    static ReplayPlayer rp;
+    if (!ReplayOpen(&rp, path)) {
+        fprintf(stderr, "replay: cannot open %s\n", path);
+        return 1;
+    }
+    late_latch_enabled = false;
+    input_thread_enabled = false;
+    InitGameWindow();
+    difficulty = (DifficultyMode)rp.header->difficulty;
+    InitGame(true);
+    camera2 = camera;
+    ReplayRestoreSegment(&rp, 0);
+    printf("replay %s: %s, %d keyframes, %llu ticks\n", path, FormatReplayTime(rp.duration), rp.segment_count, (unsigned long long)rp.tick_count);
+
+    double speed = 1.0, acc = 0, seekMs = 0, lastDrag = 0;
+    int seekTicks = 0;
+    bool paused = false, dragging = false;
+    while (!WindowShouldClose()) {
+        FrameLimiterWait();
+        WorldFrameReset();
+        double frameStart = GetTime();
+        float dt = GetFrameTime();
+        if (screen_shake > 0) screen_shake -= dt * 30.0f;
+        if (screen_shake < 0) screen_shake = 0;
+
+        double jump = (IsKeyDown(KEY_LEFT_SHIFT) || IsKeyDown(KEY_RIGHT_SHIFT)) ? 60.0 : 10.0;
+        double seekTo = -1;
+        if (IsKeyPressed(KEY_SPACE)) paused = !paused;
+        if (IsKeyPressed(KEY_RIGHT)) seekTo = rp.time + jump;
+        if (IsKeyPressed(KEY_LEFT)) seekTo = fmax(rp.time - jump, 0.0);
+        if (IsKeyPressed(KEY_HOME)) seekTo = 0;
+        if (IsKeyPressed(KEY_UP) && speed < 16.0) speed *= 2.0;
+        if (IsKeyPressed(KEY_DOWN) && speed > 0.25) speed *= 0.5;
+
+        // ドラッグ中のシークは間引く（離したところには必ず合わせる）
+        Rectangle bar = ReplayTimelineRect();
+        Vector2 mouse = GetMousePosition();
+        Rectangle hit = { bar.x, bar.y - 8, bar.width, bar.height + 16 };
+        if (IsMouseButtonPressed(MOUSE_LEFT_BUTTON) && CheckCollisionPointRec(mouse, hit)) dragging = true;
+        if (dragging) {
+            double t = Clamp((mouse.x - bar.x) / bar.width, 0.0f, 1.0f) * rp.duration;
+            bool released = !IsMouseButtonDown(MOUSE_LEFT_BUTTON);
+            if (released || GetTime() - lastDrag > 1.0 / 15.0) {
+                seekTo = t;
+                lastDrag = GetTime();
+            }
+            if (released) dragging = false;
+        }
+
+        if (seekTo >= 0) {
+            double t0 = NetNow();
+            seekTicks = ReplaySeek(&rp, fmin(seekTo, rp.duration));
+            seekMs = (NetNow() - t0) * 1000.0;
+            acc = 0;
+        } else if (!paused) {
+            acc += dt * speed;
+            int steps = 0;
+            const ReplayTick *k;
+            while (steps < REPLAY_MAX_STEPS_PER_FRAME && (k = ReplayNextTick(&rp)) && acc >= k->dt) {
+                acc -= k->dt;
+                ReplayStep(&rp);
+                steps++;
+            }
+            if (steps == REPLAY_MAX_STEPS_PER_FRAME || !ReplayNextTick(&rp)) acc = 0;
+        }
+        if (rp.header->mode == 1) UpdatePvPCameras();
+        else UpdateFollowCamera(player.position, dt);
+        if (IsKeyPressed(KEY_F3)) quality.show = !quality.show;
+        if (IsKeyPressed(KEY_F4)) bloom_enabled = !bloom_enabled;
+        if (IsKeyPressed(KEY_F5)) radar_enabled = !radar_enabled;
+        if (IsKeyPressed(KEY_F9)) ToggleCapture(NULL);
+        double simEnd = GetTime();
+
+        BeginDrawing();
+        if (rp.header->mode == 1) DrawGamePvP();
+        else DrawGame();
+        CapturePresentedFrame();
+        DrawReplayControls(&rp, speed, paused, seekMs, seekTicks);
+        DrawQualityOverlay();
+        double drawEnd = GetTime();
+        EndDrawing();
+        UpdateQuality((float)(simEnd - frameStart), (float)(drawEnd - simEnd));
     }
-    rlEnd();
+    if (rp.desyncs > 0) printf("replay: %d keyframes did not match the simulation\n", rp.desyncs);
+    if (rp.tick_desyncs > 0) {
+        printf("replay: %d ticks did not match the recorded state hash (first at tick %llu)\n", rp.tick_desyncs,
+               (unsigned long long)rp.first_desync_tick);
+    }
+    ReplayClose(&rp);
+    CloseGameWindow();
+    return 0;
 }
 
-void DrawMecha(Vector3 pos, float angle, Color color, float anim_time, EnemyType type) {
-    rlPushMatrix();
-    rlTranslatef(pos.x, pos.y, pos.z);
-    rlRotatef(angle * RAD2DEG, 0, 1, 0);
-    
-    float scale = (type == ENEMY_BOSS) ? 2.5f : 1.0f;
-    rlScalef(scale, scale, scale);
+Rectangle ReplayTimelineRect() {
+    return (Rectangle){ 20, (float)GetScreenHeight() - 56, (float)GetScreenWidth() - 40, 8 };
+}
 
-    float bounce = sinf(anim_time * 15.0f) * 0.1f;
-    if (type == ENEMY_TANK) bounce *= 0.2f;
-    rlTranslatef(0, bounce, 0);
+// タイムラインと再生状況（録画には入れない）
+void DrawReplayControls(const ReplayPlayer *rp, double speed, bool paused, double seekMs, int seekTicks) {
+    Rectangle bar = ReplayTimelineRect();
+    float f = rp->duration > 0 ? (float)(rp->time / rp->duration) : 0.0f;
+    DrawRectangle((int)bar.x - 4, (int)bar.y - 22, (int)bar.width + 8, (int)bar.height + 30, (Color){ 0, 0, 0, 150 });
+    DrawRectangleRec(bar, (Color){ 40, 40, 60, 255 });
+    // キーフレームの目盛り（多いときは間引く）
+    int every = rp->segment_count / 200 + 1;
+    for (int i=0; i<rp->segment_count; i += every) {
+        float x = bar.x + bar.width * (float)(rp->index[i].start_time / rp->duration);
+        DrawLine((int)x, (int)bar.y, (int)x, (int)(bar.y + bar.height), (Color){ 90, 90, 120, 255 });
+    }
+    DrawRectangle((int)bar.x, (int)bar.y, (int)(bar.width * f), (int)bar.height, COL_NEON_CYAN);
+    DrawCircle((int)(bar.x + bar.width * f), (int)(bar.y + bar.height / 2), 6, WHITE);
+    DrawText(TextFormat("%s  %s / %s  x%g  seek %.2f ms (%d ticks)%s", paused ? "PAUSE" : "PLAY",
+                        FormatReplayTime(rp->time), FormatReplayTime(rp->duration), speed, seekMs, seekTicks,
+                        rp->desyncs > 0 ? TextFormat("  DESYNC %d", rp->desyncs) : ""),
+             (int)bar.x, (int)bar.y - 18, 10, rp->desyncs > 0 ? COL_NEON_ORANGE : WHITE);
+}
 
-    float bodySize = (type == ENEMY_TANK || type == ENEMY_BOSS) ? 1.5f : 0.8f;
-    
-    DrawCube((Vector3){0, bodySize, 0}, bodySize, bodySize, bodySize, color);
-    DrawCubeWires((Vector3){0, bodySize, 0}, bodySize, bodySize, bodySize, WHITE); 
+// h:mm:ss.s（同じ式の中で2回使えるよう、バッファを交互に使う）
+const char *FormatReplayTime(double t) {
+    static char buf[2][32];
+    static int next = 0;
+    char *s = buf[next];
+    next ^= 1;
+    long long ds = (long long)(t * 10.0 + 0.5);
+    snprintf(s, sizeof(buf[0]), "%lld:%02lld:%04.1f", ds / 36000, (ds / 600) % 60, (ds % 600) / 10.0);
+    return s;
+}
 
-    Vector3 headPos = {0, bodySize * 1.8f, 0};
-    float headSize = bodySize * 0.6f;
-    DrawCube(headPos, headSize, headSize, headSize, GRAY);
-    DrawCube((Vector3){0, headPos.y, headSize/2 + 0.05f}, headSize*0.8f, headSize*0.3f, 0.1f, COL_NEON_CYAN);
+// localhost 上でボットを接続し、人数・敵数ごとのティック負荷と帯域を測る
+int RunServerBench() {
+    const int playerCounts[] = { 1, 2, 4, 8 };
+    const int enemyCounts[] = { 25, 50, enemy_capacity };
+    const int warmupTicks = 30, measureTicks = 300;
+    const float dt = 1.0f / NET_TICK_RATE;
+    static NetClient bots[MAX_NET_PLAYERS];
 
-    float legOffset = bodySize * 0.4f;
-    float legLength = (type == ENEMY_TANK) ? 0.8f : 1.0f;
-    float legAngle = sinf(anim_time * 15.0f) * 30.0f;
+    printf("players enemies | sim ms  snapshot ms  tick ms (max) | ents/client  KB/s/client  bytes/snapshot\n");
+    for (int pc=0; pc<(int)(sizeof(playerCounts)/sizeof(playerCounts[0])); pc++) {
+        for (int ec=0; ec<(int)(sizeof(enemyCounts)/sizeof(enemyCounts[0])); ec++) {
+            int nPlayers = playerCounts[pc], nEnemies = enemyCounts[ec];
+            if (!NetServerStart(0)) { fprintf(stderr, "bench: cannot open socket\n"); return 1; }
+            int port = NetSocketPort(net_socket);
+            for (int i=0; i<nPlayers; i++) {
+                if (!NetClientOpen(&bots[i], "127.0.0.1", port)) { fprintf(stderr, "bench: bot socket failed\n"); return 1; }
+                NetClientSendHello(&bots[i]);
+            }
+            for (int tries=0; tries<100; tries++) {
+                NetServerReceive();
+                bool all = true;
+                for (int i=0; i<nPlayers; i++) { NetClientReceive(&bots[i]); if (bots[i].slot < 0) all = false; }
+                if (all) break;
+                NetSleepUntil(NetNow() + 0.001);
+            }
+            kills_required_for_boss = 1 << 30;
 
-    rlPushMatrix();
-    rlTranslatef(-legOffset, bodySize/2, 0);
-    rlRotatef(legAngle, 1, 0, 0);
-    DrawCube((Vector3){0, -legLength/2, 0}, 0.3f, legLength, 0.3f, DARKGRAY);
-    rlPopMatrix();
+            double simSum = 0, snapSum = 0, tickMax = 0;
+            uint64_t bytesStart = 0, entSum = 0;
+            for (int t=0; t<warmupTicks + measureTicks; t++) {
+                if (t == warmupTicks) {
+                    for (int s=0; s<MAX_NET_PLAYERS; s++) bytesStart += net_slots[s].total_out;
+                }
+                for (int i=0; i<nPlayers; i++) {
+                    NetClientReceive(&bots[i]);
+                    int s = bots[i].slot;
+                    if (s < 0) continue;
+                    float a = (float)t * 0.05f + i;
+                    PlayerInput in = { 0 };
+                    in.move_x = cosf(a); in.move_z = sinf(a);
+                    in.aim_point = Vector3Add(net_players[s].position, (Vector3){ cosf(a * 3.0f) * 10.0f, 0, sinf(a * 3.0f) * 10.0f });
+                    in.fire = true;
+                    in.dash = (t % 90) == i;
+                    NetClientSendInput(&bots[i], &in);
+                }
+                NetServerReceive();
+                // 敵数を目標値に保つ・プレイヤーは倒れない
+                int active = 0;
+                for (int e=0; e<enemy_slots; e++) if (enemies[e].active) active++;
+                for (; active < nEnemies; active++) SpawnEnemy(false);
+                for (int s=0; s<sim_player_count; s++) if (net_slots[s].connected) net_players[s].hp = net_players[s].max_hp;
 
-    rlPushMatrix();
-    rlTranslatef(legOffset, bodySize/2, 0);
-    rlRotatef(-legAngle, 1, 0, 0);
-    DrawCube((Vector3){0, -legLength/2, 0}, 0.3f, legLength, 0.3f, DARKGRAY);
-    rlPopMatrix();
-    
-    if (type == ENEMY_BOSS) {
-        rlPushMatrix();
-        rlTranslatef(0, bodySize * 1.5f, -0.5f);
-        DrawCube((Vector3){0,0,0}, 1.2f, 1.2f, 0.5f, DARKGRAY);
-        DrawCube((Vector3){0.8f, 0.5f, 0.2f}, 0.2f, 0.2f, 1.0f, COL_NEON_ORANGE);
-        DrawCube((Vector3){-0.8f, 0.5f, 0.2f}, 0.2f, 0.2f, 1.0f, COL_NEON_ORANGE);
-        rlPopMatrix();
+                double t0 = NetNow();
+                NetServerTick(dt);
+                double t1 = NetNow();
+                NetServerSendSnapshots();
+                double t2 = NetNow();
+                if (t >= warmupTicks) {
+                    simSum += t1 - t0;
+                    snapSum += t2 - t1;
+                    if (t2 - t0 > tickMax) tickMax = t2 - t0;
+                    for (int s=0; s<MAX_NET_PLAYERS; s++) if (net_slots[s].connected) entSum += net_slots[s].entity_count;
+                }
+            }
+            uint64_t bytesEnd = 0;
+            for (int s=0; s<MAX_NET_PLAYERS; s++) bytesEnd += net_slots[s].total_out;
+            double perClientPerTick = (double)(bytesEnd - bytesStart) / nPlayers / measureTicks;
+            printf("%7d %7d | %6.3f  %11.3f  %7.3f (%.3f) | %11.1f  %11.2f  %14.1f\n",
+                   nPlayers, nEnemies,
+                   simSum * 1000.0 / measureTicks, snapSum * 1000.0 / measureTicks,
+                   (simSum + snapSum) * 1000.0 / measureTicks, tickMax * 1000.0,
+                   (double)entSum / nPlayers / measureTicks,
+                   perClientPerTick * NET_TICK_RATE / 1024.0, perClientPerTick);
+            for (int i=0; i<nPlayers; i++) NetClientClose(&bots[i]);
+            NetServerStop();
+        }
     }
-    rlPopMatrix();
-    
-    rlBegin(RL_TRIANGLES);
-        Color shadow = (Color){0,0,0, 100};
-        float shadowSize = bodySize * 0.8f;
-        rlColor4ub(shadow.r, shadow.g, shadow.b, shadow.a);
-        rlVertex3f(pos.x - shadowSize, 0.05f, pos.z - shadowSize);
-        rlVertex3f(pos.x - shadowSize, 0.05f, pos.z + shadowSize);
-        rlVertex3f(pos.x + shadowSize, 0.05f, pos.z + shadowSize);
-        rlVertex3f(pos.x - shadowSize, 0.05f, pos.z - shadowSize);
-        rlVertex3f(pos.x + shadowSize, 0.05f, pos.z + shadowSize);
-        rlVertex3f(pos.x + shadowSize, 0.05f, pos.z - shadowSize);
-    rlEnd();
+    return 0;
 }
 
-void UpdateGame() {
-    float dt = GetFrameTime();
-    game_time += dt;
+// ベンチマーク（--bench <name>）
+int RunBench(const char *name, const char *arg) {
+    if (strcmp(name, "bullets") == 0) return RunBulletBench();
+    if (strcmp(name, "weapons") == 0) return RunWeaponBench();
+    if (strcmp(name, "bloom") == 0) return RunBloomBench();
+    if (strcmp(name, "seek") == 0) return RunSeekBench(arg);
+    if (strcmp(name, "enemies") == 0) return RunEnemyBench();
+    if (strcmp(name, "telemetry") == 0) return RunTelemetryBench();
+    if (strcmp(name, "renderqueue") == 0) return RunRenderQueueBench();
+    if (strcmp(name, "radar") == 0) return RunRadarBench();
+    if (strcmp(name, "hash") == 0) return RunHashBench();
+    if (strcmp(name, "roam") == 0) return RunRoamBench();
+    fprintf(stderr, "unknown bench '%s' (available: bullets, weapons, bloom, seek, enemies, telemetry, renderqueue, radar, hash, roam)\n", name);
+    return 1;
+}
 
-    // 特殊状態
-    if (current_state == STATE_GAMEOVER) {
-        if (IsKeyPressed(KEY_R)) {
-            current_state = STATE_TITLE;
-            camera_angle_rad = 0.0f;
+// 敵弾プールの更新コスト。旧方式（Bullet 配列＋Vector3Distance）とも比べる
+int RunBulletBench() {
+    const int bulletCounts[] = { 1000, 2000, 4000, 8000, 16000 };
+    const int ticks = 300;
+    const float dt = 1.0f / 60.0f;
+    static Bullet legacy[MAX_ENEMY_BULLETS];
+
+    SetRandomSeed(1);
+    current_stage = 1;
+    ArenaGenerate(current_stage);
+    InitPlayer(&player, (Vector3){ 0, 0, 0 });
+    sim_players[0] = &player;
+    sim_player_count = 1;
+
+    printf("bullets | pool ms/tick  ns/bullet  ms/1k | legacy ms/tick  ms/1k | speedup\n");
+    for (int c=0; c<(int)(sizeof(bulletCounts)/sizeof(bulletCounts[0])); c++) {
+        int count = bulletCounts[c];
+        if (count > enemy_bullets.capacity) break;     // --budget で小さくしたとき
+        double poolSum = 0, legacySum = 0;
+        for (int t=0; t<ticks; t++) {
+            // 消えた分を補充してから計測（補充は計測外）
+            while (enemy_bullets.count < count) {
+                float a = GetRandomValue(0, 3600) * 0.1f * DEG2RAD, r = (float)GetRandomValue(5, 40);
+                float va = GetRandomValue(0, 3600) * 0.1f * DEG2RAD;
+                SpawnEnemyBullet(cosf(a) * r, sinf(a) * r, cosf(va) * 10.0f, sinf(va) * 10.0f,
+                                 ENEMY_BULLET_PATTERN_LIFE, ENEMY_BULLET_PATTERN);
+            }
+            for (int i=0; i<count; i++) {
+                if (legacy[i].active) continue;
+                legacy[i].active = true;
+                legacy[i].position = (Vector3){ enemy_bullets.x[i], ENEMY_BULLET_Y, enemy_bullets.z[i] };
+                legacy[i].velocity = (Vector3){ enemy_bullets.vx[i], 0, enemy_bullets.vz[i] };
+                legacy[i].life_time = ENEMY_BULLET_PATTERN_LIFE;
+            }
+            player.hp = player.max_hp;
+            player.invincible_timer = 0;
+            current_state = STATE_PLAYING;
+
+            double t0 = NetNow();
+            UpdateEnemyBullets(dt);
+            double t1 = NetNow();
+            // 旧方式：全スロットを走査し、弾ごとにセル判定と 3D 距離
+            Vector3 playerCenter = { player.position.x, 1.0f, player.position.z };
+            for (int i=0; i<count; i++) {
+                if (!legacy[i].active) continue;
+                legacy[i].position = Vector3Add(legacy[i].position, Vector3Scale(legacy[i].velocity, dt));
+                legacy[i].life_time -= dt;
+                if (legacy[i].life_time <= 0) { legacy[i].active = false; continue; }
+                if (ArenaSolidCell(ArenaCellCoord(legacy[i].position.x), 0, ArenaCellCoord(legacy[i].position.z))) { legacy[i].active = false; continue; }
+                if (Vector3Distance(legacy[i].position, playerCenter) < 2.0f) legacy[i].active = false;
+            }
+            double t2 = NetNow();
+            poolSum += t1 - t0;
+            legacySum += t2 - t1;
         }
-        return;
+        double poolMs = poolSum * 1000.0 / ticks, legacyMs = legacySum * 1000.0 / ticks;
+        printf("%7d | %12.4f  %9.2f  %5.4f | %14.4f  %5.4f | %6.2fx\n",
+               count, poolMs, poolMs * 1e6 / count, poolMs * 1000.0 / count,
+               legacyMs, legacyMs * 1000.0 / count, legacyMs / poolMs);
+        enemy_bullets.count = 0;
+        for (int i=0; i<MAX_ENEMY_BULLETS; i++) legacy[i].active = false;
     }
-    if (current_state == STATE_STAGE_CLEAR) {
-        state_timer += dt;
-        if (state_timer > 3.0f) {
-            current_stage++;
-            ResetStage();
-            current_state = STATE_PLAYING;
+
+    // ボスの弾幕を実時間 60 秒ぶん回したときの生成数と同時弾数
+    printf("\nboss patterns (60 s @ 60 Hz, player invincible)\n");
+    printf("stage | spawned/s  peak alive  dropped  ms/tick\n");
+    int failed = 0;
+    for (int stage=1; stage<=BOSS_PATTERN_SETS; stage++) {
+        current_stage = stage;
+        ArenaGenerate(stage);
+        // 数だけ戻す（列はワールドの領域にあるので、構造体ごと消すと容量 0 になって全部捨てられる）
+        enemy_bullets.count = enemy_bullets.peak = enemy_bullets.dropped = 0;
+        enemy_bullets.next_serial = 0;
+        Enemy boss = { 0 };
+        boss.active = true;
+        boss.type = ENEMY_BOSS;
+        boss.position = (Vector3){ 0, 0, 10.0f };
+        double sum = 0;
+        const int frames = 60 * 60;
+        for (int f=0; f<frames; f++) {
+            player.invincible_timer = 1.0f;
+            double t0 = NetNow();
+            UpdateBossPattern(&boss, player.position, dt);
+            UpdateEnemyBullets(dt);
+            sum += NetNow() - t0;
+        }
+        printf("%5d | %9.1f  %10d  %7d  %7.4f\n", stage, enemy_bullets.next_serial / 60.0,
+               enemy_bullets.peak, enemy_bullets.dropped, sum * 1000.0 / frames);
+        if (enemy_bullets.peak == 0) {
+            fprintf(stderr, "bench: stage %d boss patterns spawned no bullets (capacity %d, dropped %d)\n",
+                    stage, enemy_bullets.capacity, enemy_bullets.dropped);
+            failed = 1;
         }
-        return;
     }
-    if (current_state == STATE_BOSS_INTRO) {
-        AddScreenShake(0.1f); 
-        state_timer += dt;
-        if (state_timer > 2.0f) {
-            SpawnEnemy(true);
-            current_state = STATE_PLAYING;
+    enemy_bullets.count = 0;
+    return failed;
+}
+
+// 全敵を総当たりで調べる版（ベンチマークの比較・検算用）
+int EnemyRayQueryBrute(Vector3 origin, Vector3 dir, float maxDist, bool firstOnly, RayHit *hits, int maxHits) {
+    float invX = (dir.x != 0) ? 1.0f / dir.x : 1e30f, invZ = (dir.z != 0) ? 1.0f / dir.z : 1e30f;
+    float best = maxDist;
+    int n = 0;
+    for (int e=0; e<enemy_slots; e++) {
+        if (!enemies[e].active || !enemies[e].is_grounded) continue;
+        float t;
+        if (!RayHitsBox2D(origin, invX, invZ, EnemyHitbox(&enemies[e]), maxDist, &t)) continue;
+        if (firstOnly) {
+            if (t < best || n == 0) { best = t; hits[0] = (RayHit){ e, t }; n = 1; }
+        } else if (n < maxHits) hits[n++] = (RayHit){ e, t };
+    }
+    return n;
+}
+
+// 画面いっぱいの敵に対するレール（貫通・全ヒット）とレーザー（最初の1体）のクエリ性能
+int RunWeaponBench() {
+    const int queries = 200000;
+    SetRandomSeed(1);
+    current_stage = 3;
+    ArenaGenerate(current_stage);
+    InitPlayer(&player, (Vector3){ 0, 0, 0 });
+    sim_players[0] = &player;
+    sim_player_count = 1;
+
+    // 全スロットに敵を置く（後ろの 1/4 はタンク、ボスの枠にボス）
+    for (int i=0; i<enemy_slots; i++) {
+        enemies[i] = (Enemy){ 0 };
+        enemies[i].active = true;
+        enemies[i].is_grounded = true;
+        enemies[i].type = (i >= enemy_capacity) ? ENEMY_BOSS : (i >= enemy_capacity * 3 / 4 ? ENEMY_TANK : ENEMY_DRONE);
+        enemies[i].position = (Vector3){ (float)GetRandomValue(-300, 300) * 0.1f, 0, (float)GetRandomValue(-300, 300) * 0.1f };
+        enemies[i].hp = enemies[i].max_hp = 1 << 30;
+    }
+
+    const int builds = 10000;
+    double t0 = NetNow();
+    for (int k=0; k<builds; k++) EnemyHitGridBuild();
+    double buildUs = (NetNow() - t0) * 1e6 / builds;
+    printf("enemies %d  grid %dx%d (cell %.0f)  refs %d  build %.2f us\n",
+           enemy_slots, HIT_GRID_DIM, HIT_GRID_DIM, HIT_GRID_CELL, enemy_hit_grid.ref_count, buildUs);
+
+    static Vector3 origins[1024], dirs[1024];
+    for (int k=0; k<1024; k++) {
+        float a = GetRandomValue(0, 3600) * 0.1f * DEG2RAD;
+        origins[k] = (Vector3){ (float)GetRandomValue(-100, 100) * 0.1f, ENEMY_BULLET_Y, (float)GetRandomValue(-100, 100) * 0.1f };
+        dirs[k] = (Vector3){ cosf(a), 0, sinf(a) };
+    }
+
+    printf("weapon  query  | queries/ms  hits/ms  hits/query | mismatches\n");
+    for (int w=0; w<2; w++) {
+        bool firstOnly = (w == 1);
+        float range = firstOnly ? LASER_RANGE : RAIL_RANGE;
+        const char *name = firstOnly ? "laser" : "rail";
+        long hitsGrid = 0, hitsBrute = 0, mismatches = 0;
+        double gridSec = 0, bruteSec = 0;
+        RayHit hits[MAX_RAY_HITS], ref[MAX_RAY_HITS];
+        for (int q=0; q<queries; q++) {
+            Vector3 o = origins[q & 1023], d = dirs[q & 1023];
+            double a = NetNow();
+            int n = EnemyRayQuery(o, d, range, firstOnly, hits, MAX_RAY_HITS);
+            double b = NetNow();
+            int m = EnemyRayQueryBrute(o, d, range, firstOnly, ref, MAX_RAY_HITS);
+            double c = NetNow();
+            gridSec += b - a;
+            bruteSec += c - b;
+            hitsGrid += n;
+            hitsBrute += m;
+            if (n != m || (firstOnly && n > 0 && (hits[0].enemy != ref[0].enemy || fabsf(hits[0].t - ref[0].t) > 1e-4f))) mismatches++;
         }
-        return; 
+        printf("%-6s  grid   | %10.1f  %7.1f  %10.2f | %ld\n", name,
+               queries / (gridSec * 1000.0), hitsGrid / (gridSec * 1000.0), (double)hitsGrid / queries, mismatches);
+        printf("%-6s  brute  | %10.1f  %7.1f  %10.2f |\n", name,
+               queries / (bruteSec * 1000.0), hitsBrute / (bruteSec * 1000.0), (double)hitsBrute / queries);
     }
 
-    // 視点移動
-    if (IsKeyDown(KEY_E)) camera_angle_rad -= 2.0f * dt;
-    if (IsKeyDown(KEY_Q)) camera_angle_rad += 2.0f * dt;
+    // 壁までの距離（レール・レーザーが毎発行う）
+    int cell;
+    double wallSum = 0;
+    t0 = NetNow();
+    for (int q=0; q<queries; q++) wallSum += ArenaRayDistance(origins[q & 1023], dirs[q & 1023], RAIL_RANGE, &cell);
+    printf("arena wall ray | %10.1f queries/ms (avg dist %.1f)\n", queries / ((NetNow() - t0) * 1000.0), wallSum / queries);
+    return 0;
+}
 
-    float camDistH = 18.0f;
-    float camHeight = 25.0f;
-    float camOffsetX = sinf(camera_angle_rad) * camDistH;
-    float camOffsetZ = cosf(camera_angle_rad) * camDistH;
+// ブルームの1フレームあたりのコスト。ウィンドウを隠して実際に描画し、敵の数・分割画面で比べる
+// （LIBGL_ALWAYS_SOFTWARE=1 を付けると Mesa のソフトウェア GL で測れる）
+int RunBloomBench() {
+    const int warmup = 10, frames = 120;
+    const int enemyCounts[] = { 0, enemy_capacity };
+    const int mips[3] = { 0, 2, 1 };
+    SetConfigFlags(FLAG_WINDOW_HIDDEN);
+    input_thread_enabled = false;
+    frame_limiter_enabled = true;   // 垂直同期を切る（リミッターの待ちは呼ばない）
+    InitGameWindow();
+    SetWindowSize(1280, 720);
+    SetTargetFPS(0);
+    if (!bloom_ready) {
+        fprintf(stderr, "bench: bloom shaders unavailable\n");
+        CloseGameWindow();
+        return 1;
+    }
 
-    Vector3 targetCamPos = {
-        player.position.x + camOffsetX,
-        camHeight,
-        player.position.z + camOffsetZ
-    };
+    SetRandomSeed(1);
+    InitGame(true);
+    player.position = (Vector3){ -10, 0, 0 };
+    player2.position = (Vector3){ 10, 0, 0 };
+    camera2 = camera;
 
-    Ray ray = GetMouseRay(GetMousePosition(), camera);
-    float t = -ray.position.y / ray.direction.y;
-    Vector3 aim_point = Vector3Add(ray.position, Vector3Scale(ray.direction, t));
-    
-    float shakeX = (float)GetRandomValue(-10, 10) * 0.05f * screen_shake;
-    float shakeZ = (float)GetRandomValue(-10, 10) * 0.05f * screen_shake;
-    Vector3 finalCamPos = Vector3Add(targetCamPos, (Vector3){shakeX, 0, shakeZ});
+    printf("%dx%d, %d frames per case (ms/frame, GPU included)\n", GetScreenWidth(), GetScreenHeight(), frames);
+    printf("view   enemies |  off     1/4     1/2   | +1/4    +1/2   | bloom cpu ms\n");
+    for (int split=0; split<2; split++) {
+        current_state = split ? STATE_PVP : STATE_PLAYING;
+        for (int ec=0; ec<(int)(sizeof(enemyCounts)/sizeof(enemyCounts[0])); ec++) {
+            for (int i=0; i<enemy_slots; i++) enemies[i] = (Enemy){ 0 };
+            for (int i=0; i<enemyCounts[ec]; i++) {
+                Enemy e = { 0 };
+                e.active = true;
+                e.is_grounded = true;
+                e.type = (i % 4 == 0) ? ENEMY_TANK : ENEMY_DRONE;
+                e.position = (Vector3){ (float)GetRandomValue(-300, 300) * 0.1f, 0, (float)GetRandomValue(-300, 300) * 0.1f };
+                e.hp = e.max_hp = 100;
+                enemies[AllocEnemySlot(e.type)] = e;
+            }
+            EnemyBucketsRebuild();
+            double ms[3];
+            for (int m=0; m<3; m++) {
+                bloom_mip_override = mips[m];
+                double t0 = 0;
+                for (int f=0; f<warmup + frames; f++) {
+                    if (f == warmup) {
+                        // 溜まった描画を終わらせてから測り始める
+                        Image sync = LoadImageFromScreen();
+                        UnloadImage(sync);
+                        t0 = NetNow();
+                        bloom_cpu_avg = 0;
+                    }
+                    WorldFrameReset();
+                    BeginDrawing();
+                    if (split) DrawGamePvP();
+                    else DrawGame();
+                    EndDrawing();
+                }
+                Image sync = LoadImageFromScreen();
+                UnloadImage(sync);
+                ms[m] = (NetNow() - t0) * 1000.0 / frames;
+            }
+            printf("%-6s %7d | %6.2f  %6.2f  %6.2f | %+6.2f  %+6.2f | %6.3f\n", split ? "split" : "single", enemyCounts[ec],
+                   ms[0], ms[1], ms[2], ms[1] - ms[0], ms[2] - ms[0], bloom_cpu_avg * 1000.0f);
+        }
+    }
+    bloom_mip_override = -1;
+    CloseGameWindow();
+    return 0;
+}
 
-    camera.position = Vector3Lerp(camera.position, finalCamPos, 0.1f);
-    camera.target = Vector3Lerp(camera.target, player.position, 0.1f);
+// 決まった場面を非表示のウィンドウに垂直同期なしで描き続け、1フレームあたりの CPU の発行時間
+// （描画関数を呼んで溜まったバッチを GL に渡し終えるまで）、フレーム全体の時間（GPU 込み）、
+// ドローコール・バッチのフラッシュ・頂点数を表示する。
+// 場面ごとに1枚だけ画面のハッシュを取り、ファイルがあれば突き合わせ、なければ書き出す
+// （アニメーションの時刻は止めてあるので、描画の結果が変わらなければ同じ値になる）
+int RunRenderBench(const char *hashPath) {
+    const char *names[RENDER_SCENE_COUNT] = { "title", "wave100-3d", "wave100", "boss", "pvp" };
+    SetConfigFlags(FLAG_WINDOW_HIDDEN);
+    input_thread_enabled = false;
+    late_latch_enabled = false;
+    frame_limiter_enabled = true;   // 垂直同期を切る（リミッターの待ちは呼ばない）
+    InitGameWindow();
+    SetWindowSize(OFFSCREEN_WIDTH, OFFSCREEN_HEIGHT);
+    SetTargetFPS(0);
+    anim_time_fixed = RENDER_BENCH_ANIM_TIME;
+    bool counted = RenderStatsInstall();
 
-    Vector3 diff = Vector3Subtract(aim_point, player.position);
-    player.facing_angle = -atan2f(diff.z, diff.x) + PI/2;
+    // 前回のハッシュ（なければこの回のものを書き出す）
+    uint64_t expected[RENDER_SCENE_COUNT] = { 0 };
+    bool haveExpected[RENDER_SCENE_COUNT] = { false };
+    FILE *hf = hashPath ? fopen(hashPath, "r") : NULL;
+    bool compare = (hf != NULL);
+    if (hf) {
+        char name[64];
+        unsigned long long h;
+        while (fscanf(hf, "%63s %llx", name, &h) == 2) {
+            for (int k=0; k<RENDER_SCENE_COUNT; k++) {
+                if (strcmp(name, names[k]) == 0) { expected[k] = h; haveExpected[k] = true; }
+            }
+        }
+        fclose(hf);
+    }
 
-    UpdateTrail(&player);
-    if (player.invincible_timer > 0) player.invincible_timer -= dt;
-    
-    //プレイヤー移動
-    Vector3 move = {0};
-    Vector3 forward = { -sinf(camera_angle_rad), 0, -cosf(camera_angle_rad) };
-    Vector3 right   = { cosf(camera_angle_rad),  0, -sinf(camera_angle_rad) };
+    printf("%dx%d, %d frames per scene, bloom %s%s\n", GetScreenWidth(), GetScreenHeight(), RENDER_BENCH_FRAMES,
+           (bloom_enabled && bloom_ready) ? "on" : "off", counted ? "" : " (GL call counters unavailable in this build)");
+    printf("scene      | submit ms  frame ms | draws  instanced  flushes   vertices | image hash\n");
+    uint64_t hashes[RENDER_SCENE_COUNT];
+    int mismatches = 0;
+    for (int sc=0; sc<RENDER_SCENE_COUNT; sc++) {
+        RenderBenchSetup(sc);
+        double t0 = 0, submit = 0;
+        for (int f=0; f<RENDER_BENCH_WARMUP + RENDER_BENCH_FRAMES; f++) {
+            if (f == RENDER_BENCH_WARMUP) {
+                // 溜まった描画を終わらせてから測り始める
+                Image sync = LoadImageFromScreen();
+                UnloadImage(sync);
+                RenderStatsReset();
+                t0 = NetNow();
+            }
+            WorldFrameReset();
+            double a = NetNow();
+            BeginDrawing();
+            RenderBenchDraw(sc);
+            rlDrawRenderBatchActive();
+            if (f >= RENDER_BENCH_WARMUP) submit += NetNow() - a;
+            EndDrawing();
+        }
+        Image sync = LoadImageFromScreen();
+        UnloadImage(sync);
+        double frameMs = (NetNow() - t0) * 1000.0 / RENDER_BENCH_FRAMES;
+        RenderStats st;
+        RenderStatsGet(&st);
 
-    if (IsKeyDown(KEY_W)) move = Vector3Add(move, forward);
-    if (IsKeyDown(KEY_S)) move = Vector3Subtract(move, forward);
-    if (IsKeyDown(KEY_D)) move = Vector3Add(move, right);
-    if (IsKeyDown(KEY_A)) move = Vector3Subtract(move, right);
+        // ハッシュは入れ替える前のバックバッファから取る
+        WorldFrameReset();
+        BeginDrawing();
+        RenderBenchDraw(sc);
+        rlDrawRenderBatchActive();
+        hashes[sc] = HashScreen();
+        EndDrawing();
 
-    if ((IsKeyPressed(KEY_SPACE) || IsKeyPressed(KEY_LEFT_SHIFT)) && player.dash_cooldown <= 0) {
-        player.dash_duration = 0.2f;
-        player.dash_cooldown = 1.5f;
-        
-        if (Vector3Length(move) > 0) {
-            player.dash_dir = Vector3Normalize(move);
+        const char *verdict = "";
+        if (compare) {
+            if (!haveExpected[sc]) verdict = "  (new)";
+            else if (expected[sc] == hashes[sc]) verdict = "  ok";
+            else { verdict = "  CHANGED"; mismatches++; }
+        }
+        if (counted) {
+            printf("%-10s | %9.3f  %8.2f | %5.0f  %9.0f  %7.0f  %9.0f | %016llx%s\n", names[sc],
+                   submit * 1000.0 / RENDER_BENCH_FRAMES, frameMs,
+                   (double)st.draw_calls / RENDER_BENCH_FRAMES, (double)st.instanced_calls / RENDER_BENCH_FRAMES,
+                   (double)st.batch_flushes / RENDER_BENCH_FRAMES, (double)st.vertices / RENDER_BENCH_FRAMES,
+                   (unsigned long long)hashes[sc], verdict);
         } else {
-            if (Vector3Length(diff) > 0.1f) player.dash_dir = Vector3Normalize(diff);
-            else player.dash_dir = (Vector3){0, 0, 1};
+            printf("%-10s | %9.3f  %8.2f | %5s  %9s  %7s  %9s | %016llx%s\n", names[sc],
+                   submit * 1000.0 / RENDER_BENCH_FRAMES, frameMs, "-", "-", "-", "-", (unsigned long long)hashes[sc], verdict);
         }
-        SpawnExplosion(player.position, WHITE, 5);
-        AddScreenShake(0.2f);
     }
-    
-    if (player.dash_duration > 0) {
-        player.dash_duration -= dt;
-        player.position = Vector3Add(player.position, Vector3Scale(player.dash_dir, player.speed * 3.0f * dt));
-    } else {
-        if (Vector3Length(move) > 0) {
-            move = Vector3Normalize(move);
-            player.position = Vector3Add(player.position, Vector3Scale(move, player.speed * dt));
-            player.walk_anim_timer += dt;
-        } else player.walk_anim_timer = 0;
+
+    if (hashPath && !compare) {
+        FILE *out = fopen(hashPath, "w");
+        if (out) {
+            for (int k=0; k<RENDER_SCENE_COUNT; k++) fprintf(out, "%s %016llx\n", names[k], (unsigned long long)hashes[k]);
+            fclose(out);
+            printf("image hashes written to %s\n", hashPath);
+        } else {
+            fprintf(stderr, "bench: cannot write %s\n", hashPath);
+        }
+    } else if (compare) {
+        printf("%d of %d scenes changed since %s\n", mismatches, RENDER_SCENE_COUNT, hashPath);
     }
 
-    // 攻撃
-    if (player.shoot_cooldown > 0) player.shoot_cooldown -= dt;
-    if (IsMouseButtonDown(MOUSE_LEFT_BUTTON) && player.shoot_cooldown <= 0) {
-        Vector3 aim_dir = Vector3Normalize(Vector3Subtract(aim_point, player.position));
-        aim_dir.y = 0;
-        SpawnBullet(player.position, aim_dir, false, false);
-        player.shoot_cooldown = 0.15f; 
-        if (player.level > 5) player.shoot_cooldown = 0.12f;
-        if (player.level > 10) player.shoot_cooldown = 0.08f;
-        AddScreenShake(0.1f);
+    RenderStatsRemove();
+    anim_time_fixed = -1.0;
+    CloseGameWindow();
+    return mismatches > 0 ? 1 : 0;
+}
+
+// 場面を作る。乱数の種を固定するので毎回同じ配置になる
+void RenderBenchSetup(int scene) {
+    SetRandomSeed(1);
+    difficulty = MODE_HARD;
+    InitGame(true);
+    current_stage = 8;
+    ResetStage();
+    current_state = STATE_PLAYING;
+    camera_angle_rad = 0;
+    camera.target = player.position;
+    camera.position = (Vector3){ player.position.x, 25.0f, player.position.z + 18.0f };
+
+    if (scene == RENDER_SCENE_TITLE) {
+        current_state = STATE_TITLE;
+        camera.position = (Vector3){ sinf(RENDER_BENCH_ANIM_TIME * 0.3f) * 35.0f, 20.0f, cosf(RENDER_BENCH_ANIM_TIME * 0.3f) * 35.0f };
+        camera.target = (Vector3){ 0, 0, 0 };
+        camera.fovy = 45.0f;
+        return;
     }
 
-    // ヒット判定
-    for (int i=0; i<MAX_BULLETS; i++) {
-        if (!bullets[i].active) continue;
-        bullets[i].position = Vector3Add(bullets[i].position, Vector3Scale(bullets[i].velocity, dt));
-        bullets[i].life_time -= dt;
+    if (scene == RENDER_SCENE_PVP) {
+        current_state = STATE_PVP;
+        player.position = (Vector3){ -10, 0, 0 };
+        player2.position = (Vector3){ 10, 0, 0 };
+        player2.hp = 100; player2.max_hp = 100; player2.speed = 10.0f;
+        UpdatePvPCameras();
+    } else {
+        // ウェーブ（ボス戦は取り巻きを減らす）
+        int count = (scene == RENDER_SCENE_BOSS) ? RENDER_BENCH_ENEMIES / 3 : RENDER_BENCH_ENEMIES;
+        if (count > enemy_capacity) count = enemy_capacity;
+        for (int i=0; i<count; i++) {
+            Enemy e = { 0 };
+            e.active = true;
+            e.is_grounded = true;
+            e.type = (i % 4 == 0) ? ENEMY_TANK : ENEMY_DRONE;
+            e.position = (Vector3){ (float)GetRandomValue(-250, 250) * 0.1f, 0, (float)GetRandomValue(-200, 150) * 0.1f };
+            e.anim_timer = (float)GetRandomValue(0, 100) * 0.01f;
+            e.hp = e.max_hp = 100;
+            enemies[AllocEnemySlot(e.type)] = e;
+        }
+    }
+    if (scene == RENDER_SCENE_BOSS) {
+        SpawnEnemy(true);
+        Enemy *boss = &enemies[enemy_capacity];
+        boss->position = (Vector3){ 0, 0, -12 };
+        boss->hp = boss->max_hp / 2;
 
-        if (bullets[i].life_time <= 0) { 
-            bullets[i].active = false;
-            continue;
+        // 弾幕はボスの周りの輪、パーティクルはプールを使い切る
+        for (int i=0; i<enemy_bullets.capacity && i < 2000; i++) {
+            float a = (float)i * 0.37f, r = 3.0f + (float)(i % 40) * 0.6f;
+            SpawnEnemyBullet(boss->position.x + cosf(a) * r, boss->position.z + sinf(a) * r, cosf(a) * 8.0f, sinf(a) * 8.0f,
+                             ENEMY_BULLET_PATTERN_LIFE, ENEMY_BULLET_PATTERN);
         }
-        if (bullets[i].is_enemy_bullet && player.invincible_timer <= 0 && player.dash_duration <= 0) {
-            Vector3 playerCenter = { player.position.x, 1.0f, player.position.z };
-            if (Vector3Distance(bullets[i].position, playerCenter) < 2.0f) { 
-                player.hp -= 10;
-                player.invincible_timer = 0.5f;
-                bullets[i].active = false;
-                SpawnExplosion(player.position, COL_NEON_PINK, 15);
-                AddScreenShake(0.8f);
-                if (player.hp <= 0) current_state = STATE_GAMEOVER;
-            }
+        const Color colors[4] = { COL_NEON_ORANGE, COL_NEON_PINK, COL_NEON_PURPLE, COL_NEON_CYAN };
+        for (int i=0; i<particle_capacity; i++) {
+            Particle *pt = &particles[i];
+            pt->active = true;
+            pt->position = (Vector3){ (float)GetRandomValue(-150, 150) * 0.1f, (float)GetRandomValue(0, 60) * 0.1f,
+                                      -12.0f + (float)GetRandomValue(-150, 150) * 0.1f };
+            pt->velocity = (Vector3){ 0, 0, 0 };
+            pt->color = colors[i % 4];
+            pt->max_life = 0.6f;
+            pt->life = (float)GetRandomValue(10, 60) * 0.01f;
+            pt->size = (float)GetRandomValue(3, 8) / 10.0f;
         }
+        for (int i=0; i<8; i++) {
+            SpawnDamageNumber(enemy_capacity - 1 - i, 10 + i * 5, enemies[enemy_capacity - 1 - i].position);
+        }
+        for (int i=0; i<4; i++) AddKillFeed(i == 3 ? ENEMY_TANK : ENEMY_DRONE);
     }
 
-    // アイテム取得
-    for (int i=0; i<MAX_ITEMS; i++) {
-        if (!items[i].active) continue;
-        items[i].angle += dt * 90.0f;
-        items[i].life_time -= dt;
-        if (items[i].life_time <= 0) items[i].active = false;
-        if (Vector3Distance(player.position, items[i].position) < 3.0f) {
-            if (items[i].type == ITEM_HEAL) {
-                player.hp += 30;
-                if(player.hp > player.max_hp) player.hp = player.max_hp;
-                SpawnExplosion(player.position, COL_NEON_GREEN, 10);
-            } 
-            else if (items[i].type == ITEM_EXP) {
-                player.exp += 1;
-                
-                if (player.exp >= player.next_level_exp) {
-                    player.level++;
-                    player.exp = 0;
-                    player.next_level_exp += 5; 
-                    player.max_hp += 10;
-                    player.hp = player.max_hp;
-                    player.damage += 5;
-                    
-                    SpawnExplosion(player.position, GOLD, 20);
-                }
-                SpawnExplosion(player.position, COL_NEON_CYAN, 5);
-            }
-            items[i].active = false;
-        }
+    // 自機の弾とアイテム
+    for (int i=0; i<bullet_capacity && i < 120; i++) {
+        Bullet *b = &bullets[i];
+        bool p2 = (scene == RENDER_SCENE_PVP) && (i % 2 == 1);
+        Vector3 from = p2 ? player2.position : player.position;
+        float a = (float)i * 0.53f;
+        float r = 2.0f + (float)(i % 12) * 1.5f;
+        b->active = true;
+        b->is_p2_bullet = p2;
+        b->owner = p2 ? 1 : 0;
+        b->position = (Vector3){ from.x + cosf(a) * r, 1.0f, from.z + sinf(a) * r };
+        b->velocity = (Vector3){ cosf(a) * 30.0f, 0, sinf(a) * 30.0f };
+        b->life_time = 1.0f;
+    }
+    for (int i=0; i<item_capacity && i < 20; i++) {
+        items[i].active = true;
+        items[i].type = (i % 3 == 0) ? ITEM_HEAL : ITEM_EXP;
+        items[i].position = (Vector3){ (float)GetRandomValue(-150, 150) * 0.1f, 0, (float)GetRandomValue(-150, 150) * 0.1f };
+        items[i].life_time = 15.0f;
+        items[i].angle = (float)(i * 37 % 360);
     }
+    EnemyBucketsRebuild();
+}
 
-    // 敵のスポーン
-    if (!boss_spawned) {
-        if (stage_kills >= kills_required_for_boss) {
-            current_state = STATE_BOSS_INTRO;
-            state_timer = 0.0f;
-            for(int i=0; i<MAX_ENEMIES; i++) if(enemies[i].active) {
-                enemies[i].hp = 0;
-                SpawnExplosion(enemies[i].position, COL_NEON_ORANGE, 5);
-                enemies[i].active = false;
-            }
-        } else {
-            enemy_spawn_timer += dt;
-            float spawnInterval = 0.5f - (current_stage * 0.05f);
-            if (spawnInterval < 0.1f) spawnInterval = 0.1f;
-            if (difficulty == MODE_HARD) spawnInterval *= 0.7f;
+void RenderBenchDraw(int scene) {
+    switch (scene) {
+        case RENDER_SCENE_TITLE: DrawTitle(); break;
+        case RENDER_SCENE_WAVE_3D:
+            ClearBackground(COL_DARK_BG);
+            BeginMode3D(camera);
+            DrawScene(camera, true);
+            EndMode3D();
+            break;
+        case RENDER_SCENE_PVP: DrawGamePvP(); break;
+        default: DrawGame(); break;
+    }
+}
 
-            if (enemy_spawn_timer > spawnInterval) {
-                SpawnEnemy(false);
-                enemy_spawn_timer = 0.0f;
-            }
+// 画面の FNV-1a ハッシュ（描画の結果が変わったかを見るだけ）
+uint64_t HashScreen() {
+    Image img = LoadImageFromScreen();
+    uint64_t h = 0xcbf29ce484222325ull;
+    const unsigned char *px = img.data;
+    size_t n = (size_t)img.width * img.height * 4;
+    for (size_t i=0; i<n; i++) {
+        h ^= px[i];
+        h *= 0x100000001b3ull;
+    }
+    UnloadImage(img);
+    return h;
+}
+
+// ハードの自動操縦で長い試合を記録し、ランダムな時刻へのシークの時間を測る。
+// 倒れると展開が止まるので、HP が減ったらキーフレームの直前に回復させる
+// （書き換えた状態は次のキーフレームに入る。その区間は食い違いの確認から外す）
+int RunSeekBench(const char *arg) {
+    const char *path = "seek_bench.vsr";
+    const float dt = 1.0f / 60.0f;
+    const int seeks = 200, lookups = 1000000, checks = 32;
+    double minutes = arg ? atof(arg) : 0;
+    if (minutes <= 0) minutes = 120;
+    uint64_t ticks = (uint64_t)(minutes * 60.0 * 60.0 + 0.5);
+
+    SetRandomSeed(1);
+    difficulty = MODE_HARD;
+    InitGame(true);
+    current_state = STATE_PLAYING;
+    if (!ReplayStartRecording(path, 0)) {
+        fprintf(stderr, "bench: cannot write %s\n", path);
+        return 1;
+    }
+    size_t maxSegments = ticks / REPLAY_KEYFRAME_TICKS + 2;
+    bool *edited = calloc(maxSegments, sizeof(bool));
+    int heals = 0;
+    double t0 = NetNow();
+    for (uint64_t i=0; i<ticks; i++) {
+        if (replay_recorder.segment_ticks >= REPLAY_KEYFRAME_TICKS &&
+            (player.hp < player.max_hp / 2 || current_state == STATE_GAMEOVER)) {
+            player.hp = player.max_hp;
+            if (current_state == STATE_GAMEOVER) current_state = STATE_PLAYING;
+            edited[replay_recorder.header.segment_count] = true;
+            heals++;
         }
+        PlayerInput in = { 0 };
+        if (current_state == STATE_PLAYING) in = AutopilotInput();
+        StepGame(dt, &in);
+    }
+    double recordSec = NetNow() - t0;
+    ReplayStopRecording();
+
+    static ReplayPlayer rp;
+    if (!ReplayOpen(&rp, path)) {
+        fprintf(stderr, "bench: cannot map %s\n", path);
+        free(edited);
+        return 1;
+    }
+    double usPerTick = recordSec * 1e6 / (double)ticks;
+    printf("recorded %s (%llu ticks) in %.1f s (%.1f us/tick), stage %d, %d heals\n", FormatReplayTime(rp.duration),
+           (unsigned long long)rp.tick_count, recordSec, usPerTick, current_stage, heals);
+    printf("file %.1f MB, %d keyframes every %d ticks (avg keyframe %.1f KB)\n", rp.size / (1024.0 * 1024.0), rp.segment_count,
+           REPLAY_KEYFRAME_TICKS, (rp.size - rp.tick_count * sizeof(ReplayTick)) / 1024.0 / rp.segment_count);
+
+    // ランダムな時刻へのシーク（キーフレームを戻して、その区間の残りをシミュレーション）
+    double *ms = malloc(seeks * sizeof(double));
+    long long resim = 0;
+    for (int k=0; k<seeks; k++) {
+        double t = rp.duration * GetRandomValue(0, 1000000) / 1e6;
+        double a = NetNow();
+        resim += ReplaySeek(&rp, t);
+        ms[k] = (NetNow() - a) * 1000.0;
+    }
+    for (int i=1; i<seeks; i++) {
+        double v = ms[i];
+        int j = i - 1;
+        while (j >= 0 && ms[j] > v) { ms[j + 1] = ms[j]; j--; }
+        ms[j + 1] = v;
+    }
+    printf("seek x%d: p50 %.2f ms  p99 %.2f ms  max %.2f ms  (avg %.0f ticks re-simulated)\n", seeks,
+           ms[seeks / 2], ms[seeks * 99 / 100], ms[seeks - 1], (double)resim / seeks);
+
+    // 索引の二分探索だけ
+    int sink = 0;
+    double a = NetNow();
+    for (int i=0; i<lookups; i++) sink += ReplayFindSegment(&rp, rp.duration * (double)(((long long)i * 7919) % 100003) / 100003.0);
+    printf("index lookup: %.1f ns (%d keyframes, sink %d)\n", (NetNow() - a) * 1e9 / lookups, rp.segment_count, sink & 1);
+
+    // 区間を最後まで再生して次のキーフレームと突き合わせる
+    int checked = 0;
+    rp.desyncs = 0;
+    for (int k=0; k<checks && rp.segment_count > 1; k++) {
+        int s = 1 + GetRandomValue(0, rp.segment_count - 2);
+        if (edited[s]) continue;
+        ReplaySeek(&rp, rp.index[s - 1].start_time);
+        while (rp.segment < s && ReplayStep(&rp)) {}
+        checked++;
     }
+    printf("determinism: %d/%d keyframes matched the re-simulation, %d ticks differed from the recorded hash\n",
+           checked - rp.desyncs, checked, rp.tick_desyncs);
 
-    // 敵の制御
-    for (int i=0; i<MAX_ENEMIES; i++) {
+    double target = fmin(20.0 * 60.0, rp.duration);
+    a = NetNow();
+    int n = ReplaySeek(&rp, target);
+    printf("seek to %s: %.2f ms (%d ticks); replaying from the start would take about %.0f ms\n", FormatReplayTime(target),
+           (NetNow() - a) * 1000.0, n, target / dt * usPerTick / 1000.0);
+
+    free(ms);
+    free(edited);
+    ReplayClose(&rp);
+    remove(path);
+    return 0;
+}
+
+// 種類を混ぜた1本の配列を、種類で分岐しながら回す版（ベンチマークの比較用。種類別カーネルにする前の敵ループ）
+void UpdateEnemiesMixed(int count, float dt) {
+    for (int i=0; i<count; i++) {
         if (!enemies[i].active) continue;
         if (!enemies[i].is_grounded) {
             enemies[i].vertical_speed -= 40.0f * dt;
@@ -615,527 +7584,427 @@ void UpdateGame() {
                 SpawnExplosion(enemies[i].position, LIGHTGRAY, 5);
             } else continue;
         }
-        Vector3 to_player = Vector3Subtract(player.position, enemies[i].position);
+        // 一番近い生存プレイヤーを追う
+        Player *target = NearestAlivePlayer(enemies[i].position);
+        if (!target) target = sim_players[0];
+        Vector3 to_player = Vector3Subtract(target->position, enemies[i].position);
         float dist = Vector3Length(to_player);
         to_player = Vector3Normalize(to_player);
         
+        float hitSize = (enemies[i].type == ENEMY_BOSS) ? 2.5f : 1.0f;
         enemies[i].anim_timer += dt;
         if (dist > 1.5f) {
             Vector3 move = Vector3Scale(to_player, enemies[i].speed * dt);
             Vector3 knock = Vector3Scale(enemies[i].knockback, dt);
-            enemies[i].position = Vector3Add(enemies[i].position, Vector3Add(move, knock));
+            enemies[i].position = ArenaMove(enemies[i].position, Vector3Add(move, knock), hitSize);
         }
         enemies[i].knockback = Vector3Scale(enemies[i].knockback, 0.85f);
         if (enemies[i].flash_timer > 0) enemies[i].flash_timer -= dt;
 
         if (enemies[i].shoot_cooldown > 0) enemies[i].shoot_cooldown -= dt;
-        if (enemies[i].type == ENEMY_BOSS || (enemies[i].type == ENEMY_TANK && difficulty == MODE_HARD)) {
+        if (enemies[i].type == ENEMY_BOSS) UpdateBossPattern(&enemies[i], target->position, dt);
+        else if (enemies[i].type == ENEMY_TANK && difficulty == MODE_HARD) {
             if (enemies[i].shoot_cooldown <= 0 && dist < enemies[i].attack_range) {
-                SpawnBullet(enemies[i].position, to_player, true, false);
-                enemies[i].shoot_cooldown = (enemies[i].type == ENEMY_BOSS) ? 1.0f : 2.5f;
+                SpawnEnemyBullet(enemies[i].position.x, enemies[i].position.z, to_player.x * 20.0f, to_player.z * 20.0f, 2.0f, ENEMY_BULLET_SHOT);
+                enemies[i].shoot_cooldown = 2.5f;
             }
         }
-        if (dist < 1.5f && player.dash_duration <= 0 && player.invincible_timer <= 0) {
-            player.hp -= 5;
-            player.invincible_timer = 0.5f;
+        if (dist < 1.5f && target->hp > 0 && target->dash_duration <= 0 && target->invincible_timer <= 0) {
+            target->hp -= 5;
+            target->invincible_timer = 0.5f;
             AddScreenShake(0.5f);
-            if (player.hp <= 0) current_state = STATE_GAMEOVER;
+            if (AllPlayersDown()) current_state = STATE_GAMEOVER;
         }
 
-        // プレイヤーと敵の当たり判定
-        float hitSize = (enemies[i].type == ENEMY_BOSS) ? 2.5f : 1.0f;
-        BoundingBox box = {
-            (Vector3){enemies[i].position.x - hitSize, 0, enemies[i].position.z - hitSize},
-            (Vector3){enemies[i].position.x + hitSize, hitSize * 2.5f, enemies[i].position.z + hitSize}
-        };
-        for (int b=0; b<MAX_BULLETS; b++) {
-            if (!bullets[b].active || bullets[b].is_enemy_bullet) continue;
+        // プレイヤーの弾と敵の当たり判定
+        BoundingBox box = EnemyHitbox(&enemies[i]);
+        for (int b=0; b<bullet_capacity; b++) {
+            if (!bullets[b].active) continue;
             if (CheckCollisionBoxSphere(box, bullets[b].position, 0.5f)) {
                 bullets[b].active = false;
-                enemies[i].hp -= player.damage; 
-                enemies[i].flash_timer = 0.1f;
-                if (enemies[i].type != ENEMY_BOSS) {
-                    Vector3 push = Vector3Normalize(bullets[b].velocity);
-                    enemies[i].knockback = Vector3Add(enemies[i].knockback, Vector3Scale(push, 15.0f));
-                }
-                SpawnExplosion(bullets[b].position, COL_NEON_CYAN, 3);
-                
-                if (enemies[i].hp <= 0) {
-                    enemies[i].active = false;
-                    SpawnExplosion(enemies[i].position, enemies[i].type == ENEMY_TANK ? COL_NEON_PURPLE : COL_NEON_ORANGE, 20);
-                    AddScreenShake(0.3f);
-                    if (enemies[i].type == ENEMY_BOSS) {
-                        boss_spawned = false; 
-                        current_state = STATE_STAGE_CLEAR;
-                        state_timer = 0;
-                        AddScreenShake(2.0f);
-                    } else {
-                        stage_kills++;
-                        if (GetRandomValue(0, 100) < 50) SpawnItem(enemies[i].position);
-                    }
-                }
+                int owner = (bullets[b].owner < sim_player_count) ? bullets[b].owner : 0;
+                Vector3 push = Vector3Scale(Vector3Normalize(bullets[b].velocity), 15.0f);
+                if (DamageEnemy(i, sim_players[owner]->damage, push, bullets[b].position)) break;
             }
         }
     }
-    for(int i=0; i<MAX_PARTICLES; i++){
-        if(!particles[i].active) continue;
-        particles[i].position = Vector3Add(particles[i].position, Vector3Scale(particles[i].velocity, dt));
-        particles[i].life -= dt;
-        if(particles[i].life <= 0) particles[i].active = false;
-    }
 }
 
-// ２人対戦
-void UpdateGamePvP() {
-    float dt = GetFrameTime();
-    if (current_state == STATE_PVP_RESULT) {
-        if (IsKeyPressed(KEY_R)) {
-            current_state = STATE_TITLE;
-            camera_angle_rad = 0.0f;
-        }
-        return;
-    }
-    
-    // P1
-    UpdateTrail(&player);
-    if (player.invincible_timer > 0) player.invincible_timer -= dt;
-    if (IsKeyPressed(KEY_SPACE) && player.dash_cooldown <= 0) {
-        player.dash_duration = 0.2f; player.dash_cooldown = 1.5f;
-        Vector3 input = {0};
-        if (IsKeyDown(KEY_W)) input.z -= 1; if (IsKeyDown(KEY_S)) input.z += 1;
-        if (IsKeyDown(KEY_A)) input.x -= 1; if (IsKeyDown(KEY_D)) input.x += 1;
-        if (Vector3Length(input) > 0) player.dash_dir = Vector3Normalize(input);
-        else player.dash_dir = (Vector3){0,0,-1};
-        AddScreenShake(0.2f);
-    }
-    if (player.dash_duration > 0) {
-        player.dash_duration -= dt;
-        player.position = Vector3Add(player.position, Vector3Scale(player.dash_dir, player.speed * 3.0f * dt));
-    } else {
-        Vector3 move = {0};
-        if (IsKeyDown(KEY_W)) move.z -= 1; if (IsKeyDown(KEY_S)) move.z += 1;
-        if (IsKeyDown(KEY_A)) move.x -= 1; if (IsKeyDown(KEY_D)) move.x += 1;
-        if (Vector3Length(move) > 0) {
-            move = Vector3Normalize(move);
-            player.position = Vector3Add(player.position, Vector3Scale(move, player.speed * dt));
-            player.walk_anim_timer += dt;
-        } else player.walk_anim_timer = 0;
-    }
-    if (player.dash_cooldown > 0) player.dash_cooldown -= dt;
-
-    Vector2 mousePos = GetMousePosition();
-    float screenW = (float)GetScreenWidth();
-    if (mousePos.x > screenW / 2.0f) mousePos.x = screenW / 2.0f;
-    mousePos.x *= 2.0f;
-    Ray ray = GetMouseRay(mousePos, camera);
-    float t = -ray.position.y / ray.direction.y;
-    Vector3 aim_point = Vector3Add(ray.position, Vector3Scale(ray.direction, t));
-    Vector3 d = Vector3Subtract(aim_point, player.position);
-    d.y = 0; 
-    player.facing_angle = -atan2f(d.z, d.x) + PI/2;
-    if (player.shoot_cooldown > 0) player.shoot_cooldown -= dt;
-    if (IsMouseButtonDown(MOUSE_LEFT_BUTTON) && player.shoot_cooldown <= 0) {
-        SpawnBullet(player.position, Vector3Normalize(d), false, false);
-        player.shoot_cooldown = 0.3f;
-    }
+// 終盤のタンクが多いウェーブで、出現順に種類が混ざった配列と種類ごとの範囲とで敵の更新を比べる。
+// 毎ティック同じ状態から始め（敵は倒れない）、プレイヤーの弾は自機から放射状に飛ばしておく
+int RunEnemyBench() {
+    const int ticks = 4000, rounds = 4;
+    const float dt = 1.0f / 60.0f;
+    const int enemyCounts[] = { 50, enemy_capacity };
+    const int tankShares[] = { 30, 70 };
+    SetRandomSeed(1);
+    difficulty = MODE_HARD;
+    current_stage = 8;
+    current_state = STATE_PLAYING;
+    ArenaGenerate(current_stage);
+    InitPlayer(&player, (Vector3){ 0, 0, 0 });
+    sim_players[0] = &player;
+    sim_player_count = 1;
 
-    // P2
-    UpdateTrail(&player2);
-    if (player2.invincible_timer > 0) player2.invincible_timer -= dt;
-    if (IsKeyPressed(KEY_ENTER) && player2.dash_cooldown <= 0) {
-        player2.dash_duration = 0.2f; player2.dash_cooldown = 1.5f;
-        Vector3 input = {0};
-        if (IsKeyDown(KEY_UP)) input.z -= 1; if (IsKeyDown(KEY_DOWN)) input.z += 1;
-        if (IsKeyDown(KEY_LEFT)) input.x -= 1; if (IsKeyDown(KEY_RIGHT)) input.x += 1;
-        if (Vector3Length(input) > 0) player2.dash_dir = Vector3Normalize(input);
-        else player2.dash_dir = (Vector3){0,0,1};
-        AddScreenShake(0.2f);
-    }
-    if (player2.dash_duration > 0) {
-        player2.dash_duration -= dt;
-        player2.position = Vector3Add(player2.position, Vector3Scale(player2.dash_dir, player2.speed * 3.0f * dt));
-    } else {
-        Vector3 move = {0};
-        if (IsKeyDown(KEY_UP)) move.z -= 1; if (IsKeyDown(KEY_DOWN)) move.z += 1;
-        if (IsKeyDown(KEY_LEFT)) move.x -= 1; if (IsKeyDown(KEY_RIGHT)) move.x += 1;
-        if (Vector3Length(move) > 0) {
-            move = Vector3Normalize(move);
-            player2.position = Vector3Add(player2.position, Vector3Scale(move, player2.speed * dt));
-            player2.walk_anim_timer += dt;
-        } else player2.walk_anim_timer = 0;
-    }
-    if (player2.dash_cooldown > 0) player2.dash_cooldown -= dt;
-    Vector3 toP1 = Vector3Subtract(player.position, player2.position);
-    player2.facing_angle = -atan2f(toP1.z, toP1.x) + PI/2;
-    if (player2.shoot_cooldown > 0) player2.shoot_cooldown -= dt;
-    if (IsKeyDown(KEY_RIGHT_SHIFT) && player2.shoot_cooldown <= 0) {
-        SpawnBullet(player2.position, Vector3Normalize(toP1), false, true);
-        player2.shoot_cooldown = 0.3f;
+    Enemy *pool = enemies;
+    Enemy *wave = malloc(enemy_slots * sizeof(Enemy));
+    Enemy *mixed = malloc(enemy_slots * sizeof(Enemy));
+    Enemy *bucketed = malloc(enemy_slots * sizeof(Enemy));
+    Bullet *shots = malloc(bullet_capacity * sizeof(Bullet));
+    for (int b=0; b<bullet_capacity; b++) {
+        float a = GetRandomValue(0, 3600) * 0.1f * DEG2RAD;
+        float r = GetRandomValue(0, 300) * 0.1f;
+        shots[b] = (Bullet){ 0 };
+        shots[b].active = (b < 60);
+        shots[b].position = (Vector3){ cosf(a) * r, ENEMY_BULLET_Y, sinf(a) * r };
+        shots[b].velocity = (Vector3){ cosf(a) * 40.0f, 0, sinf(a) * 40.0f };
+        shots[b].life_time = 1.0f;
     }
 
-    Vector3 p1CamBase = Vector3Add(player.position, (Vector3){0, 20, 15});
-    Vector3 p2CamBase = Vector3Add(player2.position, (Vector3){0, 20, 15});
-    float shakeX = (float)GetRandomValue(-10, 10) * 0.05f * screen_shake;
-    float shakeZ = (float)GetRandomValue(-10, 10) * 0.05f * screen_shake;
-    camera.target = player.position;
-    camera.position = Vector3Add(p1CamBase, (Vector3){shakeX, 0, shakeZ});
-    camera2.target = player2.position;
-    camera2.position = Vector3Add(p2CamBase, (Vector3){shakeX, 0, shakeZ});
-
-    for (int i=0; i<MAX_BULLETS; i++) {
-        if (!bullets[i].active) continue;
-        bullets[i].position = Vector3Add(bullets[i].position, Vector3Scale(bullets[i].velocity, dt));
-        bullets[i].life_time -= dt;
-        if (bullets[i].life_time <= 0) { bullets[i].active = false; continue; }
+    printf("stage %d hard, %d player bullets, %d ticks\n", current_stage, 60, ticks);
+    printf("enemies tanks | mixed us/tick  bucketed us/tick | speedup  ns/enemy (mixed -> bucketed)\n");
+    for (int ec=0; ec<(int)(sizeof(enemyCounts)/sizeof(enemyCounts[0])); ec++) {
+        for (int ts=0; ts<(int)(sizeof(tankShares)/sizeof(tankShares[0])); ts++) {
+            int n = enemyCounts[ec];
+            for (int i=0; i<n; i++) {
+                Enemy e = { 0 };
+                e.active = true;
+                e.is_grounded = true;
+                e.type = (GetRandomValue(0, 99) < tankShares[ts]) ? ENEMY_TANK : ENEMY_DRONE;
+                float a = GetRandomValue(0, 3600) * 0.1f * DEG2RAD;
+                float r = 4.0f + GetRandomValue(0, 360) * 0.1f;
+                e.position = ArenaFindFree((Vector3){ cosf(a) * r, 0, sinf(a) * r }, 1.0f);
+                e.speed = (e.type == ENEMY_TANK) ? 3.0f : 6.0f;
+                e.attack_range = (e.type == ENEMY_TANK) ? 15.0f : 5.0f;
+                e.hp = e.max_hp = 1 << 30;
+                wave[i] = e;
+            }
+            // 同じウェーブを出現順のまま並べたものと、種類の範囲に入れたもの
+            memcpy(mixed, wave, n * sizeof(Enemy));
+            enemies = pool;
+            for (int i=0; i<enemy_slots; i++) enemies[i].active = false;
+            for (int i=0; i<n; i++) enemies[AllocEnemySlot(wave[i].type)] = wave[i];
+            memcpy(bucketed, pool, enemy_slots * sizeof(Enemy));
 
-        Vector3 p1Center = {player.position.x, 1, player.position.z};
-        Vector3 p2Center = {player2.position.x, 1, player2.position.z};
+            double sum[2] = { 0, 0 };
+            for (int r=0; r<rounds; r++) {
+                for (int layout=0; layout<2; layout++) {
+                    enemies = pool;
+                    for (int t=0; t<ticks / rounds; t++) {
+                        if (layout == 0) memcpy(pool, mixed, n * sizeof(Enemy));
+                        else memcpy(pool, bucketed, enemy_slots * sizeof(Enemy));
+                        memcpy(bullets, shots, bullet_capacity * sizeof(Bullet));
+                        enemy_bullets.count = 0;
+                        player.invincible_timer = 1.0f;
+                        double t0 = NetNow();
+                        if (layout == 0) UpdateEnemiesMixed(n, dt);
+                        else UpdateEnemies(dt);
+                        sum[layout] += NetNow() - t0;
+                    }
+                }
+            }
+            double us[2] = { sum[0] * 1e6 / ticks, sum[1] * 1e6 / ticks };
+            printf("%7d %4d%% | %13.2f  %16.2f | %6.2fx  %6.1f -> %6.1f\n", n, tankShares[ts], us[0], us[1],
+                   us[0] / us[1], us[0] * 1000.0 / n, us[1] * 1000.0 / n);
+        }
+    }
 
-        if (current_state == STATE_PVP_RESULT) continue;
+    enemies = pool;
+    for (int i=0; i<enemy_slots; i++) enemies[i].active = false;
+    EnemyBucketsRebuild();
+    free(wave);
+    free(mixed);
+    free(bucketed);
+    free(shots);
+    return 0;
+}
 
-        if (bullets[i].is_p2_bullet && player.invincible_timer <= 0 && player.dash_duration <= 0) {
-            if (Vector3Distance(bullets[i].position, p1Center) < 2.0f) {
-                player.hp -= 5; player.invincible_timer = 0.5f;
-                bullets[i].active = false;
-                SpawnExplosion(player.position, COL_NEON_PINK, 10);
-                AddScreenShake(0.5f);
-                if (player.hp <= 0) { current_state = STATE_PVP_RESULT; winner_id = 2; }
-            }
+// テレメトリの1件あたりのコスト（ゲームのスレッド側）。重いフレームを想定して 1ms ごとに 256 件ずつ入れ、
+// 書き出しスレッドが動いている状態で測る。比較に同じ内容を fprintf でテキストに書いた場合も測る
+int RunTelemetryBench() {
+    const int frames = 2000, burst = 256;
+    const char *paths[2] = { "telemetry_bench.vtl", "telemetry_bench.txt" };
+    double *us = malloc(frames * sizeof(double));
+    printf("%d frames x %d events, 1 ms apart\n", frames, burst);
+    printf("method    | ns/event  burst p50 us  p99 us  max us | written  dropped  KB\n");
+    for (int m=0; m<2; m++) {
+        FILE *text = NULL;
+        if (m == 0) {
+            if (!TelemetryStart(paths[0], ARENA_HALF)) { fprintf(stderr, "bench: cannot write %s\n", paths[0]); free(us); return 1; }
+        } else if (!(text = fopen(paths[1], "w"))) {
+            fprintf(stderr, "bench: cannot write %s\n", paths[1]);
+            free(us);
+            return 1;
         }
-        else if (!bullets[i].is_p2_bullet && player2.invincible_timer <= 0 && player2.dash_duration <= 0) {
-            if (Vector3Distance(bullets[i].position, p2Center) < 2.0f) {
-                player2.hp -= 5; player2.invincible_timer = 0.5f;
-                bullets[i].active = false;
-                SpawnExplosion(player2.position, COL_NEON_PINK, 10);
-                AddScreenShake(0.5f);
-                if (player2.hp <= 0) { current_state = STATE_PVP_RESULT; winner_id = 1; }
+        double total = 0;
+        for (int f=0; f<frames; f++) {
+            double t0 = NetNow();
+            for (int k=0; k<burst; k++) {
+                TelemetryEvent e = {
+                    .time = f / 60.0f, .type = TELEMETRY_KILL, .player = 0, .stage = (uint8_t)(1 + f / 500),
+                    .sub = (uint8_t)(k % 3), .x = (float)(k % 97) - 48.0f, .z = (float)(f % 89) - 44.0f, .value = 20 + k
+                };
+                if (m == 0) TelemetryPush(&e);
+                else fprintf(text, "%.3f %d %d %d %d %.2f %.2f %d %d\n", e.time, e.type, e.player, e.stage, e.sub, e.x, e.z, e.value, e.value2);
             }
+            us[f] = (NetNow() - t0) * 1e6;
+            total += us[f];
+            NetSleepUntil(NetNow() + 0.001);
         }
+        unsigned long long written, dropped = 0;
+        double kb;
+        if (m == 0) {
+            TelemetryStop();
+            TelemetryStats st;
+            TelemetryGetStats(&st);
+            written = st.written; dropped = st.dropped; kb = st.bytes_written / 1024.0;
+        } else {
+            kb = ftell(text) / 1024.0;
+            fclose(text);
+            written = (unsigned long long)frames * burst;
+        }
+        for (int i=1; i<frames; i++) {
+            double v = us[i];
+            int j = i - 1;
+            while (j >= 0 && us[j] > v) { us[j + 1] = us[j]; j--; }
+            us[j + 1] = v;
+        }
+        printf("%-9s | %8.1f  %12.2f  %6.2f  %6.1f | %7llu  %7llu  %.0f\n", m == 0 ? "ring" : "fprintf",
+               total * 1000.0 / ((double)frames * burst), us[frames / 2], us[frames * 99 / 100], us[frames - 1], written, dropped, kb);
+        remove(paths[m]);
     }
-    for(int i=0; i<MAX_PARTICLES; i++){
-        if(!particles[i].active) continue;
-        particles[i].position = Vector3Add(particles[i].position, Vector3Scale(particles[i].velocity, dt));
-        particles[i].life -= dt;
-        if(particles[i].life <= 0) particles[i].active = false;
-    }
+    free(us);
+    return 0;
 }
 
-// UI
-void DrawGame() {
-    int w = GetScreenWidth();
-    int h = GetScreenHeight();
-    ClearBackground(COL_DARK_BG);
-
-    BeginMode3D(camera);
-    DrawScene(camera, true);
-    EndMode3D();
-
-    DrawText(TextFormat("STAGE %d", current_stage), 20, 20, 30, WHITE);
-    DrawText(TextFormat("HP: %d/%d", player.hp, player.max_hp), 20, 60, 40, (player.hp < 30 ? COL_NEON_PINK : COL_NEON_GREEN));
-    DrawText(TextFormat("LV. %d", player.level), 20, 110, 40, GOLD);
-
-    float expRatio = (float)player.exp / (float)player.next_level_exp;
-    if (expRatio > 1.0f) expRatio = 1.0f;
-
-    DrawRectangle(140, 120, 200, 20, (Color){ 50, 40, 0, 200 });
-    DrawRectangle(140, 120, (int)(200 * expRatio), 20, GOLD);
-    DrawRectangleLines(140, 120, 200, 20, WHITE);
-    DrawText(TextFormat("EXP: %d/%d", player.exp, player.next_level_exp), 150, 122, 10, BLACK);
-
-    if (!boss_spawned) {
-        float progress = (float)stage_kills / kills_required_for_boss;
-        if(progress > 1.0) progress = 1.0;
-        DrawRectangle(w/2 - 150, 50, 300, 20, DARKGRAY);
-        DrawRectangle(w/2 - 150, 50, 300 * progress, 20, COL_NEON_ORANGE);
-        DrawRectangleLines(w/2 - 150, 50, 300, 20, WHITE);
-    } else DrawText("!! WARNING: BOSS ACTIVE !!", w/2 - 200, 30, 30, COL_NEON_PINK);
-
-    if (current_state == STATE_BOSS_INTRO) {
-        DrawRectangle(0, h/2 - 60, w, 120, (Color){0,0,0,150});
-        DrawText("WARNING", w/2 - MeasureText("WARNING", 50)/2, h/2 - 40, 50, COL_NEON_PINK);
-    }
-    if (current_state == STATE_STAGE_CLEAR) {
-        DrawRectangle(0, h/2 - 60, w, 120, (Color){255,255,255,150});
-        DrawText("STAGE CLEAR!", w/2 - MeasureText("STAGE CLEAR!", 50)/2, h/2 - 20, 50, GOLD);
-    }
-    if (current_state == STATE_GAMEOVER) {
-        DrawRectangle(0, 0, w, h, (Color){0,0,0,200});
-        DrawText("GAME OVER", w/2 - MeasureText("GAME OVER", 80)/2, h/2 - 50, 80, COL_NEON_PINK);
-        DrawText("PRESS 'R' TO RETURN TITLE", w/2 - MeasureText("PRESS 'R' TO RETURN TITLE", 20)/2, h/2 + 50, 20, GRAY);
-    }
+// 描画キューの積み込みと並べ替えのコスト（描画はしない）。場面と同じ割合でパスを混ぜたコマンドを
+// カメラの前に散らして積み、基数ソートと qsort を比べる
+int CompareRenderKey(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
 }
 
-void DrawGamePvP() {
-    int screenW = GetScreenWidth();
-    int screenH = GetScreenHeight();
-    int renderW = GetRenderWidth();
-    int renderH = GetRenderHeight();
-    
-    ClearBackground(COL_DARK_BG);
-    
-    // P1
-    rlViewport(0, 0, renderW/2, renderH); 
-    BeginScissorMode(0, 0, screenW/2, screenH);
-        ClearBackground(COL_DARK_BG);
-        BeginMode3D(camera);
-            DrawScene(camera, true);
-        EndMode3D();
-        DrawRectangleLines(0, 0, screenW/2, screenH, COL_NEON_CYAN); 
-    EndScissorMode();
-
-    // P2
-    rlViewport(renderW/2, 0, renderW/2, renderH);
-    BeginScissorMode(screenW/2, 0, screenW/2, screenH);
-        ClearBackground(COL_DARK_BG);
-        BeginMode3D(camera2);
-            DrawScene(camera2, false);
-        EndMode3D();
-        DrawRectangleLines(screenW/2, 0, screenW/2, screenH, COL_NEON_ORANGE);
-    EndScissorMode();
-
-    // UI
-    rlViewport(0, 0, renderW, renderH);
-    DrawText("P1", 20, 20, 30, COL_NEON_CYAN);
-    DrawText(TextFormat("HP: %d", player.hp), 20, 60, 30, COL_NEON_GREEN);
-
-    DrawText("P2", screenW/2 + 20, 20, 30, COL_NEON_ORANGE);
-    DrawText(TextFormat("HP: %d", player2.hp), screenW/2 + 20, 60, 30, COL_NEON_GREEN);
-    
-    DrawLine(screenW/2, 0, screenW/2, screenH, WHITE);
-    
-    if (current_state == STATE_PVP_RESULT) {
-        DrawRectangle(0, screenH/2 - 60, screenW, 120, (Color){0,0,0,220});
-        const char* winText = (winner_id == 1) ? "PLAYER 1 WINS!" : "PLAYER 2 WINS!";
-        Color winColor = (winner_id == 1) ? COL_NEON_CYAN : COL_NEON_ORANGE;
-        DrawText(winText, screenW/2 - MeasureText(winText, 40)/2, screenH/2 - 20, 40, winColor);
-        DrawText("PRESS 'R' TO RETURN TITLE", screenW/2 - MeasureText("PRESS 'R' TO RETURN TITLE", 20)/2, screenH/2 + 30, 20, WHITE);
+int RunRenderQueueBench() {
+    const int counts[] = { 1000, 4000, 16000, 64000 };
+    const int maxCount = 64000, reps = 100;
+    Camera3D cam = { .position = { 0, 25, 18 }, .target = { 0, 0, 0 }, .up = { 0, 1, 0 }, .fovy = 50 };
+    RenderQueue *q = &render_queue;
+    RenderCommand *cmds = malloc(maxCount * sizeof(RenderCommand));
+    uint64_t *keys = malloc(maxCount * sizeof(uint64_t));
+    uint64_t *scratch = malloc(maxCount * sizeof(uint64_t));
+    uint64_t *pushed = malloc(maxCount * sizeof(uint64_t));
+    uint64_t *ref = malloc(maxCount * sizeof(uint64_t));
+    Vector3 *pos = malloc(maxCount * sizeof(Vector3));
+    SetRandomSeed(1);
+    for (int i=0; i<maxCount; i++) {
+        pos[i] = (Vector3){ GetRandomValue(-400, 400) * 0.1f, GetRandomValue(0, 60) * 0.1f, GetRandomValue(-400, 300) * 0.1f };
     }
-}
 
-void DrawScene(Camera3D cam, bool draw_cursor) {
-    // 地面の描画
-    DrawCyberGrid(cam.target);
+    printf("commands | push ns/cmd | radix ns/key (digits) | qsort ns/key | speedup\n");
+    for (int c=0; c<(int)(sizeof(counts)/sizeof(counts[0])); c++) {
+        int n = counts[c];
+        double pushSec = 0, radixSec = 0, qsortSec = 0;
+        int digits = 0;
+        bool same = true;
+        for (int r=0; r<reps; r++) {
+            RenderQueueBegin(cam, 0);
+            q->cmds = cmds;
+            q->keys = keys;
+            q->scratch = scratch;
+            q->capacity = n;
+            // 不透明 1/4（メカ・HP バー）、半透明 1/4（影・残像）、加算合成 1/2（弾・爆発）
+            double a = NetNow();
+            for (int i=0; i<n; i++) {
+                RenderPass pass = (i % 4 == 0) ? RENDER_PASS_OPAQUE : (i % 4 == 1 ? RENDER_PASS_ALPHA : RENDER_PASS_ADDITIVE);
+                RenderMaterial mat = (pass == RENDER_PASS_OPAQUE && i % 8 == 0) ? (RenderMaterial)(RENDER_MAT_MECHA + i % 3) : RENDER_MAT_SHAPES;
+                RenderPush(pass, mat, &(RenderCommand){ .a = pos[i], .type = RENDER_CMD_CUBE });
+            }
+            pushSec += NetNow() - a;
+            memcpy(pushed, keys, n * sizeof(uint64_t));
 
-    // マウスカーソル
-    if (draw_cursor) {
-        Ray ray = GetMouseRay(GetMousePosition(), cam);
-        if (ray.direction.y != 0) {
-            float t = -ray.position.y / ray.direction.y;
-            Vector3 aimPos = Vector3Add(ray.position, Vector3Scale(ray.direction, t));
-            
-            rlPushMatrix();
-            rlTranslatef(aimPos.x, 0.1f, aimPos.z);
-            rlRotatef(GetTime() * 90.0f, 0, 1, 0);
-            
-            DrawCubeWires((Vector3){0,0,0}, 2.0f, 0.0f, 2.0f, ColorAlpha(COL_NEON_CYAN, 0.8f));
-            DrawCube((Vector3){0,0,0}, 0.3f, 0.3f, 0.3f, WHITE);
-            
-            rlPopMatrix();
-            
-            DrawLine3D(player.position, aimPos, ColorAlpha(COL_NEON_CYAN, 0.3f));
-        }
-    }
+            a = NetNow();
+            RenderQueueSort(keys, scratch, n);
+            radixSec += NetNow() - a;
+            digits = q->last_sort_passes;
 
-    // P1
-    Color p1Color = (player.dash_duration > 0) ? COL_NEON_CYAN : BLUE;
-    if (player.invincible_timer > 0 && (int)(GetTime()*20)%2 == 0) p1Color = WHITE;
-    DrawMecha(player.position, player.facing_angle, p1Color, player.walk_anim_timer, ENEMY_DRONE);
-    
-    // P1のダッシュの残像
-    if(player.dash_duration > 0){
-        for(int i=0; i<TRAIL_LENGTH; i+=2) {
-            if(player.trail_pos[i].x != 0) {
-                Color trailColor = ColorAlpha(COL_NEON_CYAN, 0.3f);
-                DrawCube(player.trail_pos[i], 0.8f, 0.8f, 0.8f, trailColor);
-            }
+            memcpy(ref, pushed, n * sizeof(uint64_t));
+            a = NetNow();
+            qsort(ref, n, sizeof(uint64_t), CompareRenderKey);
+            qsortSec += NetNow() - a;
+            if (memcmp(ref, keys, n * sizeof(uint64_t)) != 0) same = false;
         }
+        double total = (double)n * reps;
+        printf("%8d | %11.1f | %12.1f (%d)     | %12.1f | %6.1fx%s\n", n, pushSec * 1e9 / total, radixSec * 1e9 / total, digits,
+               qsortSec * 1e9 / total, qsortSec / radixSec, same ? "" : "  MISMATCH");
     }
+    q->count = 0;
+    q->capacity = 0;
+    free(cmds); free(keys); free(scratch); free(pushed); free(ref); free(pos);
+    return 0;
+}
 
-    // P2
-    if (current_state == STATE_PVP || current_state == STATE_PVP_RESULT || (current_state == STATE_PAUSED && previous_state == STATE_PVP)) {
-        Color p2Color = (player2.dash_duration > 0) ? COL_NEON_ORANGE : ORANGE;
-        if (player2.invincible_timer > 0 && (int)(GetTime()*20)%2 == 0) p2Color = WHITE;
-        DrawMecha(player2.position, player2.facing_angle, p2Color, player2.walk_anim_timer, ENEMY_TANK);
-        
-        // P2のダッシュの残像
-        if(player2.dash_duration > 0){
-            for(int i=0; i<TRAIL_LENGTH; i+=2) {
-                if(player2.trail_pos[i].x != 0) {
-                    Color trailColor = ColorAlpha(COL_NEON_ORANGE, 0.3f);
-                    DrawCube(player2.trail_pos[i], 1.2f, 1.2f, 1.2f, trailColor);
-                }
-            }
-        }
-    }
+// レーダーの集計。敵弾の数を変えて、格子に数える時間と1フレーム分（集計と画素づくり）の時間を出す
+int RunRadarBench() {
+    const int counts[] = { 1000, 4000, 10000, 16000 };
+    const int reps = 2000;
+    Camera3D cam = { .position = { 0, 25, 18 }, .target = { 0, 0, 0 }, .up = { 0, 1, 0 }, .fovy = 50 };
+    Radar *r = &radars[0];
 
-    // 敵
-    for (int i=0; i<MAX_ENEMIES; i++) {
-        if (!enemies[i].active) continue;
+    SetRandomSeed(1);
+    InitPlayer(&player, (Vector3){ 0, 0, 0 });
+    current_state = STATE_PLAYING;
+    enemy_bullets.count = 0;
+    RadarBasis b = RadarMakeBasis(player.position, cam);
 
-        // 着地点表示
-        if (!enemies[i].is_grounded) {
-            DrawLine3D(enemies[i].position, (Vector3){enemies[i].position.x, 0, enemies[i].position.z}, ColorAlpha(RED, 0.5f));
-            DrawCircle3D((Vector3){enemies[i].position.x, 0.1f, enemies[i].position.z}, 1.0f, (Vector3){1,0,0}, 90, ColorAlpha(RED, 0.3f));
+    printf("bullets | bin ns/bullet | frame us (bin + pixels)\n");
+    for (int c=0; c<(int)(sizeof(counts)/sizeof(counts[0])); c++) {
+        int n = counts[c];
+        if (n > enemy_bullets.capacity) break;     // --budget で小さくしたとき
+        // 半分ほどは範囲の外に置く
+        while (enemy_bullets.count < n) {
+            float a = GetRandomValue(0, 3600) * 0.1f * DEG2RAD, d = (float)GetRandomValue(0, 700) * 0.1f;
+            SpawnEnemyBullet(cosf(a) * d, sinf(a) * d, 0, 0, ENEMY_BULLET_PATTERN_LIFE, ENEMY_BULLET_PATTERN);
         }
-
-        // 敵の色分け
-        Color eColor = COL_NEON_PINK;
-        if (enemies[i].type == ENEMY_TANK) eColor = COL_NEON_PURPLE;
-        if (enemies[i].type == ENEMY_BOSS) eColor = COL_NEON_ORANGE;
-        if (enemies[i].flash_timer > 0) eColor = WHITE;
-        DrawMecha(enemies[i].position, 0, eColor, enemies[i].anim_timer, enemies[i].type);
-        
-        // HPバー
-        if (enemies[i].hp < enemies[i].max_hp) {
-            Vector3 hpPos = enemies[i].position; 
-            float barWidth = (enemies[i].type == ENEMY_BOSS ? 6.0f : 2.0f);
-            hpPos.y += (enemies[i].type == ENEMY_BOSS ? 7.0f : 3.0f);
-            DrawCube(hpPos, barWidth, 0.3f, 0.2f, BLACK);
-            float ratio = (float)enemies[i].hp / (float)enemies[i].max_hp;
-            if(ratio < 0) ratio = 0;
-            DrawCube(hpPos, barWidth * ratio, 0.35f, 0.25f, COL_NEON_GREEN);
+        double binSec = 0, frameSec = 0;
+        for (int k=0; k<reps; k++) {
+            memset(r->counts, 0, sizeof(r->counts));
+            double t0 = NetNow();
+            RadarBin(r->counts[RADAR_ENEMY_BULLET], enemy_bullets.x, enemy_bullets.z, n, &b);
+            double t1 = NetNow();
+            UpdateRadar(r, &player, cam);
+            RadarPixels(r, 1.0f);
+            double t2 = NetNow();
+            binSec += t1 - t0;
+            frameSec += t2 - t1;
         }
+        printf("%7d | %13.2f | %8.1f\n", n, binSec * 1e9 / ((double)n * reps), frameSec * 1e6 / reps);
     }
-    
-    // 弾やアイテムなど
-    rlDrawRenderBatchActive(); 
-    BeginBlendMode(BLEND_ADDITIVE); 
+    enemy_bullets.count = 0;
+    return 0;
+}
 
-    // 弾
-    for (int i=0; i<MAX_BULLETS; i++) {
-        if (bullets[i].active) {
-            Color bColor = COL_NEON_CYAN;
-            if (bullets[i].is_enemy_bullet) bColor = COL_NEON_PINK;
-            if (bullets[i].is_p2_bullet) bColor = COL_NEON_ORANGE;
-            float bSize = (bullets[i].is_enemy_bullet || bullets[i].is_p2_bullet) ? 0.6f : 0.4f;
-            DrawSphere(bullets[i].position, bSize, bColor);
-            DrawSphere(bullets[i].position, bSize * 0.5f, WHITE);
-        }
-    }
+// 状態のハッシュのコスト。自動操縦の試合の1ティックと比べ、敵弾の数を変えてハッシュだけも測る
+int RunHashBench() {
+    const float dt = 1.0f / 60.0f;
+    const int ticks = 3600, reps = 1000;
+    const int counts[] = { 0, 1000, 4000, 16000 };
 
-    // アイテム
-    for (int i=0; i<MAX_ITEMS; i++) {
-        if(items[i].active) {
-            rlPushMatrix();
-            rlTranslatef(items[i].position.x, 1.0f + sinf(GetTime()*3)*0.2f, items[i].position.z);
-            rlRotatef(items[i].angle, 0, 1, 0);
-            Color itemColor = (items[i].type == ITEM_HEAL) ? COL_NEON_GREEN : COL_NEON_CYAN;
-            DrawCube((Vector3){0,0,0}, 0.8f, 0.8f, 0.8f, itemColor);
-            DrawCubeWires((Vector3){0,0,0}, 0.8f, 0.8f, 0.8f, WHITE);
-            rlPopMatrix();
+    SetRandomSeed(1);
+    difficulty = MODE_HARD;
+    InitGame(true);
+    current_state = STATE_PLAYING;
+    world_hash_sec = 0;
+    double t0 = NetNow();
+    for (int t=0; t<ticks; t++) {
+        if (player.hp < player.max_hp / 2 || current_state == STATE_GAMEOVER) {
+            player.hp = player.max_hp;
+            if (current_state == STATE_GAMEOVER) current_state = STATE_PLAYING;
         }
+        PlayerInput in = { 0 };
+        if (current_state == STATE_PLAYING) in = AutopilotInput();
+        StepGame(dt, &in);
     }
+    double sec = NetNow() - t0;
+    int active = 0;
+    for (int i=0; i<enemy_slots; i++) active += enemies[i].active;
+    printf("autopilot %d ticks (stage %d, %d enemies at the end): tick %.2f us, hash %.2f us (%.2f%% of the tick)\n",
+           ticks, current_stage, active, sec * 1e6 / ticks, world_hash_sec * 1e6 / ticks, world_hash_sec * 100.0 / sec);
 
-    // 爆発
-    for (int i=0; i<MAX_PARTICLES; i++) {
-        if (particles[i].active) {
-            float alpha = particles[i].life / particles[i].max_life;
-            Color pColor = ColorAlpha(particles[i].color, alpha);
-            DrawCube(particles[i].position, particles[i].size, particles[i].size, particles[i].size, pColor);
+    printf("enemy bullets | hash us | ns/bullet\n");
+    WorldHash wh;
+    uint64_t sink = 0;
+    for (int c=0; c<(int)(sizeof(counts)/sizeof(counts[0])); c++) {
+        int n = counts[c];
+        if (n > enemy_bullets.capacity) break;     // --budget で小さくしたとき
+        enemy_bullets.count = 0;
+        while (enemy_bullets.count < n) {
+            float a = GetRandomValue(0, 3600) * 0.1f * DEG2RAD, r = (float)GetRandomValue(5, 40);
+            SpawnEnemyBullet(cosf(a) * r, sinf(a) * r, cosf(a) * 10.0f, sinf(a) * 10.0f, ENEMY_BULLET_PATTERN_LIFE, ENEMY_BULLET_PATTERN);
         }
-    }
-    EndBlendMode(); 
-}
-
-void SpawnBullet(Vector3 pos, Vector3 direction, bool is_enemy, bool is_p2) {
-    for (int i=0; i<MAX_BULLETS; i++) {
-        if (!bullets[i].active) {
-            bullets[i].active = true;
-            bullets[i].position = (Vector3){pos.x, 1.5f, pos.z};
-            float spd = (is_enemy || is_p2) ? 20.0f : 35.0f;
-            bullets[i].velocity = Vector3Scale(direction, spd);
-            bullets[i].life_time = 2.0f;
-            bullets[i].is_enemy_bullet = is_enemy;
-            bullets[i].is_p2_bullet = is_p2;
-            break;
+        double a = NetNow();
+        for (int k=0; k<reps; k++) {
+            WorldHashCompute(&wh);
+            sink ^= wh.total;
         }
+        double us = (NetNow() - a) * 1e6 / reps;
+        printf("%13d | %7.2f | %9.2f\n", n, us, n > 0 ? us * 1000.0 / n : 0.0);
     }
+    printf("(sink %llu)\n", (unsigned long long)(sink & 1));
+    enemy_bullets.count = 0;
+    return 0;
 }
 
-void SpawnEnemy(bool force_boss) {
-    for (int i=0; i<MAX_ENEMIES; i++) {
-        if (!enemies[i].active) {
-            enemies[i].active = true;
-            enemies[i].knockback = (Vector3){0,0,0};
-            enemies[i].flash_timer = 0; enemies[i].anim_timer = 0;
-            enemies[i].shoot_cooldown = 2.0f; enemies[i].attack_range = 20.0f;
-
-            if (force_boss) {
-                enemies[i].type = ENEMY_BOSS;
-                enemies[i].position = (Vector3){player.position.x, 30.0f, player.position.z + 10.0f}; 
-                enemies[i].is_grounded = false; enemies[i].vertical_speed = 0.0f;
-                enemies[i].speed = 4.0f + (current_stage * 0.5f);
-                enemies[i].max_hp = 300 + (current_stage * 100);
-                enemies[i].hp = enemies[i].max_hp;
-                boss_spawned = true;
-                return;
-            }
-            float angle = GetRandomValue(0, 360) * DEG2RAD;
-            float dist = 35.0f;
-            bool skyfall = (difficulty == MODE_HARD || current_stage > 2) && GetRandomValue(0, 100) < 40;
-            if (skyfall) {
-                enemies[i].position = (Vector3){
-                    player.position.x + (float)GetRandomValue(-15, 15),
-                    25.0f, player.position.z + (float)GetRandomValue(-15, 15)
-                };
-                enemies[i].is_grounded = false; enemies[i].vertical_speed = 0.0f;
-            } else {
-                enemies[i].position = (Vector3){ player.position.x + cosf(angle) * dist, 0, player.position.z + sinf(angle) * dist };
-                enemies[i].is_grounded = true;
-            }
-            if (current_stage > 1 && GetRandomValue(0, 100) < 30) {
-                enemies[i].type = ENEMY_TANK;
-                enemies[i].speed = 3.0f;
-                enemies[i].max_hp = 60 + (current_stage * 10);
-                enemies[i].hp = enemies[i].max_hp;
-                enemies[i].attack_range = 15.0f;
-            } else {
-                enemies[i].type = ENEMY_DRONE;
-                enemies[i].speed = 6.0f;
-                enemies[i].max_hp = 20 + (current_stage * 5);
-                enemies[i].hp = enemies[i].max_hp;
-                enemies[i].attack_range = 5.0f; 
-            }
-            break;
-        }
-    }
+// 探索モードで一方向へ歩き続ける（自動操縦で撃ちながら）。原点の移動と読み込みの1ティックの時間（p99 と最大）、
+// セクターの枠の使い方、ローカル座標の大きさ（浮動原点がなければワールド座標で float がどれだけ粗くなるか）を出す
+int CompareDouble(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
 }
 
-void SpawnItem(Vector3 pos) {
-    for (int i=0; i<MAX_ITEMS; i++) {
-        if (!items[i].active) {
-            items[i].active = true; 
-            items[i].position = pos;
-            items[i].type = (GetRandomValue(0, 100) < 70) ? ITEM_EXP : ITEM_HEAL; 
-            items[i].life_time = 15.0f; 
-            items[i].angle = 0;
-            break;
-        }
-    }
-}
+int RunRoamBench() {
+    const float dt = 1.0f / 60.0f;
+    const int ticks = 60 * 60 * 20;
+    double *tickUs = malloc(ticks * sizeof(double));
+    double *streamUs = malloc(ticks * sizeof(double));
 
-void SpawnExplosion(Vector3 pos, Color color, int count) {
-    int spawned = 0;
-    for (int i=0; i<MAX_PARTICLES; i++) {
-        if (!particles[i].active) {
-            particles[i].active = true;
-            particles[i].position = pos;
-            particles[i].color = color;
-            particles[i].max_life = 0.6f;
-            particles[i].life = particles[i].max_life;
-            particles[i].size = (float)GetRandomValue(3, 8) / 10.0f;
-            
-            Vector3 rndVec = {
-                (float)GetRandomValue(-100, 100),
-                (float)GetRandomValue(-100, 100),
-                (float)GetRandomValue(-100, 100)
-            };
-            rndVec = Vector3Normalize(rndVec);
-            float speed = (float)GetRandomValue(10, 40) / 2.0f;
-            particles[i].velocity = Vector3Scale(rndVec, speed);
-            
-            spawned++;
-            if (spawned >= count) break;
+    SetRandomSeed(1);
+    difficulty = MODE_NORMAL;
+    roam_mode = true;
+    InitGame(true);
+    current_state = STATE_PLAYING;
+    float localMax = 0;
+    int residentPeak = 0;
+    double t0 = NetNow();
+    for (int t=0; t<ticks; t++) {
+        if (player.hp < player.max_hp / 2 || current_state == STATE_GAMEOVER) {
+            player.hp = player.max_hp;
+            if (current_state == STATE_GAMEOVER) current_state = STATE_PLAYING;
+        }
+        PlayerInput in = { 0 };
+        if (current_state == STATE_PLAYING) {
+            in = AutopilotInput();
+            // 少し蛇行しながら +X へ（横のセクターも通る）
+            in.move_x = 1.0f;
+            in.move_z = sinf(t * dt * 0.2f) * 0.6f;
+            in.dash = false;
         }
+        double a = NetNow();
+        StepGame(dt, &in);
+        double b = NetNow();
+        tickUs[t] = (b - a) * 1e6;
+        streamUs[t] = roam.stream_sec * 1e6;
+
+        // ローカル座標の大きさ（生きているものすべて）
+        float m = fmaxf(fabsf(player.position.x), fabsf(player.position.z));
+        for (int i=0; i<enemy_slots; i++) if (enemies[i].active) m = fmaxf(m, fmaxf(fabsf(enemies[i].position.x), fabsf(enemies[i].position.z)));
+        for (int i=0; i<bullet_capacity; i++) if (bullets[i].active) m = fmaxf(m, fmaxf(fabsf(bullets[i].position.x), fabsf(bullets[i].position.z)));
+        for (int i=0; i<item_capacity; i++) if (items[i].active) m = fmaxf(m, fmaxf(fabsf(items[i].position.x), fabsf(items[i].position.z)));
+        for (int i=0; i<enemy_bullets.count; i++) m = fmaxf(m, fmaxf(fabsf(enemy_bullets.x[i]), fabsf(enemy_bullets.z[i])));
+        if (m > localMax) localMax = m;
+        int resident = 0;
+        for (int i=0; i<ROAM_SECTOR_SLOTS; i++) resident += roam.sectors[i].used;
+        if (resident > residentPeak) residentPeak = resident;
     }
-}
\ No newline at end of file
+    double sec = NetNow() - t0;
+
+    double wx = roam.origin_x * (double)ROAM_SECTOR_SIZE + player.position.x;
+    double wz = roam.origin_z * (double)ROAM_SECTOR_SIZE + player.position.z;
+    float far = (float)fmax(fabs(wx), fabs(wz));
+    printf("roam %d ticks (stage %d): sector %d, %d, %.0f m from the start\n", ticks, current_stage,
+           RoamSectorOf(player.position.x, roam.origin_x), RoamSectorOf(player.position.z, roam.origin_z), sqrt(wx * wx + wz * wz));
+    printf("rebases %d (max %.1f us), sectors generated %d, evicted %d, resident peak %d/%d, remembered %d/%d\n",
+           roam.rebases, roam.rebase_sec_max * 1e6, roam.generated, roam.evicted, residentPeak, ROAM_SECTOR_SLOTS,
+           roam.memory_count, ROAM_MEMORY);
+    printf("spawn sets triggered %d, sector pickups taken %d\n", roam.sets_triggered, roam.pickups_taken);
+    qsort(tickUs, ticks, sizeof(double), CompareDouble);
+    qsort(streamUs, ticks, sizeof(double), CompareDouble);
+    printf("tick avg %.2f us, p99 %.1f us, max %.1f us; roam %.2f us/tick (%.2f%%)\n", sec * 1e6 / ticks,
+           tickUs[ticks * 99 / 100], tickUs[ticks - 1], roam.sec * 1e6 / ticks, roam.sec * 100.0 / sec);
+    printf("stream + spawn p99 %.1f us, max %.1f us\n", streamUs[ticks * 99 / 100], streamUs[ticks - 1]);
+    printf("largest local coordinate %.1f (float step %g); without rebasing %.0f (float step %g)\n",
+           localMax, nextafterf(localMax, INFINITY) - localMax, far, nextafterf(far, INFINITY) - far);
+    roam_mode = false;
+    free(tickUs);
+    free(streamUs);
+    return 0;
+}
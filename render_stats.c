@@ -0,0 +1,120 @@
+#include "render_stats.h"
+
+#include <stddef.h>
+
+#if defined(__APPLE__)
+#include <OpenGL/gl3.h>
+#else
+#include <GL/gl.h>
+#include <GL/glext.h>
+#endif
+
+static RenderStats render_stats;
+static bool render_stats_installed = false;
+
+#if defined(__linux__)
+typedef void (*DrawArraysFn)(GLenum mode, GLint first, GLsizei count);
+typedef void (*DrawElementsFn)(GLenum mode, GLsizei count, GLenum type, const void *indices);
+typedef void (*DrawArraysInstancedFn)(GLenum mode, GLint first, GLsizei count, GLsizei instances);
+typedef void (*DrawElementsInstancedFn)(GLenum mode, GLsizei count, GLenum type, const void *indices, GLsizei instances);
+typedef void (*BufferSubDataFn)(GLenum target, ptrdiff_t offset, ptrdiff_t size, const void *data);
+
+// raylib（rlgl）が読み込んだ glad の関数ポインタ。無ければ弱いシンボルなので NULL になる
+extern DrawArraysFn glad_glDrawArrays __attribute__((weak));
+extern DrawElementsFn glad_glDrawElements __attribute__((weak));
+extern DrawArraysInstancedFn glad_glDrawArraysInstanced __attribute__((weak));
+extern DrawElementsInstancedFn glad_glDrawElementsInstanced __attribute__((weak));
+extern BufferSubDataFn glad_glBufferSubData __attribute__((weak));
+
+static DrawArraysFn real_draw_arrays;
+static DrawElementsFn real_draw_elements;
+static DrawArraysInstancedFn real_draw_arrays_instanced;
+static DrawElementsInstancedFn real_draw_elements_instanced;
+static BufferSubDataFn real_buffer_sub_data;
+static bool uploading = false;
+
+static void CountDraw(GLsizei count, GLsizei instances) {
+    render_stats.draw_calls++;
+    if (instances > 1) render_stats.instanced_calls++;
+    render_stats.vertices += (uint64_t)count * (uint64_t)(instances > 0 ? instances : 0);
+    uploading = false;
+}
+
+static void CountingDrawArrays(GLenum mode, GLint first, GLsizei count) {
+    CountDraw(count, 1);
+    real_draw_arrays(mode, first, count);
+}
+
+static void CountingDrawElements(GLenum mode, GLsizei count, GLenum type, const void *indices) {
+    CountDraw(count, 1);
+    real_draw_elements(mode, count, type, indices);
+}
+
+static void CountingDrawArraysInstanced(GLenum mode, GLint first, GLsizei count, GLsizei instances) {
+    CountDraw(count, instances);
+    real_draw_arrays_instanced(mode, first, count, instances);
+}
+
+static void CountingDrawElementsInstanced(GLenum mode, GLsizei count, GLenum type, const void *indices, GLsizei instances) {
+    CountDraw(count, instances);
+    real_draw_elements_instanced(mode, count, type, indices, instances);
+}
+
+// rlDrawRenderBatch は溜まった頂点を属性ごとに glBufferSubData で上げてから描く。
+// 描画のあとの最初のアップロードを1回のフラッシュと数える（空のバッチは何も上げないので数えない）
+static void CountingBufferSubData(GLenum target, ptrdiff_t offset, ptrdiff_t size, const void *data) {
+    if (target == GL_ARRAY_BUFFER && !uploading) {
+        render_stats.batch_flushes++;
+        uploading = true;
+    }
+    real_buffer_sub_data(target, offset, size, data);
+}
+#endif
+
+// ウィンドウを作った（glad を読み込んだ）あとに呼ぶ
+bool RenderStatsInstall(void) {
+    if (render_stats_installed) return true;
+#if defined(__linux__)
+    if (!&glad_glDrawArrays || !&glad_glDrawElements || !&glad_glDrawArraysInstanced ||
+        !&glad_glDrawElementsInstanced || !&glad_glBufferSubData) return false;
+    if (!glad_glDrawArrays || !glad_glDrawElements || !glad_glBufferSubData) return false;
+    real_draw_arrays = glad_glDrawArrays;
+    real_draw_elements = glad_glDrawElements;
+    real_draw_arrays_instanced = glad_glDrawArraysInstanced;
+    real_draw_elements_instanced = glad_glDrawElementsInstanced;
+    real_buffer_sub_data = glad_glBufferSubData;
+    glad_glDrawArrays = CountingDrawArrays;
+    glad_glDrawElements = CountingDrawElements;
+    if (real_draw_arrays_instanced) glad_glDrawArraysInstanced = CountingDrawArraysInstanced;
+    if (real_draw_elements_instanced) glad_glDrawElementsInstanced = CountingDrawElementsInstanced;
+    glad_glBufferSubData = CountingBufferSubData;
+    render_stats_installed = true;
+    RenderStatsReset();
+    return true;
+#else
+    return false;
+#endif
+}
+
+void RenderStatsRemove(void) {
+    if (!render_stats_installed) return;
+#if defined(__linux__)
+    glad_glDrawArrays = real_draw_arrays;
+    glad_glDrawElements = real_draw_elements;
+    if (real_draw_arrays_instanced) glad_glDrawArraysInstanced = real_draw_arrays_instanced;
+    if (real_draw_elements_instanced) glad_glDrawElementsInstanced = real_draw_elements_instanced;
+    glad_glBufferSubData = real_buffer_sub_data;
+#endif
+    render_stats_installed = false;
+}
+
+void RenderStatsReset(void) {
+    render_stats = (RenderStats){ 0 };
+#if defined(__linux__)
+    uploading = false;
+#endif
+}
+
+void RenderStatsGet(RenderStats *out) {
+    *out = render_stats;
+}
@@ -0,0 +1,24 @@
+// 描画の計測（--render-bench 用）
+// raylib が GL を呼ぶ関数ポインタ（glad）を数えるだけの関数に差し替えて、
+// ドローコール・rlgl のバッチのフラッシュ・頂点数を数える。
+// glad の関数ポインタが見えないビルド（共有ライブラリで隠れている、Linux 以外）では使えない。
+// GL のヘッダーは raylib と一緒に読めないので、このファイルは raylib を含めない。
+#ifndef RENDER_STATS_H
+#define RENDER_STATS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct {
+    uint64_t draw_calls;        // glDraw* の呼び出し（インスタンス描画を含む）
+    uint64_t instanced_calls;
+    uint64_t batch_flushes;     // 頂点のアップロードから始まる描画のまとまり（rlgl のバッチ1回分）
+    uint64_t vertices;          // 描画に渡した頂点（インデックス）数 × インスタンス数
+} RenderStats;
+
+bool RenderStatsInstall(void);
+void RenderStatsRemove(void);
+void RenderStatsReset(void);
+void RenderStatsGet(RenderStats *out);
+
+#endif
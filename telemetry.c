@@ -0,0 +1,158 @@
+#if defined(__linux__)
+#define _GNU_SOURCE
+#endif
+#include "telemetry.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define TELEMETRY_CACHE_LINE 64
+#define TELEMETRY_FILE_BUFFER (64 * 1024)
+
+// 書き込み位置（head）はゲームのスレッドだけ、読み出し位置（tail）は書き出しスレッドだけが進める。
+// 互いの位置は __atomic の acquire/release で受け渡し、偽共有しないよう別のキャッシュラインに置く
+typedef struct {
+    TelemetryEvent ring[TELEMETRY_RING_EVENTS];
+
+    uint32_t head;
+    uint32_t tail_cache;        // 最後に読んだ tail（一杯に見えたときだけ読み直す）
+    uint64_t dropped;
+    uint8_t pad0[TELEMETRY_CACHE_LINE - 2 * sizeof(uint32_t) - sizeof(uint64_t)];
+
+    uint32_t tail;
+    uint32_t ring_peak;
+    uint64_t written;
+    uint64_t bytes_written;
+    uint64_t flushes;
+    uint8_t pad1[TELEMETRY_CACHE_LINE - 2 * sizeof(uint32_t) - 3 * sizeof(uint64_t)];
+
+    FILE *file;
+    char path[256];
+    int stop;
+    pthread_t thread;
+} Telemetry;
+
+static Telemetry telemetry __attribute__((aligned(TELEMETRY_CACHE_LINE)));
+static bool telemetry_active = false;
+
+static double TelemetryNow(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// リングにあるだけ書き出す。書いた数を返す
+static uint32_t TelemetryDrain(Telemetry *t) {
+    uint32_t tail = t->tail;
+    uint32_t head = __atomic_load_n(&t->head, __ATOMIC_ACQUIRE);
+    uint32_t n = head - tail;
+    if (n == 0) return 0;
+    if (n > t->ring_peak) __atomic_store_n(&t->ring_peak, n, __ATOMIC_RELAXED);
+
+    // 折り返しをまたぐときは2回に分けて書く
+    uint32_t at = tail & (TELEMETRY_RING_EVENTS - 1);
+    uint32_t first = TELEMETRY_RING_EVENTS - at;
+    if (first > n) first = n;
+    fwrite(&t->ring[at], sizeof(TelemetryEvent), first, t->file);
+    if (n > first) fwrite(&t->ring[0], sizeof(TelemetryEvent), n - first, t->file);
+
+    __atomic_store_n(&t->tail, tail + n, __ATOMIC_RELEASE);
+    __atomic_store_n(&t->written, t->written + n, __ATOMIC_RELAXED);
+    __atomic_store_n(&t->bytes_written, t->bytes_written + (uint64_t)n * sizeof(TelemetryEvent), __ATOMIC_RELAXED);
+    return n;
+}
+
+static void *TelemetryWriterMain(void *arg) {
+    (void)arg;
+    Telemetry *t = &telemetry;
+    double flushAt = TelemetryNow() + TELEMETRY_FLUSH_SECONDS;
+    bool dirty = false;
+    for (;;) {
+        bool stopping = __atomic_load_n(&t->stop, __ATOMIC_ACQUIRE);
+        if (TelemetryDrain(t) > 0) dirty = true;
+        double now = TelemetryNow();
+        if (stopping || (dirty && now >= flushAt)) {
+            fflush(t->file);
+            __atomic_store_n(&t->flushes, t->flushes + 1, __ATOMIC_RELAXED);
+            dirty = false;
+            flushAt = now + TELEMETRY_FLUSH_SECONDS;
+        }
+        // 止める指示を見てからもう一度空にしているので、ここで抜けても取りこぼさない
+        if (stopping) break;
+        struct timespec ts = { 0, TELEMETRY_DRAIN_MS * 1000000L };
+        nanosleep(&ts, NULL);
+    }
+    return NULL;
+}
+
+bool TelemetryStart(const char *path, float arenaHalf) {
+    if (telemetry_active) return false;
+    Telemetry *t = &telemetry;
+    memset(t, 0, sizeof(*t));
+    t->file = fopen(path, "wb");
+    if (!t->file) return false;
+    setvbuf(t->file, NULL, _IOFBF, TELEMETRY_FILE_BUFFER);
+    snprintf(t->path, sizeof(t->path), "%s", path);
+
+    TelemetryHeader h = { 0 };
+    h.magic = TELEMETRY_MAGIC;
+    h.version = TELEMETRY_VERSION;
+    h.event_size = sizeof(TelemetryEvent);
+    h.arena_half = arenaHalf;
+    h.start_time = (uint64_t)time(NULL);
+    fwrite(&h, sizeof(h), 1, t->file);
+
+    if (pthread_create(&t->thread, NULL, TelemetryWriterMain, NULL) != 0) {
+        fclose(t->file);
+        return false;
+    }
+    telemetry_active = true;
+    return true;
+}
+
+// 残りを書き出してから閉じる
+void TelemetryStop(void) {
+    Telemetry *t = &telemetry;
+    if (!telemetry_active) return;
+    __atomic_store_n(&t->stop, 1, __ATOMIC_RELEASE);
+    pthread_join(t->thread, NULL);
+    fclose(t->file);
+    telemetry_active = false;
+}
+
+bool TelemetryActive(void) {
+    return telemetry_active;
+}
+
+// ゲームのスレッドから呼ぶ（呼ぶスレッドは1つだけ）。一杯なら捨てて false
+bool TelemetryPush(const TelemetryEvent *e) {
+    Telemetry *t = &telemetry;
+    uint32_t head = t->head;
+    if (head - t->tail_cache >= TELEMETRY_RING_EVENTS) {
+        t->tail_cache = __atomic_load_n(&t->tail, __ATOMIC_ACQUIRE);
+        if (head - t->tail_cache >= TELEMETRY_RING_EVENTS) {
+            __atomic_store_n(&t->dropped, t->dropped + 1, __ATOMIC_RELAXED);
+            return false;
+        }
+    }
+    t->ring[head & (TELEMETRY_RING_EVENTS - 1)] = *e;
+    __atomic_store_n(&t->head, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+void TelemetryGetStats(TelemetryStats *out) {
+    Telemetry *t = &telemetry;
+    out->pushed = __atomic_load_n(&t->head, __ATOMIC_RELAXED);
+    out->dropped = __atomic_load_n(&t->dropped, __ATOMIC_RELAXED);
+    out->written = __atomic_load_n(&t->written, __ATOMIC_RELAXED);
+    out->bytes_written = __atomic_load_n(&t->bytes_written, __ATOMIC_RELAXED);
+    out->flushes = __atomic_load_n(&t->flushes, __ATOMIC_RELAXED);
+    out->ring_peak = __atomic_load_n(&t->ring_peak, __ATOMIC_RELAXED);
+}
+
+const char *TelemetryPath(void) {
+    return telemetry.path;
+}
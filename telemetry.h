@@ -0,0 +1,76 @@
+// ゲームプレイのテレメトリ
+// ゲームのスレッドは固定長のイベントをロックなしの単一生産者・単一消費者リングに入れるだけで、
+// 書き出しは別スレッドが一定間隔でリングを空にしてバイナリのログに追記する（一定時間ごとに fflush）。
+// リングが一杯のときはそのイベントを捨てて数える（ゲームのスレッドは待たない）。
+// ログはヘッダー1つと TelemetryEvent の並び。集計は telemetry_tool（make telemetry_tool）で行う。
+// 集計ツールからも読むので、このファイルは raylib を含めない。
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define TELEMETRY_MAGIC 0x4C545356u     // "VSTL"
+#define TELEMETRY_VERSION 1
+#define TELEMETRY_RING_EVENTS 8192      // 2 の累乗
+#define TELEMETRY_DRAIN_MS 5            // 書き出しスレッドがリングを見に行く間隔
+#define TELEMETRY_FLUSH_SECONDS 1.0
+#define TELEMETRY_NO_PLAYER 0xFF
+
+typedef enum {
+    TELEMETRY_MATCH_START,  // sub: 0 シングル / 1 対戦 / 2 協力（サーバー）、value: 難易度
+    TELEMETRY_MATCH_END,    // value: 試合時間 (ms)、value2: 到達ステージ。対戦は player が勝者
+    TELEMETRY_KILL,         // 位置: 倒した敵、sub: 敵の種類 (0 ドローン / 1 タンク / 2 ボス)、value: 最後の一撃のダメージ
+    TELEMETRY_DAMAGE,       // 位置: 受けたプレイヤー、sub: TelemetryDamageSource、value: ダメージ、value2: 残り HP
+    TELEMETRY_PICKUP,       // 位置: アイテム、sub: 0 経験値 / 1 回復
+    TELEMETRY_LEVEL_UP,     // value: 上がった後のレベル
+    TELEMETRY_STAGE_CLEAR,  // value: ステージ開始からボス撃破までの時間 (ms)
+    TELEMETRY_BOSS_KILL,    // 位置: ボス、value: ボスの出現から撃破までの時間 (ms)
+    TELEMETRY_EVENT_TYPES
+} TelemetryEventType;
+
+typedef enum {
+    TELEMETRY_DAMAGE_CONTACT,   // 敵に触れた
+    TELEMETRY_DAMAGE_SHOT,      // 敵の弾
+    TELEMETRY_DAMAGE_PVP,       // 対戦相手の弾
+} TelemetryDamageSource;
+
+// 1件 24 バイト（リングとログで同じ形）
+typedef struct {
+    float time;             // 試合（サーバーは起動）からの秒
+    uint8_t type;           // TelemetryEventType
+    uint8_t player;         // プレイヤー番号（関係ないときは TELEMETRY_NO_PLAYER）
+    uint8_t stage;
+    uint8_t sub;
+    float x;                // ワールド座標（XZ 平面）
+    float z;
+    int32_t value;
+    int32_t value2;
+} TelemetryEvent;
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t event_size;    // sizeof(TelemetryEvent)
+    float arena_half;       // ヒートマップの範囲（-arena_half〜arena_half）
+    uint32_t reserved;
+    uint64_t start_time;    // 記録を始めた UNIX 時刻
+} TelemetryHeader;
+
+typedef struct {
+    uint64_t pushed;        // リングに入れた数
+    uint64_t dropped;       // リングが一杯で捨てた数
+    uint64_t written;       // ログに書いた数
+    uint64_t bytes_written;
+    uint64_t flushes;
+    uint32_t ring_peak;     // 書き出しスレッドが見たリングの最大の溜まり
+} TelemetryStats;
+
+bool TelemetryStart(const char *path, float arenaHalf);
+void TelemetryStop(void);
+bool TelemetryActive(void);
+bool TelemetryPush(const TelemetryEvent *e);
+void TelemetryGetStats(TelemetryStats *out);
+const char *TelemetryPath(void);
+
+#endif
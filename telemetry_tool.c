@@ -0,0 +1,178 @@
+// テレメトリのログ（--telemetry で書いた .vtl）を集計する
+//   $ ./telemetry_tool telemetry_xxx.vtl [--grid 24] [--pgm kills.pgm]
+// イベントの数、ステージごとの集計（クリア時間・ボス撃破時間・撃破数・被ダメージ・取得・レベルアップ）、
+// 撃破位置と被弾位置のヒートマップ（文字で表示。--pgm で撃破位置を画像にも書く）を出す。
+#include "telemetry.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define TOOL_MAX_STAGES 256
+#define TOOL_MAX_GRID 64
+#define TOOL_READ_EVENTS 4096
+
+typedef struct {
+    int clears;
+    double clear_ms;
+    int boss_kills;
+    double boss_ms;
+    int boss_best_ms;
+    int kills[3];           // ドローン・タンク・ボス
+    int hits;
+    long damage;
+    int pickups[2];         // 経験値・回復
+    int level_ups;
+} StageSummary;
+
+static const char *event_names[TELEMETRY_EVENT_TYPES] = {
+    "match start", "match end", "kill", "damage", "pickup", "level up", "stage clear", "boss kill"
+};
+
+static StageSummary stages[TOOL_MAX_STAGES];
+static long kill_map[TOOL_MAX_GRID * TOOL_MAX_GRID];
+static long damage_map[TOOL_MAX_GRID * TOOL_MAX_GRID];
+
+static int GridCell(float v, float half, int grid) {
+    int c = (int)((v + half) / (2.0f * half) * grid);
+    if (c < 0) c = 0;
+    if (c >= grid) c = grid - 1;
+    return c;
+}
+
+// 一番多いセルを基準に濃さの文字で描く（上が -Z）
+static void PrintHeatmap(const char *title, const long *map, int grid) {
+    static const char ramp[] = " .:-=+*#%@";
+    long peak = 0, total = 0;
+    for (int i=0; i<grid * grid; i++) {
+        if (map[i] > peak) peak = map[i];
+        total += map[i];
+    }
+    printf("\n%s (%ld events, peak %ld per cell)\n", title, total, peak);
+    printf("+");
+    for (int x=0; x<grid; x++) printf("--");
+    printf("+\n");
+    for (int z=0; z<grid; z++) {
+        printf("|");
+        for (int x=0; x<grid; x++) {
+            long v = map[z * grid + x];
+            int level = (peak > 0 && v > 0) ? 1 + (int)((v * (long)(sizeof(ramp) - 3)) / peak) : 0;
+            printf("%c%c", ramp[level], ramp[level]);
+        }
+        printf("|\n");
+    }
+    printf("+");
+    for (int x=0; x<grid; x++) printf("--");
+    printf("+\n");
+}
+
+static bool WritePgm(const char *path, const long *map, int grid) {
+    FILE *f = fopen(path, "wb");
+    if (!f) return false;
+    long peak = 0;
+    for (int i=0; i<grid * grid; i++) if (map[i] > peak) peak = map[i];
+    fprintf(f, "P5\n%d %d\n255\n", grid, grid);
+    for (int i=0; i<grid * grid; i++) fputc(peak > 0 ? (int)(map[i] * 255 / peak) : 0, f);
+    fclose(f);
+    return true;
+}
+
+int main(int argc, char **argv) {
+    const char *path = NULL, *pgmPath = NULL;
+    int grid = 24;
+    for (int i=1; i<argc; i++) {
+        if (strcmp(argv[i], "--grid") == 0 && i + 1 < argc) grid = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--pgm") == 0 && i + 1 < argc) pgmPath = argv[++i];
+        else path = argv[i];
+    }
+    if (!path) {
+        fprintf(stderr, "usage: %s <telemetry.vtl> [--grid N] [--pgm kills.pgm]\n", argv[0]);
+        return 1;
+    }
+    if (grid < 4) grid = 4;
+    if (grid > TOOL_MAX_GRID) grid = TOOL_MAX_GRID;
+
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        fprintf(stderr, "cannot open %s\n", path);
+        return 1;
+    }
+    TelemetryHeader h;
+    if (fread(&h, sizeof(h), 1, f) != 1 || h.magic != TELEMETRY_MAGIC || h.version != TELEMETRY_VERSION ||
+        h.event_size != sizeof(TelemetryEvent)) {
+        fprintf(stderr, "%s: not a telemetry log of this version\n", path);
+        fclose(f);
+        return 1;
+    }
+
+    long counts[TELEMETRY_EVENT_TYPES] = { 0 };
+    long matches = 0, matchEnds = 0;
+    double matchMs = 0;
+    int bestStage = 0, maxStage = 0;
+    float lastTime = 0;
+    static TelemetryEvent buf[TOOL_READ_EVENTS];
+    size_t n;
+    while ((n = fread(buf, sizeof(TelemetryEvent), TOOL_READ_EVENTS, f)) > 0) {
+        for (size_t k=0; k<n; k++) {
+            const TelemetryEvent *e = &buf[k];
+            if (e->type >= TELEMETRY_EVENT_TYPES) continue;
+            counts[e->type]++;
+            lastTime = e->time;
+            StageSummary *st = &stages[e->stage];
+            if (e->stage > maxStage) maxStage = e->stage;
+            int cell = GridCell(e->z, h.arena_half, grid) * grid + GridCell(e->x, h.arena_half, grid);
+            switch (e->type) {
+                case TELEMETRY_MATCH_START: matches++; break;
+                case TELEMETRY_MATCH_END:
+                    matchEnds++;
+                    matchMs += e->value;
+                    if (e->value2 > bestStage) bestStage = e->value2;
+                    break;
+                case TELEMETRY_KILL:
+                    if (e->sub < 3) st->kills[e->sub]++;
+                    kill_map[cell]++;
+                    break;
+                case TELEMETRY_DAMAGE:
+                    st->hits++;
+                    st->damage += e->value;
+                    damage_map[cell]++;
+                    break;
+                case TELEMETRY_PICKUP: if (e->sub < 2) st->pickups[e->sub]++; break;
+                case TELEMETRY_LEVEL_UP: st->level_ups++; break;
+                case TELEMETRY_STAGE_CLEAR: st->clears++; st->clear_ms += e->value; break;
+                case TELEMETRY_BOSS_KILL:
+                    if (st->boss_kills == 0 || e->value < st->boss_best_ms) st->boss_best_ms = e->value;
+                    st->boss_kills++;
+                    st->boss_ms += e->value;
+                    break;
+            }
+        }
+    }
+    fclose(f);
+
+    time_t start = (time_t)h.start_time;
+    char stamp[32];
+    strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", localtime(&start));
+    printf("%s: started %s, last event at %.1f s\n", path, stamp, lastTime);
+    for (int t=0; t<TELEMETRY_EVENT_TYPES; t++) printf("  %-12s %ld\n", event_names[t], counts[t]);
+    printf("matches %ld started, %ld ended (avg %.1f s), best stage %d\n", matches, matchEnds,
+           matchEnds > 0 ? matchMs / 1000.0 / matchEnds : 0.0, bestStage);
+
+    printf("\nstage | clears  avg clear s | boss kills  avg s  best s | kills drone tank boss | hits  damage | exp  heal | lv up\n");
+    for (int s=1; s<=maxStage; s++) {
+        const StageSummary *st = &stages[s];
+        printf("%5d | %6d  %11.1f | %10d  %5.1f  %6.1f | %11d %4d %4d | %4d  %6ld | %3d  %4d | %5d\n", s,
+               st->clears, st->clears > 0 ? st->clear_ms / 1000.0 / st->clears : 0.0,
+               st->boss_kills, st->boss_kills > 0 ? st->boss_ms / 1000.0 / st->boss_kills : 0.0, st->boss_best_ms / 1000.0,
+               st->kills[0], st->kills[1], st->kills[2], st->hits, st->damage, st->pickups[0], st->pickups[1], st->level_ups);
+    }
+
+    PrintHeatmap("kills", kill_map, grid);
+    PrintHeatmap("damage taken", damage_map, grid);
+    if (pgmPath) {
+        if (WritePgm(pgmPath, kill_map, grid)) printf("\nkill heatmap written to %s (%dx%d)\n", pgmPath, grid, grid);
+        else fprintf(stderr, "cannot write %s\n", pgmPath);
+    }
+    return 0;
+}